@@ -0,0 +1,329 @@
+#include "access_log.h"
+#include <algorithm>
+#include <chrono>
+#include <charconv>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+// 实例编号不复用：线程本地缓冲按编号匹配，实例重建后不会误用已释放的缓冲
+std::atomic<uint64_t> next_log_id{1};
+
+// 一个数据块的目标大小：块数较多时writev分多次写入
+constexpr size_t kBlockSize = 64 * 1024;
+
+#ifdef IOV_MAX
+constexpr size_t kMaxIov = IOV_MAX < 64 ? IOV_MAX : 64;
+#else
+constexpr size_t kMaxIov = 16;
+#endif
+
+// 复制字段，超出部分截断，返回复制的长度
+size_t copyField(char* dst, size_t capacity, std::string_view value) {
+    size_t length = std::min(value.size(), capacity);
+    std::memcpy(dst, value.data(), length);
+    return length;
+}
+
+void appendNumber(std::string& out, int64_t value) {
+    char digits[24];
+    out.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr - digits);
+}
+
+// 追加JSON字符串（含引号）：控制字符和非ASCII字节转义为\u00XX，保证每行都是合法的JSON
+void appendJsonString(std::string& out, std::string_view value) {
+    static const char kHex[] = "0123456789abcdef";
+    out.push_back('"');
+    for (char c : value) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(c);
+        } else if (byte < 0x20 || byte >= 0x7f) {
+            out.append("\\u00");
+            out.push_back(kHex[byte >> 4]);
+            out.push_back(kHex[byte & 0xf]);
+        } else {
+            out.push_back(c);
+        }
+    }
+    out.push_back('"');
+}
+
+} // namespace
+
+AccessLog::AccessLog(const AccessLogConfig& config)
+    : config_(config), id_(next_log_id.fetch_add(1, std::memory_order_relaxed)) {
+}
+
+AccessLog::~AccessLog() {
+    if (writer_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        writer_.join();
+    }
+    if (fd_ >= 0) close(fd_);
+}
+
+bool AccessLog::open() {
+    if (!openFile(false)) return false;
+    writer_ = std::thread(&AccessLog::run, this);
+    return true;
+}
+
+bool AccessLog::openFile(bool truncate) {
+    int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (truncate ? O_TRUNC : 0);
+    fd_ = ::open(config_.path.c_str(), flags, 0644);
+    if (fd_ < 0) {
+        perror(("打开访问日志失败: " + config_.path).c_str());
+        return false;
+    }
+    struct stat st;
+    file_size_ = fstat(fd_, &st) == 0 ? static_cast<size_t>(st.st_size) : 0;
+    return true;
+}
+
+AccessLog::Ring& AccessLog::localRing() {
+    // 一个线程通常只写入一个实例，线性查找即可
+    thread_local std::vector<std::pair<uint64_t, Ring*>> local;
+    for (const auto& item : local) {
+        if (item.first == id_) return *item.second;
+    }
+    size_t capacity = 2;
+    while (capacity < config_.ring_capacity) capacity <<= 1;
+    std::unique_ptr<Ring> ring(new Ring(capacity));
+    Ring* result = ring.get();
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        rings_.push_back(std::move(ring));
+    }
+    local.emplace_back(id_, result);
+    return *result;
+}
+
+void AccessLog::log(std::string_view method, std::string_view path, std::string_view version, int status,
+                    int64_t bytes, uint64_t latency_us, uint64_t connection_id) {
+    Ring& ring = localRing();
+    size_t tail = ring.tail.load(std::memory_order_relaxed);
+    if (tail - ring.cached_head > ring.mask) {
+        ring.cached_head = ring.head.load(std::memory_order_acquire);
+        if (tail - ring.cached_head > ring.mask) {
+            // 后台线程跟不上：丢弃并计数，不等待
+            ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    AccessLogEntry& entry = ring.slots[tail & ring.mask];
+    entry.time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    entry.connection_id = connection_id;
+    entry.latency_us = latency_us;
+    entry.bytes = bytes;
+    entry.status = static_cast<uint16_t>(status);
+    entry.method_length = static_cast<uint8_t>(copyField(entry.method, AccessLogEntry::kMaxMethod, method));
+    entry.version_length = static_cast<uint8_t>(copyField(entry.version, AccessLogEntry::kMaxVersion, version));
+    entry.path_length = static_cast<uint8_t>(copyField(entry.path, AccessLogEntry::kMaxPath, path));
+    entry.path_truncated = path.size() > AccessLogEntry::kMaxPath;
+    ring.tail.store(tail + 1, std::memory_order_release);
+
+    // 缓冲过半时提前唤醒后台线程（没有线程等待时只是一次原子读）
+    if (tail + 1 - ring.cached_head == (ring.mask + 1) / 2) wake_.notify_one();
+}
+
+void AccessLog::flush() {
+    if (!writer_.joinable()) return;
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t target = ++flush_requests_;
+    wake_.notify_one();
+    flushed_cv_.wait(lock, [this, target]() { return flushed_ >= target; });
+}
+
+void AccessLog::reopen() {
+    reopen_.store(true, std::memory_order_relaxed);
+    wake_.notify_one();
+}
+
+uint64_t AccessLog::dropped() const {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    uint64_t total = 0;
+    for (const auto& ring : rings_) {
+        total += ring->dropped.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void AccessLog::run() {
+    std::chrono::milliseconds interval(std::max(config_.flush_interval_ms, 1));
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        // 不带条件等待：生产者的提前唤醒不持有锁，漏掉时最多推迟一个间隔
+        if (!stopping_ && flush_requests_ == flushed_) wake_.wait_for(lock, interval);
+        bool stop = stopping_;
+        uint64_t requested = flush_requests_;
+        lock.unlock();
+
+        if (reopen_.exchange(false, std::memory_order_relaxed)) {
+            if (fd_ >= 0) close(fd_);
+            openFile(false);
+        }
+        drain();
+
+        lock.lock();
+        flushed_ = requested;
+        flushed_cv_.notify_all();
+        if (stop) break;
+    }
+}
+
+void AccessLog::drain() {
+    std::vector<Ring*> rings;
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        rings.reserve(rings_.size());
+        for (const auto& ring : rings_) rings.push_back(ring.get());
+    }
+
+    std::vector<Block> blocks;
+    Block block;
+    for (Ring* ring : rings) {
+        size_t head = ring->head.load(std::memory_order_relaxed);
+        size_t tail = ring->tail.load(std::memory_order_acquire);
+        for (; head != tail; ++head) {
+            if (block.data.empty()) block.data.reserve(kBlockSize + 512);
+            format(ring->slots[head & ring->mask], block.data);
+            block.entries++;
+            if (block.data.size() >= kBlockSize) {
+                blocks.push_back(std::move(block));
+                block = Block();
+            }
+        }
+        // 条目已复制进数据块，槽位可以交还生产者
+        ring->head.store(head, std::memory_order_release);
+    }
+    if (block.entries > 0) blocks.push_back(std::move(block));
+    if (!blocks.empty()) writeBlocks(blocks);
+}
+
+void AccessLog::format(const AccessLogEntry& entry, std::string& out) {
+    int64_t second = entry.time_us / 1000000;
+    if (second != time_second_) {
+        time_t t = static_cast<time_t>(second);
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        char buffer[32];
+        size_t length = strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &tm);
+        time_prefix_.assign(buffer, length);
+        time_second_ = second;
+    }
+    int millis = static_cast<int>(entry.time_us / 1000 % 1000);
+    char fraction[5] = { '.', static_cast<char>('0' + millis / 100), static_cast<char>('0' + millis / 10 % 10),
+                         static_cast<char>('0' + millis % 10), 'Z' };
+
+    out.append("{\"time\":\"");
+    out.append(time_prefix_);
+    out.append(fraction, sizeof(fraction));
+    out.append("\",\"conn\":");
+    appendNumber(out, static_cast<int64_t>(entry.connection_id));
+    out.append(",\"method\":");
+    appendJsonString(out, std::string_view(entry.method, entry.method_length));
+    out.append(",\"path\":");
+    appendJsonString(out, std::string_view(entry.path, entry.path_length));
+    if (entry.path_truncated) out.append(",\"path_truncated\":true");
+    out.append(",\"proto\":");
+    appendJsonString(out, std::string_view(entry.version, entry.version_length));
+    out.append(",\"status\":");
+    appendNumber(out, entry.status);
+    out.append(",\"bytes\":");
+    if (entry.bytes >= 0) {
+        appendNumber(out, entry.bytes);
+    } else {
+        out.append("null");
+    }
+    out.append(",\"latency_us\":");
+    appendNumber(out, static_cast<int64_t>(entry.latency_us));
+    out.append("}\n");
+}
+
+void AccessLog::writeBlocks(const std::vector<Block>& blocks) {
+    size_t next = 0;
+    while (next < blocks.size()) {
+        if (fd_ < 0 && !openFile(false)) return;
+
+        // 一次writev写入尽可能多的块，但不使文件超过大小上限（文件为空时至少写入一块）
+        iovec iov[kMaxIov];
+        size_t count = 0;
+        size_t bytes = 0;
+        size_t entries = 0;
+        while (next + count < blocks.size() && count < kMaxIov) {
+            const Block& block = blocks[next + count];
+            if (config_.max_file_size > 0 && file_size_ + bytes > 0 &&
+                file_size_ + bytes + block.data.size() > config_.max_file_size) {
+                break;
+            }
+            iov[count].iov_base = const_cast<char*>(block.data.data());
+            iov[count].iov_len = block.data.size();
+            bytes += block.data.size();
+            entries += block.entries;
+            count++;
+        }
+        if (count == 0) {
+            rotate();
+            continue;
+        }
+
+        // 处理部分写入：跳过已写出的部分后继续
+        iovec* pending = iov;
+        size_t remaining = count;
+        while (remaining > 0) {
+            ssize_t n = writev(fd_, pending, static_cast<int>(remaining));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                // 磁盘已满等错误：丢弃本批数据，下一批重试
+                perror("写入访问日志失败");
+                return;
+            }
+            file_size_ += static_cast<size_t>(n);
+            size_t written = static_cast<size_t>(n);
+            while (remaining > 0 && written >= pending->iov_len) {
+                written -= pending->iov_len;
+                ++pending;
+                --remaining;
+            }
+            if (remaining > 0) {
+                pending->iov_base = static_cast<char*>(pending->iov_base) + written;
+                pending->iov_len -= written;
+            }
+        }
+        written_.fetch_add(entries, std::memory_order_relaxed);
+        next += count;
+    }
+}
+
+void AccessLog::rotate() {
+    close(fd_);
+    fd_ = -1;
+    if (config_.max_files == 0) {
+        openFile(true);
+        return;
+    }
+    // path.(n-1) -> path.n，……，path -> path.1；最旧的一个被覆盖
+    for (size_t i = config_.max_files; i > 1; --i) {
+        std::string from = config_.path + "." + std::to_string(i - 1);
+        std::string to = config_.path + "." + std::to_string(i);
+        rename(from.c_str(), to.c_str());
+    }
+    rename(config_.path.c_str(), (config_.path + ".1").c_str());
+    openFile(false);
+}
@@ -0,0 +1,127 @@
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// 访问日志：处理请求的线程把定长条目写入本线程独占的单生产者单消费者环形缓冲（不加锁、不分配内存、
+// 不做系统调用），后台线程定期取出各缓冲中的条目，格式化为JSON行后以writev批量写入文件；
+// 环形缓冲已满时丢弃条目并计数，不阻塞处理请求的线程
+
+// 访问日志的配置（ServerConfig::access_log）
+struct AccessLogConfig {
+    std::string path;                   // 日志文件路径，为空时不记录
+    size_t max_file_size = 64 << 20;    // 文件超过该大小时轮转为path.1、path.2……；0表示不轮转
+    size_t max_files = 5;               // 保留的轮转文件数，0表示轮转时直接截断
+    size_t ring_capacity = 4096;        // 每个线程的环形缓冲条目数（向上取整为2的幂）
+    int flush_interval_ms = 100;        // 后台线程的写入间隔（缓冲过半时提前唤醒）
+};
+
+// 一条访问记录：定长，写入环形缓冲时只复制，不分配内存
+struct AccessLogEntry {
+    static constexpr size_t kMaxMethod = 16;
+    static constexpr size_t kMaxVersion = 8;
+    static constexpr size_t kMaxPath = 190;    // 更长的路径被截断
+
+    int64_t time_us = 0;           // 响应完成的时间（Unix时间，微秒）
+    uint64_t connection_id = 0;
+    uint64_t latency_us = 0;       // 处理耗时
+    int64_t bytes = 0;             // 响应体字节数，-1表示未知（流式生成或连接层直接返回的错误响应）
+    uint16_t status = 0;
+    uint8_t method_length = 0;
+    uint8_t version_length = 0;
+    uint8_t path_length = 0;
+    bool path_truncated = false;
+    char method[kMaxMethod];
+    char version[kMaxVersion];
+    char path[kMaxPath];
+};
+
+class AccessLog {
+private:
+    // 单生产者单消费者环形缓冲：生产者是拥有它的线程，消费者是后台写入线程
+    // 两端的位置只增不减，各占一个缓存行；生产者缓存消费者的位置，只在看似已满时重新读取
+    struct Ring {
+        std::unique_ptr<AccessLogEntry[]> slots;
+        size_t mask;
+        alignas(64) std::atomic<size_t> head{0};     // 消费者位置
+        alignas(64) std::atomic<size_t> tail{0};     // 生产者位置
+        size_t cached_head = 0;                      // 生产者看到的消费者位置
+        std::atomic<uint64_t> dropped{0};            // 已满时丢弃的条目数（只由生产者增加）
+
+        explicit Ring(size_t capacity) : slots(new AccessLogEntry[capacity]), mask(capacity - 1) {}
+    };
+
+    AccessLogConfig config_;
+    uint64_t id_;                                    // 区分不同实例的线程本地缓冲
+    int fd_ = -1;
+    size_t file_size_ = 0;
+
+    mutable std::mutex rings_mutex_;
+    std::vector<std::unique_ptr<Ring>> rings_;       // 各线程的缓冲，随实例一起释放
+
+    // 后台写入线程
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable flushed_cv_;
+    uint64_t flush_requests_ = 0;
+    uint64_t flushed_ = 0;
+    bool stopping_ = false;
+    std::atomic<bool> reopen_{false};
+    std::atomic<uint64_t> written_{0};
+    std::thread writer_;
+
+    // 以下只由后台线程访问
+    struct Block {
+        std::string data;        // 已格式化的若干行
+        size_t entries = 0;
+    };
+    int64_t time_second_ = -1;   // time_prefix_对应的秒
+    std::string time_prefix_;    // 格式化到秒的时间（每秒格式化一次）
+
+    // 当前线程的缓冲，首次写入时创建
+    Ring& localRing();
+    void run();
+    // 取出所有缓冲中的条目并写入文件
+    void drain();
+    // 把一条记录格式化为一行JSON，追加到out
+    void format(const AccessLogEntry& entry, std::string& out);
+    // 把已格式化的数据块写入文件，文件将超过大小上限时先轮转
+    void writeBlocks(const std::vector<Block>& blocks);
+    // 打开日志文件（truncate为true时清空原有内容），失败时返回false
+    bool openFile(bool truncate);
+    void rotate();
+
+public:
+    explicit AccessLog(const AccessLogConfig& config);
+    ~AccessLog();
+    AccessLog(const AccessLog&) = delete;
+    AccessLog& operator=(const AccessLog&) = delete;
+
+    // 打开日志文件并启动后台线程，失败时返回false
+    bool open();
+
+    // 线程安全：记录一次请求（只写入当前线程的缓冲）
+    void log(std::string_view method, std::string_view path, std::string_view version, int status,
+             int64_t bytes, uint64_t latency_us, uint64_t connection_id);
+
+    // 线程安全：等待此前记录的条目全部写入文件
+    void flush();
+    // 线程安全：关闭并重新打开日志文件（配合外部的logrotate等工具）
+    void reopen();
+
+    // 已写入文件的条目数
+    uint64_t written() const { return written_.load(std::memory_order_relaxed); }
+    // 因缓冲已满丢弃的条目数
+    uint64_t dropped() const;
+};
+
+#endif // ACCESS_LOG_H
@@ -0,0 +1,540 @@
+// HTTP压测工具：通过回环地址驱动服务器，输出吞吐量和延迟分位数（JSON）
+//
+// 闭环模式（默认）：每个连接收到响应后立即发送下一个请求，测量服务器能承受的最大吞吐量；
+// 开环模式（--rate）：按固定速率发出请求，与响应快慢无关；没有空闲连接时请求进入积压队列，
+// 延迟从计划发送时间算起，服务器变慢时不会因客户端同步等待而低估延迟（coordinated omission）
+//
+// 用法示例：
+//   webserver_loadgen --port 8080 --path /api/status --connections 64 --duration 10
+//   webserver_loadgen --port 8080 --rate 20000 --connections 128 --threads 2 --no-keep-alive
+#include "metrics.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    std::string method = "GET";
+    std::string path = "/";
+    std::vector<std::string> headers;
+    size_t connections = 64;
+    size_t threads = 1;
+    double duration = 10;      // 统计时长（秒）
+    double warmup = 1;         // 预热时长（秒），期间的请求不计入结果
+    double rate = 0;           // 开环模式的总请求速率（请求/秒），0表示闭环模式
+    bool keep_alive = true;
+};
+
+// 所有工作线程共享的统计结果
+struct Totals {
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> status[6] = {};   // 按状态码首位分类（下标0为其他）
+    std::atomic<uint64_t> max_latency{0};   // 微秒
+    std::atomic<uint64_t> backlog{0};       // 结束时开环模式积压的请求数
+    LatencyHistogram latency;
+};
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 从buffer开头解析一个完整的响应，返回其长度；数据不完整时返回0，格式错误时返回-1
+// eof表示对端已关闭，没有长度信息的响应体以关闭连接结束
+long parseResponse(const std::string& buffer, bool eof, bool head, int& status, bool& close) {
+    size_t header_end = buffer.find("\r\n\r\n");
+    if (header_end == std::string::npos) return eof && !buffer.empty() ? -1 : 0;
+    if (buffer.compare(0, 5, "HTTP/") != 0 || header_end < 12) return -1;
+
+    status = std::atoi(buffer.c_str() + 9);
+    close = buffer.compare(5, 3, "1.0") == 0;
+    bool chunked = false;
+    bool has_length = false;
+    size_t content_length = 0;
+
+    size_t pos = buffer.find("\r\n") + 2;
+    while (pos < header_end) {
+        size_t line_end = buffer.find("\r\n", pos);
+        std::string_view line(buffer.data() + pos, line_end - pos);
+        size_t colon = line.find(':');
+        if (colon != std::string_view::npos) {
+            std::string_view name = line.substr(0, colon);
+            std::string_view value = line.substr(colon + 1);
+            while (!value.empty() && value.front() == ' ') value.remove_prefix(1);
+            if (equalsIgnoreCase(name, "Content-Length")) {
+                has_length = true;
+                content_length = std::strtoull(std::string(value).c_str(), nullptr, 10);
+            } else if (equalsIgnoreCase(name, "Transfer-Encoding")) {
+                chunked = equalsIgnoreCase(value, "chunked");
+            } else if (equalsIgnoreCase(name, "Connection")) {
+                close = equalsIgnoreCase(value, "close");
+            }
+        }
+        pos = line_end + 2;
+    }
+
+    size_t body_start = header_end + 4;
+    if (head || status / 100 == 1 || status == 204 || status == 304) return body_start;
+
+    if (chunked) {
+        pos = body_start;
+        while (true) {
+            size_t line_end = buffer.find("\r\n", pos);
+            if (line_end == std::string::npos) return eof ? -1 : 0;
+            size_t size = std::strtoull(buffer.c_str() + pos, nullptr, 16);
+            pos = line_end + 2;
+            if (size == 0) {
+                // 最后一个分块之后是可选的尾部头部和空行
+                if (buffer.compare(pos, 2, "\r\n") == 0) return pos + 2;
+                size_t trailer_end = buffer.find("\r\n\r\n", pos);
+                if (trailer_end == std::string::npos) return eof ? -1 : 0;
+                return trailer_end + 4;
+            }
+            if (buffer.size() < pos + size + 2) return eof ? -1 : 0;
+            pos += size + 2;
+        }
+    }
+
+    if (has_length) {
+        if (buffer.size() < body_start + content_length) return eof ? -1 : 0;
+        return body_start + content_length;
+    }
+
+    // 没有长度信息：响应体到连接关闭为止
+    close = true;
+    return eof ? static_cast<long>(buffer.size()) : 0;
+}
+
+// 单个压测线程：一个epoll实例驱动一组非阻塞连接
+class Worker {
+private:
+    enum class State { Closed, Connecting, Open };
+
+    struct Conn {
+        int fd = -1;
+        State state = State::Closed;
+        bool busy = false;               // 有请求在途
+        bool idle = false;               // 开环模式：在空闲列表中
+        size_t sent = 0;                 // 当前请求已发送的字节数
+        std::string in;                  // 已接收的响应数据
+        Clock::time_point started;       // 当前请求的开始（开环模式下为计划发送）时间
+        Clock::time_point retry_at;      // 连接失败后的重连时间（未失败时为零值）
+    };
+
+    const Options& options_;
+    Totals& totals_;
+    const sockaddr_storage& address_;
+    socklen_t address_len_;
+    std::string request_;
+    double rate_;
+    int epoll_fd_ = -1;
+    std::vector<Conn> conns_;
+    std::vector<size_t> idle_;                 // 开环模式：空闲的连接
+    std::deque<Clock::time_point> backlog_;    // 开环模式：等待空闲连接的请求（计划发送时间）
+    Clock::time_point measure_start_;
+    Clock::time_point end_;
+    uint64_t max_latency_ = 0;
+
+    bool running(Clock::time_point now) const { return now < end_; }
+
+    void openConn(size_t index) {
+        Conn& conn = conns_[index];
+        conn.retry_at = Clock::time_point();
+        conn.fd = socket(address_.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (conn.fd < 0) {
+            perror("socket");
+            std::exit(1);
+        }
+        int one = 1;
+        setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        conn.state = State::Connecting;
+        conn.in.clear();
+        if (connect(conn.fd, reinterpret_cast<const sockaddr*>(&address_), address_len_) == 0) {
+            conn.state = State::Open;
+        } else if (errno != EINPROGRESS) {
+            failConn(index);
+            return;
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.u64 = index;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, conn.fd, &ev);
+    }
+
+    void closeConn(Conn& conn) {
+        if (conn.fd != -1) {
+            close(conn.fd);
+            conn.fd = -1;
+        }
+        conn.state = State::Closed;
+        conn.busy = false;
+    }
+
+    // 连接出错：在途请求记为错误，稍后重连，避免服务器不可用时空转
+    void failConn(size_t index) {
+        Conn& conn = conns_[index];
+        if (conn.busy && conn.started >= measure_start_) totals_.errors.fetch_add(1, std::memory_order_relaxed);
+        closeConn(conn);
+        conn.retry_at = Clock::now() + std::chrono::milliseconds(10);
+    }
+
+    // 在连接上开始一个请求（连接尚未建立时在可写后发送）
+    void startRequest(size_t index, Clock::time_point started) {
+        Conn& conn = conns_[index];
+        conn.busy = true;
+        conn.idle = false;
+        conn.sent = 0;
+        conn.started = started;
+        if (conn.state == State::Closed) openConn(index);
+        if (conn.fd != -1 && conn.state == State::Open) sendRequest(index);
+    }
+
+    // 连接可以承接下一个请求
+    void onAvailable(size_t index, Clock::time_point now) {
+        if (!running(now)) return;
+        if (rate_ <= 0) {
+            startRequest(index, now);
+        } else if (!backlog_.empty()) {
+            Clock::time_point scheduled = backlog_.front();
+            backlog_.pop_front();
+            startRequest(index, scheduled);
+        } else if (!conns_[index].idle) {
+            conns_[index].idle = true;
+            idle_.push_back(index);
+        }
+    }
+
+    void sendRequest(size_t index) {
+        Conn& conn = conns_[index];
+        while (conn.sent < request_.size()) {
+            ssize_t n = write(conn.fd, request_.data() + conn.sent, request_.size() - conn.sent);
+            if (n > 0) {
+                conn.sent += n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+            failConn(index);
+            return;
+        }
+    }
+
+    void receive(size_t index, Clock::time_point now) {
+        Conn& conn = conns_[index];
+        char buffer[65536];
+        bool eof = false;
+        while (true) {
+            ssize_t n = read(conn.fd, buffer, sizeof(buffer));
+            if (n > 0) {
+                conn.in.append(buffer, n);
+                if (conn.started >= measure_start_) totals_.bytes.fetch_add(n, std::memory_order_relaxed);
+                continue;
+            }
+            if (n == 0) {
+                eof = true;
+                break;
+            }
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            failConn(index);
+            return;
+        }
+
+        while (conn.busy) {
+            int status = 0;
+            bool close_conn = false;
+            long length = parseResponse(conn.in, eof, options_.method == "HEAD", status, close_conn);
+            if (length < 0) {
+                failConn(index);
+                return;
+            }
+            if (length == 0) break;
+            conn.in.erase(0, length);
+            if (status / 100 == 1) continue;   // 中间响应（如100 Continue）
+
+            if (conn.started >= measure_start_) {
+                uint64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(now - conn.started).count();
+                totals_.latency.record(micros);
+                max_latency_ = std::max(max_latency_, micros);
+                totals_.requests.fetch_add(1, std::memory_order_relaxed);
+                totals_.status[status >= 100 && status < 600 ? status / 100 : 0].fetch_add(1, std::memory_order_relaxed);
+            }
+            conn.busy = false;
+            if (close_conn || !options_.keep_alive || eof) closeConn(conn);
+            onAvailable(index, now);
+            return;
+        }
+
+        // 对端关闭了连接：有在途请求时记为错误，否则在下一个请求时重连
+        if (eof) {
+            if (conn.busy) {
+                failConn(index);
+            } else {
+                closeConn(conn);
+            }
+        }
+    }
+
+    void handleEvent(size_t index, uint32_t events, Clock::time_point now) {
+        Conn& conn = conns_[index];
+        if (conn.fd == -1) return;
+        if (conn.state == State::Connecting) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err != 0) {
+                failConn(index);
+                return;
+            }
+            if (!(events & EPOLLOUT)) return;
+            conn.state = State::Open;
+        }
+        if ((events & EPOLLOUT) && conn.busy && conn.sent < request_.size()) {
+            sendRequest(index);
+            if (conn.fd == -1) return;
+        }
+        if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+            receive(index, now);
+        }
+    }
+
+public:
+    Worker(const Options& options, Totals& totals, const sockaddr_storage& address, socklen_t address_len,
+           size_t connections, double rate)
+        : options_(options), totals_(totals), address_(address), address_len_(address_len),
+          rate_(rate), conns_(connections) {
+        request_ = options.method + " " + options.path + " HTTP/1.1\r\n"
+                   "Host: " + options.host + ":" + std::to_string(options.port) + "\r\n";
+        for (const std::string& header : options.headers) {
+            request_ += header + "\r\n";
+        }
+        if (!options.keep_alive) request_ += "Connection: close\r\n";
+        request_ += "\r\n";
+    }
+
+    ~Worker() {
+        for (Conn& conn : conns_) closeConn(conn);
+        if (epoll_fd_ != -1) close(epoll_fd_);
+    }
+
+    void run(Clock::time_point start) {
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        measure_start_ = start + std::chrono::duration_cast<Clock::duration>(
+                                     std::chrono::duration<double>(options_.warmup));
+        end_ = measure_start_ + std::chrono::duration_cast<Clock::duration>(
+                                    std::chrono::duration<double>(options_.duration));
+
+        Clock::duration interval{};
+        Clock::time_point next_send = start;
+        if (rate_ > 0) {
+            interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate_));
+        }
+        for (size_t i = 0; i < conns_.size(); ++i) {
+            if (rate_ > 0) {
+                openConn(i);
+                onAvailable(i, start);
+            } else {
+                startRequest(i, start);
+            }
+        }
+
+        std::vector<epoll_event> events(conns_.size() + 1);
+        while (true) {
+            Clock::time_point now = Clock::now();
+            if (!running(now)) break;
+
+            // 开环模式：发出所有已到计划时间的请求
+            if (rate_ > 0) {
+                while (next_send <= now) {
+                    // 空闲列表中的连接可能已被积压请求取走，跳过
+                    while (!idle_.empty() && !conns_[idle_.back()].idle) idle_.pop_back();
+                    if (!idle_.empty()) {
+                        size_t index = idle_.back();
+                        idle_.pop_back();
+                        startRequest(index, next_send);
+                    } else {
+                        backlog_.push_back(next_send);
+                    }
+                    next_send += interval;
+                }
+            }
+
+            // 重连失败的连接
+            Clock::time_point wake = end_;
+            if (rate_ > 0) wake = std::min(wake, next_send);
+            for (size_t i = 0; i < conns_.size(); ++i) {
+                Conn& conn = conns_[i];
+                if (conn.state != State::Closed || conn.retry_at == Clock::time_point()) continue;
+                if (conn.retry_at <= now) {
+                    conn.retry_at = Clock::time_point();
+                    if (rate_ > 0) {
+                        openConn(i);
+                        if (conns_[i].fd != -1) onAvailable(i, now);
+                    } else {
+                        onAvailable(i, now);
+                    }
+                } else {
+                    wake = std::min(wake, conn.retry_at);
+                }
+            }
+
+            int timeout = static_cast<int>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count());
+            int count = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), std::max(timeout, 0));
+            now = Clock::now();
+            for (int i = 0; i < count; ++i) {
+                handleEvent(static_cast<size_t>(events[i].data.u64), events[i].events, now);
+            }
+        }
+
+        totals_.backlog.fetch_add(backlog_.size(), std::memory_order_relaxed);
+        uint64_t observed = totals_.max_latency.load(std::memory_order_relaxed);
+        while (observed < max_latency_ &&
+               !totals_.max_latency.compare_exchange_weak(observed, max_latency_, std::memory_order_relaxed)) {
+        }
+    }
+};
+
+void usage(const char* program) {
+    std::cerr << "用法: " << program << " [选项]\n"
+              << "  --host 主机           目标主机（默认127.0.0.1）\n"
+              << "  --port 端口           目标端口（默认8080）\n"
+              << "  --method 方法         请求方法（默认GET）\n"
+              << "  --path 路径           请求路径（默认/）\n"
+              << "  --header 'K: V'       附加请求头（可重复）\n"
+              << "  --connections N       并发连接数（默认64）\n"
+              << "  --threads N           压测线程数（默认1）\n"
+              << "  --duration 秒         统计时长（默认10）\n"
+              << "  --warmup 秒           预热时长，不计入结果（默认1）\n"
+              << "  --rate R              开环模式：总请求速率（请求/秒），默认闭环\n"
+              << "  --no-keep-alive       每个请求使用新连接\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                usage(argv[0]);
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+        if (arg == "--host") options.host = value();
+        else if (arg == "--port") options.port = std::atoi(value());
+        else if (arg == "--method") options.method = value();
+        else if (arg == "--path") options.path = value();
+        else if (arg == "--header") options.headers.push_back(value());
+        else if (arg == "--connections") options.connections = std::strtoul(value(), nullptr, 10);
+        else if (arg == "--threads") options.threads = std::strtoul(value(), nullptr, 10);
+        else if (arg == "--duration") options.duration = std::atof(value());
+        else if (arg == "--warmup") options.warmup = std::atof(value());
+        else if (arg == "--rate") options.rate = std::atof(value());
+        else if (arg == "--no-keep-alive") options.keep_alive = false;
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (options.connections == 0 || options.threads == 0 || options.duration <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    options.threads = std::min(options.threads, options.connections);
+
+    // 解析目标地址
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    int err = getaddrinfo(options.host.c_str(), std::to_string(options.port).c_str(), &hints, &result);
+    if (err != 0 || result == nullptr) {
+        std::cerr << "无法解析地址 " << options.host << ": " << gai_strerror(err) << std::endl;
+        return 1;
+    }
+    sockaddr_storage address{};
+    std::memcpy(&address, result->ai_addr, result->ai_addrlen);
+    socklen_t address_len = result->ai_addrlen;
+    freeaddrinfo(result);
+
+    // 连接数和速率平均分给各线程
+    Totals totals;
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (size_t t = 0; t < options.threads; ++t) {
+        size_t connections = options.connections / options.threads +
+                             (t < options.connections % options.threads ? 1 : 0);
+        workers.emplace_back(new Worker(options, totals, address, address_len, connections,
+                                        options.rate / options.threads));
+    }
+
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> threads;
+    for (auto& worker : workers) {
+        threads.emplace_back([&worker, start]() { worker->run(start); });
+    }
+    for (std::thread& thread : threads) thread.join();
+
+    HistogramSnapshot latency = totals.latency.snapshot();
+    uint64_t requests = totals.requests.load();
+    double rps = requests / options.duration;
+    double mean = latency.count ? static_cast<double>(latency.sum) / latency.count : 0.0;
+
+    std::cerr << "requests: " << requests << ", errors: " << totals.errors.load()
+              << ", rps: " << static_cast<uint64_t>(rps)
+              << ", p50: " << latency.quantile(0.5) << "us, p99: " << latency.quantile(0.99) << "us" << std::endl;
+
+    std::printf("{\"mode\": \"%s\", \"target\": \"http://%s:%d%s\", \"method\": \"%s\", "
+                "\"connections\": %zu, \"threads\": %zu, \"keep_alive\": %s, "
+                "\"duration_s\": %.3f, \"warmup_s\": %.3f, \"target_rate\": %.1f, "
+                "\"requests\": %llu, \"errors\": %llu, \"backlog\": %llu, "
+                "\"status\": {\"1xx\": %llu, \"2xx\": %llu, \"3xx\": %llu, \"4xx\": %llu, \"5xx\": %llu, \"other\": %llu}, "
+                "\"rps\": %.1f, \"bytes_received\": %llu, "
+                "\"latency_us\": {\"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"p999\": %.1f, "
+                "\"max\": %llu}}\n",
+                options.rate > 0 ? "open" : "closed", options.host.c_str(), options.port, options.path.c_str(),
+                options.method.c_str(), options.connections, options.threads,
+                options.keep_alive ? "true" : "false", options.duration, options.warmup, options.rate,
+                static_cast<unsigned long long>(requests),
+                static_cast<unsigned long long>(totals.errors.load()),
+                static_cast<unsigned long long>(totals.backlog.load()),
+                static_cast<unsigned long long>(totals.status[1].load()),
+                static_cast<unsigned long long>(totals.status[2].load()),
+                static_cast<unsigned long long>(totals.status[3].load()),
+                static_cast<unsigned long long>(totals.status[4].load()),
+                static_cast<unsigned long long>(totals.status[5].load()),
+                static_cast<unsigned long long>(totals.status[0].load()),
+                rps, static_cast<unsigned long long>(totals.bytes.load()),
+                mean, latency.quantile(0.5), latency.quantile(0.9), latency.quantile(0.99), latency.quantile(0.999),
+                static_cast<unsigned long long>(totals.max_latency.load()));
+    return 0;
+}
@@ -0,0 +1,327 @@
+// 微基准：测量请求解析、URL解码、路由匹配和响应构建的单次耗时
+// 用法：webserver_microbench [--filter 子串] [--min-time 秒]
+// 结果以JSON输出到标准输出，便于在CI中与基线比较
+#include "webserver.h"
+#include "websocket.h"
+#include "response_cache.h"
+#include "middleware.h"
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+// 阻止编译器把被测代码当作无用计算优化掉
+template <typename T>
+inline void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct BenchResult {
+    std::string name;
+    uint64_t iterations;
+    double ns_per_op;
+};
+
+// 反复执行fn，直到总耗时不少于min_time秒；迭代次数按上一轮耗时倍增
+template <typename F>
+BenchResult runBenchmark(const std::string& name, double min_time, F&& fn) {
+    using Clock = std::chrono::steady_clock;
+
+    // 预热
+    for (int i = 0; i < 1000; ++i) fn();
+
+    uint64_t iterations = 1000;
+    while (true) {
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < iterations; ++i) fn();
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        if (elapsed >= min_time || iterations >= (1ULL << 40)) {
+            return { name, iterations, elapsed * 1e9 / iterations };
+        }
+        double scale = elapsed > 0 ? min_time * 1.4 / elapsed : 10.0;
+        scale = std::min(std::max(scale, 2.0), 100.0);
+        iterations = static_cast<uint64_t>(iterations * scale);
+    }
+}
+
+const char kGetRequest[] =
+    "GET /api/users/12345/posts?page=2&sort=desc&q=hello%20world HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko)\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Cookie: session=4f2a9c1e7b3d; theme=dark\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+const char kPostRequest[] =
+    "POST /submit HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "Content-Length: 75\r\n"
+    "\r\n"
+    "name=%E5%BC%A0%E4%B8%89&email=zhang%40example.com&message=hello+world%21%21";
+
+// 模拟一个中等规模应用的路由表
+void registerRoutes(Router& router) {
+    static const char* const kPaths[] = {
+        "/", "/api/status", "/api/users", "/api/users/:id", "/api/users/:id/posts",
+        "/api/users/:id/posts/:post", "/api/orders", "/api/orders/:id", "/api/products",
+        "/api/products/:id", "/api/products/:id/reviews", "/api/search", "/api/login",
+        "/api/logout", "/health", "/files/*path", "/docs/:section/:page"
+    };
+    for (const char* path : kPaths) {
+        router.get(path, [](const Request& req, Response& res) {
+            res.setContent("ok");
+        });
+        router.post(path, [](const Request& req, Response& res) {
+            res.setContent("created");
+        });
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::string filter;
+    double min_time = 0.5;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            min_time = std::atof(argv[++i]);
+        } else {
+            std::cerr << "用法: " << argv[0] << " [--filter 子串] [--min-time 秒]" << std::endl;
+            return 2;
+        }
+    }
+
+    std::vector<BenchResult> results;
+    auto bench = [&](const std::string& name, auto&& fn) {
+        if (!filter.empty() && name.find(filter) == std::string::npos) return;
+        results.push_back(runBenchmark(name, min_time, fn));
+        std::cerr << name << ": " << results.back().ns_per_op << " ns/op" << std::endl;
+    };
+
+    // 请求解析：与事件循环相同，在复用的缓冲和Request上解析
+    {
+        std::string buffer;
+        Request req;
+        RequestParser parser;
+        bench("Request::parse/get", [&]() {
+            buffer.assign(kGetRequest, sizeof(kGetRequest) - 1);
+            parser.reset();
+            doNotOptimize(parser.parse(&buffer[0], buffer.size(), req));
+            doNotOptimize(req.header("Cookie"));
+        });
+        bench("Request::parse/post_form", [&]() {
+            buffer.assign(kPostRequest, sizeof(kPostRequest) - 1);
+            parser.reset();
+            doNotOptimize(parser.parse(&buffer[0], buffer.size(), req));
+            doNotOptimize(req.body());
+        });
+        bench("Request::parse/copying", [&]() {
+            Request copy;
+            doNotOptimize(copy.parse(kGetRequest));
+        });
+    }
+
+    // URL解码
+    {
+        const std::string plain = "the-quick-brown-fox-jumps-over-the-lazy-dog";
+        const std::string encoded = "name=%E5%BC%A0%E4%B8%89+%E6%9D%8E%E5%9B%9B&email=zhang%40example.com"
+                                    "&message=hello+world%21+%E4%BD%A0%E5%A5%BD";
+        bench("urlDecode/plain", [&]() {
+            doNotOptimize(urlDecode(plain));
+        });
+        bench("urlDecode/encoded", [&]() {
+            doNotOptimize(urlDecode(encoded));
+        });
+
+        // 长查询串：大段无需解码的文本中夹杂少量转义
+        std::string long_query;
+        for (int i = 0; i < 32; ++i) {
+            long_query += "field" + std::to_string(i) + "=some-plain-value-without-escapes-" + std::to_string(i) +
+                          "%20end&";
+        }
+        std::string buffer;
+        bench("urlDecode/long_query", [&]() {
+            doNotOptimize(urlDecode(long_query));
+        });
+        bench("urlDecode/in_place", [&]() {
+            buffer.assign(long_query);
+            doNotOptimize(urlDecodeTo(buffer.data(), buffer.size(), &buffer[0]));
+        });
+
+        Request req;
+        req.parse("GET /search?" + long_query + "q=%E4%BD%A0%E5%A5%BD HTTP/1.1\r\nHost: x\r\n\r\n");
+        bench("Request::queryParam/last", [&]() {
+            doNotOptimize(req.queryParam("q"));
+        });
+    }
+
+    // 路由匹配与处理（不含静态文件）
+    {
+        Router router;
+        registerRoutes(router);
+        // 缓存路由：命中时由缓存条目生成响应（压缩版本已保存）
+        RouteCacheOptions cache;
+        cache.ttl = std::chrono::hours(1);
+        router.get("/cached/:id", [](const Request& req, Response& res) {
+            std::string json = "[";
+            for (int i = 0; json.size() < 4096; ++i) json += "{\"id\":" + std::to_string(i) + ",\"name\":\"item\"},";
+            json.back() = ']';
+            res.setHeader("Content-Type", "application/json");
+            res.setContent(std::move(json));
+        }, cache);
+        auto routeBench = [&](const std::string& name, const char* raw) {
+            Request req;
+            if (!req.parse(raw)) {
+                std::cerr << "基准请求解析失败: " << name << std::endl;
+                std::exit(1);
+            }
+            bench(name, [&]() {
+                Response res;
+                doNotOptimize(router.handle(req, res));
+            });
+        };
+        routeBench("Router::handle/static_route", "GET /api/status HTTP/1.1\r\nHost: x\r\n\r\n");
+        routeBench("Router::handle/param_route", "GET /api/products/42/reviews HTTP/1.1\r\nHost: x\r\n\r\n");
+        routeBench("Router::handle/wildcard", "GET /files/a/b/c/d.txt HTTP/1.1\r\nHost: x\r\n\r\n");
+        routeBench("Router::handle/not_found", "GET /api/unknown/path HTTP/1.1\r\nHost: x\r\n\r\n");
+        routeBench("Router::handle/cached_hit",
+                   "GET /cached/7 HTTP/1.1\r\nHost: x\r\nAccept-Encoding: gzip, br\r\n\r\n");
+    }
+
+    // 中间件：6个只做简单检查的中间件包在同一个处理函数之外，比较静态组合、运行时注册和逐层包一个std::function的调用开销
+    {
+        Request req;
+        req.parse(kGetRequest);
+        auto check = [](const Request& req, Response& res, auto&& next) {
+            if (req.methodId() == HttpMethod::Unknown) {
+                res.setStatusCode(405);
+                return;
+            }
+            next();
+        };
+        auto handler = [](const Request& req, Response& res) { res.setStatusCode(200); };
+        HandlerFunc static_chain = middleware(check, check, check, check, check, check).wrap(handler);
+        HandlerFunc erased = wrapMiddleware(std::vector<MiddlewareFunc>(6, check), handler);
+        HandlerFunc nested = handler;
+        for (int i = 0; i < 6; ++i) {
+            nested = [inner = nested, check](const Request& req, Response& res) {
+                std::function<void()> next = [&]() { inner(req, res); };
+                check(req, res, next);
+            };
+        }
+        Response res;
+        bench("Middleware/static_chain_6", [&]() {
+            static_chain(req, res);
+            doNotOptimize(res.statusCode());
+        });
+        bench("Middleware/type_erased_6", [&]() {
+            erased(req, res);
+            doNotOptimize(res.statusCode());
+        });
+        bench("Middleware/nested_function_6", [&]() {
+            nested(req, res);
+            doNotOptimize(res.statusCode());
+        });
+    }
+
+    // 响应构建
+    {
+        const std::string html(2048, 'x');
+        RequestArena arena;
+        bench("Response::buildResponse/html", [&]() {
+            Response res;
+            res.setHeader("Cache-Control", "no-cache");
+            res.setHtml(html);
+            doNotOptimize(res.buildResponse());
+        });
+        bench("Response::writeTo/arena", [&]() {
+            OutputBuffer out;
+            {
+                Response res(&arena);
+                res.setHeader("Cache-Control", "no-cache");
+                res.setHeader("Connection", "keep-alive");
+                res.setHtml(html);
+                res.writeTo(out);
+            }
+            doNotOptimize(out.pendingBytes());
+            arena.reset();
+        });
+        const HtmlTemplate page("<html><body><h1>{{title}}</h1>" + html + "<p>{{name}}</p></body></html>");
+        bench("Response::writeTo/template", [&]() {
+            OutputBuffer out;
+            {
+                Response res(&arena);
+                res.setHeader("Cache-Control", "no-cache");
+                res.setHtml(page, {{"title", "提交成功"}, {"name", "<Tom & Jerry>"}});
+                res.writeTo(out);
+            }
+            doNotOptimize(out.pendingBytes());
+            arena.reset();
+        });
+    }
+
+    // 响应压缩：4KB左右的动态HTML页面
+    {
+        std::string html = "<html><body><table>";
+        for (int i = 0; html.size() < 4096; ++i) {
+            html += "<tr><td>" + std::to_string(i) + "</td><td>item-" + std::to_string(i * 7) + "</td></tr>";
+        }
+        html += "</table></body></html>";
+        CompressionConfig config;
+        static const ContentCoding kCodings[] = { ContentCoding::Gzip, ContentCoding::Brotli };
+        for (ContentCoding coding : kCodings) {
+            if (!contentCodingAvailable(coding)) continue;
+            bench("compressBuffer/" + std::string(contentCodingName(coding)), [&]() {
+                std::string out;
+                compressBuffer(coding, config, html, out);
+                doNotOptimize(out.size());
+            });
+        }
+    }
+
+    // WebSocket：4KB载荷的掩码运算，以及解析一个加掩码的客户端文本帧
+    {
+        const unsigned char key[4] = { 0x37, 0xfa, 0x21, 0x3d };
+        std::string payload(4096, 'a');
+        bench("applyWebSocketMask/4k", [&]() {
+            applyWebSocketMask(&payload[0], payload.size(), key);
+            doNotOptimize(payload[0]);
+        });
+
+        struct NullHandler : WebSocketSession::Handler {
+            size_t bytes = 0;
+            void onMessage(std::string_view data, bool binary) override { bytes += data.size(); }
+        } handler;
+        WebSocketSession session(handler, 1 << 20);
+        std::string frame;
+        encodeWebSocketFrame(WebSocketOpcode::Text, std::string(1024, 'x'), frame);
+        frame[1] = static_cast<char>(frame[1] | 0x80);
+        frame.insert(4, reinterpret_cast<const char*>(key), 4);
+        applyWebSocketMask(&frame[8], 1024, key);
+        std::string in;
+        OutputBuffer out;
+        bench("WebSocketSession::receive/text_1k", [&]() {
+            in = frame;
+            session.receive(in, out);
+            doNotOptimize(handler.bytes);
+        });
+    }
+
+    // 机器可读的结果
+    std::printf("{\"simd\": \"%s\", \"min_time_s\": %.3f, \"benchmarks\": [", simdLevelName(), min_time);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        std::printf("%s\n  {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, \"ops_per_sec\": %.0f}",
+                    i ? "," : "", r.name.c_str(), static_cast<unsigned long long>(r.iterations),
+                    r.ns_per_op, r.ns_per_op > 0 ? 1e9 / r.ns_per_op : 0.0);
+    }
+    std::printf("\n]}\n");
+    return 0;
+}
@@ -0,0 +1,283 @@
+#include "compress.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef WEBSERVER_HAS_ZLIB
+#include <zlib.h>
+#endif
+#ifdef WEBSERVER_HAS_BROTLI
+#include <brotli/encode.h>
+#endif
+
+namespace {
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        char x = a[i], y = b[i];
+        if (x >= 'A' && x <= 'Z') x += 'a' - 'A';
+        if (y >= 'A' && y <= 'Z') y += 'a' - 'A';
+        if (x != y) return false;
+    }
+    return true;
+}
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) text.remove_suffix(1);
+    return text;
+}
+
+#ifdef WEBSERVER_HAS_ZLIB
+// 把data送入z_stream，输出追加到out；finish为true时结束压缩流，否则刷新已压缩的数据
+bool deflateTo(z_stream& stream, std::string_view data, std::string& out, bool finish) {
+    // avail_in是32位：超大的输入分段传入
+    const size_t kMaxInput = 1u << 30;
+    do {
+        size_t piece = std::min(data.size(), kMaxInput);
+        bool last = piece == data.size();
+        int flush = !last ? Z_NO_FLUSH : finish ? Z_FINISH : Z_SYNC_FLUSH;
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        stream.avail_in = static_cast<uInt>(piece);
+        data.remove_prefix(piece);
+        while (true) {
+            size_t offset = out.size();
+            size_t room = stream.avail_in / 2 + 4096;
+            out.resize(offset + room);
+            stream.next_out = reinterpret_cast<Bytef*>(&out[offset]);
+            stream.avail_out = static_cast<uInt>(room);
+            int result = deflate(&stream, flush);
+            out.resize(offset + room - stream.avail_out);
+            if (result == Z_STREAM_ERROR) return false;
+            if (result == Z_STREAM_END) break;
+            // 输出空间未用完说明本次输入已全部处理（且已按flush要求输出）
+            if (flush != Z_FINISH && stream.avail_out != 0) break;
+        }
+    } while (!data.empty());
+    return true;
+}
+
+int initDeflate(z_stream& stream, ContentCoding coding, const CompressionConfig& config) {
+    // windowBits 31为gzip封装，15为zlib封装（HTTP的deflate编码即zlib格式）
+    int window_bits = coding == ContentCoding::Gzip ? 31 : 15;
+    int level = std::min(std::max(config.gzip_level, 1), 9);
+    return deflateInit2(&stream, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY);
+}
+
+// 每个线程为gzip和deflate各缓存一个z_stream：deflateInit分配的窗口和哈希表较大，
+// 一次性压缩小的响应体时初始化的开销与压缩本身相当，复用时只需deflateReset
+struct ThreadDeflater {
+    z_stream stream{};
+    bool active = false;
+    int level = 0;
+
+    ~ThreadDeflater() {
+        if (active) deflateEnd(&stream);
+    }
+};
+#endif
+
+} // namespace
+
+bool CompressionConfig::compressible(std::string_view content_type) const {
+    std::string_view type = trim(content_type.substr(0, content_type.find(';')));
+    for (const std::string& allowed : types) {
+        if (!allowed.empty() && allowed.back() == '/') {
+            if (type.size() > allowed.size() && equalsIgnoreCase(type.substr(0, allowed.size()), allowed)) {
+                return true;
+            }
+        } else if (equalsIgnoreCase(type, allowed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string_view contentCodingName(ContentCoding coding) {
+    switch (coding) {
+        case ContentCoding::Gzip: return "gzip";
+        case ContentCoding::Deflate: return "deflate";
+        case ContentCoding::Brotli: return "br";
+        default: return std::string_view();
+    }
+}
+
+bool contentCodingAvailable(ContentCoding coding) {
+    switch (coding) {
+#ifdef WEBSERVER_HAS_ZLIB
+        case ContentCoding::Gzip:
+        case ContentCoding::Deflate:
+            return true;
+#endif
+#ifdef WEBSERVER_HAS_BROTLI
+        case ContentCoding::Brotli:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+bool acceptsEncoding(std::string_view accept, std::string_view encoding) {
+    bool wildcard = false;
+    size_t pos = 0;
+    while (pos < accept.size()) {
+        size_t comma = accept.find(',', pos);
+        if (comma == std::string_view::npos) comma = accept.size();
+        std::string_view item = accept.substr(pos, comma - pos);
+        pos = comma + 1;
+
+        // 拆分编码名和参数（如gzip;q=0.8）
+        size_t semicolon = item.find(';');
+        std::string_view name = trim(item.substr(0, semicolon));
+
+        bool rejected = false;
+        if (semicolon != std::string_view::npos) {
+            std::string_view params = item.substr(semicolon + 1);
+            size_t q = params.find("q=");
+            if (q != std::string_view::npos) {
+                rejected = std::strtod(std::string(params.substr(q + 2)).c_str(), nullptr) <= 0.0;
+            }
+        }
+        if (equalsIgnoreCase(name, encoding)) return !rejected;
+        if (name == "*") wildcard = !rejected;
+    }
+    return wildcard;
+}
+
+ContentCoding negotiateEncoding(std::string_view accept) {
+    if (accept.empty()) return ContentCoding::Identity;
+    static const ContentCoding kPreference[] = { ContentCoding::Brotli, ContentCoding::Gzip, ContentCoding::Deflate };
+    for (ContentCoding coding : kPreference) {
+        if (contentCodingAvailable(coding) && acceptsEncoding(accept, contentCodingName(coding))) return coding;
+    }
+    return ContentCoding::Identity;
+}
+
+// Compressor类实现：zlib的z_stream或brotli的编码器状态
+struct Compressor::Impl {
+#ifdef WEBSERVER_HAS_ZLIB
+    z_stream zlib{};
+    bool zlib_active = false;
+#endif
+#ifdef WEBSERVER_HAS_BROTLI
+    BrotliEncoderState* brotli = nullptr;
+#endif
+
+    ~Impl() {
+#ifdef WEBSERVER_HAS_ZLIB
+        if (zlib_active) deflateEnd(&zlib);
+#endif
+#ifdef WEBSERVER_HAS_BROTLI
+        if (brotli) BrotliEncoderDestroyInstance(brotli);
+#endif
+    }
+};
+
+Compressor::Compressor(ContentCoding coding, const CompressionConfig& config) : coding_(coding) {
+    std::unique_ptr<Impl> impl(new Impl());
+    switch (coding) {
+#ifdef WEBSERVER_HAS_ZLIB
+        case ContentCoding::Gzip:
+        case ContentCoding::Deflate:
+            if (initDeflate(impl->zlib, coding, config) != Z_OK) return;
+            impl->zlib_active = true;
+            break;
+#endif
+#ifdef WEBSERVER_HAS_BROTLI
+        case ContentCoding::Brotli:
+            impl->brotli = BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+            if (!impl->brotli) return;
+            BrotliEncoderSetParameter(impl->brotli, BROTLI_PARAM_QUALITY,
+                                      static_cast<uint32_t>(std::min(std::max(config.brotli_quality, 0), 11)));
+            BrotliEncoderSetParameter(impl->brotli, BROTLI_PARAM_MODE, BROTLI_MODE_TEXT);
+            break;
+#endif
+        default:
+            (void)config;
+            return;
+    }
+    impl_ = std::move(impl);
+}
+
+Compressor::~Compressor() = default;
+
+bool Compressor::update(std::string_view data, std::string& out, bool finish) {
+    if (!impl_) return false;
+    // 没有新数据时不必刷新（否则每次都会输出一个空块）
+    if (data.empty() && !finish) return true;
+
+#ifdef WEBSERVER_HAS_ZLIB
+    if (impl_->zlib_active) return deflateTo(impl_->zlib, data, out, finish);
+#endif
+#ifdef WEBSERVER_HAS_BROTLI
+    if (impl_->brotli) {
+        size_t avail_in = data.size();
+        const uint8_t* next_in = reinterpret_cast<const uint8_t*>(data.data());
+        BrotliEncoderOperation op = finish ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_FLUSH;
+        while (true) {
+            // 不提供输出缓冲，由编码器内部缓冲后取出
+            size_t avail_out = 0;
+            if (!BrotliEncoderCompressStream(impl_->brotli, op, &avail_in, &next_in, &avail_out, nullptr, nullptr)) {
+                return false;
+            }
+            size_t size = 0;
+            const uint8_t* output = BrotliEncoderTakeOutput(impl_->brotli, &size);
+            if (size > 0) out.append(reinterpret_cast<const char*>(output), size);
+            if (avail_in == 0 && !BrotliEncoderHasMoreOutput(impl_->brotli) &&
+                (!finish || BrotliEncoderIsFinished(impl_->brotli))) {
+                break;
+            }
+        }
+        return true;
+    }
+#endif
+    return false;
+}
+
+bool compressBuffer(ContentCoding coding, const CompressionConfig& config, std::string_view data, std::string& out) {
+#ifdef WEBSERVER_HAS_ZLIB
+    if (coding == ContentCoding::Gzip || coding == ContentCoding::Deflate) {
+        static thread_local ThreadDeflater deflaters[2];
+        ThreadDeflater& deflater = deflaters[coding == ContentCoding::Gzip ? 0 : 1];
+        if (deflater.active && deflater.level != config.gzip_level) {
+            deflateEnd(&deflater.stream);
+            deflater.active = false;
+        }
+        if (!deflater.active) {
+            deflater.stream = z_stream();
+            if (initDeflate(deflater.stream, coding, config) != Z_OK) return false;
+            deflater.active = true;
+            deflater.level = config.gzip_level;
+        } else if (deflateReset(&deflater.stream) != Z_OK) {
+            return false;
+        }
+        // 压缩文本通常能缩小到几分之一，先按一半预留
+        out.reserve(out.size() + data.size() / 2 + 64);
+        return deflateTo(deflater.stream, data, out, true);
+    }
+#endif
+#ifdef WEBSERVER_HAS_BROTLI
+    if (coding == ContentCoding::Brotli) {
+        // 一次性接口按输入大小选择窗口和哈希表，小的响应体比流式编码器省去大部分初始化
+        size_t offset = out.size();
+        size_t size = BrotliEncoderMaxCompressedSize(data.size());
+        if (size == 0) return false;
+        out.resize(offset + size);
+        int quality = std::min(std::max(config.brotli_quality, 0), 11);
+        if (!BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, data.size(),
+                                   reinterpret_cast<const uint8_t*>(data.data()), &size,
+                                   reinterpret_cast<uint8_t*>(&out[offset]))) {
+            out.resize(offset);
+            return false;
+        }
+        out.resize(offset + size);
+        return true;
+    }
+#endif
+    (void)config;
+    (void)data;
+    (void)out;
+    return false;
+}
@@ -0,0 +1,79 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 响应体的内容编码
+// gzip/deflate需要以WEBSERVER_HAS_ZLIB编译并链接zlib，br需要WEBSERVER_HAS_BROTLI和libbrotlienc；
+// 编译时不可用的编码不会被协商选中
+enum class ContentCoding : uint8_t {
+    Identity,
+    Gzip,
+    Deflate,
+    Brotli
+};
+
+// 可选编码的数量（不含Identity）
+constexpr size_t kContentCodingCount = 3;
+
+// 动态压缩的配置（ServerConfig::compression）
+struct CompressionConfig {
+    bool enabled = true;
+    int gzip_level = 6;                     // gzip/deflate压缩级别（1-9）
+    int brotli_quality = 5;                 // br压缩质量（0-11），动态内容不宜过高
+    size_t min_size = 1024;                 // 小于该大小的响应体不压缩（压缩收益抵不过开销）
+    size_t stream_threshold = 256 * 1024;   // 超过该大小的响应体边发送边压缩（分块传输编码），不在内存中保留完整的压缩结果
+    // 允许压缩的MIME类型：以/结尾的项按前缀匹配（如text/），其余项完全匹配（忽略;之后的参数）
+    std::vector<std::string> types = {
+        "text/", "application/javascript", "application/json", "application/xml",
+        "application/xhtml+xml", "application/wasm", "image/svg+xml"
+    };
+
+    // 内容类型是否在允许压缩的列表中
+    bool compressible(std::string_view content_type) const;
+};
+
+// 编码在Content-Encoding中的名称（Identity为空）
+std::string_view contentCodingName(ContentCoding coding);
+
+// 编码在本次编译中是否可用
+bool contentCodingAvailable(ContentCoding coding);
+
+// 判断Accept-Encoding是否接受指定编码（q=0表示明确拒绝）
+bool acceptsEncoding(std::string_view accept, std::string_view encoding);
+
+// 按Accept-Encoding选择编码：依次优先br、gzip、deflate，都不接受（或不可用）时为Identity
+ContentCoding negotiateEncoding(std::string_view accept);
+
+// 流式压缩器：数据可以分多次传入，输出追加到out
+// 构造时选择编码和级别，不可用的编码构造后valid()为false
+class Compressor {
+public:
+    Compressor(ContentCoding coding, const CompressionConfig& config);
+    ~Compressor();
+    Compressor(const Compressor&) = delete;
+    Compressor& operator=(const Compressor&) = delete;
+
+    bool valid() const { return static_cast<bool>(impl_); }
+    ContentCoding coding() const { return coding_; }
+
+    // 压缩一段数据，输出追加到out；finish为true时结束压缩流（之后不能再调用）
+    // 非结束调用会刷新已压缩的数据，使对端能及时解压收到的部分；出错时返回false
+    bool update(std::string_view data, std::string& out, bool finish);
+
+    struct Impl;
+
+private:
+    ContentCoding coding_;
+    std::unique_ptr<Impl> impl_;
+};
+
+// 一次性压缩整段数据，失败（或编码不可用）时返回false
+bool compressBuffer(ContentCoding coding, const CompressionConfig& config, std::string_view data, std::string& out);
+
+#endif // COMPRESS_H
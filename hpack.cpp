@@ -0,0 +1,376 @@
+#include "hpack.h"
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+
+// 静态表（RFC 7541附录A），下标0不使用
+struct StaticEntry {
+    std::string_view name;
+    std::string_view value;
+};
+
+const StaticEntry kStaticTable[] = {
+    {"", ""},
+    {":authority", ""}, {":method", "GET"}, {":method", "POST"}, {":path", "/"}, {":path", "/index.html"},
+    {":scheme", "http"}, {":scheme", "https"}, {":status", "200"}, {":status", "204"}, {":status", "206"},
+    {":status", "304"}, {":status", "400"}, {":status", "404"}, {":status", "500"}, {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"}, {"accept-language", ""}, {"accept-ranges", ""}, {"accept", ""},
+    {"access-control-allow-origin", ""}, {"age", ""}, {"allow", ""}, {"authorization", ""},
+    {"cache-control", ""}, {"content-disposition", ""}, {"content-encoding", ""}, {"content-language", ""},
+    {"content-length", ""}, {"content-location", ""}, {"content-range", ""}, {"content-type", ""},
+    {"cookie", ""}, {"date", ""}, {"etag", ""}, {"expect", ""}, {"expires", ""}, {"from", ""}, {"host", ""},
+    {"if-match", ""}, {"if-modified-since", ""}, {"if-none-match", ""}, {"if-range", ""},
+    {"if-unmodified-since", ""}, {"last-modified", ""}, {"link", ""}, {"location", ""}, {"max-forwards", ""},
+    {"proxy-authenticate", ""}, {"proxy-authorization", ""}, {"range", ""}, {"referer", ""}, {"refresh", ""},
+    {"retry-after", ""}, {"server", ""}, {"set-cookie", ""}, {"strict-transport-security", ""},
+    {"transfer-encoding", ""}, {"user-agent", ""}, {"vary", ""}, {"via", ""}, {"www-authenticate", ""},
+};
+const size_t kStaticCount = sizeof(kStaticTable) / sizeof(kStaticTable[0]) - 1;
+
+// 静态表按名称的索引：名称 -> 第一个同名条目（同名条目在表中相邻）
+const std::unordered_map<std::string_view, size_t>& staticNameIndex() {
+    static const std::unordered_map<std::string_view, size_t> index = [] {
+        std::unordered_map<std::string_view, size_t> map;
+        for (size_t i = kStaticCount; i >= 1; --i) map[kStaticTable[i].name] = i;
+        return map;
+    }();
+    return index;
+}
+
+// Huffman编码表（RFC 7541附录B）：每个符号的码字和位数，下标256为EOS
+struct HuffmanCode {
+    uint32_t code;
+    uint8_t bits;
+};
+
+const HuffmanCode kHuffmanCodes[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28},
+    {0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28},
+    {0xfffffef, 28}, {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+    {0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10},
+    {0xf9, 8}, {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6},
+    {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6},
+    {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7},
+    {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7},
+    {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5},
+    {0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7},
+    {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14},
+    {0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23},
+    {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23},
+    {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21},
+    {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22},
+    {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22},
+    {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23},
+    {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21},
+    {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27},
+    {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22}, {0x3fffeb, 22},
+    {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27},
+    {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30},
+};
+
+// 码表是规范Huffman编码（同长度的码字按符号顺序连续递增），解码时按位累积码字，
+// 与每个长度的首个码字比较即可确定符号
+struct HuffmanDecodeTable {
+    static const unsigned kMaxBits = 30;
+    uint32_t first_code[kMaxBits + 1] = {};   // 各长度的首个码字
+    uint16_t first_index[kMaxBits + 1] = {};  // 各长度的首个符号在symbols中的位置
+    uint16_t count[kMaxBits + 1] = {};        // 各长度的码字数
+    uint16_t symbols[257];                    // 按(长度, 码字)排序的符号
+
+    HuffmanDecodeTable() {
+        uint16_t order[257];
+        for (uint16_t i = 0; i < 257; ++i) order[i] = i;
+        std::sort(order, order + 257, [](uint16_t a, uint16_t b) {
+            if (kHuffmanCodes[a].bits != kHuffmanCodes[b].bits) return kHuffmanCodes[a].bits < kHuffmanCodes[b].bits;
+            return kHuffmanCodes[a].code < kHuffmanCodes[b].code;
+        });
+        for (uint16_t i = 0; i < 257; ++i) {
+            symbols[i] = order[i];
+            const HuffmanCode& code = kHuffmanCodes[order[i]];
+            if (count[code.bits]++ == 0) {
+                first_code[code.bits] = code.code;
+                first_index[code.bits] = i;
+            }
+        }
+    }
+};
+
+const HuffmanDecodeTable& huffmanDecodeTable() {
+    static const HuffmanDecodeTable table;
+    return table;
+}
+
+// 这些字段的值每个响应都不同或不应被缓存：编码为不加入动态表的字面量（set-cookie为永不索引）
+bool skipIndexing(std::string_view name) {
+    return name == "content-length" || name == "etag" || name == "last-modified" || name == "content-range" ||
+           name == "location" || name == "set-cookie" || name == "age";
+}
+
+} // namespace
+
+size_t huffmanEncodedSize(std::string_view data) {
+    uint64_t bits = 0;
+    for (unsigned char c : data) bits += kHuffmanCodes[c].bits;
+    return static_cast<size_t>((bits + 7) / 8);
+}
+
+void huffmanEncode(std::string_view data, std::string& out) {
+    uint64_t buffer = 0;   // 尚未输出的位（低位对齐）
+    unsigned pending = 0;
+    for (unsigned char c : data) {
+        const HuffmanCode& code = kHuffmanCodes[c];
+        buffer = (buffer << code.bits) | code.code;
+        pending += code.bits;
+        while (pending >= 8) {
+            pending -= 8;
+            out.push_back(static_cast<char>(buffer >> pending));
+        }
+        buffer &= (uint64_t(1) << pending) - 1;
+    }
+    // 末尾不足一字节的部分用EOS码字的高位（全1）填充
+    if (pending > 0) {
+        out.push_back(static_cast<char>((buffer << (8 - pending)) | (0xffu >> pending)));
+    }
+}
+
+bool huffmanDecode(std::string_view data, std::string& out) {
+    const HuffmanDecodeTable& table = huffmanDecodeTable();
+    uint32_t code = 0;
+    unsigned bits = 0;
+    for (unsigned char byte : data) {
+        for (int bit = 7; bit >= 0; --bit) {
+            code = (code << 1) | ((byte >> bit) & 1);
+            ++bits;
+            if (bits > HuffmanDecodeTable::kMaxBits) return false;
+            if (table.count[bits] == 0 || code < table.first_code[bits] ||
+                code - table.first_code[bits] >= table.count[bits]) {
+                continue;
+            }
+            uint16_t symbol = table.symbols[table.first_index[bits] + (code - table.first_code[bits])];
+            // 编码中不能出现EOS
+            if (symbol == 256) return false;
+            out.push_back(static_cast<char>(symbol));
+            code = 0;
+            bits = 0;
+        }
+    }
+    // 填充最多7位，且必须是EOS码字的高位（全1）
+    return bits <= 7 && code == (uint32_t(1) << bits) - 1;
+}
+
+void hpackEncodeInteger(uint64_t value, unsigned prefix_bits, uint8_t flags, std::string& out) {
+    uint64_t max_prefix = (uint64_t(1) << prefix_bits) - 1;
+    if (value < max_prefix) {
+        out.push_back(static_cast<char>(flags | value));
+        return;
+    }
+    out.push_back(static_cast<char>(flags | max_prefix));
+    value -= max_prefix;
+    while (value >= 128) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+bool hpackDecodeInteger(std::string_view& data, unsigned prefix_bits, uint64_t& value) {
+    if (data.empty()) return false;
+    uint64_t max_prefix = (uint64_t(1) << prefix_bits) - 1;
+    value = static_cast<unsigned char>(data[0]) & max_prefix;
+    size_t pos = 1;
+    if (value == max_prefix) {
+        unsigned shift = 0;
+        while (true) {
+            if (pos >= data.size()) return false;
+            unsigned char byte = static_cast<unsigned char>(data[pos++]);
+            // 头部中的整数不会超过32位，过长的编码视为非法
+            if (shift > 28) return false;
+            value += uint64_t(byte & 0x7f) << shift;
+            shift += 7;
+            if (!(byte & 0x80)) break;
+        }
+        if (value > UINT32_MAX) return false;
+    }
+    data.remove_prefix(pos);
+    return true;
+}
+
+// HpackTable类实现
+void HpackTable::evict(size_t needed) {
+    while (!entries_.empty() && size_ + needed > capacity_) {
+        const auto& oldest = entries_.back();
+        size_ -= oldest.first.size() + oldest.second.size() + 32;
+        entries_.pop_back();
+    }
+}
+
+void HpackTable::insert(std::string_view name, std::string_view value) {
+    size_t entry_size = name.size() + value.size() + 32;
+    if (entry_size > capacity_) {
+        entries_.clear();
+        size_ = 0;
+        return;
+    }
+    evict(entry_size);
+    entries_.emplace_front(std::string(name), std::string(value));
+    size_ += entry_size;
+}
+
+void HpackTable::setCapacity(size_t capacity) {
+    capacity_ = capacity;
+    evict(0);
+}
+
+// HpackDecoder类实现
+bool HpackDecoder::decodeField(std::string_view& block, std::string& name, std::string& value, bool& is_field) {
+    // 按表中的索引取得名称和值（索引从1开始，静态表之后是动态表）
+    auto lookup = [this](uint64_t index, std::string* name_out, std::string* value_out) {
+        if (index == 0) return false;
+        if (index <= kStaticCount) {
+            if (name_out) name_out->assign(kStaticTable[index].name);
+            if (value_out) value_out->assign(kStaticTable[index].value);
+            return true;
+        }
+        index -= kStaticCount + 1;
+        if (index >= table_.count()) return false;
+        if (name_out) name_out->assign(table_.at(index).first);
+        if (value_out) value_out->assign(table_.at(index).second);
+        return true;
+    };
+    // 字符串字面量：首位为Huffman标记，长度为7位前缀整数
+    auto readString = [&block](std::string& out) {
+        if (block.empty()) return false;
+        bool huffman = static_cast<unsigned char>(block[0]) & 0x80;
+        uint64_t length = 0;
+        if (!hpackDecodeInteger(block, 7, length) || length > block.size()) return false;
+        out.clear();
+        std::string_view data = block.substr(0, length);
+        block.remove_prefix(length);
+        if (huffman) return huffmanDecode(data, out);
+        out.assign(data);
+        return true;
+    };
+
+    unsigned char first = static_cast<unsigned char>(block[0]);
+    uint64_t index = 0;
+    is_field = true;
+    if (first & 0x80) {
+        // 索引字段
+        return hpackDecodeInteger(block, 7, index) && lookup(index, &name, &value);
+    }
+    if ((first & 0xe0) == 0x20) {
+        // 动态表容量更新
+        is_field = false;
+        if (!hpackDecodeInteger(block, 5, index) || index > max_table_size_) return false;
+        table_.setCapacity(index);
+        return true;
+    }
+
+    // 字面量：带增量索引（01）、不索引（0000）、永不索引（0001）
+    bool indexing = (first & 0xc0) == 0x40;
+    unsigned prefix = indexing ? 6 : 4;
+    if (!hpackDecodeInteger(block, prefix, index)) return false;
+    if (index == 0) {
+        if (!readString(name)) return false;
+    } else if (!lookup(index, &name, nullptr)) {
+        return false;
+    }
+    if (!readString(value)) return false;
+    if (indexing) table_.insert(name, value);
+    return true;
+}
+
+// HpackEncoder类实现
+void HpackEncoder::setPeerTableSize(size_t size) {
+    size_t capacity = std::min(size, max_table_size_);
+    if (capacity == table_.capacity() && !capacity_changed_) return;
+    // 先缩小再恢复时两次变化都要通告，记下其间的最小值（RFC 7541 4.2）
+    pending_capacity_ = capacity_changed_ ? std::min(pending_capacity_, capacity) : capacity;
+    capacity_changed_ = true;
+    table_.setCapacity(capacity);
+}
+
+void HpackEncoder::beginBlock(std::string& out) {
+    if (!capacity_changed_) return;
+    if (pending_capacity_ != table_.capacity()) hpackEncodeInteger(pending_capacity_, 5, 0x20, out);
+    hpackEncodeInteger(table_.capacity(), 5, 0x20, out);
+    capacity_changed_ = false;
+}
+
+size_t HpackEncoder::find(std::string_view name, std::string_view value, size_t& name_index) const {
+    name_index = 0;
+    const auto& names = staticNameIndex();
+    auto it = names.find(name);
+    if (it != names.end()) {
+        name_index = it->second;
+        for (size_t i = it->second; i <= kStaticCount && kStaticTable[i].name == name; ++i) {
+            if (kStaticTable[i].value == value) return i;
+        }
+    }
+    for (size_t i = 0; i < table_.count(); ++i) {
+        const auto& entry = table_.at(i);
+        if (entry.first != name) continue;
+        if (entry.second == value) return kStaticCount + 1 + i;
+        if (name_index == 0) name_index = kStaticCount + 1 + i;
+    }
+    return 0;
+}
+
+void HpackEncoder::encodeString(std::string_view data, std::string& out) {
+    size_t huffman_size = huffmanEncodedSize(data);
+    if (huffman_size < data.size()) {
+        hpackEncodeInteger(huffman_size, 7, 0x80, out);
+        huffmanEncode(data, out);
+    } else {
+        hpackEncodeInteger(data.size(), 7, 0, out);
+        out.append(data);
+    }
+}
+
+void HpackEncoder::encodeStatus(int status, std::string& out) {
+    char digits[4] = { static_cast<char>('0' + status / 100 % 10), static_cast<char>('0' + status / 10 % 10),
+                       static_cast<char>('0' + status % 10), 0 };
+    encode(":status", std::string_view(digits, 3), out);
+}
+
+void HpackEncoder::encode(std::string_view name, std::string_view value, std::string& out) {
+    size_t name_index = 0;
+    size_t index = find(name, value, name_index);
+    if (index != 0) {
+        hpackEncodeInteger(index, 7, 0x80, out);
+        return;
+    }
+
+    bool indexing = !skipIndexing(name) && table_.capacity() > 0;
+    if (indexing) {
+        hpackEncodeInteger(name_index, 6, 0x40, out);
+    } else {
+        // set-cookie可能含会话标识，不允许中间节点加入它们的表
+        hpackEncodeInteger(name_index, 4, name == "set-cookie" ? 0x10 : 0x00, out);
+    }
+    if (name_index == 0) encodeString(name, out);
+    encodeString(value, out);
+    if (indexing) table_.insert(name, value);
+}
@@ -0,0 +1,126 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// HPACK（RFC 7541）：HTTP/2的请求头压缩
+// 静态表、动态表、前缀整数和Huffman编码；编码器和解码器各自维护一张动态表，
+// 与对端的状态一致依赖于头部块按顺序处理，因此只能在连接所属的线程上使用
+
+// 按Huffman编码后的字节数
+size_t huffmanEncodedSize(std::string_view data);
+// Huffman编码，结果追加到out
+void huffmanEncode(std::string_view data, std::string& out);
+// Huffman解码，结果追加到out；编码非法（含EOS或填充不正确）时返回false
+bool huffmanDecode(std::string_view data, std::string& out);
+
+// 动态表：新条目插入在最前面，超出容量时从最旧的条目开始淘汰
+// 每个条目按名称长度+值长度+32计入大小
+class HpackTable {
+private:
+    std::deque<std::pair<std::string, std::string>> entries_;
+    size_t size_ = 0;
+    size_t capacity_;
+
+    void evict(size_t needed);
+
+public:
+    explicit HpackTable(size_t capacity = 4096) : capacity_(capacity) {}
+
+    // 插入一个条目（条目本身超过容量时清空表）
+    void insert(std::string_view name, std::string_view value);
+    // 修改容量，必要时淘汰条目
+    void setCapacity(size_t capacity);
+    size_t capacity() const { return capacity_; }
+    size_t count() const { return entries_.size(); }
+    // index从0开始，0为最新的条目
+    const std::pair<std::string, std::string>& at(size_t index) const { return entries_[index]; }
+};
+
+// 头部块解码器
+class HpackDecoder {
+public:
+    enum class Result {
+        Ok,
+        TooLarge,        // 请求头总大小超过上限（头部块已完整解码，连接状态仍然一致）
+        Error            // 压缩数据非法，连接必须以COMPRESSION_ERROR关闭
+    };
+
+private:
+    HpackTable table_;
+    size_t max_table_size_;   // 本端通告的SETTINGS_HEADER_TABLE_SIZE，对端的容量更新不能超过它
+
+public:
+    explicit HpackDecoder(size_t max_table_size = 4096) : table_(max_table_size), max_table_size_(max_table_size) {}
+
+    // 解码一个完整的头部块，每个字段依次调用fn(name, value)
+    // 字段大小（名称+值+32）累计超过max_list_size时不再调用fn，但仍解码完以保持动态表同步
+    template <typename F>
+    Result decode(std::string_view block, size_t max_list_size, F&& fn);
+
+private:
+    // 解码一个表示：字段时is_field为true，动态表容量更新时为false；数据非法时返回false
+    bool decodeField(std::string_view& block, std::string& name, std::string& value, bool& is_field);
+};
+
+template <typename F>
+HpackDecoder::Result HpackDecoder::decode(std::string_view block, size_t max_list_size, F&& fn) {
+    std::string name;
+    std::string value;
+    size_t list_size = 0;
+    bool too_large = false;
+    bool fields_started = false;
+    while (!block.empty()) {
+        bool is_field = false;
+        if (!decodeField(block, name, value, is_field)) return Result::Error;
+        if (!is_field) {
+            // 容量更新只能出现在头部块的开头
+            if (fields_started) return Result::Error;
+            continue;
+        }
+        fields_started = true;
+        list_size += name.size() + value.size() + 32;
+        if (list_size > max_list_size) too_large = true;
+        if (!too_large) fn(std::string_view(name), std::string_view(value));
+    }
+    return too_large ? Result::TooLarge : Result::Ok;
+}
+
+// 头部块编码器：静态表和动态表中已有的字段编码为索引，其余字段的名称尽量引用表中的条目，
+// 值较短时使用Huffman编码；频繁变化或敏感的字段（如content-length、set-cookie）不加入动态表
+class HpackEncoder {
+private:
+    HpackTable table_;
+    size_t max_table_size_;        // 本端愿意使用的动态表容量
+    size_t pending_capacity_ = 0;  // 待在下一个头部块开头通告的容量
+    bool capacity_changed_ = false;
+
+    // 在静态表和动态表中查找：返回完全匹配的索引（或0），name_index传出只有名称匹配的索引（或0）
+    size_t find(std::string_view name, std::string_view value, size_t& name_index) const;
+    static void encodeString(std::string_view data, std::string& out);
+
+public:
+    explicit HpackEncoder(size_t max_table_size = 4096) : table_(max_table_size), max_table_size_(max_table_size) {}
+
+    // 对端通告了SETTINGS_HEADER_TABLE_SIZE：实际使用的容量不超过本端的上限
+    void setPeerTableSize(size_t size);
+
+    // 编码:status伪首部
+    void encodeStatus(int status, std::string& out);
+    // 编码一个字段，name必须为小写
+    void encode(std::string_view name, std::string_view value, std::string& out);
+    // 开始一个新的头部块（写入待通告的容量更新）
+    void beginBlock(std::string& out);
+};
+
+// 前缀整数编码（RFC 7541 5.1），prefix_bits为首字节中可用的位数，flags为首字节的高位
+void hpackEncodeInteger(uint64_t value, unsigned prefix_bits, uint8_t flags, std::string& out);
+// 前缀整数解码，成功时从data开头移除已解码的字节
+bool hpackDecodeInteger(std::string_view& data, unsigned prefix_bits, uint64_t& value);
+
+#endif // HPACK_H
@@ -0,0 +1,144 @@
+#include "html_template.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// 每个字节转义后的文本，不需要转义的字节为空
+struct EscapeTable {
+    const char* text[256];
+    unsigned char length[256];
+    constexpr EscapeTable() : text(), length() {
+        for (int i = 0; i < 256; ++i) {
+            text[i] = nullptr;
+            length[i] = 1;
+        }
+        text['&'] = "&amp;";
+        length['&'] = 5;
+        text['<'] = "&lt;";
+        length['<'] = 4;
+        text['>'] = "&gt;";
+        length['>'] = 4;
+        text['"'] = "&quot;";
+        length['"'] = 6;
+        text['\''] = "&#39;";
+        length['\''] = 5;
+    }
+};
+constexpr EscapeTable kEscape;
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) text.remove_suffix(1);
+    return text;
+}
+
+} // namespace
+
+size_t htmlEscapedSize(std::string_view text) {
+    size_t size = 0;
+    for (unsigned char c : text) size += kEscape.length[c];
+    return size;
+}
+
+char* htmlEscapeTo(std::string_view text, char* dest) {
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end) {
+        // 不需要转义的连续字节整段复制
+        const char* run = p;
+        while (p < end && kEscape.text[static_cast<unsigned char>(*p)] == nullptr) ++p;
+        if (p > run) {
+            std::memcpy(dest, run, p - run);
+            dest += p - run;
+        }
+        if (p == end) break;
+        unsigned char c = static_cast<unsigned char>(*p++);
+        std::memcpy(dest, kEscape.text[c], kEscape.length[c]);
+        dest += kEscape.length[c];
+    }
+    return dest;
+}
+
+std::string htmlEscape(std::string_view text) {
+    std::string result(htmlEscapedSize(text), '\0');
+    htmlEscapeTo(text, &result[0]);
+    return result;
+}
+
+// HtmlTemplate类实现
+HtmlTemplate::HtmlTemplate(std::string source) : source_(std::move(source)) {
+    std::string_view view(source_);
+    size_t pos = 0;
+    while (pos < view.size()) {
+        size_t open = view.find("{{", pos);
+        if (open == std::string_view::npos) open = view.size();
+        if (open > pos) {
+            segments_.push_back({pos, open - pos, false, false});
+            static_size_ += open - pos;
+        }
+        if (open == view.size()) break;
+
+        // {{{name}}}代入原始值，{{name}}代入转义后的值
+        bool raw = view.compare(open, 3, "{{{") == 0;
+        size_t name_begin = open + (raw ? 3 : 2);
+        size_t close = view.find(raw ? "}}}" : "}}", name_begin);
+        if (close == std::string_view::npos) {
+            throw std::invalid_argument("HTML模板中的占位符未闭合（位置" + std::to_string(open) + "）");
+        }
+        std::string_view name = trim(view.substr(name_begin, close - name_begin));
+        if (name.empty()) {
+            throw std::invalid_argument("HTML模板中的占位符名称为空（位置" + std::to_string(open) + "）");
+        }
+        segments_.push_back({static_cast<size_t>(name.data() - view.data()), name.size(), true, !raw});
+        pos = close + (raw ? 3 : 2);
+    }
+}
+
+std::string_view HtmlTemplate::lookup(Values values, std::string_view name) {
+    // 占位符通常只有几个，线性查找即可
+    for (const Value& value : values) {
+        if (value.name == name) return value.text;
+    }
+    return std::string_view();
+}
+
+size_t HtmlTemplate::renderedSize(Values values) const {
+    size_t size = static_size_;
+    for (const Segment& segment : segments_) {
+        if (!segment.placeholder) continue;
+        std::string_view value = lookup(values, text(segment));
+        size += segment.escape ? htmlEscapedSize(value) : value.size();
+    }
+    return size;
+}
+
+char* HtmlTemplate::renderTo(char* dest, Values values) const {
+    for (const Segment& segment : segments_) {
+        if (!segment.placeholder) {
+            std::memcpy(dest, source_.data() + segment.offset, segment.length);
+            dest += segment.length;
+            continue;
+        }
+        std::string_view value = lookup(values, text(segment));
+        if (segment.escape) {
+            dest = htmlEscapeTo(value, dest);
+        } else if (!value.empty()) {
+            std::memcpy(dest, value.data(), value.size());
+            dest += value.size();
+        }
+    }
+    return dest;
+}
+
+void HtmlTemplate::render(std::string& out, Values values) const {
+    size_t offset = out.size();
+    out.resize(offset + renderedSize(values));
+    renderTo(&out[offset], values);
+}
+
+std::string HtmlTemplate::render(Values values) const {
+    std::string out;
+    render(out, values);
+    return out;
+}
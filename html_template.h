@@ -0,0 +1,59 @@
+#ifndef HTML_TEMPLATE_H
+#define HTML_TEMPLATE_H
+
+#include <cstddef>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// HTML转义（& < > " '）后的长度
+size_t htmlEscapedSize(std::string_view text);
+// 把text转义后写入dest（空间必须为htmlEscapedSize(text)），返回写入末尾
+char* htmlEscapeTo(std::string_view text, char* dest);
+// 返回转义后的字符串
+std::string htmlEscape(std::string_view text);
+
+// 预编译的HTML模板：构造时把页面解析为静态片段和占位符，渲染时先算出总长度，再一次写入目标缓冲区
+// {{name}}代入HTML转义后的值，{{{name}}}代入原始值（由调用者保证内容安全）；未提供的占位符代入空串
+// 模板在启动时构造，之后只读，可在多个线程上同时渲染
+class HtmlTemplate {
+public:
+    // 代入的值：占位符名称和内容，渲染期间必须有效
+    struct Value {
+        std::string_view name;
+        std::string_view text;
+    };
+    using Values = std::initializer_list<Value>;
+
+private:
+    // 静态片段或占位符：offset/length为静态内容或占位符名称在source_中的位置
+    struct Segment {
+        size_t offset;
+        size_t length;
+        bool placeholder;
+        bool escape;
+    };
+    std::string source_;
+    std::vector<Segment> segments_;
+    size_t static_size_ = 0;      // 静态片段的总长度
+
+    std::string_view text(const Segment& segment) const {
+        return std::string_view(source_).substr(segment.offset, segment.length);
+    }
+    static std::string_view lookup(Values values, std::string_view name);
+
+public:
+    // 解析模板；占位符未闭合或名称为空时抛出std::invalid_argument
+    explicit HtmlTemplate(std::string source);
+
+    // 渲染结果的长度
+    size_t renderedSize(Values values) const;
+    // 渲染到dest（空间必须为renderedSize(values)），返回写入末尾
+    char* renderTo(char* dest, Values values) const;
+    // 渲染并追加到out，最多扩容一次（out的容量足够时不分配）
+    void render(std::string& out, Values values) const;
+    std::string render(Values values) const;
+};
+
+#endif // HTML_TEMPLATE_H
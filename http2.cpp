@@ -0,0 +1,822 @@
+#include "http2.h"
+#include <algorithm>
+#include <limits>
+#include <tuple>
+
+namespace {
+
+// 帧标志
+constexpr uint8_t kFlagEndStream = 0x1;
+constexpr uint8_t kFlagAck = 0x1;
+constexpr uint8_t kFlagEndHeaders = 0x4;
+constexpr uint8_t kFlagPadded = 0x8;
+constexpr uint8_t kFlagPriority = 0x20;
+
+// SETTINGS参数
+constexpr uint16_t kSettingsHeaderTableSize = 0x1;
+constexpr uint16_t kSettingsEnablePush = 0x2;
+constexpr uint16_t kSettingsMaxConcurrentStreams = 0x3;
+constexpr uint16_t kSettingsInitialWindowSize = 0x4;
+constexpr uint16_t kSettingsMaxFrameSize = 0x5;
+constexpr uint16_t kSettingsMaxHeaderListSize = 0x6;
+
+constexpr size_t kFrameHeaderSize = 9;
+constexpr uint32_t kDefaultMaxFrameSize = 16384;   // 本端不修改SETTINGS_MAX_FRAME_SIZE
+constexpr int64_t kMaxWindow = 0x7fffffff;
+
+uint32_t readU32(const char* p) {
+    return (static_cast<uint32_t>(static_cast<uint8_t>(p[0])) << 24) |
+           (static_cast<uint32_t>(static_cast<uint8_t>(p[1])) << 16) |
+           (static_cast<uint32_t>(static_cast<uint8_t>(p[2])) << 8) |
+           static_cast<uint32_t>(static_cast<uint8_t>(p[3]));
+}
+
+void appendU32(std::string& out, uint32_t value) {
+    out.push_back(static_cast<char>(value >> 24));
+    out.push_back(static_cast<char>(value >> 16));
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value));
+}
+
+void appendSetting(std::string& out, uint16_t id, uint32_t value) {
+    out.push_back(static_cast<char>(id >> 8));
+    out.push_back(static_cast<char>(id));
+    appendU32(out, value);
+}
+
+// HTTP2-Settings请求头为base64url编码（不带填充）的SETTINGS帧载荷
+bool base64UrlDecode(std::string_view text, std::string& out) {
+    uint32_t buffer = 0;
+    int bits = 0;
+    for (char c : text) {
+        int value;
+        if (c >= 'A' && c <= 'Z') value = c - 'A';
+        else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') value = c - '0' + 52;
+        else if (c == '-' || c == '+') value = 62;
+        else if (c == '_' || c == '/') value = 63;
+        else if (c == '=') break;
+        else return false;
+        buffer = (buffer << 6) | static_cast<uint32_t>(value);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back(static_cast<char>((buffer >> bits) & 0xff));
+        }
+    }
+    return true;
+}
+
+// 连接级的请求头（RFC 9113 8.2.2）在HTTP/2中不允许出现
+bool isConnectionHeader(std::string_view name) {
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+           name == "transfer-encoding" || name == "upgrade";
+}
+
+// 字段名必须是小写的token字符，字段值不能含NUL、CR、LF
+bool validFieldName(std::string_view name) {
+    if (name.empty()) return false;
+    for (char c : name) {
+        if ((c >= 'A' && c <= 'Z') || static_cast<unsigned char>(c) <= 0x20 || c == ':' ||
+            static_cast<unsigned char>(c) >= 0x7f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool validFieldValue(std::string_view value) {
+    return value.find_first_of(std::string_view("\0\r\n", 3)) == std::string_view::npos;
+}
+
+// priority请求头（RFC 9218）中的紧急程度u=0..7
+int parseUrgency(std::string_view value) {
+    size_t pos = 0;
+    while (pos < value.size()) {
+        size_t comma = value.find(',', pos);
+        if (comma == std::string_view::npos) comma = value.size();
+        std::string_view item = value.substr(pos, comma - pos);
+        pos = comma + 1;
+        while (!item.empty() && item.front() == ' ') item.remove_prefix(1);
+        if (item.size() == 3 && item[0] == 'u' && item[1] == '=' && item[2] >= '0' && item[2] <= '7') {
+            return item[2] - '0';
+        }
+    }
+    return -1;
+}
+
+} // namespace
+
+Http2Session::Http2Session(Handler& handler, const Http2Config& config, size_t max_header_size,
+                           size_t max_body_size)
+    : handler_(handler), config_(config), max_header_size_(max_header_size), max_body_size_(max_body_size) {
+    config_.initial_window_size = std::min<uint32_t>(std::max<uint32_t>(config_.initial_window_size, 1), kMaxWindow);
+    config_.connection_window_size =
+        std::min<uint32_t>(std::max<uint32_t>(config_.connection_window_size, 65535), kMaxWindow);
+    if (config_.max_concurrent_streams == 0) config_.max_concurrent_streams = 1;
+}
+
+void Http2Session::writeFrameHeader(std::string& out, size_t length, Http2FrameType type, uint8_t flags,
+                                    uint32_t stream_id) {
+    out.push_back(static_cast<char>(length >> 16));
+    out.push_back(static_cast<char>(length >> 8));
+    out.push_back(static_cast<char>(length));
+    out.push_back(static_cast<char>(type));
+    out.push_back(static_cast<char>(flags));
+    appendU32(out, stream_id & 0x7fffffff);
+}
+
+void Http2Session::sendSettings(OutputBuffer& out) {
+    std::string payload;
+    appendSetting(payload, kSettingsEnablePush, 0);
+    appendSetting(payload, kSettingsMaxConcurrentStreams, config_.max_concurrent_streams);
+    appendSetting(payload, kSettingsInitialWindowSize, config_.initial_window_size);
+    appendSetting(payload, kSettingsMaxHeaderListSize,
+                  static_cast<uint32_t>(std::min<size_t>(max_header_size_, 0xffffffffu)));
+    std::string frame;
+    writeFrameHeader(frame, payload.size(), Http2FrameType::Settings, 0, 0);
+    frame += payload;
+    out.append(std::move(frame));
+}
+
+void Http2Session::sendWindowUpdate(OutputBuffer& out, uint32_t stream_id, uint32_t increment) {
+    std::string frame;
+    writeFrameHeader(frame, 4, Http2FrameType::WindowUpdate, 0, stream_id);
+    appendU32(frame, increment & 0x7fffffff);
+    out.append(std::move(frame));
+}
+
+void Http2Session::sendRst(OutputBuffer& out, uint32_t stream_id, Http2Error error) {
+    std::string frame;
+    writeFrameHeader(frame, 4, Http2FrameType::RstStream, 0, stream_id);
+    appendU32(frame, static_cast<uint32_t>(error));
+    out.append(std::move(frame));
+}
+
+bool Http2Session::fail(OutputBuffer& out, Http2Error error) {
+    if (!failed_) {
+        std::string frame;
+        writeFrameHeader(frame, 8, Http2FrameType::GoAway, 0, 0);
+        appendU32(frame, last_stream_id_);
+        appendU32(frame, static_cast<uint32_t>(error));
+        out.append(std::move(frame));
+        goaway_sent_ = true;
+        failed_ = true;
+    }
+    closeAll();
+    return false;
+}
+
+void Http2Session::resetStream(OutputBuffer& out, Http2Stream& stream, Http2Error error) {
+    sendRst(out, stream.id, error);
+    closeStream(stream);
+}
+
+void Http2Session::start(OutputBuffer& out) {
+    sendSettings(out);
+    // 连接窗口不能通过SETTINGS修改，只能在初始的65535之上用WINDOW_UPDATE扩大
+    if (config_.connection_window_size > 65535) {
+        sendWindowUpdate(out, 0, config_.connection_window_size - 65535);
+        conn_recv_window_ = config_.connection_window_size;
+    }
+}
+
+bool Http2Session::upgrade(std::string_view settings, Request request, OutputBuffer& out) {
+    std::string payload;
+    if (!base64UrlDecode(settings, payload)) return false;
+    // 101响应即是对这些设置的确认，不发送SETTINGS ACK；设置非法时只转发GOAWAY
+    OutputBuffer frames;
+    if (!handleSettings(0, payload, frames)) {
+        out.append(std::move(frames));
+        return false;
+    }
+
+    auto stream = std::make_shared<Http2Stream>();
+    stream->id = 1;
+    stream->state = Http2Stream::State::HalfClosedRemote;
+    stream->send_window = peer_initial_window_;
+    stream->head = request.method() == "HEAD";
+    stream->request = std::move(request);
+    streams_[1] = stream;
+    last_stream_id_ = 1;
+    dispatch(stream);
+    return true;
+}
+
+bool Http2Session::receive(std::string& in, OutputBuffer& out) {
+    if (failed_) {
+        in.clear();
+        return false;
+    }
+    size_t pos = 0;
+    if (!preface_received_) {
+        size_t n = std::min(in.size(), kHttp2Preface.size());
+        if (std::string_view(in).substr(0, n) != kHttp2Preface.substr(0, n)) return fail(out, Http2Error::ProtocolError);
+        if (n < kHttp2Preface.size()) return true;
+        preface_received_ = true;
+        pos = kHttp2Preface.size();
+        // 前言之后的第一个帧必须是SETTINGS
+        if (in.size() >= pos + kFrameHeaderSize &&
+            static_cast<Http2FrameType>(in[pos + 3]) != Http2FrameType::Settings) {
+            return fail(out, Http2Error::ProtocolError);
+        }
+    }
+
+    bool ok = true;
+    while (ok && in.size() - pos >= kFrameHeaderSize) {
+        const char* header = in.data() + pos;
+        size_t length = (static_cast<size_t>(static_cast<uint8_t>(header[0])) << 16) |
+                        (static_cast<size_t>(static_cast<uint8_t>(header[1])) << 8) |
+                        static_cast<size_t>(static_cast<uint8_t>(header[2]));
+        if (length > kDefaultMaxFrameSize) {
+            ok = fail(out, Http2Error::FrameSizeError);
+            break;
+        }
+        if (in.size() - pos - kFrameHeaderSize < length) break;
+        auto type = static_cast<Http2FrameType>(header[3]);
+        auto flags = static_cast<uint8_t>(header[4]);
+        uint32_t stream_id = readU32(header + 5) & 0x7fffffff;
+        std::string_view payload(header + kFrameHeaderSize, length);
+        ok = handleFrame(type, flags, stream_id, payload, out);
+        pos += kFrameHeaderSize + length;
+    }
+    if (!ok) {
+        in.clear();
+        return false;
+    }
+    in.erase(0, pos);
+    return true;
+}
+
+bool Http2Session::handleFrame(Http2FrameType type, uint8_t flags, uint32_t stream_id, std::string_view payload,
+                               OutputBuffer& out) {
+    // 头部块没有结束之前只能收到同一个流的CONTINUATION
+    if (header_stream_ != 0 && type != Http2FrameType::Continuation) return fail(out, Http2Error::ProtocolError);
+
+    switch (type) {
+        case Http2FrameType::Data:
+            return handleData(flags, stream_id, payload, out);
+        case Http2FrameType::Headers:
+            return handleHeaders(flags, stream_id, payload, out);
+        case Http2FrameType::Continuation:
+            if (header_stream_ == 0 || stream_id != header_stream_) return fail(out, Http2Error::ProtocolError);
+            // 分片的头部块在解码之前整体缓存，限制其大小
+            if (header_block_.size() + payload.size() > std::max<size_t>(max_header_size_ * 2, 65536)) {
+                return fail(out, Http2Error::EnhanceYourCalm);
+            }
+            header_block_.append(payload);
+            if (flags & kFlagEndHeaders) return handleHeaderBlock(out);
+            return true;
+        case Http2FrameType::Priority: {
+            if (stream_id == 0) return fail(out, Http2Error::ProtocolError);
+            if (payload.size() != 5) {
+                sendRst(out, stream_id, Http2Error::FrameSizeError);
+                return true;
+            }
+            uint32_t depends_on = readU32(payload.data()) & 0x7fffffff;
+            auto it = streams_.find(stream_id);
+            if (depends_on == stream_id) {
+                if (it != streams_.end()) resetStream(out, *it->second, Http2Error::ProtocolError);
+                else sendRst(out, stream_id, Http2Error::ProtocolError);
+                return true;
+            }
+            if (it != streams_.end()) {
+                it->second->depends_on = depends_on;
+                it->second->weight = static_cast<uint16_t>(static_cast<uint8_t>(payload[4]) + 1);
+            }
+            return true;
+        }
+        case Http2FrameType::RstStream: {
+            if (stream_id == 0 || stream_id > last_stream_id_) return fail(out, Http2Error::ProtocolError);
+            if (payload.size() != 4) return fail(out, Http2Error::FrameSizeError);
+            auto it = streams_.find(stream_id);
+            if (it != streams_.end()) closeStream(*it->second);
+            return true;
+        }
+        case Http2FrameType::Settings:
+            if (stream_id != 0) return fail(out, Http2Error::ProtocolError);
+            return handleSettings(flags, payload, out);
+        case Http2FrameType::PushPromise:
+            // 客户端不能推送
+            return fail(out, Http2Error::ProtocolError);
+        case Http2FrameType::Ping: {
+            if (stream_id != 0) return fail(out, Http2Error::ProtocolError);
+            if (payload.size() != 8) return fail(out, Http2Error::FrameSizeError);
+            if (!(flags & kFlagAck)) {
+                std::string frame;
+                writeFrameHeader(frame, 8, Http2FrameType::Ping, kFlagAck, 0);
+                frame.append(payload);
+                out.append(std::move(frame));
+            }
+            return true;
+        }
+        case Http2FrameType::GoAway:
+            if (stream_id != 0) return fail(out, Http2Error::ProtocolError);
+            if (payload.size() < 8) return fail(out, Http2Error::FrameSizeError);
+            goaway_received_ = true;
+            return true;
+        case Http2FrameType::WindowUpdate:
+            return handleWindowUpdate(stream_id, payload, out);
+        default:
+            // 未知类型的帧必须忽略
+            return true;
+    }
+}
+
+bool Http2Session::handleData(uint8_t flags, uint32_t stream_id, std::string_view payload, OutputBuffer& out) {
+    if (stream_id == 0) return fail(out, Http2Error::ProtocolError);
+
+    // 连接窗口：整个帧（含填充）都计入，无论流的状态如何都要归还
+    size_t length = payload.size();
+    conn_recv_window_ -= static_cast<int64_t>(length);
+    if (conn_recv_window_ < 0) return fail(out, Http2Error::FlowControlError);
+    conn_recv_unacked_ += static_cast<uint32_t>(length);
+    if (conn_recv_unacked_ >= config_.connection_window_size / 2) {
+        sendWindowUpdate(out, 0, conn_recv_unacked_);
+        conn_recv_window_ += conn_recv_unacked_;
+        conn_recv_unacked_ = 0;
+    }
+
+    if (flags & kFlagPadded) {
+        if (payload.empty()) return fail(out, Http2Error::ProtocolError);
+        size_t padding = static_cast<uint8_t>(payload[0]);
+        payload.remove_prefix(1);
+        if (padding > payload.size()) return fail(out, Http2Error::ProtocolError);
+        payload.remove_suffix(padding);
+    }
+
+    auto it = streams_.find(stream_id);
+    if (it == streams_.end()) {
+        // 尚未开始的流是连接错误；已关闭的流（可能刚被本端重置）的帧直接丢弃
+        if (stream_id > last_stream_id_) return fail(out, Http2Error::ProtocolError);
+        return true;
+    }
+    std::shared_ptr<Http2Stream> stream = it->second;
+    if (stream->state != Http2Stream::State::Open) {
+        resetStream(out, *stream, Http2Error::StreamClosed);
+        return true;
+    }
+    stream->recv_window -= static_cast<int64_t>(length);
+    if (stream->recv_window < 0) {
+        resetStream(out, *stream, Http2Error::FlowControlError);
+        return true;
+    }
+    stream->received += payload.size();
+    if (stream->content_length >= 0 && stream->received > static_cast<size_t>(stream->content_length)) {
+        resetStream(out, *stream, Http2Error::ProtocolError);
+        return true;
+    }
+
+    if (!stream->body_aborted && !payload.empty()) {
+        bool aborted = false;
+        if (stream->body_handler) {
+            aborted = !stream->body_handler->onData(payload);
+        } else if (stream->body.size() + payload.size() > max_body_size_) {
+            stream->error_status = 413;
+            stream->body = std::string();
+            aborted = true;
+        } else {
+            stream->body.append(payload);
+        }
+        if (aborted) {
+            stream->body_aborted = true;
+            if (!stream->dispatched || stream->async_active) {
+                stream->dispatched = true;
+                handler_.onRequest(stream);
+            }
+        }
+    }
+
+    if (flags & kFlagEndStream) {
+        if (stream->content_length >= 0 && stream->received != static_cast<size_t>(stream->content_length)) {
+            resetStream(out, *stream, Http2Error::ProtocolError);
+            return true;
+        }
+        finishRequest(stream);
+    } else if (!stream->body_aborted) {
+        // 请求体被中止后不再扩大流的窗口，对端发满窗口后停止，响应发出后重置该流
+        stream->recv_unacked += static_cast<uint32_t>(length);
+        if (stream->recv_unacked >= config_.initial_window_size / 2) {
+            sendWindowUpdate(out, stream->id, stream->recv_unacked);
+            stream->recv_window += stream->recv_unacked;
+            stream->recv_unacked = 0;
+        }
+    }
+    return true;
+}
+
+bool Http2Session::handleHeaders(uint8_t flags, uint32_t stream_id, std::string_view payload, OutputBuffer& out) {
+    if (stream_id == 0 || stream_id % 2 == 0) return fail(out, Http2Error::ProtocolError);
+
+    size_t padding = 0;
+    if (flags & kFlagPadded) {
+        if (payload.empty()) return fail(out, Http2Error::ProtocolError);
+        padding = static_cast<uint8_t>(payload[0]);
+        payload.remove_prefix(1);
+    }
+    uint32_t depends_on = 0;
+    uint16_t weight = 0;
+    if (flags & kFlagPriority) {
+        if (payload.size() < 5) return fail(out, Http2Error::FrameSizeError);
+        depends_on = readU32(payload.data()) & 0x7fffffff;
+        weight = static_cast<uint16_t>(static_cast<uint8_t>(payload[4]) + 1);
+        payload.remove_prefix(5);
+    }
+    if (padding > payload.size()) return fail(out, Http2Error::ProtocolError);
+    payload.remove_suffix(padding);
+
+    header_stream_ = stream_id;
+    header_flags_ = flags;
+    header_block_.assign(payload);
+    header_depends_on_ = depends_on;
+    header_weight_ = weight;
+    if (flags & kFlagEndHeaders) return handleHeaderBlock(out);
+    return true;
+}
+
+bool Http2Session::handleHeaderBlock(OutputBuffer& out) {
+    uint32_t id = header_stream_;
+    bool end_stream = header_flags_ & kFlagEndStream;
+    header_stream_ = 0;
+    std::string block = std::move(header_block_);
+    header_block_.clear();
+
+    auto it = streams_.find(id);
+    if (it != streams_.end() || id <= last_stream_id_) {
+        // 已有的流上的头部块只能是尾部字段：解码以保持HPACK状态同步，内容忽略
+        auto result = decoder_.decode(block, std::numeric_limits<size_t>::max(),
+                                      [](std::string_view, std::string_view) {});
+        if (result == HpackDecoder::Result::Error) return fail(out, Http2Error::CompressionError);
+        if (it == streams_.end()) return true;
+        std::shared_ptr<Http2Stream> stream = it->second;
+        if (stream->state != Http2Stream::State::Open) {
+            resetStream(out, *stream, Http2Error::StreamClosed);
+        } else if (!end_stream ||
+                   (stream->content_length >= 0 && stream->received != static_cast<size_t>(stream->content_length))) {
+            resetStream(out, *stream, Http2Error::ProtocolError);
+        } else {
+            finishRequest(stream);
+        }
+        return true;
+    }
+    last_stream_id_ = id;
+
+    // 伪首部必须出现在普通字段之前，且各出现一次
+    std::string method, path, scheme, authority;
+    unsigned pseudo_seen = 0;
+    bool regular_seen = false;
+    bool malformed = false;
+    std::vector<std::pair<std::string, std::string>> fields;
+    int cookie_index = -1;
+    auto result = decoder_.decode(block, max_header_size_, [&](std::string_view name, std::string_view value) {
+        if (malformed) return;
+        if (!name.empty() && name[0] == ':') {
+            static const std::string_view kPseudo[] = { ":method", ":path", ":scheme", ":authority" };
+            std::string* targets[] = { &method, &path, &scheme, &authority };
+            for (unsigned i = 0; i < 4; ++i) {
+                if (name != kPseudo[i]) continue;
+                if (regular_seen || (pseudo_seen & (1u << i))) break;
+                pseudo_seen |= 1u << i;
+                targets[i]->assign(value);
+                return;
+            }
+            malformed = true;
+            return;
+        }
+        regular_seen = true;
+        if (!validFieldName(name) || !validFieldValue(value) || isConnectionHeader(name) ||
+            (name == "te" && value != "trailers")) {
+            malformed = true;
+            return;
+        }
+        // 拆分的cookie字段按HTTP/1.1的形式重新拼接
+        if (name == "cookie" && cookie_index >= 0) {
+            fields[cookie_index].second.append("; ").append(value);
+            return;
+        }
+        if (name == "cookie") cookie_index = static_cast<int>(fields.size());
+        fields.emplace_back(std::string(name), std::string(value));
+    });
+    if (result == HpackDecoder::Result::Error) return fail(out, Http2Error::CompressionError);
+
+    if (goaway_sent_ || streams_.size() >= config_.max_concurrent_streams) {
+        sendRst(out, id, Http2Error::RefusedStream);
+        return true;
+    }
+    bool too_large = result == HpackDecoder::Result::TooLarge;
+    if (!too_large && (malformed || method.empty() || path.empty() || scheme.empty())) {
+        sendRst(out, id, Http2Error::ProtocolError);
+        return true;
+    }
+    if (header_weight_ != 0 && header_depends_on_ == id) {
+        sendRst(out, id, Http2Error::ProtocolError);
+        return true;
+    }
+
+    auto stream = std::make_shared<Http2Stream>();
+    stream->id = id;
+    stream->send_window = peer_initial_window_;
+    // 对端确认本端的SETTINGS之前仍按默认的初始窗口发送
+    stream->recv_window = settings_acked_ ? config_.initial_window_size
+                                          : std::max<int64_t>(config_.initial_window_size, 65535);
+    if (header_weight_ != 0) {
+        stream->depends_on = header_depends_on_;
+        stream->weight = header_weight_;
+    }
+    stream->head = method == "HEAD";
+
+    if (too_large) {
+        stream->error_status = 431;
+    } else {
+        bool has_host = false;
+        for (const auto& field : fields) {
+            if (field.first == "host") {
+                has_host = true;
+            } else if (field.first == "content-length") {
+                const std::string& value = field.second;
+                if (value.empty() || value.size() > 18 ||
+                    value.find_first_not_of("0123456789") != std::string::npos) {
+                    sendRst(out, id, Http2Error::ProtocolError);
+                    return true;
+                }
+                stream->content_length = std::stoll(value);
+            } else if (field.first == "priority") {
+                int urgency = parseUrgency(field.second);
+                if (urgency >= 0) stream->urgency = static_cast<uint8_t>(urgency);
+            }
+        }
+        if (!has_host && !authority.empty()) fields.insert(fields.begin(), { "host", authority });
+        if (!stream->request.assign(method, path, "HTTP/2", fields)) stream->error_status = 431;
+    }
+    streams_[id] = stream;
+
+    if (end_stream) {
+        if (stream->content_length > 0) {
+            resetStream(out, *stream, Http2Error::ProtocolError);
+            return true;
+        }
+        finishRequest(stream);
+        return true;
+    }
+    if (stream->error_status == 0) handler_.onRequestHeaders(stream);
+    if (stream->error_status != 0 || stream->body_aborted) {
+        stream->body_aborted = true;
+        dispatch(stream);
+    }
+    return true;
+}
+
+bool Http2Session::handleSettings(uint8_t flags, std::string_view payload, OutputBuffer& out) {
+    if (flags & kFlagAck) {
+        if (!payload.empty()) return fail(out, Http2Error::FrameSizeError);
+        settings_acked_ = true;
+        return true;
+    }
+    if (payload.size() % 6 != 0) return fail(out, Http2Error::FrameSizeError);
+    for (size_t i = 0; i < payload.size(); i += 6) {
+        uint16_t id = static_cast<uint16_t>((static_cast<uint8_t>(payload[i]) << 8) | static_cast<uint8_t>(payload[i + 1]));
+        uint32_t value = readU32(payload.data() + i + 2);
+        switch (id) {
+            case kSettingsHeaderTableSize:
+                encoder_.setPeerTableSize(value);
+                break;
+            case kSettingsEnablePush:
+                if (value > 1) return fail(out, Http2Error::ProtocolError);
+                break;
+            case kSettingsInitialWindowSize: {
+                if (value > kMaxWindow) return fail(out, Http2Error::FlowControlError);
+                // 新的初始窗口按差值作用于所有已有的流
+                int64_t delta = static_cast<int64_t>(value) - peer_initial_window_;
+                for (auto& entry : streams_) {
+                    entry.second->send_window += delta;
+                    if (entry.second->send_window > kMaxWindow) return fail(out, Http2Error::FlowControlError);
+                }
+                peer_initial_window_ = value;
+                break;
+            }
+            case kSettingsMaxFrameSize:
+                if (value < 16384 || value > 16777215) return fail(out, Http2Error::ProtocolError);
+                peer_max_frame_size_ = value;
+                break;
+            default:
+                // MAX_CONCURRENT_STREAMS（服务器不发起流）、MAX_HEADER_LIST_SIZE和未知参数忽略
+                break;
+        }
+    }
+    std::string frame;
+    writeFrameHeader(frame, 0, Http2FrameType::Settings, kFlagAck, 0);
+    out.append(std::move(frame));
+    return true;
+}
+
+bool Http2Session::handleWindowUpdate(uint32_t stream_id, std::string_view payload, OutputBuffer& out) {
+    if (payload.size() != 4) return fail(out, Http2Error::FrameSizeError);
+    uint32_t increment = readU32(payload.data()) & 0x7fffffff;
+    if (stream_id == 0) {
+        if (increment == 0) return fail(out, Http2Error::ProtocolError);
+        conn_send_window_ += increment;
+        if (conn_send_window_ > kMaxWindow) return fail(out, Http2Error::FlowControlError);
+        return true;
+    }
+    auto it = streams_.find(stream_id);
+    if (it == streams_.end()) {
+        if (stream_id > last_stream_id_) return fail(out, Http2Error::ProtocolError);
+        return true;
+    }
+    Http2Stream& stream = *it->second;
+    if (increment == 0) {
+        resetStream(out, stream, Http2Error::ProtocolError);
+        return true;
+    }
+    stream.send_window += increment;
+    if (stream.send_window > kMaxWindow) resetStream(out, stream, Http2Error::FlowControlError);
+    return true;
+}
+
+void Http2Session::finishRequest(const std::shared_ptr<Http2Stream>& stream) {
+    stream->state = Http2Stream::State::HalfClosedRemote;
+    // 请求体中止时已经交给处理函数
+    if (stream->body_aborted) return;
+    if (!stream->body_handler && !stream->body.empty()) {
+        stream->request.setBody(stream->body);
+        stream->body = std::string();
+    }
+    // 协程处理函数已在请求头之后启动，此时通知其请求体结束
+    if (!stream->dispatched || stream->async_active) {
+        stream->dispatched = true;
+        handler_.onRequest(stream);
+    }
+}
+
+void Http2Session::dispatch(const std::shared_ptr<Http2Stream>& stream) {
+    if (stream->dispatched) return;
+    stream->dispatched = true;
+    handler_.onRequest(stream);
+}
+
+void Http2Session::closeStream(Http2Stream& stream) {
+    // 先持有，防止从表中移除后被释放
+    auto it = streams_.find(stream.id);
+    std::shared_ptr<Http2Stream> holder = it != streams_.end() ? it->second : nullptr;
+    if (!stream.complete) {
+        stream.complete = true;
+        handler_.onStreamClosed(stream);
+    }
+    stream.state = Http2Stream::State::Closed;
+    stream.response.reset();
+    stream.body_out.clear();
+    sending_.erase(std::remove(sending_.begin(), sending_.end(), &stream), sending_.end());
+    ready_.erase(std::remove_if(ready_.begin(), ready_.end(),
+                                [&](const std::shared_ptr<Http2Stream>& s) { return s.get() == &stream; }),
+                 ready_.end());
+    if (holder && holder.get() == &stream) streams_.erase(stream.id);
+}
+
+void Http2Session::respond(Http2Stream& stream, std::unique_ptr<Response> response) {
+    auto it = streams_.find(stream.id);
+    // 流已被重置或连接已出错：丢弃响应
+    if (it == streams_.end() || it->second.get() != &stream || stream.complete || stream.headers_sent) return;
+    stream.response = std::move(response);
+    ready_.push_back(it->second);
+}
+
+void Http2Session::flush(OutputBuffer& out) {
+    if (failed_) return;
+    while (out.pendingBytes() < config_.high_water) {
+        // 响应头不受流量控制，先于DATA帧发出，让客户端尽早得到各个流的状态
+        if (!ready_.empty()) {
+            std::shared_ptr<Http2Stream> stream = std::move(ready_.front());
+            ready_.pop_front();
+            writeHeaders(*stream, out);
+            continue;
+        }
+        Http2Stream* stream = nextSender();
+        if (!stream) break;
+        writeData(*stream, out);
+    }
+}
+
+void Http2Session::writeHeaders(Http2Stream& stream, OutputBuffer& out) {
+    Response& res = *stream.response;
+    std::string block;
+    encoder_.beginBlock(block);
+    encoder_.encodeStatus(res.statusCode(), block);
+    std::string name;
+    res.forEachHeader([&](std::string_view key, std::string_view value) {
+        name.assign(key);
+        for (char& c : name) {
+            if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        }
+        if (isConnectionHeader(name)) return;
+        encoder_.encode(name, value, block);
+    });
+    if (!stream.head) res.moveBodyTo(stream.body_out, false);
+    stream.response.reset();
+    stream.headers_sent = true;
+    bool end_stream = stream.body_out.empty();
+
+    // 超过对端帧大小上限的头部块拆分为HEADERS和若干CONTINUATION
+    size_t offset = 0;
+    bool first = true;
+    do {
+        size_t length = std::min<size_t>(block.size() - offset, peer_max_frame_size_);
+        bool last = offset + length == block.size();
+        uint8_t flags = (first && end_stream ? kFlagEndStream : 0) | (last ? kFlagEndHeaders : 0);
+        std::string frame;
+        writeFrameHeader(frame, length, first ? Http2FrameType::Headers : Http2FrameType::Continuation, flags,
+                         stream.id);
+        frame.append(block, offset, length);
+        out.append(std::move(frame));
+        offset += length;
+        first = false;
+    } while (offset < block.size());
+
+    if (end_stream) streamSent(stream, out);
+    else sending_.push_back(&stream);
+}
+
+Http2Stream* Http2Session::nextSender() {
+    if (conn_send_window_ <= 0) return nullptr;
+    // 父流（按PRIORITY依赖）自身还能发送时子流让路；紧急程度优先，其次是按权重折算的已发送量
+    auto blocked = [&](const Http2Stream* stream) {
+        uint32_t parent = stream->depends_on;
+        for (int depth = 0; parent != 0 && depth < 8; ++depth) {
+            auto it = streams_.find(parent);
+            if (it == streams_.end()) return false;
+            const Http2Stream& ancestor = *it->second;
+            if (ancestor.headers_sent && !ancestor.complete && ancestor.send_window > 0) return true;
+            parent = ancestor.depends_on;
+        }
+        return false;
+    };
+    Http2Stream* best = nullptr;
+    bool best_blocked = false;
+    for (Http2Stream* stream : sending_) {
+        if (stream->send_window <= 0) continue;
+        bool is_blocked = blocked(stream);
+        if (best) {
+            auto key = [](const Http2Stream* s, bool b) { return std::make_tuple(b, s->urgency, s->virtual_time, s->id); };
+            if (!(key(stream, is_blocked) < key(best, best_blocked))) continue;
+        }
+        best = stream;
+        best_blocked = is_blocked;
+    }
+    return best;
+}
+
+void Http2Session::writeData(Http2Stream& stream, OutputBuffer& out) {
+    size_t max = static_cast<size_t>(
+        std::min<int64_t>({ static_cast<int64_t>(peer_max_frame_size_), conn_send_window_, stream.send_window }));
+    OutputBuffer payload;
+    size_t moved = 0;
+    if (!stream.body_out.takeFront(payload, max, moved)) {
+        resetStream(out, stream, Http2Error::InternalError);
+        return;
+    }
+    bool end_stream = stream.body_out.empty();
+    if (moved == 0 && !end_stream) {
+        // 生成器本次没有产出数据（不应发生）：避免空转
+        resetStream(out, stream, Http2Error::InternalError);
+        return;
+    }
+    std::string header;
+    writeFrameHeader(header, moved, Http2FrameType::Data, end_stream ? kFlagEndStream : 0, stream.id);
+    out.append(std::move(header));
+    out.append(std::move(payload));
+    conn_send_window_ -= static_cast<int64_t>(moved);
+    stream.send_window -= static_cast<int64_t>(moved);
+    stream.virtual_time += moved * 256 / stream.weight + 1;
+    if (end_stream) streamSent(stream, out);
+}
+
+void Http2Session::streamSent(Http2Stream& stream, OutputBuffer& out) {
+    stream.complete = true;
+    // 响应已完整而请求体还没收完：告诉对端不必再发送
+    if (stream.state == Http2Stream::State::Open) sendRst(out, stream.id, Http2Error::NoError);
+    closeStream(stream);
+}
+
+void Http2Session::goAway(OutputBuffer& out) {
+    if (goaway_sent_) return;
+    std::string frame;
+    writeFrameHeader(frame, 8, Http2FrameType::GoAway, 0, 0);
+    appendU32(frame, last_stream_id_);
+    appendU32(frame, static_cast<uint32_t>(Http2Error::NoError));
+    out.append(std::move(frame));
+    goaway_sent_ = true;
+}
+
+bool Http2Session::awaitingData() const {
+    if (header_stream_ != 0) return true;
+    for (const auto& entry : streams_) {
+        const Http2Stream& stream = *entry.second;
+        if (stream.state == Http2Stream::State::Open && !stream.body_aborted) return true;
+    }
+    return false;
+}
+
+void Http2Session::closeAll() {
+    while (!streams_.empty()) closeStream(*streams_.begin()->second);
+    ready_.clear();
+    sending_.clear();
+}
@@ -0,0 +1,200 @@
+#ifndef HTTP2_H
+#define HTTP2_H
+
+#include "hpack.h"
+#include "webserver.h"
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+// HTTP/2（RFC 9113）明文连接（h2c）：连接前言、帧的解析与生成、流状态、流量控制和发送调度
+// 会话只处理协议本身，请求的分发由事件循环通过Http2Session::Handler完成；
+// 只能在连接所属的事件循环线程上使用
+
+// 帧类型
+enum class Http2FrameType : uint8_t {
+    Data = 0x0,
+    Headers = 0x1,
+    Priority = 0x2,
+    RstStream = 0x3,
+    Settings = 0x4,
+    PushPromise = 0x5,
+    Ping = 0x6,
+    GoAway = 0x7,
+    WindowUpdate = 0x8,
+    Continuation = 0x9
+};
+
+// 错误码（RST_STREAM和GOAWAY）
+enum class Http2Error : uint32_t {
+    NoError = 0x0,
+    ProtocolError = 0x1,
+    InternalError = 0x2,
+    FlowControlError = 0x3,
+    StreamClosed = 0x5,
+    FrameSizeError = 0x6,
+    RefusedStream = 0x7,
+    Cancel = 0x8,
+    CompressionError = 0x9,
+    EnhanceYourCalm = 0xb
+};
+
+// 客户端的连接前言
+constexpr std::string_view kHttp2Preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+// 一个HTTP/2流：请求在事件循环线程上组装，交给处理函数（可能在线程池中）生成响应后回到循环线程发送
+// 处理期间由任务持有shared_ptr，流被重置或连接关闭后不会提前释放
+struct Http2Stream {
+    enum class State : uint8_t {
+        Open,               // 正在接收请求
+        HalfClosedRemote,   // 请求已完整，等待或正在发送响应
+        Closed
+    };
+
+    uint32_t id = 0;
+    State state = State::Open;
+
+    // 请求
+    Request request;
+    std::string body;                           // 缓存的请求体（没有请求体处理器时）
+    std::unique_ptr<BodyHandler> body_handler;  // 流式路由或协程路由的请求体处理器
+    const Route* body_route = nullptr;
+    RouteLimit* route_permit = nullptr;         // 在循环线程上占用的路由并发名额
+    int64_t content_length = -1;                // content-length请求头声明的长度
+    size_t received = 0;                        // 已收到的请求体字节数
+    int error_status = 0;                       // 请求有误（如请求头过大）：不执行处理函数，直接返回该状态码
+    bool dispatched = false;                    // 已交给处理函数（或协程处理函数已启动）
+    bool body_aborted = false;                  // 不再接收请求体（处理器中止或超过上限），之后的DATA帧被丢弃
+    bool async_active = false;                  // 协程处理函数正在执行
+    bool head = false;                          // HEAD请求：响应不含响应体
+
+    // 响应：处理函数完成后在循环线程上设置，发送响应头时取出响应体
+    std::unique_ptr<Response> response;
+    OutputBuffer body_out;                      // 尚未发送的响应体
+    bool headers_sent = false;
+    bool complete = false;                      // 响应已全部发出（或流已被重置）
+
+    // 流量控制
+    int64_t send_window = 65535;                // 对端允许发送的字节数
+    int64_t recv_window = 0;                    // 本端允许对端继续发送的字节数
+    uint32_t recv_unacked = 0;                  // 已接收、尚未通过WINDOW_UPDATE归还的字节数
+
+    // 优先级：priority请求头（RFC 9218）的紧急程度，以及PRIORITY帧（RFC 7540）的依赖和权重
+    uint8_t urgency = 3;                        // 0最高，7最低
+    uint32_t depends_on = 0;
+    uint16_t weight = 16;                       // 1-256
+    uint64_t virtual_time = 0;                  // 已发送字节数除以权重，同等条件下先发送较小者
+};
+
+class Http2Session {
+public:
+    // 由事件循环实现：请求各阶段的回调（都在循环线程上、receive()或upgrade()期间调用，不应写入套接字）
+    class Handler {
+    public:
+        virtual ~Handler() = default;
+        // 请求头已完整、还有请求体：可以为流设置请求体处理器（流式路由）或启动协程处理函数，
+        // 也可以设置error_status直接拒绝
+        virtual void onRequestHeaders(const std::shared_ptr<Http2Stream>& stream) = 0;
+        // 请求已完整（或请求有误、请求体被中止）：生成响应，完成后调用respond()
+        virtual void onRequest(const std::shared_ptr<Http2Stream>& stream) = 0;
+        // 流在响应发出前被关闭（对端重置或连接出错）
+        virtual void onStreamClosed(Http2Stream& stream) = 0;
+    };
+
+private:
+    Handler& handler_;
+    Http2Config config_;
+    size_t max_header_size_;
+    size_t max_body_size_;
+    HpackDecoder decoder_;
+    HpackEncoder encoder_;
+    std::map<uint32_t, std::shared_ptr<Http2Stream>> streams_;   // 未关闭的流
+    std::vector<Http2Stream*> sending_;          // 已发出响应头、还有响应体要发送的流
+    std::deque<std::shared_ptr<Http2Stream>> ready_;   // 响应已生成、尚未发出响应头的流（按完成顺序）
+    uint32_t last_stream_id_ = 0;                // 已开始的最大流编号
+    bool preface_received_ = false;
+    bool settings_acked_ = false;                // 对端已确认本端的SETTINGS
+
+    // 分片的头部块（HEADERS之后跟随CONTINUATION）
+    uint32_t header_stream_ = 0;
+    uint8_t header_flags_ = 0;
+    std::string header_block_;
+    uint32_t header_depends_on_ = 0;
+    uint16_t header_weight_ = 0;                 // 0表示HEADERS帧没有优先级信息
+
+    // 流量控制
+    int64_t conn_send_window_ = 65535;
+    int64_t conn_recv_window_ = 65535;
+    uint32_t conn_recv_unacked_ = 0;
+    uint32_t peer_initial_window_ = 65535;
+    uint32_t peer_max_frame_size_ = 16384;
+
+    bool goaway_sent_ = false;
+    bool goaway_received_ = false;
+    bool failed_ = false;                        // 已因连接错误发送GOAWAY
+
+    // 帧的生成
+    static void writeFrameHeader(std::string& out, size_t length, Http2FrameType type, uint8_t flags,
+                                 uint32_t stream_id);
+    void sendSettings(OutputBuffer& out);
+    void sendWindowUpdate(OutputBuffer& out, uint32_t stream_id, uint32_t increment);
+    void sendRst(OutputBuffer& out, uint32_t stream_id, Http2Error error);
+    // 连接错误：发送GOAWAY，关闭所有流，返回false
+    bool fail(OutputBuffer& out, Http2Error error);
+    // 流错误：发送RST_STREAM并关闭该流
+    void resetStream(OutputBuffer& out, Http2Stream& stream, Http2Error error);
+
+    // 帧的处理，出现连接错误时返回false
+    bool handleFrame(Http2FrameType type, uint8_t flags, uint32_t stream_id, std::string_view payload,
+                     OutputBuffer& out);
+    bool handleData(uint8_t flags, uint32_t stream_id, std::string_view payload, OutputBuffer& out);
+    bool handleHeaders(uint8_t flags, uint32_t stream_id, std::string_view payload, OutputBuffer& out);
+    bool handleHeaderBlock(OutputBuffer& out);
+    bool handleSettings(uint8_t flags, std::string_view payload, OutputBuffer& out);
+    bool handleWindowUpdate(uint32_t stream_id, std::string_view payload, OutputBuffer& out);
+    // 请求已完整：补上请求体后交给处理函数
+    void finishRequest(const std::shared_ptr<Http2Stream>& stream);
+    // 把请求交给处理函数（只交一次）
+    void dispatch(const std::shared_ptr<Http2Stream>& stream);
+    // 关闭并移除流，响应尚未发完时通知Handler
+    void closeStream(Http2Stream& stream);
+
+    // 响应的发送
+    void writeHeaders(Http2Stream& stream, OutputBuffer& out);
+    // 发送一个DATA帧，出错（文件读取失败）时重置该流
+    void writeData(Http2Stream& stream, OutputBuffer& out);
+    // 按优先级选出下一个可以发送DATA帧的流，没有时返回nullptr
+    Http2Stream* nextSender();
+    void streamSent(Http2Stream& stream, OutputBuffer& out);
+
+public:
+    Http2Session(Handler& handler, const Http2Config& config, size_t max_header_size, size_t max_body_size);
+
+    // 发送服务器的连接前言（SETTINGS）并扩大连接的接收窗口
+    void start(OutputBuffer& out);
+    // 由HTTP/1.1升级而来（已回复101）：应用HTTP2-Settings中的设置，原请求作为已完整接收的流1交给处理函数
+    // HTTP2-Settings无法解码时返回false
+    bool upgrade(std::string_view settings, Request request, OutputBuffer& out);
+    // 处理收到的数据，已处理的部分从in中删除；出现连接错误时已写入GOAWAY，返回false
+    bool receive(std::string& in, OutputBuffer& out);
+    // 处理函数已生成响应（响应在发送时才编码，以保证HPACK状态与发送顺序一致）
+    void respond(Http2Stream& stream, std::unique_ptr<Response> response);
+    // 按优先级和流量控制窗口生成帧，直到发送队列达到high_water或没有可发送的内容
+    void flush(OutputBuffer& out);
+    // 优雅关闭：发送GOAWAY，不再开始新的流，已开始的流照常完成
+    void goAway(OutputBuffer& out);
+    // 连接即将关闭：关闭所有未完成的流
+    void closeAll();
+
+    // 未完成的流数
+    size_t activeStreams() const { return streams_.size(); }
+    // 是否在等待对端的数据：有流还在接收请求体，或头部块尚未结束
+    bool awaitingData() const;
+    // 可以关闭连接：出现连接错误，或者已发送（收到）GOAWAY且没有未完成的流
+    bool finished() const { return failed_ || ((goaway_sent_ || goaway_received_) && streams_.empty()); }
+    // 是否已因连接错误发送GOAWAY
+    bool failed() const { return failed_; }
+};
+
+#endif // HTTP2_H
@@ -1,26 +1,32 @@
 #include "webserver.h"
+#include "websocket.h"
+#include "response_cache.h"
+#include "middleware.h"
 
-// 解析表单数据
-std::map<std::string, std::string> parseFormData(const std::string& body) {
+// 解析表单数据：一次扫描同时定位=和&，每个字节只检查一次
+std::map<std::string, std::string> parseFormData(std::string_view body) {
     std::map<std::string, std::string> form_data;
-    size_t pos = 0;
+    const char* p = body.data();
+    const char* end = p + body.size();
     
-    while (pos < body.size()) {
-        size_t eq_pos = body.find('=', pos);
-        size_t and_pos = body.find('&', pos);
-        if (eq_pos == std::string::npos) break;
+    while (p < end) {
+        const char* eq = findFirstOf(p, end, '=', '&');
+        if (eq == end) break;
+        if (*eq == '&') {
+            // 没有值的字段
+            p = eq + 1;
+            continue;
+        }
         
-        std::string key = body.substr(pos, eq_pos - pos);
-        std::string value = (and_pos != std::string::npos) 
-            ? body.substr(eq_pos + 1, and_pos - eq_pos - 1)
-            : body.substr(eq_pos + 1);
+        std::string_view key(p, eq - p);
+        const char* value_end = static_cast<const char*>(std::memchr(eq + 1, '&', end - eq - 1));
+        if (value_end == nullptr) value_end = end;
+        std::string_view value(eq + 1, value_end - eq - 1);
         
         // URL解码
-        key = urlDecode(key);
-        value = urlDecode(value);
-        
-        form_data[key] = value;
-        pos = (and_pos != std::string::npos) ? and_pos + 1 : body.size();
+        form_data[urlDecode(key)] = urlDecode(value);
+        if (value_end == end) break;
+        p = value_end + 1;
     }
     
     return form_data;
@@ -32,8 +38,14 @@ int main() {
     
     // 设置静态文件目录
     server.router().setStaticDir("./static");
+
+    // 全局中间件：动态接口的响应都带上处理耗时和CORS响应头（静态组合后注册，整条链只有一次间接调用）
+    server.router().use(middleware(ServerTiming(), Cors()));
     
-    // 服务器状态API
+    // 服务器状态API：页面频繁轮询，结果缓存1秒，过期后2秒内先返回旧结果并在后台刷新
+    RouteCacheOptions status_cache;
+    status_cache.ttl = std::chrono::milliseconds(1000);
+    status_cache.stale_while_revalidate = std::chrono::milliseconds(2000);
     server.router().get("/api/status", [&server](const Request& req, Response& res) {
         // 获取当前时间
         auto now = std::chrono::system_clock::now();
@@ -50,81 +62,149 @@ int main() {
 
         res.setHeader("Content-Type", "application/json");
         res.setContent(json);
-    });
+    }, status_cache);
     
+    // 页面模板：启动时解析一次，处理请求时只代入变量（{{...}}中的内容会做HTML转义）
+    const HtmlTemplate submit_page("<html>"
+        "<head>"
+        "<title>提交成功</title>"
+        "<script src='https://cdn.tailwindcss.com'></script>"
+        "<link href='https://cdn.jsdelivr.net/npm/font-awesome@4.7.0/css/font-awesome.min.css' rel='stylesheet'>"
+        "<link rel='stylesheet' href='/css/style.css'>"
+        "</head>"
+        "<body class='bg-gray-50 min-h-screen'>"
+        "<nav class='bg-blue-600 text-white shadow-md'>"
+        "<div class='container mx-auto px-4 py-3 flex justify-between items-center'>"
+        "<div class='text-xl font-bold'><i class='fa fa-server mr-2'></i>C++ Web Server</div>"
+        "<div class='space-x-4'>"
+        "<a href='/' class='hover:text-blue-200 transition'><i class='fa fa-home'></i> 首页</a>"
+        "<a href='/about.html' class='hover:text-blue-200 transition'><i class='fa fa-info'></i> 关于</a>"
+        "<a href='/form.html' class='hover:text-blue-200 transition'><i class='fa fa-form'></i> 表单</a>"
+        "</div></div></nav>"
+        "<div class='container mx-auto px-4 py-8 max-w-2xl'>"
+        "<div class='bg-white rounded-lg shadow-lg p-6 mt-8'>"
+        "<h1 class='text-2xl font-bold text-green-600 mb-4'><i class='fa fa-check-circle mr-2'></i>提交成功！</h1>"
+        "<div class='space-y-3 text-gray-700'>"
+        "<p><strong>姓名：</strong>{{name}}</p>"
+        "<p><strong>邮箱：</strong>{{email}}</p>"
+        "<p><strong>留言：</strong>{{message}}</p>"
+        "</div>"
+        "<div class='mt-6'><a href='/form.html' class='text-blue-600 hover:underline'><i class='fa fa-arrow-left mr-1'></i>返回表单</a></div>"
+        "</div>"
+        "</div>"
+        "<footer class='bg-gray-800 text-white py-6 mt-12'>"
+        "<div class='container mx-auto px-4 text-center'>"
+        "<p>&copy; 2023 C++ Web服务器 | 基于C++17构建</p>"
+        "</div></footer>"
+        "</body>"
+        "</html>");
+
+    const HtmlTemplate not_found_page("<html>"
+        "<head>"
+        "<title>页面未找到</title>"
+        "<script src='https://cdn.tailwindcss.com'></script>"
+        "<link href='https://cdn.jsdelivr.net/npm/font-awesome@4.7.0/css/font-awesome.min.css' rel='stylesheet'>"
+        "</head>"
+        "<body class='bg-gray-50 min-h-screen'>"
+        "<nav class='bg-blue-600 text-white shadow-md'>"
+        "<div class='container mx-auto px-4 py-3 flex justify-between items-center'>"
+        "<div class='text-xl font-bold'><i class='fa fa-server mr-2'></i>C++ Web Server</div>"
+        "<div class='space-x-4'>"
+        "<a href='/' class='hover:text-blue-200 transition'><i class='fa fa-home'></i> 首页</a>"
+        "<a href='/about.html' class='hover:text-blue-200 transition'><i class='fa fa-info'></i> 关于</a>"
+        "<a href='/form.html' class='hover:text-blue-200 transition'><i class='fa fa-form'></i> 表单</a>"
+        "</div></div></nav>"
+        "<div class='container mx-auto px-4 py-16 text-center'>"
+        "<div class='inline-block p-8 bg-white rounded-lg shadow-lg'>"
+        "<div class='text-red-500 text-5xl mb-4'><i class='fa fa-exclamation-triangle'></i></div>"
+        "<h1 class='text-3xl font-bold text-gray-800 mb-2'>404 - 页面未找到</h1>"
+        "<p class='text-gray-600 mb-6'>抱歉，您请求的页面 \"{{path}}\" 不存在</p>"
+        "<a href='/' class='bg-blue-600 text-white px-6 py-2 rounded-md hover:bg-blue-700 transition duration-300'>"
+        "<i class='fa fa-home mr-1'></i>返回首页"
+        "</a>"
+        "</div>"
+        "</div>"
+        "</body>"
+        "</html>");
+
     // 处理表单提交
-    server.router().post("/submit", [](const Request& req, Response& res) {
+    server.router().post("/submit", [&submit_page](const Request& req, Response& res) {
         // 解析表单数据
         std::map<std::string, std::string> form_data = parseFormData(req.body());
 
-        // 生成提交结果页面
-        std::string html = "<html>"
-            "<head>"
-            "<title>提交成功</title>"
-            "<script src='https://cdn.tailwindcss.com'></script>"
-            "<link href='https://cdn.jsdelivr.net/npm/font-awesome@4.7.0/css/font-awesome.min.css' rel='stylesheet'>"
-            "<link rel='stylesheet' href='/css/style.css'>"
-            "</head>"
-            "<body class='bg-gray-50 min-h-screen'>"
-            "<nav class='bg-blue-600 text-white shadow-md'>"
-            "<div class='container mx-auto px-4 py-3 flex justify-between items-center'>"
-            "<div class='text-xl font-bold'><i class='fa fa-server mr-2'></i>C++ Web Server</div>"
-            "<div class='space-x-4'>"
-            "<a href='/' class='hover:text-blue-200 transition'><i class='fa fa-home'></i> 首页</a>"
-            "<a href='/about.html' class='hover:text-blue-200 transition'><i class='fa fa-info'></i> 关于</a>"
-            "<a href='/form.html' class='hover:text-blue-200 transition'><i class='fa fa-form'></i> 表单</a>"
-            "</div></div></nav>"
-            "<div class='container mx-auto px-4 py-8 max-w-2xl'>"
-            "<div class='bg-white rounded-lg shadow-lg p-6 mt-8'>"
-            "<h1 class='text-2xl font-bold text-green-600 mb-4'><i class='fa fa-check-circle mr-2'></i>提交成功！</h1>"
-            "<div class='space-y-3 text-gray-700'>"
-            "<p><strong>姓名：</strong>" + form_data["name"] + "</p>"
-            "<p><strong>邮箱：</strong>" + form_data["email"] + "</p>"
-            "<p><strong>留言：</strong>" + form_data["message"] + "</p>"
-            "</div>"
-            "<div class='mt-6'><a href='/form.html' class='text-blue-600 hover:underline'><i class='fa fa-arrow-left mr-1'></i>返回表单</a></div>"
-            "</div>"
-            "</div>"
-            "<footer class='bg-gray-800 text-white py-6 mt-12'>"
-            "<div class='container mx-auto px-4 text-center'>"
-            "<p>&copy; 2023 C++ Web服务器 | 基于C++17构建</p>"
-            "</div></footer>"
-            "</body>"
-            "</html>";
-        
-        res.setHtml(html);
+        // 生成提交结果页面：一次写入，提交的内容经过HTML转义
+        res.setHtml(submit_page, {{"name", form_data["name"]},
+                                  {"email", form_data["email"]},
+                                  {"message", form_data["message"]}});
     });
     
+    // 流式上传：请求体边接收边处理，不在内存中缓存（支持分块传输编码和Expect: 100-continue）
+    struct UploadCounter : BodyHandler {
+        size_t bytes = 0;
+        bool onData(std::string_view chunk) override {
+            bytes += chunk.size();
+            return true;
+        }
+        void onComplete(const Request& req, Response& res) override {
+            res.setHeader("Content-Type", "application/json");
+            res.setContent("{\"bytes\": " + std::to_string(bytes) + "}");
+        }
+    };
+    server.router().stream(HttpMethod::Post, "/upload", []() {
+        return std::unique_ptr<BodyHandler>(new UploadCounter());
+    });
+
+    // 管理接口：令牌校验作为中间件包在处理函数之外，校验失败时直接返回401，不执行处理函数
+    const char* token_env = std::getenv("ADMIN_TOKEN");
+    std::string admin_token = token_env ? token_env : "";
+    auto require_admin = [admin_token](const Request& req, Response& res, auto&& next) {
+        if (admin_token.empty() || req.header("Authorization") != "Bearer " + admin_token) {
+            res.setStatusCode(401);
+            res.setHeader("WWW-Authenticate", "Bearer");
+            res.setHeader("Content-Type", "application/json");
+            res.setContent("{\"error\": \"unauthorized\"}");
+            return;
+        }
+        next();
+    };
+    server.router().post("/api/admin/reload", middleware(require_admin).wrap([&server](const Request& req, Response& res) {
+        // 清空静态文件缓存，之后的请求重新从磁盘加载
+        server.router().staticCache()->clear();
+        res.setHeader("Content-Type", "application/json");
+        res.setContent("{\"reloaded\": true}");
+    }));
+
+    // WebSocket聊天室：每个连接订阅"chat"主题，收到的消息发布给所有订阅者（帧只编码一次，各连接共享）
+    struct ChatHandler : WebSocketHandler {
+        WebServer& server;
+        explicit ChatHandler(WebServer& server) : server(server) {}
+        void onOpen(WebSocket& ws, const Request& req) override {
+            ws.subscribe("chat");
+        }
+        void onMessage(WebSocket& ws, std::string_view data, bool binary) override {
+            server.publish("chat", data, binary);
+        }
+    };
+    server.router().websocket("/ws/chat", [&server]() {
+        return std::unique_ptr<WebSocketHandler>(new ChatHandler(server));
+    });
+
+#ifdef WEBSERVER_HAS_COROUTINES
+    // 协程处理函数：等待期间不占用工作线程，事件循环继续处理其他连接
+    server.router().getAsync("/api/delay", [](Request& req, Response& res) -> Task<void> {
+        int ms = std::atoi(req.queryParam("ms").c_str());
+        ms = std::min(std::max(ms, 0), 10000);
+        co_await sleepFor(std::chrono::milliseconds(ms));
+
+        res.setHeader("Content-Type", "application/json");
+        res.setContent("{\"delayed_ms\": " + std::to_string(ms) + "}");
+    });
+#endif
+
     // 自定义404页面
-    server.setNotFoundHandler([](const Request& req, Response& res) {
-        res.setStatusCode(404, "Not Found");
-        res.setHtml("<html>"
-                    "<head>"
-                    "<title>页面未找到</title>"
-                    "<script src='https://cdn.tailwindcss.com'></script>"
-                    "<link href='https://cdn.jsdelivr.net/npm/font-awesome@4.7.0/css/font-awesome.min.css' rel='stylesheet'>"
-                    "</head>"
-                    "<body class='bg-gray-50 min-h-screen'>"
-                    "<nav class='bg-blue-600 text-white shadow-md'>"
-                    "<div class='container mx-auto px-4 py-3 flex justify-between items-center'>"
-                    "<div class='text-xl font-bold'><i class='fa fa-server mr-2'></i>C++ Web Server</div>"
-                    "<div class='space-x-4'>"
-                    "<a href='/' class='hover:text-blue-200 transition'><i class='fa fa-home'></i> 首页</a>"
-                    "<a href='/about.html' class='hover:text-blue-200 transition'><i class='fa fa-info'></i> 关于</a>"
-                    "<a href='/form.html' class='hover:text-blue-200 transition'><i class='fa fa-form'></i> 表单</a>"
-                    "</div></div></nav>"
-                    "<div class='container mx-auto px-4 py-16 text-center'>"
-                    "<div class='inline-block p-8 bg-white rounded-lg shadow-lg'>"
-                    "<div class='text-red-500 text-5xl mb-4'><i class='fa fa-exclamation-triangle'></i></div>"
-                    "<h1 class='text-3xl font-bold text-gray-800 mb-2'>404 - 页面未找到</h1>"
-                    "<p class='text-gray-600 mb-6'>抱歉，您请求的页面 \"" + req.path() + "\" 不存在</p>"
-                    "<a href='/' class='bg-blue-600 text-white px-6 py-2 rounded-md hover:bg-blue-700 transition duration-300'>"
-                    "<i class='fa fa-home mr-1'></i>返回首页"
-                    "</a>"
-                    "</div>"
-                    "</div>"
-                    "</body>"
-                    "</html>");
+    server.setNotFoundHandler([&not_found_page](const Request& req, Response& res) {
+        res.setStatusCode(404);
+        res.setHtml(not_found_page, {{"path", req.path()}});
     });
     
     // 启动服务器
@@ -0,0 +1,183 @@
+#include "metrics.h"
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+size_t nextMetricShard() {
+    static std::atomic<size_t> next_shard{0};
+    return next_shard.fetch_add(1, std::memory_order_relaxed) % kMetricShards;
+}
+
+int64_t ShardedCounter::value() const {
+    int64_t total = 0;
+    for (const Cell& cell : cells_) {
+        total += cell.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+// LatencyHistogram类实现：小于16的值各占一个桶，之后每个2的幂区间16个桶
+size_t LatencyHistogram::bucketIndex(uint64_t micros) {
+    if (micros < kSubBuckets) return static_cast<size_t>(micros);
+    int exponent = 63 - __builtin_clzll(micros);
+    if (exponent > kMaxExponent) return kBucketCount - 1;
+    size_t sub = (micros >> (exponent - kSubBucketBits)) & (kSubBuckets - 1);
+    return (exponent - kSubBucketBits + 1) * kSubBuckets + sub;
+}
+
+uint64_t LatencyHistogram::bucketLower(size_t index) {
+    if (index < kSubBuckets) return index;
+    int exponent = static_cast<int>(index / kSubBuckets) + kSubBucketBits - 1;
+    uint64_t sub = index % kSubBuckets;
+    return (kSubBuckets + sub) << (exponent - kSubBucketBits);
+}
+
+uint64_t LatencyHistogram::bucketWidth(size_t index) {
+    if (index < kSubBuckets) return 1;
+    int exponent = static_cast<int>(index / kSubBuckets) + kSubBucketBits - 1;
+    return uint64_t(1) << (exponent - kSubBucketBits);
+}
+
+HistogramSnapshot LatencyHistogram::snapshot() const {
+    HistogramSnapshot result;
+    result.buckets.assign(kBucketCount, 0);
+    for (size_t s = 0; s < kMetricShards; ++s) {
+        const Shard& shard = shards_[s];
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            uint64_t count = shard.buckets[i].load(std::memory_order_relaxed);
+            result.buckets[i] += count;
+            result.count += count;
+        }
+        result.sum += shard.sum.load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+double HistogramSnapshot::quantile(double q) const {
+    if (count == 0) return 0;
+    // 第rank个样本所在的桶，取桶的中点（宽度为1的桶是精确值）
+    uint64_t rank = static_cast<uint64_t>(std::ceil(q * count));
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            uint64_t width = LatencyHistogram::bucketWidth(i);
+            return LatencyHistogram::bucketLower(i) + (width > 1 ? width / 2.0 : 0.0);
+        }
+    }
+    return LatencyHistogram::bucketLower(buckets.size() - 1);
+}
+
+// RouteStats类实现
+RouteStats::RouteStats(std::string method, std::string route)
+    : method_(std::move(method)), route_(std::move(route)) {
+    for (size_t i = 0; i <= kStatusSlots; ++i) {
+        codes_[i].store(0, std::memory_order_relaxed);
+        histograms_[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+RouteStats::~RouteStats() {
+    for (auto& histogram : histograms_) {
+        delete histogram.load(std::memory_order_relaxed);
+    }
+}
+
+LatencyHistogram& RouteStats::slot(int status) {
+    size_t index = kStatusSlots;
+    for (size_t i = 0; i < kStatusSlots; ++i) {
+        int code = codes_[i].load(std::memory_order_acquire);
+        if (code == status) {
+            index = i;
+            break;
+        }
+        // 空槽位：尝试占用，失败说明其他线程刚刚占用，重新检查该槽位
+        if (code == 0) {
+            if (codes_[i].compare_exchange_strong(code, status, std::memory_order_acq_rel)) {
+                histograms_[i].store(new LatencyHistogram(), std::memory_order_release);
+                index = i;
+                break;
+            }
+            if (code == status) {
+                index = i;
+                break;
+            }
+        }
+    }
+
+    // 超出的状态码共用最后一个槽位
+    if (index == kStatusSlots) {
+        int expected = 0;
+        if (codes_[index].compare_exchange_strong(expected, -1, std::memory_order_acq_rel)) {
+            histograms_[index].store(new LatencyHistogram(), std::memory_order_release);
+        }
+    }
+
+    // 槽位刚被其他线程占用时，直方图可能还没有发布
+    LatencyHistogram* histogram;
+    while ((histogram = histograms_[index].load(std::memory_order_acquire)) == nullptr) {
+        std::this_thread::yield();
+    }
+    return *histogram;
+}
+
+// MetricsWriter类实现：Prometheus文本格式
+void MetricsWriter::header(std::string_view name, std::string_view type, std::string_view help) {
+    out_ += "# HELP ";
+    out_ += name;
+    out_ += ' ';
+    out_ += help;
+    out_ += "\n# TYPE ";
+    out_ += name;
+    out_ += ' ';
+    out_ += type;
+    out_ += '\n';
+}
+
+void MetricsWriter::sample(std::string_view name, std::string_view labels, double value) {
+    char number[32];
+    if (value == std::floor(value) && std::fabs(value) < 1e15) {
+        snprintf(number, sizeof(number), "%.0f", value);
+    } else {
+        snprintf(number, sizeof(number), "%.9g", value);
+    }
+    out_ += name;
+    if (!labels.empty()) {
+        out_ += '{';
+        out_ += labels;
+        out_ += '}';
+    }
+    out_ += ' ';
+    out_ += number;
+    out_ += '\n';
+}
+
+void MetricsWriter::summary(std::string_view name, std::string_view labels, const HistogramSnapshot& snapshot) {
+    static const char* const kQuantiles[] = { "0.5", "0.9", "0.99", "0.999" };
+    std::string prefix(labels);
+    if (!prefix.empty()) prefix += ',';
+    for (const char* quantile : kQuantiles) {
+        sample(name, prefix + "quantile=\"" + quantile + "\"",
+               snapshot.quantile(std::atof(quantile)) / 1e6);
+    }
+    std::string base(name);
+    sample(base + "_sum", labels, snapshot.sum / 1e6);
+    sample(base + "_count", labels, static_cast<double>(snapshot.count));
+}
+
+std::string MetricsWriter::escapeLabel(std::string_view value) {
+    std::string result;
+    result.reserve(value.size());
+    for (char ch : value) {
+        if (ch == '\\' || ch == '"') {
+            result += '\\';
+            result += ch;
+        } else if (ch == '\n') {
+            result += "\\n";
+        } else {
+            result += ch;
+        }
+    }
+    return result;
+}
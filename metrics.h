@@ -0,0 +1,161 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// 指标按线程分片：每个线程固定写入其中一个分片，分片之间按缓存行对齐，
+// 写入只是一次无竞争（或低竞争）的relaxed原子加，读取时汇总所有分片
+constexpr size_t kMetricShards = 8;
+
+// 为新线程分配分片编号（轮流分配）
+size_t nextMetricShard();
+
+// 当前线程使用的分片编号
+inline size_t metricShard() {
+    thread_local size_t shard = nextMetricShard();
+    return shard;
+}
+
+// 分片计数器：也可作为仪表（加负数）使用
+class ShardedCounter {
+private:
+    struct alignas(64) Cell {
+        std::atomic<int64_t> value{0};
+    };
+    Cell cells_[kMetricShards];
+
+public:
+    void add(int64_t delta = 1) {
+        cells_[metricShard()].value.fetch_add(delta, std::memory_order_relaxed);
+    }
+    int64_t value() const;
+};
+
+// 直方图快照：由各分片汇总得到，用于计算分位数
+struct HistogramSnapshot {
+    std::vector<uint64_t> buckets;
+    uint64_t count = 0;
+    uint64_t sum = 0;   // 微秒
+
+    // 估算分位数（q取0~1），返回微秒；没有样本时为0
+    double quantile(double q) const;
+};
+
+// 延迟直方图（HDR风格的对数线性分桶）：每个2的幂区间再均分为16个子桶，
+// 相对误差约6%，覆盖1微秒到约12天；记录一次样本只需两次relaxed原子加
+class LatencyHistogram {
+public:
+    static constexpr int kSubBucketBits = 4;
+    static constexpr size_t kSubBuckets = 1 << kSubBucketBits;
+    static constexpr int kMaxExponent = 40;
+    static constexpr size_t kBucketCount = (kMaxExponent - kSubBucketBits + 2) * kSubBuckets;
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> buckets[kBucketCount];
+        std::atomic<uint64_t> sum{0};
+        Shard() {
+            for (auto& bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+        }
+    };
+    std::unique_ptr<Shard[]> shards_;
+
+public:
+    LatencyHistogram() : shards_(new Shard[kMetricShards]) {}
+
+    // 样本值所在的桶
+    static size_t bucketIndex(uint64_t micros);
+    // 桶的下界和宽度（微秒）
+    static uint64_t bucketLower(size_t index);
+    static uint64_t bucketWidth(size_t index);
+
+    // 记录一个样本（微秒）
+    void record(uint64_t micros) {
+        Shard& shard = shards_[metricShard()];
+        shard.buckets[bucketIndex(micros)].fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(micros, std::memory_order_relaxed);
+    }
+
+    // 汇总所有分片
+    HistogramSnapshot snapshot() const;
+};
+
+// 单条路由（方法+路径模式）的请求统计：按状态码分别记录延迟直方图
+// 状态码槽位通过CAS无锁占用，只有首次出现某个状态码时才分配直方图
+class RouteStats {
+public:
+    static constexpr size_t kStatusSlots = 8;   // 超出的状态码统一记入"other"
+
+private:
+    std::string method_;
+    std::string route_;
+    // 最后一个槽位保留给超出部分（状态码记为-1）
+    std::atomic<int> codes_[kStatusSlots + 1];
+    std::atomic<LatencyHistogram*> histograms_[kStatusSlots + 1];
+
+    LatencyHistogram& slot(int status);
+
+public:
+    RouteStats(std::string method, std::string route);
+    ~RouteStats();
+    RouteStats(const RouteStats&) = delete;
+    RouteStats& operator=(const RouteStats&) = delete;
+
+    const std::string& method() const { return method_; }
+    const std::string& route() const { return route_; }
+
+    // 记录一次请求
+    void record(int status, uint64_t micros) {
+        slot(status).record(micros);
+    }
+
+    // 遍历已出现的状态码及其直方图（状态码-1表示其余状态码）
+    template <typename F>
+    void forEach(F&& fn) const {
+        for (size_t i = 0; i <= kStatusSlots; ++i) {
+            LatencyHistogram* histogram = histograms_[i].load(std::memory_order_acquire);
+            if (histogram) fn(codes_[i].load(std::memory_order_relaxed), *histogram);
+        }
+    }
+};
+
+// 服务器级别的计数器（路由延迟和线程池排队时间分别由RouteStats和ThreadPool记录）
+struct ServerMetrics {
+    ShardedCounter requests;             // 已处理的请求数（含无法解析的请求）
+    ShardedCounter bytes_received;       // 从套接字读取的字节数
+    ShardedCounter bytes_sent;           // 写入套接字的字节数
+    ShardedCounter connections_accepted; // 累计接受的连接数
+    ShardedCounter active_connections;   // 当前打开的连接数
+    ShardedCounter connections_rejected; // 超出连接数上限而拒绝的连接数
+    ShardedCounter requests_shed;        // 过载（排队已满、排队超时或路由并发已满）时返回503的请求数
+    ShardedCounter request_timeouts;     // 请求头或请求体接收超时的请求数
+    ShardedCounter websocket_connections; // 当前打开的WebSocket连接数
+    ShardedCounter websocket_slow_consumers; // 发送队列超过上限而断开的WebSocket连接数
+};
+
+// Prometheus文本格式的输出辅助
+class MetricsWriter {
+private:
+    std::string out_;
+
+public:
+    // 指标说明和类型（counter/gauge/summary）
+    void header(std::string_view name, std::string_view type, std::string_view help);
+    // 一个样本；labels为已格式化的标签（如method="GET",route="/"），可为空
+    void sample(std::string_view name, std::string_view labels, double value);
+    // 直方图以summary输出：分位数、总和（秒）和样本数
+    void summary(std::string_view name, std::string_view labels, const HistogramSnapshot& snapshot);
+
+    // 转义标签值中的反斜杠、双引号和换行
+    static std::string escapeLabel(std::string_view value);
+
+    std::string& str() { return out_; }
+};
+
+#endif // METRICS_H
@@ -0,0 +1,79 @@
+#include "middleware.h"
+#include <algorithm>
+#include <cstdio>
+
+HandlerFunc wrapMiddleware(std::vector<MiddlewareFunc> middleware, HandlerFunc handler) {
+    if (middleware.empty()) return handler;
+    return [middleware = std::move(middleware), handler = std::move(handler)](const Request& req, Response& res) {
+        auto last = [&]() { handler(req, res); };
+        invokeMiddleware(middleware.data(), middleware.size(), req, res, MiddlewareNext(last));
+    };
+}
+
+Cors::Cors(CorsOptions options) : options_(std::make_shared<const CorsOptions>(std::move(options))) {
+}
+
+bool Cors::allowOrigin(std::string_view origin, std::string_view& allow) const {
+    if (origin.empty()) return false;
+    for (const std::string& item : options_->origins) {
+        if (item == "*") {
+            // 允许携带凭据时规范不接受"*"，改为回应请求的来源
+            allow = options_->credentials ? origin : std::string_view("*");
+            return true;
+        }
+        if (item == origin) {
+            allow = origin;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Cors::preflight(const Request& req, Response& res) const {
+    if (req.methodId() != HttpMethod::Options || req.header("Access-Control-Request-Method").empty()) return false;
+    std::string_view allow;
+    res.setStatusCode(204);
+    res.setContent(std::string());
+    res.removeHeader("Content-Type");
+    res.setHeader("Vary", "Origin, Access-Control-Request-Method, Access-Control-Request-Headers");
+    // 不允许的来源也回应204，只是不带Access-Control-Allow-*，由浏览器拒绝
+    if (!allowOrigin(req.header("Origin"), allow)) return true;
+    res.setHeader("Access-Control-Allow-Origin", allow);
+    res.setHeader("Access-Control-Allow-Methods", options_->methods);
+    if (!options_->headers.empty()) res.setHeader("Access-Control-Allow-Headers", options_->headers);
+    if (options_->credentials) res.setHeader("Access-Control-Allow-Credentials", "true");
+    if (options_->max_age > 0) res.setHeader("Access-Control-Max-Age", std::to_string(options_->max_age));
+    return true;
+}
+
+void Cors::addHeaders(const Request& req, Response& res) const {
+    std::string_view allow;
+    if (!allowOrigin(req.header("Origin"), allow)) return;
+    res.setHeader("Access-Control-Allow-Origin", allow);
+    if (allow != "*") {
+        // 响应随Origin变化，共享缓存需要区分
+        std::string_view vary = res.header("Vary");
+        if (vary.empty()) {
+            res.setHeader("Vary", "Origin");
+        } else if (vary.find("Origin") == std::string_view::npos && vary != "*") {
+            res.setHeader("Vary", std::string(vary) + ", Origin");
+        }
+    }
+    if (options_->credentials) res.setHeader("Access-Control-Allow-Credentials", "true");
+    if (!options_->expose_headers.empty()) res.setHeader("Access-Control-Expose-Headers", options_->expose_headers);
+}
+
+ServerTiming::ServerTiming(std::string metric) : metric_(std::move(metric)) {
+}
+
+void ServerTiming::record(Response& res, std::chrono::steady_clock::duration elapsed) const {
+    // 以毫秒为单位，保留两位小数
+    char value[64];
+    int length = std::snprintf(value, sizeof(value), ";dur=%.2f",
+                               std::chrono::duration<double, std::milli>(elapsed).count());
+    std::string entry = metric_;
+    entry.append(value, static_cast<size_t>(std::clamp(length, 0, static_cast<int>(sizeof(value)) - 1)));
+    // 多个计时中间件的结果合并在同一个响应头中
+    std::string_view existing = res.header("Server-Timing");
+    res.setHeader("Server-Timing", existing.empty() ? entry : std::string(existing) + ", " + entry);
+}
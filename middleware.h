@@ -0,0 +1,126 @@
+#ifndef MIDDLEWARE_H
+#define MIDDLEWARE_H
+
+#include "webserver.h"
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// 中间件：包在处理函数之外的通用逻辑（鉴权、CORS、限流、计时等）
+// 中间件是可调用对象 void(const Request& req, Response& res, Next&& next)：调用next()执行之后的中间件和处理函数，
+// 返回后可以继续修改响应；不调用next()时以当前响应结束（短路，如鉴权失败直接返回401）。
+// 中间件会被多个线程同时调用，调用运算符应为const，可变状态自行同步
+//
+// 两种组合方式：
+// - 静态组合：middleware(a, b, c)在编译期把整条链展开为嵌套调用，next是具体的lambda类型，编译器可以全部内联；
+//   chain.wrap(handler)得到的处理函数注册为路由后，整条链只有HandlerFunc本身一次间接调用
+// - 运行时注册：Router::use（全局）和wrapMiddleware（单个路由）把每个中间件类型擦除为MiddlewareFunc，
+//   next为MiddlewareNext，每层多一次间接调用但不分配内存
+// 以泛型lambda（auto&& next）或模板调用运算符编写的中间件两种方式都可以使用
+//
+// 缓存路由（见response_cache.h）命中时不执行处理函数，包在处理函数中的中间件也不会执行；
+// 需要对每个请求生效的中间件（鉴权等）应通过Router::use注册。缓存条目只保存处理函数自己设置的响应头，
+// 全局中间件在next()之前或之后设置的响应头（请求编号、鉴权结果等）每个请求各自加上，不会进入缓存；
+// 与缓存条目同名的响应头以缓存条目为准
+
+// 静态组合的中间件链：本身也是一个中间件，可以嵌套在其他链中或交给Router::use
+template <typename... Ms>
+class MiddlewareChain {
+private:
+    std::tuple<Ms...> middleware_;
+
+    template <size_t I, typename Last>
+    void invoke(const Request& req, Response& res, Last& last) const {
+        if constexpr (I == sizeof...(Ms)) {
+            last();
+        } else {
+            auto next = [&]() { this->template invoke<I + 1>(req, res, last); };
+            std::get<I>(middleware_)(req, res, next);
+        }
+    }
+
+public:
+    explicit MiddlewareChain(Ms... middleware) : middleware_(std::move(middleware)...) {}
+
+    // 依次执行各中间件，最后调用next
+    template <typename Next>
+    void operator()(const Request& req, Response& res, Next&& next) const {
+        invoke<0>(req, res, next);
+    }
+
+    // 把处理函数接在链的末尾，得到可以直接注册为路由的处理函数
+    template <typename Handler>
+    auto wrap(Handler handler) const {
+        return [chain = *this, handler = std::move(handler)](const Request& req, Response& res) {
+            auto last = [&]() { handler(req, res); };
+            chain(req, res, last);
+        };
+    }
+};
+
+// 静态组合中间件，按参数顺序执行
+template <typename... Ms>
+MiddlewareChain<std::decay_t<Ms>...> middleware(Ms&&... ms) {
+    return MiddlewareChain<std::decay_t<Ms>...>(std::forward<Ms>(ms)...);
+}
+
+// 运行时组合：把中间件依次包在处理函数之外（用于注册时才确定的中间件列表）
+HandlerFunc wrapMiddleware(std::vector<MiddlewareFunc> middleware, HandlerFunc handler);
+
+// CORS的配置
+struct CorsOptions {
+    std::vector<std::string> origins = { "*" };    // 允许的来源（如https://example.com），"*"表示任意来源
+    std::string methods = "GET, POST, PUT, DELETE, PATCH, OPTIONS";
+    std::string headers = "Content-Type, Authorization";   // 允许的请求头
+    std::string expose_headers;                    // 允许脚本读取的响应头，为空时不发送
+    bool credentials = false;                      // 允许携带Cookie（此时按请求的Origin回应，而不是"*"）
+    int max_age = 600;                             // 预检结果的缓存时间（秒）
+};
+
+// CORS中间件：给跨域请求的响应加上Access-Control-Allow-*；预检请求（OPTIONS + Access-Control-Request-Method）
+// 直接回应204，不再执行之后的中间件和处理函数
+class Cors {
+private:
+    std::shared_ptr<const CorsOptions> options_;   // 复制中间件时共享配置
+
+    // 请求的Origin是否被允许，允许时写入应回应的Access-Control-Allow-Origin
+    bool allowOrigin(std::string_view origin, std::string_view& allow) const;
+    // 预检请求：写入204响应并返回true
+    bool preflight(const Request& req, Response& res) const;
+    // 给普通请求的响应加上CORS响应头
+    void addHeaders(const Request& req, Response& res) const;
+
+public:
+    explicit Cors(CorsOptions options = CorsOptions());
+
+    template <typename Next>
+    void operator()(const Request& req, Response& res, Next&& next) const {
+        if (preflight(req, res)) return;
+        next();
+        addHeaders(req, res);
+    }
+};
+
+// 计时中间件：把之后的中间件和处理函数的耗时写入Server-Timing响应头（如app;dur=0.42），浏览器开发者工具可以直接显示
+class ServerTiming {
+private:
+    std::string metric_;
+
+    void record(Response& res, std::chrono::steady_clock::duration elapsed) const;
+
+public:
+    explicit ServerTiming(std::string metric = "app");
+
+    template <typename Next>
+    void operator()(const Request& req, Response& res, Next&& next) const {
+        auto started = std::chrono::steady_clock::now();
+        next();
+        record(res, std::chrono::steady_clock::now() - started);
+    }
+};
+
+#endif // MIDDLEWARE_H
@@ -0,0 +1,318 @@
+#include "response_cache.h"
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+
+namespace {
+
+int64_t steadyNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 可以缓存的状态码（RFC 9111 中默认可缓存的状态码，去掉需要额外处理的206/405/414/501）
+bool cacheableStatus(int status) {
+    switch (status) {
+    case 200: case 203: case 204: case 300: case 301: case 308: case 404: case 410:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// 获取缓存响应按coding压缩后的响应体：首次请求时压缩并保存，之后直接复用
+// 同一结果同时到达的请求只压缩一次；压缩后没有变小时返回空（以后也不再尝试）
+std::shared_ptr<const std::string> compressedBody(const CachedResponse& cached, ContentCoding coding,
+                                                  const CompressionConfig& config) {
+    size_t index = static_cast<size_t>(coding) - 1;
+    std::lock_guard<std::mutex> lock(cached.variants_mutex);
+    if (!cached.variants[index]) {
+        auto body = std::make_shared<std::string>();
+        if (!compressBuffer(coding, config, *cached.body, *body) || body->size() >= cached.body->size()) {
+            body->clear();
+        }
+        cached.variants[index] = std::move(body);
+    }
+    return cached.variants[index]->empty() ? nullptr : cached.variants[index];
+}
+
+} // namespace
+
+ResponseCache::ResponseCache(std::string route, HandlerFunc handler, RouteCacheOptions options)
+    : route_(std::move(route)), handler_(std::move(handler)), options_(std::move(options)) {
+}
+
+std::string ResponseCache::keyFor(const Request& req) const {
+    // 各部分以长度前缀分隔：解码后的查询参数可能含有任意字节，不能靠分隔符区分
+    std::string key(req.path());
+    auto append = [&key](std::string_view value) {
+        key.push_back('\0');
+        key += std::to_string(value.size());
+        key.push_back(':');
+        key.append(value.data(), value.size());
+    };
+    for (const std::string& name : options_.query_params) append(req.queryParam(name));
+    for (const std::string& name : options_.headers) append(req.header(name));
+    return key;
+}
+
+std::shared_ptr<const CachedResponse> ResponseCache::snapshot(const Response& res,
+                                                              const CompressionConfig& compression) const {
+    std::string_view body;
+    if (!cacheableStatus(res.statusCode()) || !res.bufferedBody(body)) return nullptr;
+
+    auto cached = std::make_shared<CachedResponse>();
+    bool cacheable = true;
+    bool encoded = false;
+    std::string_view content_type;
+    res.forEachHeader([&](std::string_view name, std::string_view value) {
+        if (equalsIgnoreCase(name, "Date") || equalsIgnoreCase(name, "Content-Length")) return;
+        if (equalsIgnoreCase(name, "Set-Cookie")) {
+            // 针对单个客户端的响应不能共享
+            cacheable = false;
+        } else if (equalsIgnoreCase(name, "Cache-Control")) {
+            if (value.find("no-store") != std::string_view::npos || value.find("no-cache") != std::string_view::npos ||
+                value.find("private") != std::string_view::npos) {
+                cacheable = false;
+            }
+        } else if (equalsIgnoreCase(name, "Content-Encoding")) {
+            encoded = true;
+        } else if (equalsIgnoreCase(name, "Content-Type")) {
+            content_type = value;
+        }
+        cached->headers.emplace_back(std::string(name), std::string(value));
+    });
+    if (!cacheable) return nullptr;
+
+    cached->status_code = res.statusCode();
+    cached->status_text = std::string(res.statusText());
+    cached->body = std::make_shared<const std::string>(body);
+    cached->compressible = !encoded && cached->status_code != 204 && body.size() >= compression.min_size &&
+                           compression.compressible(content_type);
+    int64_t now = steadyNowNs();
+    cached->fresh_until_ns = now + std::chrono::nanoseconds(options_.ttl).count();
+    cached->stale_until_ns = cached->fresh_until_ns + std::chrono::nanoseconds(options_.stale_while_revalidate).count();
+    return cached;
+}
+
+void ResponseCache::store(const std::string& key, std::shared_ptr<const CachedResponse> response) {
+    response->last_access.store(clock_.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+        it->second = std::move(response);
+        return;
+    }
+
+    if (entries_.size() >= options_.max_entries) {
+        // 先清除已彻底过期的结果，仍然已满时淘汰最久未访问的一个
+        int64_t now = steadyNowNs();
+        for (auto item = entries_.begin(); item != entries_.end();) {
+            item = item->second->stale_until_ns <= now ? entries_.erase(item) : std::next(item);
+        }
+        while (!entries_.empty() && entries_.size() >= options_.max_entries) {
+            auto oldest = std::min_element(entries_.begin(), entries_.end(), [](const auto& a, const auto& b) {
+                return a.second->last_access.load(std::memory_order_relaxed) <
+                       b.second->last_access.load(std::memory_order_relaxed);
+            });
+            entries_.erase(oldest);
+        }
+    }
+    entries_.emplace(key, std::move(response));
+}
+
+void ResponseCache::finish(const std::string& key, Flight& flight, std::shared_ptr<const CachedResponse> result) {
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (result) store(key, result);
+        flight.result = std::move(result);
+        flight.done = true;
+        flights_.erase(key);
+    }
+    flight_cv_.notify_all();
+}
+
+std::shared_ptr<const CachedResponse> ResponseCache::refresh(const Request& req, const std::string& key,
+                                                             const std::shared_ptr<const CachedResponse>& stale,
+                                                             const CompressionConfig& compression) {
+    std::shared_ptr<const CachedResponse> result;
+    try {
+        Response res;
+        handler_(req, res);
+        result = snapshot(res, compression);
+    } catch (const std::exception& e) {
+        std::cerr << "刷新缓存的响应时处理函数异常: " << e.what() << std::endl;
+    } catch (...) {
+        std::cerr << "刷新缓存的响应时处理函数异常" << std::endl;
+    }
+    if (result) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        store(key, result);
+    }
+    // 没有得到可缓存的结果时，下一个请求重新尝试刷新
+    stale->refreshing.store(false, std::memory_order_release);
+    return result;
+}
+
+void ResponseCache::handle(const Request& req, Response& res, const CompressionConfig& compression,
+                           const CacheRefreshExecutor& executor) {
+    std::string key = keyFor(req);
+    std::string_view accept = req.header("Accept-Encoding");
+    int64_t now = steadyNowNs();
+
+    std::shared_ptr<const CachedResponse> cached;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end() && now < it->second->stale_until_ns) cached = it->second;
+    }
+    if (cached) {
+        cached->last_access.store(clock_.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+        if (now < cached->fresh_until_ns) {
+            hits_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            stale_hits_.fetch_add(1, std::memory_order_relaxed);
+            // 过期后第一个看到它的请求负责刷新，其余请求继续使用旧结果
+            if (!cached->refreshing.exchange(true, std::memory_order_acq_rel)) {
+                std::shared_ptr<ResponseCache> self = shared_from_this();
+                if (!executor || !executor([self, copy = req, key, cached, compression]() {
+                        self->refresh(copy, key, cached, compression);
+                    })) {
+                    // 没有后台执行者（或队列已满）：由当前请求刷新，并返回新的结果
+                    std::shared_ptr<const CachedResponse> fresh = refresh(req, key, cached, compression);
+                    if (fresh) cached = std::move(fresh);
+                }
+            }
+        }
+        serve(*cached, accept, compression, res);
+        return;
+    }
+
+    // 未命中：同一个键只有第一个请求执行处理函数，其余请求等待它的结果
+    // 事件循环线程（多反应器模式）不能等待，否则同一循环上的所有连接都要停顿：改为自己执行处理函数并保存结果
+    // （已超出stale_while_revalidate的结果不再返回）
+    bool on_loop = EventLoop::current() != nullptr;
+    std::shared_ptr<Flight> flight;
+    bool leader = false;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end() && now < it->second->stale_until_ns) {
+            // 在加写锁之前刚刚完成的结果
+            cached = it->second;
+        } else {
+            std::shared_ptr<Flight>& slot = flights_[key];
+            if (!slot) {
+                slot = std::make_shared<Flight>();
+                leader = true;
+            }
+            flight = slot;
+            if (!leader && !on_loop) {
+                coalesced_.fetch_add(1, std::memory_order_relaxed);
+                flight_cv_.wait(lock, [&flight]() { return flight->done; });
+                cached = flight->result;
+            }
+        }
+    }
+    if (cached) {
+        if (!flight) hits_.fetch_add(1, std::memory_order_relaxed);
+        serve(*cached, accept, compression, res);
+        return;
+    }
+    if (!leader && on_loop) {
+        // 事件循环线程上不等待正在执行的处理函数：自己执行，可缓存的结果同样保存，之后的请求直接命中
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        if (std::shared_ptr<const CachedResponse> result = execute(req, res, accept, compression)) {
+            std::unique_lock<std::shared_mutex> lock(mutex_);
+            store(key, std::move(result));
+        }
+        return;
+    }
+    if (!leader) {
+        // 结果不可缓存：各自执行处理函数
+        handler_(req, res);
+        return;
+    }
+
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    // 处理函数抛出异常时同样要唤醒等待者（它们随后各自执行处理函数）
+    struct FlightGuard {
+        ResponseCache* cache;
+        const std::string& key;
+        Flight& flight;
+        std::shared_ptr<const CachedResponse> result;
+        ~FlightGuard() { cache->finish(key, flight, std::move(result)); }
+    } guard{this, key, *flight, nullptr};
+    guard.result = execute(req, res, accept, compression);
+}
+
+std::shared_ptr<const CachedResponse> ResponseCache::execute(const Request& req, Response& res,
+                                                             std::string_view accept,
+                                                             const CompressionConfig& compression) {
+    // 处理函数写入新的响应：res中可能已有中间件为这个请求设置的响应头，不能进入共享的缓存条目
+    Response fresh(res.arena());
+    handler_(req, fresh);
+    std::shared_ptr<const CachedResponse> result = snapshot(fresh, compression);
+    if (result) {
+        // 与之后的命中一样由缓存条目生成响应，首次压缩的结果也随条目保存
+        serve(*result, accept, compression, res);
+    } else {
+        fresh.inheritHeaders(res);
+        res = std::move(fresh);
+    }
+    return result;
+}
+
+void ResponseCache::serve(const CachedResponse& cached, std::string_view accept_encoding,
+                          const CompressionConfig& compression, Response& res) {
+    // 合并到调用者的响应中：中间件已设置的响应头保留，同名的以缓存条目为准
+    res.setStatusCode(cached.status_code, cached.status_text);
+    res.removeHeader("Content-Type");
+    for (const auto& header : cached.headers) {
+        res.setHeader(header.first, header.second);
+    }
+
+    std::shared_ptr<const std::string> body = cached.body;
+    if (cached.compressible && compression.enabled) {
+        // 同一URL的响应随Accept-Encoding变化，缓存需要区分（与Response::compress相同）
+        std::string_view vary = res.header("Vary");
+        if (vary.empty()) {
+            res.setHeader("Vary", "Accept-Encoding");
+        } else if (vary.find("Accept-Encoding") == std::string_view::npos && vary != "*") {
+            res.setHeader("Vary", std::string(vary) + ", Accept-Encoding");
+        }
+        ContentCoding coding = negotiateEncoding(accept_encoding);
+        if (coding != ContentCoding::Identity) {
+            if (std::shared_ptr<const std::string> variant = compressedBody(cached, coding, compression)) {
+                body = std::move(variant);
+                res.setHeader("Content-Encoding", contentCodingName(coding));
+                std::string_view etag = res.header("ETag");
+                if (!etag.empty() && etag.front() == '"') res.setHeader("ETag", "W/" + std::string(etag));
+            }
+        }
+    }
+
+    // 响应体与缓存条目共享，不复制
+    OutputBuffer chunks;
+    if (!body->empty()) chunks.append(std::move(body));
+    res.setBodyChunks(std::move(chunks));
+}
+
+void ResponseCache::clear() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    entries_.clear();
+}
+
+size_t ResponseCache::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return entries_.size();
+}
@@ -0,0 +1,119 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include "webserver.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// 动态路由的响应微缓存：处理函数的结果按"路径+选定的查询参数+选定的请求头"保存一小段时间，
+// 期间的相同请求直接由缓存生成响应（响应体共享，不复制）；同一个键同时未命中的请求只执行一次处理函数，
+// 其余请求等待它的结果（single-flight）。过期后的stale_while_revalidate期间仍返回旧结果，
+// 同时在后台重新执行处理函数，超出这段时间的结果不再返回。在事件循环线程上执行的请求（多反应器模式）
+// 不等待其他请求的结果，以免阻塞同一循环上的其他连接：改为自己执行处理函数，可缓存的结果同样保存
+
+// 路由缓存的配置（Router::get的cache参数）
+struct RouteCacheOptions {
+    std::chrono::milliseconds ttl{1000};                     // 结果保持新鲜的时间
+    std::chrono::milliseconds stale_while_revalidate{0};     // 过期后继续返回旧结果、同时后台刷新的时间
+    std::vector<std::string> query_params;                   // 参与缓存键的查询参数（其余查询参数被忽略）
+    std::vector<std::string> headers;                        // 参与缓存键的请求头（如Accept-Language）
+    size_t max_entries = 1024;                               // 最多保存的结果数，超出时淘汰最久未访问的结果
+};
+
+// 一份缓存的响应：状态、响应头（不含Date和Content-Length）和内存中的响应体
+struct CachedResponse {
+    int status_code = 200;
+    std::string status_text;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::shared_ptr<const std::string> body;
+    bool compressible = false;         // 可以按Accept-Encoding压缩（类型允许且没有Content-Encoding）
+    int64_t fresh_until_ns = 0;        // steady_clock纳秒
+    int64_t stale_until_ns = 0;
+
+    // 近似LRU：最近一次访问的逻辑时钟
+    mutable std::atomic<uint64_t> last_access{0};
+    // 已有请求在后台刷新这个结果
+    mutable std::atomic<bool> refreshing{false};
+    // 按需压缩的响应体（按ContentCoding下标，压缩后没有变小时为空字符串），与StaticFileCache::compressed相同
+    mutable std::mutex variants_mutex;
+    mutable std::shared_ptr<const std::string> variants[kContentCodingCount];
+};
+
+// 一条路由的响应缓存（由Router持有，见Router::get）
+class ResponseCache : public std::enable_shared_from_this<ResponseCache> {
+private:
+    // 同一个键正在执行的处理函数：等待者在flight_cv_上等待done
+    struct Flight {
+        bool done = false;
+        std::shared_ptr<const CachedResponse> result;   // 结果不可缓存（或处理函数抛出异常）时为空
+    };
+
+    std::string route_;
+    HandlerFunc handler_;
+    RouteCacheOptions options_;
+
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<const CachedResponse>> entries_;
+    std::unordered_map<std::string, std::shared_ptr<Flight>> flights_;
+    std::condition_variable_any flight_cv_;
+    std::atomic<uint64_t> clock_{0};
+
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> stale_hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> coalesced_{0};
+
+    // 请求对应的缓存键
+    std::string keyFor(const Request& req) const;
+    // 执行处理函数并写入res（保留res中已有的响应头），返回可缓存的结果，不可缓存时返回空
+    std::shared_ptr<const CachedResponse> execute(const Request& req, Response& res, std::string_view accept,
+                                                  const CompressionConfig& compression);
+    // 把处理函数生成的响应转换为缓存条目，不可缓存时返回空
+    std::shared_ptr<const CachedResponse> snapshot(const Response& res, const CompressionConfig& compression) const;
+    // 保存结果（加写锁调用），超出容量时淘汰
+    void store(const std::string& key, std::shared_ptr<const CachedResponse> response);
+    // 结束一次未命中的处理：保存可缓存的结果并唤醒等待者
+    void finish(const std::string& key, Flight& flight, std::shared_ptr<const CachedResponse> result);
+    // 重新执行处理函数并保存结果（刷新过期的stale），结束时清除它的refreshing标记；不可缓存时返回空
+    std::shared_ptr<const CachedResponse> refresh(const Request& req, const std::string& key,
+                                                  const std::shared_ptr<const CachedResponse>& stale,
+                                                  const CompressionConfig& compression);
+
+public:
+    ResponseCache(std::string route, HandlerFunc handler, RouteCacheOptions options);
+    ResponseCache(const ResponseCache&) = delete;
+    ResponseCache& operator=(const ResponseCache&) = delete;
+
+    // 处理一个请求：命中时由缓存生成响应，否则执行处理函数（同一个键只执行一次）并保存可缓存的结果
+    // 结果过期但仍在stale_while_revalidate期间时返回旧结果，并通过executor在后台刷新
+    // （executor为空或返回false时由当前请求同步刷新）
+    void handle(const Request& req, Response& res, const CompressionConfig& compression,
+                const CacheRefreshExecutor& executor);
+
+    // 由缓存条目生成响应：按Accept-Encoding选择压缩版本（首次使用时压缩并保存），响应体不复制
+    // res中已有的响应头（如中间件设置的）保留，同名的被缓存条目覆盖
+    static void serve(const CachedResponse& cached, std::string_view accept_encoding,
+                      const CompressionConfig& compression, Response& res);
+
+    // 清空缓存的结果
+    void clear();
+
+    const std::string& route() const { return route_; }
+    size_t size() const;
+    uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    uint64_t staleHits() const { return stale_hits_.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+    uint64_t coalesced() const { return coalesced_.load(std::memory_order_relaxed); }
+};
+
+#endif // RESPONSE_CACHE_H
@@ -0,0 +1,228 @@
+#include "simd_scan.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_SCAN_X86 1
+#endif
+
+namespace {
+
+// 十六进制字符的值，非十六进制字符为-1
+struct HexTable {
+    int8_t value[256];
+    constexpr HexTable() : value() {
+        for (int i = 0; i < 256; ++i) value[i] = -1;
+        for (int i = 0; i < 10; ++i) value['0' + i] = static_cast<int8_t>(i);
+        for (int i = 0; i < 6; ++i) {
+            value['a' + i] = static_cast<int8_t>(10 + i);
+            value['A' + i] = static_cast<int8_t>(10 + i);
+        }
+    }
+};
+constexpr HexTable kHex;
+
+// 标量实现
+const char* findFirstOf2Scalar(const char* p, const char* end, char a, char b) {
+    for (; p < end; ++p) {
+        if (*p == a || *p == b) return p;
+    }
+    return end;
+}
+
+const char* findFirstOf3Scalar(const char* p, const char* end, char a, char b, char c) {
+    for (; p < end; ++p) {
+        if (*p == a || *p == b || *p == c) return p;
+    }
+    return end;
+}
+
+// 每次异或8字节：掩码键重复两次拼成64位（按内存顺序，与字节序无关）
+void applyMaskScalar(char* p, size_t len, const unsigned char key[4]) {
+    uint32_t key32;
+    std::memcpy(&key32, key, 4);
+    uint64_t key64 = (static_cast<uint64_t>(key32) << 32) | key32;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, p + i, 8);
+        word ^= key64;
+        std::memcpy(p + i, &word, 8);
+    }
+    // 已处理的长度是8的倍数，尾部从键的第0字节继续
+    for (; i < len; ++i) p[i] ^= static_cast<char>(key[i & 3]);
+}
+
+#ifdef SIMD_SCAN_X86
+// SSE2实现：每次比较16字节，命中位置由比较掩码的最低位给出
+__attribute__((target("sse2")))
+const char* findFirstOf2Sse2(const char* p, const char* end, char a, char b) {
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    for (; end - p >= 16; p += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)));
+        if (mask != 0) return p + __builtin_ctz(mask);
+    }
+    return findFirstOf2Scalar(p, end, a, b);
+}
+
+__attribute__((target("sse2")))
+const char* findFirstOf3Sse2(const char* p, const char* end, char a, char b, char c) {
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    const __m128i vc = _mm_set1_epi8(c);
+    for (; end - p >= 16; p += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)),
+                                    _mm_cmpeq_epi8(chunk, vc));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask != 0) return p + __builtin_ctz(mask);
+    }
+    return findFirstOf3Scalar(p, end, a, b, c);
+}
+
+// AVX2实现：每次比较32字节，不足32字节的尾部交给SSE2
+__attribute__((target("avx2")))
+const char* findFirstOf2Avx2(const char* p, const char* end, char a, char b) {
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    for (; end - p >= 32; p += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, va), _mm256_cmpeq_epi8(chunk, vb))));
+        if (mask != 0) return p + __builtin_ctz(mask);
+    }
+    return findFirstOf2Sse2(p, end, a, b);
+}
+
+__attribute__((target("avx2")))
+const char* findFirstOf3Avx2(const char* p, const char* end, char a, char b, char c) {
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    const __m256i vc = _mm256_set1_epi8(c);
+    for (; end - p >= 32; p += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, va), _mm256_cmpeq_epi8(chunk, vb)),
+                                       _mm256_cmpeq_epi8(chunk, vc));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hits));
+        if (mask != 0) return p + __builtin_ctz(mask);
+    }
+    return findFirstOf3Sse2(p, end, a, b, c);
+}
+
+__attribute__((target("sse2")))
+void applyMaskSse2(char* p, size_t len, const unsigned char key[4]) {
+    int key32;
+    std::memcpy(&key32, key, 4);
+    const __m128i vkey = _mm_set1_epi32(key32);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i* chunk = reinterpret_cast<__m128i*>(p + i);
+        _mm_storeu_si128(chunk, _mm_xor_si128(_mm_loadu_si128(chunk), vkey));
+    }
+    applyMaskScalar(p + i, len - i, key);
+}
+
+__attribute__((target("avx2")))
+void applyMaskAvx2(char* p, size_t len, const unsigned char key[4]) {
+    int key32;
+    std::memcpy(&key32, key, 4);
+    const __m256i vkey = _mm256_set1_epi32(key32);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i* chunk = reinterpret_cast<__m256i*>(p + i);
+        _mm256_storeu_si256(chunk, _mm256_xor_si256(_mm256_loadu_si256(chunk), vkey));
+    }
+    applyMaskSse2(p + i, len - i, key);
+}
+#endif
+
+// 按CPU选择的一组实现
+struct ScanOps {
+    const char* (*find2)(const char*, const char*, char, char);
+    const char* (*find3)(const char*, const char*, char, char, char);
+    void (*mask)(char*, size_t, const unsigned char*);
+    const char* name;
+};
+
+ScanOps selectOps() {
+    const ScanOps scalar = { findFirstOf2Scalar, findFirstOf3Scalar, applyMaskScalar, "scalar" };
+    const char* forced = std::getenv("WEBSERVER_SIMD");
+    if (forced && std::strcmp(forced, "scalar") == 0) return scalar;
+
+#ifdef SIMD_SCAN_X86
+    __builtin_cpu_init();
+    const ScanOps sse2 = { findFirstOf2Sse2, findFirstOf3Sse2, applyMaskSse2, "sse2" };
+    const ScanOps avx2 = { findFirstOf2Avx2, findFirstOf3Avx2, applyMaskAvx2, "avx2" };
+    bool has_sse2 = __builtin_cpu_supports("sse2");
+    bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (forced && std::strcmp(forced, "sse2") == 0) return has_sse2 ? sse2 : scalar;
+    if (has_avx2) return avx2;
+    if (has_sse2) return sse2;
+#endif
+    return scalar;
+}
+
+// 首次使用时选择实现（线程安全的局部静态变量，之后每次调用只有一次判断）
+const ScanOps& ops() {
+    static const ScanOps selected = selectOps();
+    return selected;
+}
+
+}  // namespace
+
+const char* findFirstOf(const char* begin, const char* end, char a, char b) {
+    return ops().find2(begin, end, a, b);
+}
+
+const char* findFirstOf(const char* begin, const char* end, char a, char b, char c) {
+    return ops().find3(begin, end, a, b, c);
+}
+
+size_t urlDecodeTo(const char* src, size_t len, char* dst) {
+    const char* p = src;
+    const char* end = src + len;
+    char* out = dst;
+    const auto find2 = ops().find2;
+
+    while (p < end) {
+        // 整段复制不需要解码的字节
+        if (*p != '%' && *p != '+') {
+            const char* special = find2(p + 1, end, '%', '+');
+            size_t run = special - p;
+            if (out != p) std::memmove(out, p, run);
+            out += run;
+            p = special;
+            if (p == end) break;
+        }
+
+        if (*p == '+') {
+            *out++ = ' ';
+            ++p;
+            continue;
+        }
+        if (end - p >= 3) {
+            int high = kHex.value[static_cast<unsigned char>(p[1])];
+            int low = kHex.value[static_cast<unsigned char>(p[2])];
+            if ((high | low) >= 0) {
+                *out++ = static_cast<char>((high << 4) | low);
+                p += 3;
+                continue;
+            }
+        }
+        *out++ = '%';
+        ++p;
+    }
+    return out - dst;
+}
+
+void applyWebSocketMask(char* data, size_t len, const unsigned char key[4]) {
+    ops().mask(data, len, key);
+}
+
+const char* simdLevelName() {
+    return ops().name;
+}
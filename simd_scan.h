@@ -0,0 +1,25 @@
+#ifndef SIMD_SCAN_H
+#define SIMD_SCAN_H
+
+#include <cstddef>
+
+// 文本扫描内核：查找分隔符、跳过不需要解码的字节，以及WebSocket帧的掩码运算
+// x86上按CPU在运行时选择AVX2或SSE2实现，其余平台使用标量实现；
+// 设置环境变量WEBSERVER_SIMD=scalar/sse2/avx2可强制使用指定实现（不支持时退回可用的最高级别）
+
+// 查找[begin, end)中第一个等于a或b的字节，未找到时返回end
+const char* findFirstOf(const char* begin, const char* end, char a, char b);
+// 查找[begin, end)中第一个等于a、b或c的字节，未找到时返回end
+const char* findFirstOf(const char* begin, const char* end, char a, char b, char c);
+
+// URL解码（%XX和+），结果写入dst，返回写入的字节数（不超过len）
+// dst可以等于src（原地解码）；不合法的%序列原样保留
+size_t urlDecodeTo(const char* src, size_t len, char* dst);
+
+// WebSocket掩码（RFC 6455 5.3）：data[i] ^= key[i % 4]，原地进行；掩码和解码是同一操作
+void applyWebSocketMask(char* data, size_t len, const unsigned char key[4]);
+
+// 当前使用的实现（"avx2"、"sse2"或"scalar"）
+const char* simdLevelName();
+
+#endif // SIMD_SCAN_H
@@ -0,0 +1,372 @@
+#include "static_cache.h"
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <climits>
+#include <cstdio>
+#include <ctime>
+#include <cerrno>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+int64_t steadyNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 条目的估算内存占用（包含键和固定开销）
+size_t entryBytes(const std::string& key, const CachedFile& file) {
+    return key.size() + file.path.size() + file.headers.size() + file.encoded_headers.size() +
+           file.body.size() + 256;
+}
+
+// 与内容编码无关的响应头（Content-Length/ETag/Last-Modified/Accept-Ranges）
+std::string commonHeaders(const CachedFile& file) {
+    return "Content-Length: " + std::to_string(file.size) + "\r\n"
+           "ETag: " + file.etag + "\r\n"
+           "Last-Modified: " + file.last_modified + "\r\n"
+           "Accept-Ranges: bytes\r\n";
+}
+
+} // namespace
+
+const std::string& mimeTypeFor(std::string_view path) {
+    // 只在首次调用时构建一次
+    static const std::unordered_map<std::string, std::string> mime_types = {
+        {"html", "text/html"},
+        {"css", "text/css"},
+        {"js", "application/javascript"},
+        {"png", "image/png"},
+        {"jpg", "image/jpeg"},
+        {"jpeg", "image/jpeg"},
+        {"gif", "image/gif"},
+        {"ico", "image/x-icon"},
+        {"svg", "image/svg+xml"}
+    };
+    static const std::string default_type = "application/octet-stream";
+
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of('/');
+    if (dot == std::string_view::npos || (slash != std::string_view::npos && dot < slash)) {
+        return default_type;
+    }
+    std::string ext(path.substr(dot + 1));
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    auto it = mime_types.find(ext);
+    return it != mime_types.end() ? it->second : default_type;
+}
+
+time_t parseHttpDate(std::string_view value) {
+    std::string text(value);
+    struct tm tm_time;
+    std::memset(&tm_time, 0, sizeof(tm_time));
+    const char* end = strptime(text.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm_time);
+    if (end == nullptr || *end != '\0') return -1;
+    return timegm(&tm_time);
+}
+
+std::string formatHttpDate(time_t t) {
+    struct tm tm_time;
+    gmtime_r(&t, &tm_time);
+    char buffer[64];
+    size_t n = strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm_time);
+    return std::string(buffer, n);
+}
+
+// StaticFileCache类实现
+StaticFileCache::StaticFileCache(const std::string& root, size_t max_bytes, size_t max_file_size)
+    : root_(root), max_bytes_(max_bytes), max_file_size_(max_file_size) {
+    // 去掉末尾的/，键总是以/开头
+    while (root_.size() > 1 && root_.back() == '/') root_.pop_back();
+
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+        perror("inotify不可用，静态缓存改为定期校验");
+        return;
+    }
+    addWatch("");
+}
+
+StaticFileCache::~StaticFileCache() {
+    if (inotify_fd_ != -1) close(inotify_fd_);
+}
+
+void StaticFileCache::addWatch(const std::string& relative_dir) {
+    std::string dir = root_ + relative_dir;
+    const uint32_t mask = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE |
+                          IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+    int wd = inotify_add_watch(inotify_fd_, dir.c_str(), mask);
+    if (wd < 0) return;
+    {
+        std::lock_guard<std::mutex> lock(watch_mutex_);
+        watch_dirs_[wd] = relative_dir;
+    }
+
+    // 递归监视子目录
+    DIR* d = opendir(dir.c_str());
+    if (d == nullptr) return;
+    while (dirent* entry = readdir(d)) {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..") continue;
+        std::string child = relative_dir + "/" + name;
+        struct stat st;
+        if (stat((root_ + child).c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+            addWatch(child);
+        }
+    }
+    closedir(d);
+}
+
+void StaticFileCache::processEvents() {
+    if (inotify_fd_ < 0) return;
+
+    alignas(inotify_event) char buffer[16 * 1024];
+    while (true) {
+        ssize_t n = read(inotify_fd_, buffer, sizeof(buffer));
+        if (n <= 0) return;
+
+        for (char* p = buffer; p < buffer + n;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+
+            // 事件溢出：无法确定哪些文件变化，整体清空
+            if (event->mask & IN_Q_OVERFLOW) {
+                clear();
+                continue;
+            }
+
+            std::string dir;
+            {
+                std::lock_guard<std::mutex> lock(watch_mutex_);
+                auto it = watch_dirs_.find(event->wd);
+                if (it == watch_dirs_.end()) continue;
+                dir = it->second;
+                if (event->mask & IN_IGNORED) {
+                    watch_dirs_.erase(it);
+                    continue;
+                }
+            }
+
+            // 目录结构变化影响其下所有路径（包括缓存的"不存在"条目），整体清空
+            if (event->mask & (IN_ISDIR | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)) && event->len > 0) {
+                    addWatch(dir + "/" + event->name);
+                }
+                clear();
+                continue;
+            }
+
+            if (event->len > 0) {
+                invalidate(dir + "/" + event->name);
+            }
+        }
+    }
+}
+
+std::shared_ptr<CachedFile> StaticFileCache::load(const std::string& key) const {
+    std::shared_ptr<CachedFile> file = std::make_shared<CachedFile>();
+    file->path = root_ + key;
+    file->validated_ns.store(steadyNowNs(), std::memory_order_relaxed);
+
+    int fd = open(file->path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return file;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return file;
+    }
+
+    file->exists = true;
+    file->size = st.st_size;
+    file->mtime = st.st_mtim.tv_sec;
+    file->mtime_nsec = st.st_mtim.tv_nsec;
+    file->inode = st.st_ino;
+    file->content_type = mimeTypeFor(key);
+    file->last_modified = formatHttpDate(st.st_mtim.tv_sec);
+
+    char etag[64];
+    snprintf(etag, sizeof(etag), "\"%llx-%llx\"", static_cast<unsigned long long>(st.st_size),
+             static_cast<unsigned long long>(st.st_mtim.tv_sec) * 1000000000ULL + st.st_mtim.tv_nsec);
+    file->etag = etag;
+
+    // 小文件整体读入内存
+    if (static_cast<size_t>(st.st_size) <= max_file_size_) {
+        file->body.resize(st.st_size);
+        size_t done = 0;
+        while (done < file->body.size()) {
+            ssize_t n = read(fd, &file->body[done], file->body.size() - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            done += n;
+        }
+        file->body.resize(done);
+        file->size = done;
+        file->in_memory = true;
+    }
+    close(fd);
+
+    std::string common = commonHeaders(*file);
+    file->headers = "Content-Type: " + file->content_type + "\r\n" + common;
+
+    // 预压缩文件：按去掉后缀后的原文件类型发送
+    std::string_view base;
+    if (key.size() > 3 && key.compare(key.size() - 3, 3, ".gz") == 0) {
+        file->encoding = "gzip";
+        base = std::string_view(key).substr(0, key.size() - 3);
+    } else if (key.size() > 3 && key.compare(key.size() - 3, 3, ".br") == 0) {
+        file->encoding = "br";
+        base = std::string_view(key).substr(0, key.size() - 3);
+    }
+    if (!file->encoding.empty()) {
+        file->encoded_headers = "Content-Type: " + mimeTypeFor(base) + "\r\n"
+                                "Content-Encoding: " + file->encoding + "\r\n" + common;
+    }
+    return file;
+}
+
+std::shared_ptr<const CachedFile> StaticFileCache::compressed(const std::shared_ptr<const CachedFile>& file,
+                                                              ContentCoding coding, const CompressionConfig& config) {
+    if (coding == ContentCoding::Identity || !file->in_memory) return nullptr;
+    size_t index = static_cast<size_t>(coding) - 1;
+
+    // 压缩期间持有锁：同一文件的并发请求等待结果，而不是各自压缩一遍
+    std::lock_guard<std::mutex> lock(file->variants_mutex);
+    if (file->variants[index]) {
+        return file->variants[index]->exists ? file->variants[index] : nullptr;
+    }
+
+    auto variant = std::make_shared<CachedFile>();
+    std::string body;
+    if (compressBuffer(coding, config, file->body, body) && body.size() < file->body.size()) {
+        variant->path = file->path;
+        variant->exists = true;
+        variant->in_memory = true;
+        variant->content_type = file->content_type;
+        // 各编码版本的内容不同，强校验值也必须不同
+        std::string_view name = contentCodingName(coding);
+        variant->etag = file->etag.substr(0, file->etag.size() - 1) + "-" + std::string(name) + "\"";
+        variant->last_modified = file->last_modified;
+        variant->encoding = std::string(name);
+        variant->body = std::move(body);
+        variant->size = variant->body.size();
+        variant->mtime = file->mtime;
+        variant->mtime_nsec = file->mtime_nsec;
+        variant->inode = file->inode;
+        std::string common = commonHeaders(*variant);
+        variant->headers = "Content-Type: " + variant->content_type + "\r\n" + common;
+        variant->encoded_headers = "Content-Type: " + variant->content_type + "\r\n"
+                                   "Content-Encoding: " + variant->encoding + "\r\n" + common;
+    }
+    file->variants[index] = variant;
+    return variant->exists ? variant : nullptr;
+}
+
+bool StaticFileCache::stillValid(const CachedFile& file) const {
+    struct stat st;
+    if (stat(file.path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return !file.exists;
+    }
+    return file.exists && st.st_size == file.size && st.st_ino == file.inode &&
+           st.st_mtim.tv_sec == file.mtime && st.st_mtim.tv_nsec == file.mtime_nsec;
+}
+
+std::shared_ptr<const CachedFile> StaticFileCache::lookup(const std::string& key) {
+    Shard& shard = shardFor(key);
+    std::shared_ptr<const CachedFile> stale;
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end()) {
+            const std::shared_ptr<const CachedFile>& file = it->second;
+            bool fresh = inotify_fd_ >= 0 ||
+                         steadyNowNs() - file->validated_ns.load(std::memory_order_relaxed) <
+                             std::chrono::nanoseconds(revalidate_interval_).count();
+            if (fresh) {
+                file->last_access.store(clock_.fetch_add(1, std::memory_order_relaxed),
+                                        std::memory_order_relaxed);
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return file;
+            }
+            stale = file;
+        }
+    }
+
+    // 未使用inotify时，过期条目先stat确认文件未变
+    if (stale && stillValid(*stale)) {
+        stale->validated_ns.store(steadyNowNs(), std::memory_order_relaxed);
+        stale->last_access.store(clock_.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return stale;
+    }
+
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    std::shared_ptr<CachedFile> file = load(key);
+    file->last_access.store(clock_.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+    insert(shard, key, file);
+    return file;
+}
+
+void StaticFileCache::insert(Shard& shard, const std::string& key, std::shared_ptr<const CachedFile> file) {
+    size_t budget = max_bytes_ / kShardCount;
+    size_t size = entryBytes(key, *file);
+    if (size > budget) return;
+
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.end()) {
+        shard.bytes -= entryBytes(key, *it->second);
+        it->second = std::move(file);
+    } else {
+        shard.entries.emplace(key, std::move(file));
+    }
+    shard.bytes += size;
+
+    // 淘汰最久未访问的条目，直到回到预算之内
+    while (shard.bytes > budget && shard.entries.size() > 1) {
+        auto victim = shard.entries.end();
+        uint64_t oldest = UINT64_MAX;
+        for (auto entry = shard.entries.begin(); entry != shard.entries.end(); ++entry) {
+            if (entry->first == key) continue;
+            uint64_t access = entry->second->last_access.load(std::memory_order_relaxed);
+            if (access < oldest) {
+                oldest = access;
+                victim = entry;
+            }
+        }
+        if (victim == shard.entries.end()) break;
+        shard.bytes -= entryBytes(victim->first, *victim->second);
+        shard.entries.erase(victim);
+    }
+}
+
+void StaticFileCache::invalidate(const std::string& key) {
+    Shard& shard = shardFor(key);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.end()) {
+        shard.bytes -= entryBytes(key, *it->second);
+        shard.entries.erase(it);
+    }
+}
+
+void StaticFileCache::clear() {
+    for (Shard& shard : shards_) {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        shard.entries.clear();
+        shard.bytes = 0;
+    }
+}
+
+size_t StaticFileCache::bytes() const {
+    size_t total = 0;
+    for (const Shard& shard : shards_) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        total += shard.bytes;
+    }
+    return total;
+}
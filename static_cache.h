@@ -0,0 +1,123 @@
+#ifndef STATIC_CACHE_H
+#define STATIC_CACHE_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+#include "compress.h"
+
+// 缓存的静态文件：响应头块、内容及校验信息在加载时一次性生成
+struct CachedFile {
+    std::string path;            // 文件系统路径
+    bool exists = false;         // 文件是否存在（不存在的路径同样缓存，避免反复访问文件系统）
+    bool in_memory = false;      // 内容是否已载入内存（超过单文件上限的大文件只缓存元数据）
+    std::string content_type;
+    std::string etag;            // 强校验值："大小-修改时间"
+    std::string last_modified;   // HTTP日期格式
+    std::string encoding;        // 预压缩文件（.gz/.br）的内容编码，否则为空
+    std::string headers;         // 预格式化的响应头（Content-Type/Content-Length/ETag/Last-Modified）
+    std::string encoded_headers; // 作为预压缩版本发送时的响应头（原文件类型+Content-Encoding）
+    std::string body;
+    off_t size = 0;
+    time_t mtime = 0;
+    long mtime_nsec = 0;
+    ino_t inode = 0;
+
+    // 近似LRU：最近一次访问的逻辑时钟，读者只更新原子变量无需加写锁
+    mutable std::atomic<uint64_t> last_access{0};
+    // 上次校验时间（steady_clock纳秒，inotify不可用时按间隔重新stat）
+    mutable std::atomic<int64_t> validated_ns{0};
+
+    // 按需压缩的版本（按ContentCoding下标，见StaticFileCache::compressed），随条目一起失效
+    mutable std::mutex variants_mutex;
+    mutable std::shared_ptr<const CachedFile> variants[kContentCodingCount];
+};
+
+// 静态文件缓存：按路径分片的有界缓存
+// 命中时只在分片上加读锁，不访问文件系统；文件变化通过inotify失效，
+// inotify不可用时退化为按固定间隔stat校验
+class StaticFileCache {
+private:
+    static constexpr size_t kShardCount = 16;
+
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<const CachedFile>> entries;
+        size_t bytes = 0;
+    };
+
+    std::string root_;
+    size_t max_bytes_;
+    size_t max_file_size_;
+    Shard shards_[kShardCount];
+    std::atomic<uint64_t> clock_{0};
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+
+    int inotify_fd_ = -1;
+    std::mutex watch_mutex_;
+    std::unordered_map<int, std::string> watch_dirs_;   // 监视描述符 -> 相对目录（以/开头或为空）
+    std::chrono::milliseconds revalidate_interval_{1000};
+
+    Shard& shardFor(const std::string& key) {
+        return shards_[std::hash<std::string>()(key) % kShardCount];
+    }
+    // 从文件系统加载一个条目
+    std::shared_ptr<CachedFile> load(const std::string& key) const;
+    // 条目对应的文件是否未发生变化
+    bool stillValid(const CachedFile& file) const;
+    // 插入条目，超出容量时淘汰最久未访问的条目
+    void insert(Shard& shard, const std::string& key, std::shared_ptr<const CachedFile> file);
+    // 递归添加目录监视
+    void addWatch(const std::string& relative_dir);
+
+public:
+    // root：静态文件根目录；max_bytes：缓存总字节上限；max_file_size：单个文件载入内存的上限
+    StaticFileCache(const std::string& root, size_t max_bytes, size_t max_file_size);
+    ~StaticFileCache();
+
+    StaticFileCache(const StaticFileCache&) = delete;
+    StaticFileCache& operator=(const StaticFileCache&) = delete;
+
+    // 按URL路径（以/开头，已规范化）查找文件，未命中时从文件系统加载
+    std::shared_ptr<const CachedFile> lookup(const std::string& key);
+
+    // 获取内存中的文件按coding压缩后的版本：首次请求时压缩并保存在条目中，之后直接复用
+    // 同一文件同时到达的请求只压缩一次；压缩后没有变小时返回空（以后也不再尝试）
+    // 压缩版本不计入缓存容量
+    std::shared_ptr<const CachedFile> compressed(const std::shared_ptr<const CachedFile>& file, ContentCoding coding,
+                                                 const CompressionConfig& config);
+
+    // 使某个路径的条目失效
+    void invalidate(const std::string& key);
+    // 清空缓存
+    void clear();
+
+    // inotify描述符（不可用时为-1），可注册到事件循环中
+    int watchFd() const { return inotify_fd_; }
+    // 处理inotify事件，使发生变化的文件失效（非阻塞）
+    void processEvents();
+
+    const std::string& root() const { return root_; }
+    uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+    size_t bytes() const;
+};
+
+// 根据扩展名返回MIME类型
+const std::string& mimeTypeFor(std::string_view path);
+
+// 格式化HTTP日期（RFC 7231，如"Sun, 06 Nov 1994 08:49:37 GMT"）
+std::string formatHttpDate(time_t t);
+
+// 解析HTTP日期，格式不正确时返回-1
+time_t parseHttpDate(std::string_view value);
+
+#endif // STATIC_CACHE_H
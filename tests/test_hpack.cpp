@@ -0,0 +1,227 @@
+// HPACK：前缀整数、Huffman编码（含非法填充和EOS）、RFC 7541附录C的示例，以及编码器与解码器的往返
+#include "hpack.h"
+#include "test_util.h"
+#include <random>
+#include <vector>
+
+namespace {
+
+using HeaderList = std::vector<std::pair<std::string, std::string>>;
+
+std::string fromHex(std::string_view hex) {
+    std::string out;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+        out.push_back(static_cast<char>(std::stoi(std::string(hex.substr(i, 2)), nullptr, 16)));
+    }
+    return out;
+}
+
+HpackDecoder::Result decodeBlock(HpackDecoder& decoder, std::string_view block, HeaderList& headers,
+                                 size_t max_list_size = 64 * 1024) {
+    headers.clear();
+    return decoder.decode(block, max_list_size, [&headers](std::string_view name, std::string_view value) {
+        headers.emplace_back(std::string(name), std::string(value));
+    });
+}
+
+void testIntegers() {
+    // RFC 7541 C.1
+    std::string out;
+    hpackEncodeInteger(10, 5, 0, out);
+    CHECK_EQ(out, fromHex("0a"));
+    out.clear();
+    hpackEncodeInteger(1337, 5, 0, out);
+    CHECK_EQ(out, fromHex("1f9a0a"));
+    out.clear();
+    hpackEncodeInteger(42, 8, 0, out);
+    CHECK_EQ(out, fromHex("2a"));
+
+    for (uint64_t value : { 0ULL, 30ULL, 31ULL, 127ULL, 128ULL, 16383ULL, 1ULL << 31, 0xffffffffULL }) {
+        for (unsigned prefix = 1; prefix <= 8; ++prefix) {
+            std::string encoded;
+            hpackEncodeInteger(value, prefix, 0, encoded);
+            std::string_view data(encoded);
+            uint64_t decoded = 0;
+            CHECK(hpackDecodeInteger(data, prefix, decoded));
+            CHECK_EQ(decoded, value);
+            CHECK(data.empty());
+        }
+    }
+
+    // 截断和溢出
+    std::string_view truncated("\x1f\x9a", 2);
+    uint64_t value = 0;
+    CHECK(!hpackDecodeInteger(truncated, 5, value));
+    std::string overflow = fromHex("1fffffffffffffffffffff7f");
+    std::string_view overflow_view(overflow);
+    CHECK(!hpackDecodeInteger(overflow_view, 5, value));
+    // 头部中的整数不超过32位
+    std::string too_large;
+    hpackEncodeInteger(1ULL << 32, 5, 0, too_large);
+    std::string_view too_large_view(too_large);
+    CHECK(!hpackDecodeInteger(too_large_view, 5, value));
+}
+
+void testHuffman() {
+    // RFC 7541 C.4.1
+    std::string encoded;
+    huffmanEncode("www.example.com", encoded);
+    CHECK_EQ(encoded, fromHex("f1e3c2e5f23a6ba0ab90f4ff"));
+    CHECK_EQ(huffmanEncodedSize("www.example.com"), encoded.size());
+
+    // 随机字节的往返
+    std::mt19937 rng(12345);
+    for (int round = 0; round < 200; ++round) {
+        std::string data(rng() % 64, '\0');
+        for (char& ch : data) ch = static_cast<char>(rng() & 0xff);
+        std::string packed;
+        huffmanEncode(data, packed);
+        CHECK_EQ(packed.size(), huffmanEncodedSize(data));
+        std::string unpacked;
+        CHECK(huffmanDecode(packed, unpacked));
+        if (unpacked != data) {
+            CHECK(unpacked == data);
+            break;
+        }
+    }
+
+    std::string out;
+    // 'a'为00011，用1填充：00011111
+    CHECK(huffmanDecode(fromHex("1f"), out));
+    CHECK_EQ(out, "a");
+    // 填充位不全为1
+    out.clear();
+    CHECK(!huffmanDecode(fromHex("18"), out));
+    // 填充超过7位
+    out.clear();
+    CHECK(!huffmanDecode(fromHex("1fff"), out));
+    out.clear();
+    CHECK(!huffmanDecode(fromHex("ff"), out));
+    // 数据中出现EOS（30个1）
+    out.clear();
+    CHECK(!huffmanDecode(fromHex("fffffffc"), out));
+    out.clear();
+    CHECK(!huffmanDecode(fromHex("ffffffff"), out));
+}
+
+void testRfcRequestExamples() {
+    // RFC 7541 C.4：使用Huffman编码的三个连续请求，共享动态表
+    HpackDecoder decoder;
+    HeaderList headers;
+    CHECK(decodeBlock(decoder, fromHex("828684418cf1e3c2e5f23a6ba0ab90f4ff"), headers) == HpackDecoder::Result::Ok);
+    CHECK(headers == HeaderList({ { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" },
+                                  { ":authority", "www.example.com" } }));
+
+    CHECK(decodeBlock(decoder, fromHex("828684be5886a8eb10649cbf"), headers) == HpackDecoder::Result::Ok);
+    CHECK(headers == HeaderList({ { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" },
+                                  { ":authority", "www.example.com" }, { "cache-control", "no-cache" } }));
+
+    CHECK(decodeBlock(decoder, fromHex("828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf"), headers) ==
+          HpackDecoder::Result::Ok);
+    CHECK(headers == HeaderList({ { ":method", "GET" }, { ":scheme", "https" }, { ":path", "/index.html" },
+                                  { ":authority", "www.example.com" }, { "custom-key", "custom-value" } }));
+}
+
+void testDecoderErrors() {
+    HeaderList headers;
+    {
+        // 索引0和超出范围的索引
+        HpackDecoder decoder;
+        CHECK(decodeBlock(decoder, fromHex("80"), headers) == HpackDecoder::Result::Error);
+        HpackDecoder other;
+        CHECK(decodeBlock(other, fromHex("ff00"), headers) == HpackDecoder::Result::Error);
+    }
+    {
+        // 字符串长度超出剩余数据
+        HpackDecoder decoder;
+        CHECK(decodeBlock(decoder, fromHex("400a637573746f6d"), headers) == HpackDecoder::Result::Error);
+    }
+    {
+        // 值的Huffman填充非法
+        HpackDecoder decoder;
+        CHECK(decodeBlock(decoder, fromHex("4003616263" "8118"), headers) == HpackDecoder::Result::Error);
+    }
+    {
+        // 容量更新超过本端通告的上限，或出现在字段之后
+        HpackDecoder decoder(4096);
+        CHECK(decodeBlock(decoder, fromHex("3fe21f"), headers) == HpackDecoder::Result::Error);
+        HpackDecoder other(4096);
+        CHECK(decodeBlock(other, fromHex("823f01"), headers) == HpackDecoder::Result::Error);
+    }
+    {
+        // 超过请求头总大小上限：不再回调，但仍返回TooLarge而不是Error
+        HpackDecoder decoder;
+        CHECK(decodeBlock(decoder, fromHex("828684"), headers, 50) == HpackDecoder::Result::TooLarge);
+        CHECK_EQ(headers.size(), 1u);
+    }
+}
+
+void testEncoderRoundTrip() {
+    HpackEncoder encoder;
+    HpackDecoder decoder;
+    std::vector<HeaderList> blocks = {
+        { { "content-type", "text/html; charset=UTF-8" }, { "server", "webserver" }, { "x-request-id", "1" } },
+        { { "content-type", "text/html; charset=UTF-8" }, { "server", "webserver" }, { "x-request-id", "2" } },
+        { { "set-cookie", "session=secret" }, { "content-length", "1234" }, { "x-custom", std::string(300, 'v') } },
+        { { "server", "webserver" }, { "vary", "Accept-Encoding" } },
+    };
+    size_t first_size = 0;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        std::string block;
+        encoder.beginBlock(block);
+        for (const auto& header : blocks[i]) encoder.encode(header.first, header.second, block);
+        if (i == 0) first_size = block.size();
+        // 第二个头部块的字段已在动态表中，编码后明显更小
+        if (i == 1) CHECK(block.size() < first_size / 2);
+        HeaderList headers;
+        CHECK(decodeBlock(decoder, block, headers) == HpackDecoder::Result::Ok);
+        CHECK(headers == blocks[i]);
+    }
+
+    // 状态码
+    std::string block;
+    encoder.beginBlock(block);
+    encoder.encodeStatus(200, block);
+    encoder.encodeStatus(418, block);
+    HeaderList headers;
+    CHECK(decodeBlock(decoder, block, headers) == HpackDecoder::Result::Ok);
+    CHECK(headers == HeaderList({ { ":status", "200" }, { ":status", "418" } }));
+
+    // 对端缩小动态表后，容量更新写在下一个头部块的开头，解码端随之淘汰条目
+    encoder.setPeerTableSize(64);
+    block.clear();
+    encoder.beginBlock(block);
+    encoder.encode("x-after-resize", "value", block);
+    encoder.encode("server", "webserver", block);
+    CHECK(decodeBlock(decoder, block, headers) == HpackDecoder::Result::Ok);
+    CHECK(headers == HeaderList({ { "x-after-resize", "value" }, { "server", "webserver" } }));
+}
+
+void testDynamicTable() {
+    HpackTable table(100);
+    table.insert("a", std::string(30, 'x'));   // 63
+    CHECK_EQ(table.count(), 1u);
+    table.insert("b", "y");                     // 34，合计97
+    CHECK_EQ(table.count(), 2u);
+    CHECK_EQ(table.at(0).first, "b");
+    table.insert("c", "z");                     // 淘汰最旧的a
+    CHECK_EQ(table.count(), 2u);
+    CHECK_EQ(table.at(1).first, "b");
+    table.insert("big", std::string(200, 'x')); // 本身超过容量：清空
+    CHECK_EQ(table.count(), 0u);
+    table.insert("d", "w");
+    table.setCapacity(0);
+    CHECK_EQ(table.count(), 0u);
+}
+
+} // namespace
+
+int main() {
+    testIntegers();
+    testHuffman();
+    testRfcRequestExamples();
+    testDecoderErrors();
+    testEncoderRoundTrip();
+    testDynamicTable();
+    return test::report("test_hpack");
+}
@@ -0,0 +1,199 @@
+// 请求解析器：完整请求、分段到达、分块请求体的原地解码，以及可能被用于请求走私的长度声明
+#include "webserver.h"
+#include "test_util.h"
+
+namespace {
+
+struct ParseResult {
+    RequestParser::Status status;
+    int error = 0;
+    size_t consumed = 0;
+    std::string body;
+};
+
+// 一次性解析完整的数据（请求头阶段直接继续）
+ParseResult parseAll(std::string data, size_t max_body_size = 8 * 1024 * 1024) {
+    RequestParser parser(64 * 1024, max_body_size);
+    Request req;
+    RequestParser::Status status;
+    do {
+        status = parser.parse(&data[0], data.size(), req);
+    } while (status == RequestParser::Status::Headers);
+    ParseResult result{ status, parser.errorCode(), parser.consumed(), std::string() };
+    if (status == RequestParser::Status::Complete) {
+        req.setRaw(data);
+        result.body = std::string(req.body());
+    }
+    return result;
+}
+
+bool rejected(const std::string& data, int code) {
+    ParseResult result = parseAll(data);
+    return result.status == RequestParser::Status::Error && result.error == code;
+}
+
+void testSimpleRequest() {
+    Request req;
+    CHECK(req.parse("GET /users/42?tab=info&q=a%20b HTTP/1.1\r\nHost: example.com\r\nX-Empty:\r\n\r\n"));
+    CHECK(req.methodId() == HttpMethod::Get);
+    CHECK_EQ(req.path(), "/users/42");
+    CHECK_EQ(req.query(), "tab=info&q=a%20b");
+    CHECK_EQ(req.queryParam("q"), "a b");
+    CHECK_EQ(req.version(), "HTTP/1.1");
+    CHECK_EQ(req.header("host"), "example.com");
+    CHECK_EQ(req.header("X-Empty"), "");
+    CHECK(req.keepAlive());
+
+    CHECK(rejected("GET / HTTP/2.0\r\n\r\n", 505));
+    CHECK(rejected("GET /\r\n\r\n", 400));
+    // 已废弃的多行折叠头部
+    CHECK(rejected("GET / HTTP/1.1\r\nA: b\r\n  c\r\n\r\n", 400));
+    // 名称与冒号之间不能有空白
+    CHECK(rejected("GET / HTTP/1.1\r\nHost : a\r\n\r\n", 400));
+}
+
+void testIncrementalHeaders() {
+    // 逐字节到达：每次传入从请求起始处开始的完整缓冲区
+    std::string full = "POST /submit HTTP/1.1\r\nHost: a\r\nContent-Length: 5\r\n\r\nhello";
+    RequestParser parser;
+    Request req;
+    std::string buffer;
+    RequestParser::Status status = RequestParser::Status::Incomplete;
+    bool saw_headers = false;
+    for (char ch : full) {
+        buffer.push_back(ch);
+        status = parser.parse(&buffer[0], buffer.size(), req);
+        if (status == RequestParser::Status::Headers) {
+            saw_headers = true;
+            status = parser.parse(&buffer[0], buffer.size(), req);
+        }
+        if (status != RequestParser::Status::Incomplete) break;
+    }
+    CHECK(saw_headers);
+    CHECK(status == RequestParser::Status::Complete);
+    CHECK_EQ(parser.consumed(), full.size());
+    req.setRaw(buffer);
+    CHECK_EQ(req.body(), "hello");
+    CHECK_EQ(req.header("Content-Length"), "5");
+}
+
+void testPipelinedRequests() {
+    std::string first = "GET /a HTTP/1.1\r\nHost: a\r\n\r\n";
+    ParseResult result = parseAll(first + "GET /b HTTP/1.1\r\n\r\n");
+    CHECK(result.status == RequestParser::Status::Complete);
+    CHECK_EQ(result.consumed, first.size());
+}
+
+void testContentLength() {
+    // 相同的重复值可以接受
+    ParseResult same = parseAll("POST / HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 3\r\n\r\nabc");
+    CHECK(same.status == RequestParser::Status::Complete);
+    CHECK_EQ(same.body, "abc");
+
+    // 不同的重复值、带符号或非数字的值都拒绝
+    CHECK(rejected("POST / HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 4\r\n\r\nabcd", 400));
+    CHECK(rejected("POST / HTTP/1.1\r\nContent-Length: +3\r\n\r\nabc", 400));
+    CHECK(rejected("POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\n", 400));
+    CHECK(rejected("POST / HTTP/1.1\r\nContent-Length: 3, 3\r\n\r\nabc", 400));
+    CHECK(rejected("POST / HTTP/1.1\r\nContent-Length: 0x10\r\n\r\n", 400));
+    CHECK(rejected("POST / HTTP/1.1\r\nContent-Length:\r\n\r\n", 400));
+    // 超过19位的值（可能溢出）
+    CHECK(rejected("POST / HTTP/1.1\r\nContent-Length: 99999999999999999999\r\n\r\n", 400));
+    // 超出请求体上限
+    ParseResult large = parseAll("POST / HTTP/1.1\r\nContent-Length: 100\r\n\r\n", 10);
+    CHECK(large.status == RequestParser::Status::Error);
+    CHECK_EQ(large.error, 413);
+}
+
+void testTransferEncoding() {
+    // 同时出现Content-Length和Transfer-Encoding（两种顺序）
+    CHECK(rejected("POST / HTTP/1.1\r\nContent-Length: 5\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n", 400));
+    CHECK(rejected("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nContent-Length: 5\r\n\r\n0\r\n\r\n", 400));
+    // 只支持单独的chunked
+    CHECK(rejected("POST / HTTP/1.1\r\nTransfer-Encoding: gzip, chunked\r\n\r\n0\r\n\r\n", 501));
+    CHECK(rejected("POST / HTTP/1.1\r\nTransfer-Encoding: identity\r\n\r\n", 501));
+}
+
+void testChunkedBody() {
+    std::string data = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                       "5\r\nhello\r\n"
+                       "1;ext=1\r\n,\r\n"
+                       "6\r\n world\r\n"
+                       "0\r\nX-Trailer: 1\r\n\r\n";
+    ParseResult result = parseAll(data);
+    CHECK(result.status == RequestParser::Status::Complete);
+    CHECK_EQ(result.body, "hello, world");
+    CHECK_EQ(result.consumed, data.size());
+
+    // 分段到达：在任意位置切开都得到相同的结果
+    for (size_t split = 1; split < data.size(); ++split) {
+        RequestParser parser;
+        Request req;
+        std::string buffer = data.substr(0, split);
+        RequestParser::Status status;
+        do {
+            status = parser.parse(&buffer[0], buffer.size(), req);
+        } while (status == RequestParser::Status::Headers);
+        if (status == RequestParser::Status::Incomplete) {
+            buffer.append(data, split, std::string::npos);
+            do {
+                status = parser.parse(&buffer[0], buffer.size(), req);
+            } while (status == RequestParser::Status::Headers);
+        }
+        CHECK(status == RequestParser::Status::Complete);
+        req.setRaw(buffer);
+        if (req.body() != "hello, world") {
+            CHECK_EQ(req.body(), "hello, world");
+            break;
+        }
+    }
+}
+
+void testChunkSizeLimits() {
+    // 分块大小超过15位十六进制数（可能溢出）
+    CHECK(rejected("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                   "10000000000000000\r\n", 400));
+    CHECK(rejected("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                   "ffffffffffffffff\r\n", 400));
+    // 15位以内但超出请求体上限
+    CHECK(rejected("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                   "fffffffffffffff\r\n", 413));
+    // 多个分块累计超出上限
+    ParseResult total = parseAll("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                                 "8\r\n12345678\r\n8\r\n12345678\r\n0\r\n\r\n", 10);
+    CHECK(total.status == RequestParser::Status::Error);
+    CHECK_EQ(total.error, 413);
+    // 非法的分块大小和缺少分块结尾的CRLF
+    CHECK(rejected("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                   "-1\r\n", 400));
+    CHECK(rejected("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                   "\r\n", 400));
+    CHECK(rejected("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                   "3\r\nabcX\r\n0\r\n\r\n", 400));
+}
+
+void testHeaderLimits() {
+    std::string many = "GET / HTTP/1.1\r\n";
+    for (size_t i = 0; i <= Request::kMaxHeaders; ++i) many += "X-H" + std::to_string(i) + ": v\r\n";
+    CHECK(rejected(many + "\r\n", 431));
+
+    RequestParser parser(64, 1024);
+    Request req;
+    std::string data = "GET /" + std::string(100, 'a') + " HTTP/1.1\r\n\r\n";
+    CHECK(parser.parse(&data[0], data.size(), req) == RequestParser::Status::Error);
+    CHECK_EQ(parser.errorCode(), 431);
+}
+
+} // namespace
+
+int main() {
+    testSimpleRequest();
+    testIncrementalHeaders();
+    testPipelinedRequests();
+    testContentLength();
+    testTransferEncoding();
+    testChunkedBody();
+    testChunkSizeLimits();
+    testHeaderLimits();
+    return test::report("test_parser");
+}
@@ -0,0 +1,333 @@
+// 路由响应缓存：TTL、stale-while-revalidate的期限、并发未命中的合并、缓存键和不可缓存的响应
+#include "response_cache.h"
+#include "test_util.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+using namespace std::chrono_literals;
+
+// 每次执行返回"gen N"的处理函数，可选地模拟耗时
+struct CountingHandler {
+    std::shared_ptr<std::atomic<int>> calls = std::make_shared<std::atomic<int>>(0);
+    std::chrono::milliseconds delay{0};
+
+    HandlerFunc func() const {
+        return [calls = calls, delay = delay](const Request&, Response& res) {
+            int generation = calls->fetch_add(1) + 1;
+            if (delay.count() > 0) std::this_thread::sleep_for(delay);
+            res.setHeader("Content-Type", "text/plain");
+            res.setContent("gen " + std::to_string(generation));
+        };
+    }
+    int count() const { return calls->load(); }
+};
+
+Request makeRequest(const std::string& target, const std::string& headers = std::string()) {
+    Request req;
+    req.parse("GET " + target + " HTTP/1.1\r\nHost: test\r\n" + headers + "\r\n");
+    return req;
+}
+
+// 取出响应体：缓存生成的响应体是共享的分段数据，经套接字对读出
+std::string bodyOf(Response& res) {
+    OutputBuffer out;
+    res.moveBodyTo(out, false);
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) return "<socketpair failed>";
+    size_t written = 0;
+    out.writeTo(fds[0], written);
+    close(fds[0]);
+    std::string body;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(fds[1], buffer, sizeof(buffer))) > 0) body.append(buffer, static_cast<size_t>(n));
+    close(fds[1]);
+    return body;
+}
+
+CompressionConfig noCompression() {
+    CompressionConfig config;
+    config.enabled = false;
+    return config;
+}
+
+std::string fetch(ResponseCache& cache, const std::string& target,
+                  const CacheRefreshExecutor& executor = CacheRefreshExecutor()) {
+    Request req = makeRequest(target);
+    Response res;
+    cache.handle(req, res, noCompression(), executor);
+    return bodyOf(res);
+}
+
+void testTtl() {
+    CountingHandler handler;
+    RouteCacheOptions options;
+    options.ttl = 100ms;
+    auto cache = std::make_shared<ResponseCache>("/ttl", handler.func(), options);
+
+    CHECK_EQ(fetch(*cache, "/ttl"), "gen 1");
+    CHECK_EQ(fetch(*cache, "/ttl"), "gen 1");
+    CHECK_EQ(handler.count(), 1);
+    CHECK_EQ(cache->misses(), 1u);
+    CHECK_EQ(cache->hits(), 1u);
+
+    // 过期且没有stale_while_revalidate：重新执行处理函数
+    std::this_thread::sleep_for(150ms);
+    CHECK_EQ(fetch(*cache, "/ttl"), "gen 2");
+    CHECK_EQ(handler.count(), 2);
+    CHECK_EQ(cache->staleHits(), 0u);
+
+    cache->clear();
+    CHECK_EQ(cache->size(), 0u);
+    CHECK_EQ(fetch(*cache, "/ttl"), "gen 3");
+}
+
+void testStaleWhileRevalidate() {
+    CountingHandler handler;
+    RouteCacheOptions options;
+    options.ttl = 50ms;
+    options.stale_while_revalidate = 2000ms;
+    auto cache = std::make_shared<ResponseCache>("/swr", handler.func(), options);
+
+    // 后台刷新任务先保存起来，由测试决定何时执行
+    std::vector<std::function<void()>> tasks;
+    CacheRefreshExecutor executor = [&tasks](std::function<void()> task) {
+        tasks.push_back(std::move(task));
+        return true;
+    };
+
+    CHECK_EQ(fetch(*cache, "/swr", executor), "gen 1");
+    std::this_thread::sleep_for(80ms);
+    // 过期后仍返回旧结果，只提交一次刷新
+    CHECK_EQ(fetch(*cache, "/swr", executor), "gen 1");
+    CHECK_EQ(fetch(*cache, "/swr", executor), "gen 1");
+    CHECK_EQ(tasks.size(), 1u);
+    CHECK_EQ(cache->staleHits(), 2u);
+    CHECK_EQ(handler.count(), 1);
+
+    tasks.front()();
+    CHECK_EQ(handler.count(), 2);
+    CHECK_EQ(fetch(*cache, "/swr", executor), "gen 2");
+    CHECK_EQ(cache->hits(), 1u);
+
+    // 没有后台执行者（或被拒绝）时由请求同步刷新，直接返回新结果
+    std::this_thread::sleep_for(80ms);
+    CHECK_EQ(fetch(*cache, "/swr", [](std::function<void()>) { return false; }), "gen 3");
+    CHECK_EQ(fetch(*cache, "/swr"), "gen 3");
+}
+
+void testStaleLimit() {
+    // 超过ttl+stale_while_revalidate的结果不再返回
+    CountingHandler handler;
+    RouteCacheOptions options;
+    options.ttl = 50ms;
+    options.stale_while_revalidate = 50ms;
+    auto cache = std::make_shared<ResponseCache>("/limit", handler.func(), options);
+    std::vector<std::function<void()>> tasks;
+    CacheRefreshExecutor executor = [&tasks](std::function<void()> task) {
+        tasks.push_back(std::move(task));
+        return true;
+    };
+
+    CHECK_EQ(fetch(*cache, "/limit", executor), "gen 1");
+    std::this_thread::sleep_for(150ms);
+    CHECK_EQ(fetch(*cache, "/limit", executor), "gen 2");
+    CHECK(tasks.empty());
+    CHECK_EQ(cache->staleHits(), 0u);
+}
+
+void testCoalescing() {
+    // 工作线程上同时未命中的相同请求只执行一次处理函数，其余等待它的结果
+    CountingHandler handler;
+    handler.delay = 200ms;
+    RouteCacheOptions options;
+    options.ttl = 5000ms;
+    auto cache = std::make_shared<ResponseCache>("/slow", handler.func(), options);
+
+    const int kThreads = 8;
+    std::vector<std::string> bodies(kThreads);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreads; ++i) {
+        threads.emplace_back([&, i]() { bodies[i] = fetch(*cache, "/slow"); });
+    }
+    for (std::thread& thread : threads) thread.join();
+
+    CHECK_EQ(handler.count(), 1);
+    CHECK_EQ(cache->misses(), 1u);
+    CHECK_EQ(cache->coalesced() + cache->hits(), static_cast<uint64_t>(kThreads - 1));
+    for (const std::string& body : bodies) CHECK_EQ(body, "gen 1");
+}
+
+void testCacheKey() {
+    CountingHandler handler;
+    RouteCacheOptions options;
+    options.query_params = { "page" };
+    options.headers = { "Accept-Language" };
+    auto cache = std::make_shared<ResponseCache>("/list", handler.func(), options);
+
+    CHECK_EQ(fetch(*cache, "/list?page=1"), "gen 1");
+    // 不参与缓存键的查询参数被忽略
+    CHECK_EQ(fetch(*cache, "/list?page=1&utm=x"), "gen 1");
+    CHECK_EQ(fetch(*cache, "/list?page=2"), "gen 2");
+    CHECK_EQ(fetch(*cache, "/list"), "gen 3");
+
+    Request req = makeRequest("/list?page=1", "Accept-Language: fr\r\n");
+    Response res;
+    cache->handle(req, res, noCompression(), CacheRefreshExecutor());
+    CHECK_EQ(bodyOf(res), "gen 4");
+    CHECK_EQ(cache->size(), 4u);
+}
+
+void testUncacheable() {
+    auto calls = std::make_shared<std::atomic<int>>(0);
+    RouteCacheOptions options;
+    auto cache = std::make_shared<ResponseCache>("/private", [calls](const Request&, Response& res) {
+        calls->fetch_add(1);
+        res.setHeader("Set-Cookie", "session=1");
+        res.setContent("secret");
+    }, options);
+    fetch(*cache, "/private");
+    fetch(*cache, "/private");
+    CHECK_EQ(calls->load(), 2);
+    CHECK_EQ(cache->size(), 0u);
+
+    auto errors = std::make_shared<std::atomic<int>>(0);
+    auto failing = std::make_shared<ResponseCache>("/error", [errors](const Request&, Response& res) {
+        errors->fetch_add(1);
+        res.setStatusCode(500, "Internal Server Error");
+        res.setContent("error");
+    }, options);
+    fetch(*failing, "/error");
+    fetch(*failing, "/error");
+    CHECK_EQ(errors->load(), 2);
+}
+
+void testCallerHeadersStayOutOfCache() {
+    // 调用者（全局中间件）已设置的响应头保留在本次响应中，但不进入缓存条目
+    CountingHandler handler;
+    RouteCacheOptions options;
+    auto cache = std::make_shared<ResponseCache>("/headers", handler.func(), options);
+
+    Request req = makeRequest("/headers");
+    Response first;
+    first.setHeader("X-Request-Id", "a");
+    cache->handle(req, first, noCompression(), CacheRefreshExecutor());
+    CHECK_EQ(first.header("X-Request-Id"), "a");
+    CHECK_EQ(first.header("Content-Type"), "text/plain");
+
+    Response second;
+    cache->handle(req, second, noCompression(), CacheRefreshExecutor());
+    CHECK_EQ(second.header("X-Request-Id"), "");
+    CHECK_EQ(bodyOf(second), "gen 1");
+}
+
+int64_t steadyNowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 通过回环地址发送一个GET请求（Connection: close），返回响应体，连接失败时返回空
+std::string httpGet(int port, const std::string& path) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return std::string();
+    }
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+    send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+    std::string response;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) response.append(buffer, static_cast<size_t>(n));
+    close(fd);
+    size_t body = response.find("\r\n\r\n");
+    return body == std::string::npos ? std::string() : response.substr(body + 4);
+}
+
+void testMultiReactorNeverServesExpired() {
+    // 多反应器模式：处理函数直接在事件循环线程上执行，相同请求不等待彼此。
+    // 响应体带有生成时刻，任何请求都不能收到生成超过ttl+stale_while_revalidate的结果
+    const int64_t kTtlMs = 100;
+    const int64_t kStaleMs = 100;
+    const int port = 20000 + static_cast<int>(getpid() % 20000);
+    auto calls = std::make_shared<std::atomic<int>>(0);
+
+    WebServer server(port, 2);
+    server.config().reactor_count = 4;
+    server.config().pin_reactors = false;
+    server.config().handle_signals = false;
+    server.config().shutdown_timeout_ms = 1000;
+    RouteCacheOptions options;
+    options.ttl = std::chrono::milliseconds(kTtlMs);
+    options.stale_while_revalidate = std::chrono::milliseconds(kStaleMs);
+    server.router().get("/gen", [calls](const Request&, Response& res) {
+        calls->fetch_add(1);
+        std::this_thread::sleep_for(300ms);
+        res.setHeader("Content-Type", "text/plain");
+        res.setContent(std::to_string(steadyNowMs()));
+    }, options);
+    std::thread runner([&server]() { server.start(); });
+
+    bool ready = false;
+    for (int i = 0; i < 200 && !ready; ++i) {
+        ready = !httpGet(port, "/gen").empty();
+        if (!ready) std::this_thread::sleep_for(10ms);
+    }
+    CHECK(ready);
+
+    if (ready) {
+        // 每一轮先等结果彻底过期，再同时发出一批请求（分散到各个反应器）
+        const int kRequests = 20;
+        for (int round = 0; round < 3; ++round) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(kTtlMs + kStaleMs + 300));
+            std::vector<int64_t> sent(kRequests);
+            std::vector<std::string> bodies(kRequests);
+            std::vector<std::thread> clients;
+            for (int i = 0; i < kRequests; ++i) {
+                clients.emplace_back([&, i]() {
+                    sent[i] = steadyNowMs();
+                    bodies[i] = httpGet(port, "/gen");
+                });
+            }
+            for (std::thread& client : clients) client.join();
+            for (int i = 0; i < kRequests; ++i) {
+                CHECK(!bodies[i].empty());
+                if (bodies[i].empty()) continue;
+                int64_t age = sent[i] - std::stoll(bodies[i]);
+                if (age > kTtlMs + kStaleMs) CHECK_EQ(age, kTtlMs + kStaleMs);
+            }
+        }
+
+        // 事件循环线程上各自执行的结果也会保存：随后的请求直接命中，不再执行处理函数
+        int before = calls->load();
+        for (int i = 0; i < 8; ++i) CHECK(!httpGet(port, "/gen").empty());
+        CHECK_EQ(calls->load(), before);
+    }
+
+    server.shutdown();
+    runner.join();
+}
+
+} // namespace
+
+int main() {
+    testTtl();
+    testStaleWhileRevalidate();
+    testStaleLimit();
+    testCoalescing();
+    testCacheKey();
+    testUncacheable();
+    testCallerHeadersStayOutOfCache();
+    testMultiReactorNeverServesExpired();
+    return test::report("test_response_cache");
+}
@@ -0,0 +1,157 @@
+// 路由树：静态段 > 参数段 > 通配段的优先级，匹配失败时回溯到参数段和通配段，以及Router的分发
+#include "webserver.h"
+#include "test_util.h"
+#include <stdexcept>
+
+namespace {
+
+// 按路由的标签区分匹配到的是哪一条
+Route labeled(std::string* hit, const std::string& label) {
+    Route route;
+    route.handler = [hit, label](const Request&, Response&) { *hit = label; };
+    return route;
+}
+
+// 查找path并返回匹配到的路由标签，未匹配时为空
+std::string lookup(const RouteTree& tree, std::string* hit, std::string_view path, RouteTree::Match& match) {
+    match = RouteTree::Match();
+    hit->clear();
+    const Route* route = tree.find(path, match);
+    if (route == nullptr) return std::string();
+    Request req;
+    Response res;
+    route->handler(req, res);
+    return *hit;
+}
+
+std::string paramOf(const RouteTree::Match& match, std::string_view name) {
+    for (size_t i = 0; i < match.count; ++i) {
+        if (match.names[i] == name) return std::string(match.values[i]);
+    }
+    return "<none>";
+}
+
+void testPriorityAndBacktracking() {
+    std::string hit;
+    RouteTree tree;
+    tree.insert("/users/new", labeled(&hit, "static"));
+    tree.insert("/users/:id/profile", labeled(&hit, "param"));
+    tree.insert("/users/*rest", labeled(&hit, "wildcard"));
+    tree.insert("/a/b/c", labeled(&hit, "abc"));
+    tree.insert("/a/:x/d", labeled(&hit, "axd"));
+    tree.insert("/", labeled(&hit, "root"));
+
+    RouteTree::Match match;
+    CHECK_EQ(lookup(tree, &hit, "/users/new", match), "static");
+    CHECK_EQ(match.count, 0u);
+
+    CHECK_EQ(lookup(tree, &hit, "/users/42/profile", match), "param");
+    CHECK_EQ(paramOf(match, "id"), "42");
+
+    // 静态段new匹配后剩余/profile无路可走：回溯到参数段
+    CHECK_EQ(lookup(tree, &hit, "/users/new/profile", match), "param");
+    CHECK_EQ(paramOf(match, "id"), "new");
+    CHECK_EQ(match.count, 1u);
+
+    // 参数段之后不匹配：回溯到通配段，参数段留下的值被丢弃
+    CHECK_EQ(lookup(tree, &hit, "/users/42/settings", match), "wildcard");
+    CHECK_EQ(paramOf(match, "rest"), "42/settings");
+    CHECK_EQ(paramOf(match, "id"), "<none>");
+    CHECK_EQ(match.count, 1u);
+
+    CHECK_EQ(lookup(tree, &hit, "/users/new/other", match), "wildcard");
+    CHECK_EQ(paramOf(match, "rest"), "new/other");
+
+    // 共享前缀的静态段和参数段
+    CHECK_EQ(lookup(tree, &hit, "/a/b/c", match), "abc");
+    CHECK_EQ(lookup(tree, &hit, "/a/b/d", match), "axd");
+    CHECK_EQ(paramOf(match, "x"), "b");
+    CHECK_EQ(lookup(tree, &hit, "/a/zz/d", match), "axd");
+    CHECK_EQ(lookup(tree, &hit, "/a/b/e", match), "");
+    CHECK_EQ(lookup(tree, &hit, "/a/b", match), "");
+
+    CHECK_EQ(lookup(tree, &hit, "/", match), "root");
+    CHECK_EQ(lookup(tree, &hit, "/user", match), "");
+    // 参数段不能为空
+    CHECK_EQ(lookup(tree, &hit, "/users//profile", match), "wildcard");
+}
+
+void testStaticEdgeSplitting() {
+    // 后注册的路由拆分已压缩的边
+    std::string hit;
+    RouteTree tree;
+    tree.insert("/static/images", labeled(&hit, "images"));
+    tree.insert("/static/index", labeled(&hit, "index"));
+    tree.insert("/stat", labeled(&hit, "stat"));
+    tree.insert("/static/i", labeled(&hit, "i"));
+
+    RouteTree::Match match;
+    CHECK_EQ(lookup(tree, &hit, "/static/images", match), "images");
+    CHECK_EQ(lookup(tree, &hit, "/static/index", match), "index");
+    CHECK_EQ(lookup(tree, &hit, "/stat", match), "stat");
+    CHECK_EQ(lookup(tree, &hit, "/static/i", match), "i");
+    CHECK_EQ(lookup(tree, &hit, "/static/im", match), "");
+    CHECK_EQ(lookup(tree, &hit, "/static", match), "");
+}
+
+void testInvalidPatterns() {
+    std::string hit;
+    RouteTree tree;
+    tree.insert("/files/:id", labeled(&hit, "id"));
+    bool threw = false;
+    try {
+        tree.insert("/files/*path/more", labeled(&hit, "bad"));
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    // 同一位置的参数名冲突
+    threw = false;
+    try {
+        tree.insert("/files/:name/raw", labeled(&hit, "bad"));
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+void testRouterDispatch() {
+    Router router;
+    router.get("/users/:id", [](const Request& req, Response& res) {
+        res.setContent("user " + std::string(req.param("id")));
+    });
+    router.get("/files/*path", [](const Request& req, Response& res) {
+        res.setContent("file " + std::string(req.param("path")));
+    });
+    router.post("/users/:id", [](const Request& req, Response& res) {
+        res.setContent("post " + std::string(req.param("id")));
+    });
+
+    auto dispatch = [&router](const std::string& raw) {
+        Request req;
+        if (!req.parse(raw)) return std::string("<parse error>");
+        Response res;
+        router.handle(req, res);
+        std::string response = res.buildResponse();
+        return std::to_string(res.statusCode()) + " " + response.substr(response.find("\r\n\r\n") + 4);
+    };
+
+    CHECK_EQ(dispatch("GET /users/7 HTTP/1.1\r\n\r\n"), "200 user 7");
+    CHECK_EQ(dispatch("POST /users/7 HTTP/1.1\r\nContent-Length: 0\r\n\r\n"), "200 post 7");
+    CHECK_EQ(dispatch("GET /files/a/b/c.txt HTTP/1.1\r\n\r\n"), "200 file a/b/c.txt");
+    // HEAD没有单独注册时使用GET的路由
+    CHECK_EQ(dispatch("HEAD /users/7 HTTP/1.1\r\n\r\n").substr(0, 3), "200");
+    CHECK_EQ(dispatch("GET /users/7/extra HTTP/1.1\r\n\r\n").substr(0, 3), "404");
+    CHECK_EQ(dispatch("DELETE /users/7 HTTP/1.1\r\n\r\n").substr(0, 3), "404");
+}
+
+} // namespace
+
+int main() {
+    testPriorityAndBacktracking();
+    testStaticEdgeSplitting();
+    testInvalidPatterns();
+    testRouterDispatch();
+    return test::report("test_router");
+}
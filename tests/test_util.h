@@ -0,0 +1,48 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+// 单元测试用的断言：失败时输出位置后继续执行，程序结束时以失败数决定返回值（由ctest判断）
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace test {
+
+inline int& failures() {
+    static int count = 0;
+    return count;
+}
+
+inline void fail(const char* file, int line, const std::string& message) {
+    ++failures();
+    std::cerr << file << ":" << line << ": " << message << std::endl;
+}
+
+template <typename A, typename B>
+void checkEqual(const A& actual, const B& expected, const char* expr, const char* file, int line) {
+    if (actual == expected) return;
+    std::ostringstream message;
+    message << "CHECK_EQ(" << expr << ") 实际为 " << actual << "，应为 " << expected;
+    fail(file, line, message.str());
+}
+
+// 输出结果，作为main的返回值
+inline int report(const char* name) {
+    if (failures() == 0) {
+        std::cout << name << ": 全部通过" << std::endl;
+        return 0;
+    }
+    std::cerr << name << ": " << failures() << " 项失败" << std::endl;
+    return 1;
+}
+
+} // namespace test
+
+#define CHECK(cond)                                                      \
+    do {                                                                 \
+        if (!(cond)) test::fail(__FILE__, __LINE__, "CHECK(" #cond ")"); \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) test::checkEqual((actual), (expected), #actual ", " #expected, __FILE__, __LINE__)
+
+#endif // TEST_UTIL_H
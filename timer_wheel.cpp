@@ -0,0 +1,97 @@
+#include "timer_wheel.h"
+#include <algorithm>
+
+void TimerWheel::Timer::cancel() {
+    if (wheel_ == nullptr) return;
+    unlink();
+    --wheel_->count_;
+    wheel_ = nullptr;
+}
+
+TimerWheel::TimerWheel(Clock::duration tick, Clock::time_point now) : tick_(tick), origin_(now) {
+}
+
+TimerWheel::~TimerWheel() {
+    // 仍在轮中的定时器与哨兵脱离，之后它们的析构不再访问时间轮
+    for (auto& level : slots_) {
+        for (Timer& head : level) {
+            while (head.next_ != &head) {
+                Timer* timer = head.next_;
+                timer->unlink();
+                timer->wheel_ = nullptr;
+            }
+        }
+    }
+}
+
+void TimerWheel::place(Timer& timer) {
+    // 超出最高层范围的到期时间截断为最远的刻度
+    const uint64_t max_delta = (uint64_t(1) << (kSlotBits * kLevels)) - 1;
+    uint64_t delta = timer.deadline_ - current_;
+    if (delta > max_delta) {
+        delta = max_delta;
+        timer.deadline_ = current_ + max_delta;
+    }
+    unsigned level = 0;
+    while (delta >= (uint64_t(1) << (kSlotBits * (level + 1)))) ++level;
+
+    Timer& head = slots_[level][(timer.deadline_ >> (kSlotBits * level)) & kSlotMask];
+    timer.prev_ = head.prev_;
+    timer.next_ = &head;
+    head.prev_->next_ = &timer;
+    head.prev_ = &timer;
+}
+
+void TimerWheel::schedule(Timer& timer, Clock::time_point deadline) {
+    timer.cancel();
+    // 向上取整到刻度，不会早于deadline到期
+    uint64_t tick = deadline <= origin_ ? 0 : static_cast<uint64_t>((deadline - origin_ + tick_ - Clock::duration(1)) / tick_);
+    timer.deadline_ = std::max(tick, current_);
+    timer.wheel_ = this;
+    ++count_;
+    place(timer);
+}
+
+void TimerWheel::collect(Timer& expired) {
+    // 下层转完一圈：把上一层当前槽位的定时器按剩余时间重新放置（此时它们都落在更低的层）
+    for (unsigned level = 1; level < kLevels; ++level) {
+        if (((current_ >> (kSlotBits * (level - 1))) & kSlotMask) != 0) break;
+        Timer& head = slots_[level][(current_ >> (kSlotBits * level)) & kSlotMask];
+        while (head.next_ != &head) {
+            Timer* timer = head.next_;
+            timer->unlink();
+            place(*timer);
+        }
+    }
+
+    // 第0层当前槽位中的定时器都在本刻度到期
+    Timer& head = slots_[0][current_ & kSlotMask];
+    if (head.next_ != &head) {
+        expired.next_ = head.next_;
+        expired.prev_ = head.prev_;
+        expired.next_->prev_ = &expired;
+        expired.prev_->next_ = &expired;
+        head.prev_ = head.next_ = &head;
+    }
+    ++current_;
+}
+
+int TimerWheel::nextTimeout(Clock::time_point now, int max_ms) const {
+    if (count_ == 0) return max_ms;
+
+    // 第0层本圈内最近的非空槽位；都为空时到下一次下移时再处理
+    // current_恰好是一圈的开始时，上层槽位尚未下移，需要先处理这一刻度
+    uint64_t next = (current_ & kSlotMask) == 0 ? current_ : (current_ | kSlotMask) + 1;
+    for (uint64_t tick = current_; tick < next; ++tick) {
+        const Timer& head = slots_[0][tick & kSlotMask];
+        if (head.next_ != &head) {
+            next = tick;
+            break;
+        }
+    }
+    Clock::duration wait = origin_ + tick_ * static_cast<Clock::rep>(next) - now;
+    if (wait <= Clock::duration::zero()) return 0;
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(wait + std::chrono::milliseconds(1) -
+                                                                    std::chrono::nanoseconds(1));
+    return static_cast<int>(std::min<int64_t>(ms.count(), max_ms));
+}
@@ -0,0 +1,99 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// 分层时间轮：4层、每层64个槽位，第0层每个槽位一个刻度，上层每个槽位覆盖下一层的一整圈
+// 添加、重新设置和取消定时器都是O(1)（只改链表指针，不分配内存），适合每个连接一个、频繁顺延的超时
+// 上层的定时器在下层转完一圈时整槽下移，到期时间的精度为一个刻度
+// 只能在单个线程上使用
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // 侵入式定时器：嵌入在所属对象中，销毁前自动取消；不可复制或移动
+    class Timer {
+    private:
+        friend class TimerWheel;
+        Timer* prev_;
+        Timer* next_;
+        TimerWheel* wheel_ = nullptr;   // 已设置时为所在的时间轮
+        uint64_t deadline_ = 0;         // 到期的刻度
+
+        void unlink() {
+            prev_->next_ = next_;
+            next_->prev_ = prev_;
+            prev_ = next_ = this;
+        }
+
+    public:
+        void* owner = nullptr;          // 所属对象，由使用者设置，到期回调中用于找回对象
+
+        Timer() : prev_(this), next_(this) {}
+        ~Timer() { cancel(); }
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        bool armed() const { return wheel_ != nullptr; }
+        // 取消（未设置时不做任何事）
+        void cancel();
+    };
+
+private:
+    static const unsigned kLevels = 4;
+    static const unsigned kSlotBits = 6;
+    static const unsigned kSlots = 1u << kSlotBits;
+    static const uint64_t kSlotMask = kSlots - 1;
+
+    Clock::duration tick_;
+    Clock::time_point origin_;
+    uint64_t current_ = 0;              // 下一个要处理的刻度
+    size_t count_ = 0;                  // 已设置的定时器数
+    Timer slots_[kLevels][kSlots];      // 各槽位链表的哨兵
+
+    uint64_t tickOf(Clock::time_point time) const {
+        return time <= origin_ ? 0 : static_cast<uint64_t>((time - origin_) / tick_);
+    }
+    // 按到期刻度放入对应层的槽位
+    void place(Timer& timer);
+    // 处理刻度current_：必要时把上层槽位下移，取出本刻度到期的定时器放入expired，然后前进一个刻度
+    void collect(Timer& expired);
+
+public:
+    explicit TimerWheel(Clock::duration tick = std::chrono::milliseconds(10), Clock::time_point now = Clock::now());
+    ~TimerWheel();
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // 设置（或重新设置）timer在deadline到期；已经过去的时间在下一个刻度到期
+    void schedule(Timer& timer, Clock::time_point deadline);
+
+    // 处理到now为止到期的定时器：逐个取消后调用on_expire(timer)
+    // 回调中可以设置或取消任意定时器（包括本刻度尚未回调的定时器）
+    template <typename F>
+    void advance(Clock::time_point now, F&& on_expire) {
+        uint64_t target = tickOf(now);
+        while (current_ <= target) {
+            if (count_ == 0) {
+                current_ = target + 1;
+                break;
+            }
+            Timer expired;
+            collect(expired);
+            while (expired.next_ != &expired) {
+                Timer* timer = expired.next_;
+                timer->cancel();
+                on_expire(*timer);
+            }
+        }
+    }
+
+    // 距下一次需要调用advance的毫秒数（向上取整，最多max_ms）
+    int nextTimeout(Clock::time_point now, int max_ms) const;
+
+    size_t size() const { return count_; }
+};
+
+#endif // TIMER_WHEEL_H
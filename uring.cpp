@@ -0,0 +1,347 @@
+#include "uring.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+
+// 需要的内核接口在编译时的头文件中都存在时才启用
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_ACCEPT_MULTISHOT) && defined(IORING_ENTER_EXT_ARG) && \
+    defined(IORING_RSRC_REGISTER_SPARSE) && defined(__NR_io_uring_setup)
+#define URING_SUPPORTED 1
+#endif
+
+#ifdef URING_SUPPORTED
+
+namespace {
+
+// 提供缓冲区环的组号（每个实例只有一组）
+const uint16_t kBufferGroup = 0;
+
+template <typename T>
+T loadAcquire(const T* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+template <typename T>
+void storeRelease(T* p, T value) {
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+int uringRegister(int fd, unsigned opcode, const void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+}  // namespace
+
+bool IoUring::Completion::more() const { return (flags & IORING_CQE_F_MORE) != 0; }
+bool IoUring::Completion::hasBuffer() const { return (flags & IORING_CQE_F_BUFFER) != 0; }
+uint16_t IoUring::Completion::bufferId() const { return static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT); }
+
+std::unique_ptr<IoUring> IoUring::create(unsigned entries, std::string& reason) {
+    std::unique_ptr<IoUring> ring(new IoUring());
+
+    io_uring_params params{};
+    // 完成队列留出余量：多次操作在一轮中可能产生大量完成事件
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+        reason = std::string("io_uring_setup: ") + std::strerror(errno);
+        return nullptr;
+    }
+    ring->ring_fd_ = fd;
+
+    const unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & required) != required) {
+        reason = "内核缺少io_uring所需特性（需要6.0+）";
+        return nullptr;
+    }
+
+    ring->sq_entries_ = params.sq_entries;
+    ring->sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    // 单次映射同时包含提交队列和完成队列
+    size_t ring_size = std::max(ring->sq_ring_size_, ring->cq_ring_size_);
+    ring->sq_ring_size_ = ring_size;
+    void* sq = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) {
+        reason = std::string("mmap: ") + std::strerror(errno);
+        return nullptr;
+    }
+    ring->sq_ring_ = sq;
+    ring->cq_ring_ = sq;
+    ring->cq_ring_size_ = 0;
+
+    ring->sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, ring->sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                      IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        reason = std::string("mmap: ") + std::strerror(errno);
+        return nullptr;
+    }
+    ring->sqes_ = sqes;
+
+    char* base = static_cast<char*>(sq);
+    ring->sq_head_ = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+    ring->sq_tail_ = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+    ring->sq_mask_ = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+    ring->sq_array_ = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+    ring->cq_head_ = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+    ring->cq_tail_ = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+    ring->cq_mask_ = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+    ring->cqes_ = base + params.cq_off.cqes;
+    ring->local_tail_ = *ring->sq_tail_;
+    ring->submitted_tail_ = ring->local_tail_;
+    return ring;
+}
+
+IoUring::~IoUring() {
+    if (sqes_) munmap(sqes_, sqes_size_);
+    if (sq_ring_) munmap(sq_ring_, sq_ring_size_);
+    if (ring_fd_ != -1) ::close(ring_fd_);
+    if (buf_ring_) munmap(buf_ring_, buf_ring_size_);
+}
+
+int IoUring::enter(unsigned to_submit, unsigned min_complete, unsigned flags, const void* arg, size_t arg_size) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, arg, arg_size));
+}
+
+void IoUring::publish() {
+    if (local_tail_ != submitted_tail_) {
+        storeRelease(sq_tail_, local_tail_);
+        submitted_tail_ = local_tail_;
+    }
+}
+
+io_uring_sqe* IoUring::nextSqe() {
+    while (local_tail_ - loadAcquire(sq_head_) >= sq_entries_) {
+        // 提交队列已满：先把已填入的操作交给内核
+        publish();
+        if (enter(sq_entries_, 0, 0, nullptr, 0) < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+            break;
+        }
+    }
+    unsigned index = local_tail_ & sq_mask_;
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes_) + index;
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    ++local_tail_;
+    return sqe;
+}
+
+bool IoUring::registerFiles(const int* fds, unsigned count) {
+    return uringRegister(ring_fd_, IORING_REGISTER_FILES, fds, count) == 0;
+}
+
+bool IoUring::setupBufferRing(unsigned count, unsigned size) {
+    buf_ring_size_ = count * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        buf_ring_ = nullptr;
+        return false;
+    }
+    buf_ring_ = ring;
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = count;
+    reg.bgid = kBufferGroup;
+    if (uringRegister(ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) return false;
+
+    buf_count_ = count;
+    buf_size_ = size;
+    buf_memory_.reset(new char[static_cast<size_t>(count) * size]);
+    io_uring_buf* bufs = static_cast<io_uring_buf*>(ring);
+    for (unsigned i = 0; i < count; ++i) {
+        bufs[i].addr = reinterpret_cast<uint64_t>(buf_memory_.get() + static_cast<size_t>(i) * size);
+        bufs[i].len = size;
+        bufs[i].bid = static_cast<uint16_t>(i);
+    }
+    buf_tail_ = static_cast<uint16_t>(count);
+    storeRelease(&static_cast<io_uring_buf_ring*>(ring)->tail, buf_tail_);
+    return true;
+}
+
+void IoUring::recycleBuffer(uint16_t id) {
+    // 不使用io_uring_buf_ring::bufs：C++中内核头文件的柔性数组宏会使其偏移8字节，与内核布局不符
+    io_uring_buf& buf = static_cast<io_uring_buf*>(buf_ring_)[buf_tail_ & (buf_count_ - 1)];
+    buf.addr = reinterpret_cast<uint64_t>(buf_memory_.get() + static_cast<size_t>(id) * buf_size_);
+    buf.len = buf_size_;
+    buf.bid = id;
+    ++buf_tail_;
+    storeRelease(&static_cast<io_uring_buf_ring*>(buf_ring_)->tail, buf_tail_);
+}
+
+bool IoUring::registerBufferTable(unsigned count) {
+    io_uring_rsrc_register reg{};
+    reg.nr = count;
+    reg.flags = IORING_RSRC_REGISTER_SPARSE;
+    if (uringRegister(ring_fd_, IORING_REGISTER_BUFFERS2, &reg, sizeof(reg)) != 0) return false;
+    fixed_buffer_count_ = count;
+    return true;
+}
+
+bool IoUring::updateBuffer(unsigned slot, const void* data, size_t length) {
+    iovec iov;
+    iov.iov_base = const_cast<void*>(data);
+    iov.iov_len = length;
+    if (length == 0) iov.iov_base = nullptr;
+    uint64_t tag = 0;
+    io_uring_rsrc_update2 update{};
+    update.offset = slot;
+    update.data = reinterpret_cast<uint64_t>(&iov);
+    update.tags = reinterpret_cast<uint64_t>(&tag);
+    update.nr = 1;
+    return uringRegister(ring_fd_, IORING_REGISTER_BUFFERS_UPDATE, &update, sizeof(update)) == 1;
+}
+
+void IoUring::acceptMultishot(int fixed_index, uint64_t user_data) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fixed_index;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = user_data;
+}
+
+void IoUring::recvMultishot(int fd, uint64_t user_data) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->buf_group = kBufferGroup;
+    sqe->user_data = user_data;
+}
+
+void IoUring::sendmsg(int fd, const msghdr* msg, int flags, uint64_t user_data, bool link) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(msg);
+    sqe->len = 1;
+    sqe->msg_flags = static_cast<uint32_t>(flags);
+    if (link) sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = user_data;
+}
+
+void IoUring::writeFixed(int fd, const void* data, size_t length, unsigned slot, uint64_t user_data, bool link) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = static_cast<uint32_t>(length);
+    sqe->off = static_cast<uint64_t>(-1);
+    sqe->buf_index = static_cast<uint16_t>(slot);
+    if (link) sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = user_data;
+}
+
+void IoUring::close(int fd, uint64_t user_data) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = user_data;
+}
+
+void IoUring::pollMultishot(int fixed_index, uint32_t events, uint64_t user_data) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fixed_index;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->poll32_events = events;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = user_data;
+}
+
+void IoUring::pollOnce(int fd, uint32_t events, uint64_t user_data) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = user_data;
+}
+
+void IoUring::cancel(uint64_t target, uint64_t user_data) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = user_data;
+}
+
+bool IoUring::submitAndWait(int timeout_ms) {
+    publish();
+    unsigned to_submit = submitted_tail_ - loadAcquire(sq_head_);
+
+    __kernel_timespec ts{};
+    io_uring_getevents_arg arg{};
+    arg.sigmask = 0;
+    arg.sigmask_sz = _NSIG / 8;
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+
+    // 完成队列中已有事件时不等待，只提交
+    unsigned wait = loadAcquire(cq_tail_) != *cq_head_ ? 0 : 1;
+    int ret = enter(to_submit, wait, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if (ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY && errno != EAGAIN) return false;
+    return true;
+}
+
+bool IoUring::pop(Completion& completion) {
+    unsigned head = *cq_head_;
+    if (head == loadAcquire(cq_tail_)) return false;
+    const io_uring_cqe& cqe = static_cast<const io_uring_cqe*>(cqes_)[head & cq_mask_];
+    completion.user_data = cqe.user_data;
+    completion.res = cqe.res;
+    completion.flags = cqe.flags;
+    storeRelease(cq_head_, head + 1);
+    return true;
+}
+
+#else
+
+// 编译环境的内核头文件过旧：总是退回epoll
+bool IoUring::Completion::more() const { return false; }
+bool IoUring::Completion::hasBuffer() const { return false; }
+uint16_t IoUring::Completion::bufferId() const { return 0; }
+
+std::unique_ptr<IoUring> IoUring::create(unsigned, std::string& reason) {
+    reason = "编译时的内核头文件不支持io_uring";
+    return nullptr;
+}
+
+IoUring::~IoUring() {}
+io_uring_sqe* IoUring::nextSqe() { return nullptr; }
+void IoUring::publish() {}
+int IoUring::enter(unsigned, unsigned, unsigned, const void*, size_t) { return -1; }
+bool IoUring::registerFiles(const int*, unsigned) { return false; }
+bool IoUring::setupBufferRing(unsigned, unsigned) { return false; }
+void IoUring::recycleBuffer(uint16_t) {}
+bool IoUring::registerBufferTable(unsigned) { return false; }
+bool IoUring::updateBuffer(unsigned, const void*, size_t) { return false; }
+void IoUring::acceptMultishot(int, uint64_t) {}
+void IoUring::recvMultishot(int, uint64_t) {}
+void IoUring::sendmsg(int, const msghdr*, int, uint64_t, bool) {}
+void IoUring::writeFixed(int, const void*, size_t, unsigned, uint64_t, bool) {}
+void IoUring::close(int, uint64_t) {}
+void IoUring::pollMultishot(int, uint32_t, uint64_t) {}
+void IoUring::pollOnce(int, uint32_t, uint64_t) {}
+void IoUring::cancel(uint64_t, uint64_t) {}
+bool IoUring::submitAndWait(int) { return false; }
+bool IoUring::pop(Completion&) { return false; }
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef URING_H
+#define URING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+struct io_uring_sqe;
+
+// io_uring的最小封装：直接使用系统调用（不依赖liburing），只提供事件循环用到的操作
+// 准备操作只是填入提交队列，由submitAndWait批量提交，一次系统调用同时提交和收割
+// 需要内核6.0+（多次accept/recv、提供缓冲区环）；不满足时create返回nullptr，由调用者退回epoll
+// 只能在单个线程上使用
+class IoUring {
+public:
+    // 一个完成事件
+    struct Completion {
+        uint64_t user_data;
+        int32_t res;
+        uint32_t flags;
+
+        // 多次操作（multishot）之后还会有完成事件
+        bool more() const;
+        // 使用了提供缓冲区环中的缓冲区
+        bool hasBuffer() const;
+        uint16_t bufferId() const;
+    };
+
+private:
+    int ring_fd_ = -1;
+    unsigned sq_entries_ = 0;
+
+    // 提交队列与完成队列的映射
+    void* sq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;
+    size_t cq_ring_size_ = 0;
+    void* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    void* cqes_ = nullptr;
+
+    unsigned local_tail_ = 0;       // 已填入、尚未对内核可见的提交位置
+    unsigned submitted_tail_ = 0;   // 已对内核可见的提交位置
+
+    // 提供缓冲区环（多次recv使用）
+    void* buf_ring_ = nullptr;
+    size_t buf_ring_size_ = 0;
+    unsigned buf_count_ = 0;
+    unsigned buf_size_ = 0;
+    uint16_t buf_tail_ = 0;
+    std::unique_ptr<char[]> buf_memory_;
+
+    unsigned fixed_buffer_count_ = 0;
+
+    IoUring() = default;
+    // 取得一个空闲的提交项（提交队列已满时先提交）
+    io_uring_sqe* nextSqe();
+    // 把已填入的提交项对内核可见
+    void publish();
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags, const void* arg, size_t arg_size);
+
+public:
+    // 创建实例，entries为提交队列长度；不支持时返回nullptr，原因写入reason
+    static std::unique_ptr<IoUring> create(unsigned entries, std::string& reason);
+    ~IoUring();
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // 注册长期使用的fd（固定文件表），之后以下标代替fd提交操作，省去每次操作查找fd的开销
+    bool registerFiles(const int* fds, unsigned count);
+
+    // 创建提供缓冲区环：count个size字节的缓冲区，由多次recv按需取用（count必须为2的幂）
+    bool setupBufferRing(unsigned count, unsigned size);
+    // 缓冲区的内容
+    const char* buffer(uint16_t id) const { return buf_memory_.get() + static_cast<size_t>(id) * buf_size_; }
+    // 把用完的缓冲区还给内核
+    void recycleBuffer(uint16_t id);
+
+    // 创建count个槽位的固定缓冲区表（初始为空），之后可随时替换各槽位
+    bool registerBufferTable(unsigned count);
+    unsigned bufferTableSize() const { return fixed_buffer_count_; }
+    // 把槽位替换为[data, data+length)，length为0时清空槽位
+    bool updateBuffer(unsigned slot, const void* data, size_t length);
+
+    // 以下只填入提交队列，link为true时下一个操作在本操作完整成功后才执行（失败或不完整时取消）
+    // 多次accept：每个新连接产生一个完成事件，res为新fd（非阻塞）；fixed_index为固定文件表下标
+    void acceptMultishot(int fixed_index, uint64_t user_data);
+    // 多次recv：每次收到数据产生一个完成事件，数据位于提供缓冲区中，res为0表示对端关闭
+    void recvMultishot(int fd, uint64_t user_data);
+    // 发送msg中的iovec数组（提交后到完成前msg及其iovec必须有效）；非阻塞套接字上可能只发送一部分
+    void sendmsg(int fd, const msghdr* msg, int flags, uint64_t user_data, bool link);
+    // 从固定缓冲区槽位中写入一段（[data, data+length)必须位于该槽位注册的内存中）
+    void writeFixed(int fd, const void* data, size_t length, unsigned slot, uint64_t user_data, bool link);
+    // 关闭fd
+    void close(int fd, uint64_t user_data);
+    // 多次poll：fixed_index为固定文件表下标，每次就绪产生一个完成事件
+    void pollMultishot(int fixed_index, uint32_t events, uint64_t user_data);
+    // 单次poll
+    void pollOnce(int fd, uint32_t events, uint64_t user_data);
+    // 取消user_data为target的操作
+    void cancel(uint64_t target, uint64_t user_data);
+
+    // 提交所有已准备的操作并等待至少一个完成事件，timeout_ms<0时一直等待；超时或被信号打断也正常返回
+    bool submitAndWait(int timeout_ms);
+    // 取出下一个完成事件，没有时返回false
+    bool pop(Completion& completion);
+};
+
+#endif // URING_H
@@ -1,199 +1,3603 @@
 #include "webserver.h"
+#include "http2.h"
+#include "websocket.h"
+#include "response_cache.h"
 #include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <csignal>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <charconv>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/wait.h>
 
-// URL解码函数实现
-std::string urlDecode(const std::string& s) {
-    std::string res;
-    for (size_t i = 0; i < s.size(); ++i) {
-        if (s[i] == '%') {
-            if (i + 2 < s.size()) {
-                char hex1 = s[i+1];
-                char hex2 = s[i+2];
-                int val = 0;
-                if (hex1 >= '0' && hex1 <= '9') val += (hex1 - '0') * 16;
-                else if (hex1 >= 'A' && hex1 <= 'F') val += (hex1 - 'A' + 10) * 16;
-                else if (hex1 >= 'a' && hex1 <= 'f') val += (hex1 - 'a' + 10) * 16;
-                
-                if (hex2 >= '0' && hex2 <= '9') val += (hex2 - '0');
-                else if (hex2 >= 'A' && hex2 <= 'F') val += (hex2 - 'A' + 10);
-                else if (hex2 >= 'a' && hex2 <= 'f') val += (hex2 - 'a' + 10);
-                
-                res += (char)val;
-                i += 2;
+// URL解码函数实现：按输入长度预分配，由扫描内核跳过无需解码的部分
+std::string urlDecode(std::string_view s) {
+    std::string res(s.size(), '\0');
+    res.resize(urlDecodeTo(s.data(), s.size(), &res[0]));
+    return res;
+}
+
+// 不区分大小写的字符串比较
+static bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (std::tolower(static_cast<unsigned char>(a[i])) !=
+            std::tolower(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 判断逗号分隔的头部值中是否包含指定记号（如Connection: keep-alive, Upgrade）
+static bool containsToken(std::string_view value, std::string_view token) {
+    size_t pos = 0;
+    while (pos <= value.size()) {
+        size_t comma = value.find(',', pos);
+        if (comma == std::string_view::npos) comma = value.size();
+        std::string_view item = value.substr(pos, comma - pos);
+        while (!item.empty() && (item.front() == ' ' || item.front() == '\t')) item.remove_prefix(1);
+        while (!item.empty() && (item.back() == ' ' || item.back() == '\t')) item.remove_suffix(1);
+        if (equalsIgnoreCase(item, token)) return true;
+        pos = comma + 1;
+    }
+    return false;
+}
+
+HttpMethod parseHttpMethod(std::string_view method) {
+    switch (method.size()) {
+        case 3:
+            if (method == "GET") return HttpMethod::Get;
+            if (method == "PUT") return HttpMethod::Put;
+            break;
+        case 4:
+            if (method == "HEAD") return HttpMethod::Head;
+            if (method == "POST") return HttpMethod::Post;
+            break;
+        case 5:
+            if (method == "PATCH") return HttpMethod::Patch;
+            break;
+        case 6:
+            if (method == "DELETE") return HttpMethod::Delete;
+            break;
+        case 7:
+            if (method == "OPTIONS") return HttpMethod::Options;
+            break;
+    }
+    return HttpMethod::Unknown;
+}
+
+std::string_view methodName(HttpMethod method) {
+    switch (method) {
+        case HttpMethod::Get: return "GET";
+        case HttpMethod::Head: return "HEAD";
+        case HttpMethod::Post: return "POST";
+        case HttpMethod::Put: return "PUT";
+        case HttpMethod::Delete: return "DELETE";
+        case HttpMethod::Patch: return "PATCH";
+        case HttpMethod::Options: return "OPTIONS";
+        default: return "";
+    }
+}
+
+// RequestParser类实现：可恢复的HTTP/1.x请求解析状态机
+bool RequestParser::parseRequestLine(const char* data, size_t end, Request& req) {
+    // 请求行格式：方法 SP 请求目标 SP 协议版本
+    const char* begin = data + pos_;
+    const char* line_end = data + end;
+
+    const char* sp1 = static_cast<const char*>(std::memchr(begin, ' ', line_end - begin));
+    if (sp1 == nullptr || sp1 == begin) return false;
+    const char* target = sp1 + 1;
+    const char* sp2 = static_cast<const char*>(std::memchr(target, ' ', line_end - target));
+    if (sp2 == nullptr || sp2 == target) return false;
+    const char* version = sp2 + 1;
+
+    std::string_view version_view(version, line_end - version);
+    if (version_view.substr(0, 5) != "HTTP/") return false;
+    if (version_view != "HTTP/1.1" && version_view != "HTTP/1.0") {
+        error_code_ = 505;
+        return false;
+    }
+
+    req.method_ = { static_cast<uint32_t>(begin - data), static_cast<uint32_t>(sp1 - begin) };
+    req.method_id_ = parseHttpMethod(std::string_view(begin, sp1 - begin));
+    req.version_ = { static_cast<uint32_t>(version - data), static_cast<uint32_t>(line_end - version) };
+
+    // 拆分路径与查询串
+    const char* question = static_cast<const char*>(std::memchr(target, '?', sp2 - target));
+    const char* path_end = question ? question : sp2;
+    req.path_ = { static_cast<uint32_t>(target - data), static_cast<uint32_t>(path_end - target) };
+    if (question) {
+        req.query_ = { static_cast<uint32_t>(question + 1 - data),
+                       static_cast<uint32_t>(sp2 - question - 1) };
+    }
+    return true;
+}
+
+bool RequestParser::parseHeaderLine(const char* data, size_t begin, size_t end, Request& req) {
+    // 不支持已废弃的多行折叠头部
+    if (data[begin] == ' ' || data[begin] == '\t') return false;
+
+    // 一次扫描同时找到冒号并确认名称中没有空白
+    const char* line = data + begin;
+    const char* colon = findFirstOf(line, data + end, ':', ' ', '\t');
+    if (colon == data + end || *colon != ':' || colon == line) return false;
+
+    std::string_view name(line, colon - line);
+
+    // 去掉值两侧的空白
+    size_t value_begin = colon + 1 - data;
+    size_t value_end = end;
+    while (value_begin < value_end && (data[value_begin] == ' ' || data[value_begin] == '\t')) ++value_begin;
+    while (value_end > value_begin && (data[value_end - 1] == ' ' || data[value_end - 1] == '\t')) --value_end;
+    std::string_view value(data + value_begin, value_end - value_begin);
+
+    if (req.header_count_ == Request::kMaxHeaders) {
+        error_code_ = 431;
+        return false;
+    }
+    Request::HeaderSpan& span = req.headers_[req.header_count_++];
+    span.name = { static_cast<uint32_t>(begin), static_cast<uint32_t>(name.size()) };
+    span.value = { static_cast<uint32_t>(value_begin), static_cast<uint32_t>(value.size()) };
+
+    // 解析请求体长度
+    if (equalsIgnoreCase(name, "Content-Length")) {
+        if (value.empty() || value.size() > 19) return false;
+        size_t length = 0;
+        for (char ch : value) {
+            if (ch < '0' || ch > '9') return false;
+            length = length * 10 + (ch - '0');
+        }
+        if (has_length_ && content_length_ != length) return false;
+        has_length_ = true;
+        content_length_ = length;
+    } else if (equalsIgnoreCase(name, "Transfer-Encoding")) {
+        // 只支持单独的chunked编码
+        if (!equalsIgnoreCase(value, "chunked")) {
+            error_code_ = 501;
+            return false;
+        }
+        chunked_ = true;
+    }
+    // 同时出现两种长度声明可能被用于请求走私，直接拒绝
+    return !(chunked_ && has_length_);
+}
+
+bool RequestParser::parseChunkSize(const char* data, size_t end) {
+    // 格式：十六进制大小 [;扩展] CRLF，扩展被忽略
+    size_t size = 0;
+    size_t digits = 0;
+    size_t i = pos_;
+    for (; i < end; ++i) {
+        char ch = data[i];
+        int value;
+        if (ch >= '0' && ch <= '9') value = ch - '0';
+        else if (ch >= 'a' && ch <= 'f') value = ch - 'a' + 10;
+        else if (ch >= 'A' && ch <= 'F') value = ch - 'A' + 10;
+        else break;
+        if (++digits > 15) return false;
+        size = size * 16 + value;
+    }
+    if (digits == 0) return false;
+    while (i < end && (data[i] == ' ' || data[i] == '\t')) ++i;
+    if (i < end && data[i] != ';') return false;
+
+    body_remaining_ = size;
+    return true;
+}
+
+RequestParser::Status RequestParser::parse(char* data, size_t size, Request& req) {
+    while (state_ != State::Done) {
+        if (state_ == State::Body) {
+            if (content_length_ > body_limit_) return fail(413);
+            size_t count = std::min(size - pos_, body_remaining_);
+            pos_ += count;
+            body_size_ += count;
+            body_remaining_ -= count;
+            if (body_remaining_ > 0) return Status::Incomplete;
+            state_ = State::Done;
+            break;
+        }
+
+        if (state_ == State::ChunkData) {
+            // 分块数据向前移动，紧接在已解码的请求体之后
+            size_t count = std::min(size - pos_, body_remaining_);
+            size_t target = body_offset_ + body_size_;
+            if (target != pos_) std::memmove(data + target, data + pos_, count);
+            pos_ += count;
+            body_size_ += count;
+            body_remaining_ -= count;
+            if (body_remaining_ > 0) return Status::Incomplete;
+            state_ = State::ChunkEnd;
+            continue;
+        }
+
+        if (state_ == State::ChunkEnd) {
+            if (size - pos_ < 1 || (data[pos_] == '\r' && size - pos_ < 2)) return Status::Incomplete;
+            if (data[pos_] == '\r') ++pos_;
+            if (data[pos_] != '\n') return fail(400);
+            ++pos_;
+            state_ = State::ChunkSize;
+            continue;
+        }
+
+        // 其余状态按行处理，从上次停下的位置继续扫描
+        const char* newline = static_cast<const char*>(std::memchr(data + pos_, '\n', size - pos_));
+        bool in_head = state_ == State::RequestLine || state_ == State::Headers;
+        if (newline == nullptr) {
+            if (in_head ? size > max_header_size_ : size - pos_ > max_header_size_) return fail(431);
+            return Status::Incomplete;
+        }
+        size_t line_end = newline - data;
+        if (in_head && line_end >= max_header_size_) return fail(431);
+        size_t content_end = line_end;
+        if (content_end > pos_ && data[content_end - 1] == '\r') --content_end;
+
+        if (state_ == State::RequestLine) {
+            // 忽略请求行之前的空行
+            if (content_end == pos_) {
+                pos_ = line_end + 1;
+                continue;
+            }
+            if (!parseRequestLine(data, content_end, req)) {
+                return fail(error_code_ ? error_code_ : 400);
+            }
+            state_ = State::Headers;
+        } else if (state_ == State::Headers) {
+            if (content_end == pos_) {
+                // 空行：请求头结束，有请求体时先通知调用者
+                pos_ = line_end + 1;
+                body_offset_ = pos_;
+                if (chunked_) {
+                    state_ = State::ChunkSize;
+                } else if (content_length_ > 0) {
+                    state_ = State::Body;
+                    body_remaining_ = content_length_;
+                } else {
+                    state_ = State::Done;
+                    break;
+                }
+                return Status::Headers;
+            }
+            if (!parseHeaderLine(data, pos_, content_end, req)) {
+                return fail(error_code_ ? error_code_ : 400);
+            }
+        } else if (state_ == State::ChunkSize) {
+            if (!parseChunkSize(data, content_end)) return fail(400);
+            if (body_received_ + body_size_ + body_remaining_ > body_limit_) return fail(413);
+            state_ = body_remaining_ > 0 ? State::ChunkData : State::Trailers;
+        } else if (content_end == pos_) {
+            // 尾部头部以空行结束（尾部头部本身被忽略）
+            pos_ = line_end + 1;
+            state_ = State::Done;
+            break;
+        }
+        pos_ = line_end + 1;
+    }
+
+    req.body_ = streaming_ ? Request::Span()
+                           : Request::Span{ static_cast<uint32_t>(body_offset_), static_cast<uint32_t>(body_size_) };
+    return Status::Complete;
+}
+
+// Request类实现
+bool Request::parse(const std::string& data) {
+    raw_ = data;
+    header_count_ = 0;
+    RequestParser parser;
+    RequestParser::Status status;
+    do {
+        status = parser.parse(&raw_[0], raw_.size(), *this);
+    } while (status == RequestParser::Status::Headers);
+    return status == RequestParser::Status::Complete;
+}
+
+bool Request::assign(std::string_view method, std::string_view target, std::string_view version,
+                     const std::vector<std::pair<std::string, std::string>>& headers) {
+    recycle();
+    if (headers.size() > kMaxHeaders) return false;
+    size_t total = method.size() + target.size() + version.size();
+    for (const auto& header : headers) total += header.first.size() + header.second.size();
+    if (total > UINT32_MAX / 2) return false;
+    raw_.reserve(total);
+
+    auto put = [this](std::string_view text) {
+        Span span{ static_cast<uint32_t>(raw_.size()), static_cast<uint32_t>(text.size()) };
+        raw_.append(text);
+        return span;
+    };
+    method_ = put(method);
+    method_id_ = parseHttpMethod(method);
+    size_t question = target.find('?');
+    path_ = put(target.substr(0, question));
+    if (question != std::string_view::npos) query_ = put(target.substr(question + 1));
+    version_ = put(version);
+    for (const auto& header : headers) {
+        HeaderSpan& span = headers_[header_count_++];
+        span.name = put(header.first);
+        span.value = put(header.second);
+    }
+    return true;
+}
+
+void Request::setBody(std::string_view body) {
+    body_ = { static_cast<uint32_t>(raw_.size()), static_cast<uint32_t>(body.size()) };
+    raw_.append(body);
+}
+
+std::string Request::recycle() {
+    std::string raw = std::move(raw_);
+    raw.clear();
+    raw_.clear();
+    method_id_ = HttpMethod::Unknown;
+    method_ = path_ = query_ = version_ = body_ = Span();
+    header_count_ = 0;
+    param_count_ = 0;
+    return raw;
+}
+
+std::string Request::queryParam(std::string_view key) const {
+    std::string_view query = this->query();
+
+    // 依次检查key=value对，只解码命中的值
+    const char* p = query.data();
+    const char* end = p + query.size();
+    while (p < end) {
+        const char* delim = findFirstOf(p, end, '=', '&');
+        if (delim == end) break;
+        if (*delim == '&') {
+            // 没有值的参数
+            p = delim + 1;
+            continue;
+        }
+        std::string_view name(p, delim - p);
+        const char* value = delim + 1;
+        const char* value_end = static_cast<const char*>(std::memchr(value, '&', end - value));
+        if (value_end == nullptr) value_end = end;
+
+        bool encoded = findFirstOf(name.data(), name.data() + name.size(), '%', '+') != name.data() + name.size();
+        if (encoded ? urlDecode(name) == key : name == key) {
+            return urlDecode(std::string_view(value, value_end - value));
+        }
+        if (value_end == end) break;
+        p = value_end + 1;
+    }
+    return "";
+}
+
+std::string_view Request::header(std::string_view key) const {
+    for (size_t i = 0; i < header_count_; ++i) {
+        if (equalsIgnoreCase(view(headers_[i].name), key)) {
+            return view(headers_[i].value);
+        }
+    }
+    return std::string_view();
+}
+
+bool Request::keepAlive() const {
+    std::string_view connection = header("Connection");
+
+    // HTTP/1.1默认保持连接，HTTP/1.0需显式声明keep-alive
+    if (version() == "HTTP/1.1") {
+        return !containsToken(connection, "close");
+    }
+    return containsToken(connection, "keep-alive");
+}
+
+// 状态码对应的标准原因短语
+std::string_view httpReasonPhrase(int code) {
+    switch (code) {
+        case 100: return "Continue";
+        case 101: return "Switching Protocols";
+        case 200: return "OK";
+        case 201: return "Created";
+        case 202: return "Accepted";
+        case 204: return "No Content";
+        case 206: return "Partial Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 303: return "See Other";
+        case 304: return "Not Modified";
+        case 307: return "Temporary Redirect";
+        case 308: return "Permanent Redirect";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 408: return "Request Timeout";
+        case 409: return "Conflict";
+        case 410: return "Gone";
+        case 411: return "Length Required";
+        case 412: return "Precondition Failed";
+        case 413: return "Payload Too Large";
+        case 414: return "URI Too Long";
+        case 415: return "Unsupported Media Type";
+        case 416: return "Range Not Satisfiable";
+        case 417: return "Expectation Failed";
+        case 422: return "Unprocessable Entity";
+        case 429: return "Too Many Requests";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+        case 505: return "HTTP Version Not Supported";
+        default: return std::string_view();
+    }
+}
+
+// 带标准原因短语的状态行（"HTTP/1.1 200 OK\r\n"），首次使用时一次格式化
+// 原因短语不是标准短语时返回空，由调用者逐段写入
+static std::string_view standardStatusLine(int code, std::string_view text) {
+    static const std::vector<std::string> lines = [] {
+        std::vector<std::string> table(600);
+        for (int i = 100; i < 600; ++i) {
+            std::string_view reason = httpReasonPhrase(i);
+            if (!reason.empty()) {
+                table[i] = "HTTP/1.1 " + std::to_string(i) + " " + std::string(reason) + "\r\n";
+            }
+        }
+        return table;
+    }();
+    if (code < 0 || code >= static_cast<int>(lines.size()) || lines[code].empty()) return std::string_view();
+    std::string_view line = lines[code];
+    // "HTTP/1.1 " + 3位状态码 + " "之后是原因短语
+    return line.substr(13, line.size() - 15) == text ? line : std::string_view();
+}
+
+// Date响应头：每个线程缓存格式化好的一行，每秒最多重新格式化一次
+// IMF-fixdate格式的长度固定，同一响应计算长度和写入时跨过秒边界也不影响
+static std::string_view cachedDateHeader() {
+    thread_local char line[64];
+    thread_local size_t length = 0;
+    thread_local time_t formatted_at = -1;
+    time_t now = time(nullptr);
+    if (now != formatted_at) {
+        struct tm tm_time;
+        gmtime_r(&now, &tm_time);
+        length = strftime(line, sizeof(line), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm_time);
+        formatted_at = now;
+    }
+    return std::string_view(line, length);
+}
+
+// Response类实现：构建响应
+size_t Response::headersSize() const {
+    // 状态行："HTTP/1.1 " + 状态码 + " " + 原因短语 + "\r\n"
+    std::string_view status_line = standardStatusLine(status_code_, status_text_);
+    size_t size = status_line.size();
+    if (status_line.empty()) {
+        char code[16];
+        size = 9 + (std::to_chars(code, code + sizeof(code), status_code_).ptr - code) +
+               1 + status_text_.size() + 2;
+    }
+    for (const auto& item : headers_) {
+        size += item.first.size() + 2 + item.second.size() + 2;
+    }
+    if (headers_.find(std::string_view("Date")) == headers_.end()) {
+        size += cachedDateHeader().size();
+    }
+    size += header_block_.size();
+    if (static_file_) {
+        size += (static_encoded_ ? static_file_->encoded_headers : static_file_->headers).size();
+    }
+    return size + 2;
+}
+
+void Response::writeHeaders(char* buffer) const {
+    char* p = buffer;
+    auto put = [&p](std::string_view text) {
+        std::memcpy(p, text.data(), text.size());
+        p += text.size();
+    };
+
+    // 状态行：常用状态码直接复制预先格式化的整行
+    std::string_view status_line = standardStatusLine(status_code_, status_text_);
+    if (!status_line.empty()) {
+        put(status_line);
+    } else {
+        put("HTTP/1.1 ");
+        char code[16];
+        put(std::string_view(code, std::to_chars(code, code + sizeof(code), status_code_).ptr - code));
+        put(" ");
+        put(status_text_);
+        put("\r\n");
+    }
+
+    // 响应头
+    for (const auto& item : headers_) {
+        put(item.first);
+        put(": ");
+        put(item.second);
+        put("\r\n");
+    }
+    if (headers_.find(std::string_view("Date")) == headers_.end()) {
+        put(cachedDateHeader());
+    }
+    if (!header_block_.empty()) put(header_block_);
+
+    // 静态文件的预格式化响应头
+    if (static_file_) {
+        put(static_encoded_ ? static_file_->encoded_headers : static_file_->headers);
+    }
+
+    // 空行分隔头和体
+    put("\r\n");
+}
+
+std::string Response::buildHeaders() const {
+    std::string response(headersSize(), '\0');
+    writeHeaders(&response[0]);
+    return response;
+}
+
+std::string Response::buildResponse() const {
+    // 响应头和响应体一次分配
+    std::string_view body = static_file_ ? std::string_view(static_file_->body)
+                          : !body_view_.empty() ? body_view_ : std::string_view(body_);
+    size_t header_size = headersSize();
+    std::string response(header_size + body.size(), '\0');
+    writeHeaders(&response[0]);
+    if (!body.empty()) std::memcpy(&response[header_size], body.data(), body.size());
+    return response;
+}
+
+void Response::writeTo(OutputBuffer& out, bool include_body) {
+    if (arena_) {
+        // 响应头一次写入内存池，不经过全局分配器
+        size_t size = headersSize();
+        char* buffer = static_cast<char*>(arena_->allocate(size, 1));
+        writeHeaders(buffer);
+        out.appendView(std::string_view(buffer, size));
+    } else {
+        out.append(buildHeaders());
+    }
+    if (include_body) moveBodyTo(out, header("Transfer-Encoding") == "chunked");
+}
+
+// 逐行取出预先格式化的响应头（"名称: 值\r\n"）
+static void forEachHeaderLine(std::string_view block,
+                              const std::function<void(std::string_view, std::string_view)>& fn) {
+    while (!block.empty()) {
+        size_t end = block.find("\r\n");
+        std::string_view line = block.substr(0, end);
+        block.remove_prefix(end == std::string_view::npos ? block.size() : end + 2);
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) continue;
+        std::string_view value = line.substr(colon + 1);
+        while (!value.empty() && value.front() == ' ') value.remove_prefix(1);
+        fn(line.substr(0, colon), value);
+    }
+}
+
+void Response::forEachHeader(const std::function<void(std::string_view name, std::string_view value)>& fn) const {
+    for (const auto& item : headers_) {
+        fn(item.first, item.second);
+    }
+    if (headers_.find(std::string_view("Date")) == headers_.end()) {
+        forEachHeaderLine(cachedDateHeader(), fn);
+    }
+    forEachHeaderLine(header_block_, fn);
+    if (static_file_) {
+        forEachHeaderLine(static_encoded_ ? static_file_->encoded_headers : static_file_->headers, fn);
+    }
+}
+
+void Response::moveBodyTo(OutputBuffer& out, bool chunked) {
+    if (static_file_) {
+        // 与缓存条目共享内容，不复制
+        out.append(std::shared_ptr<const std::string>(static_file_, &static_file_->body));
+    } else if (file_.get() != -1) {
+        out.appendFile(std::move(file_), file_offset_, file_length_);
+    } else if (!body_chunks_.empty()) {
+        out.append(std::move(body_chunks_));
+    } else if (producer_) {
+        out.appendProducer(std::move(producer_), chunked);
+    } else if (!body_view_.empty()) {
+        // 渲染在请求内存池中的内容，与响应头一样只借用
+        out.appendView(body_view_);
+    } else if (!body_.empty()) {
+        out.append(std::move(body_));
+    }
+}
+
+int64_t Response::bodySize() const {
+    if (static_file_) return static_cast<int64_t>(static_file_->body.size());
+    if (file_.get() != -1) return static_cast<int64_t>(file_length_);
+    if (!body_chunks_.empty()) return static_cast<int64_t>(body_chunks_.pendingBytes());
+    if (producer_) return -1;
+    if (!body_view_.empty()) return static_cast<int64_t>(body_view_.size());
+    return static_cast<int64_t>(body_.size());
+}
+
+void Response::compress(std::string_view accept_encoding, const CompressionConfig& config, bool allow_streaming) {
+    if (!config.enabled) return;
+    // 没有响应体或只是部分内容的状态不压缩
+    if (status_code_ < 200 || status_code_ == 204 || status_code_ == 206 || status_code_ == 304) return;
+    if (!header("Content-Encoding").empty() || !config.compressible(header("Content-Type"))) return;
+    bool streaming = static_cast<bool>(producer_);
+    std::string_view body = body_view_.empty() ? std::string_view(body_) : body_view_;
+    if (!streaming && (static_file_ || file_.get() >= 0 || !body_chunks_.empty() || body.size() < config.min_size)) {
+        return;
+    }
+
+    // 同一URL的响应随Accept-Encoding变化，缓存需要区分
+    std::string_view vary = header("Vary");
+    if (vary.empty()) {
+        setHeader("Vary", "Accept-Encoding");
+    } else if (vary.find("Accept-Encoding") == std::string_view::npos && vary != "*") {
+        setHeader("Vary", std::string(vary) + ", Accept-Encoding");
+    }
+
+    ContentCoding coding = negotiateEncoding(accept_encoding);
+    if (coding == ContentCoding::Identity) return;
+
+    if (!streaming && (!allow_streaming || body.size() <= config.stream_threshold)) {
+        std::string compressed;
+        // 压缩后没有变小（已压缩过的数据）时原样发送
+        if (!compressBuffer(coding, config, body, compressed) || compressed.size() >= body.size()) return;
+        clearBody();
+        setContentLength(compressed.size());
+        body_ = std::move(compressed);
+    } else {
+        std::shared_ptr<Compressor> compressor = std::make_shared<Compressor>(coding, config);
+        if (!compressor->valid()) return;
+        if (streaming) {
+            // 逐段压缩生成的内容：每段都刷新，对端能及时解压已收到的部分
+            ChunkProducer source = std::move(producer_);
+            producer_ = [compressor, source = std::move(source), finished = false](std::string& chunk) mutable {
+                if (finished) return false;
+                std::string raw;
+                bool more = source(raw);
+                if (!compressor->update(raw, chunk, !more)) return false;
+                finished = !more;
+                return true;
+            };
+        } else {
+            // 大的响应体边发送边压缩：按段压缩，不在内存中保留完整的压缩结果
+            // 响应体在内存池中时直接引用（内存池在发送完之后才会重置），否则接管body_
+            std::shared_ptr<std::string> owned;
+            if (body_view_.empty()) {
+                owned = std::make_shared<std::string>(std::move(body_));
+                body = *owned;
+            }
+            static const size_t kSliceSize = 32 * 1024;
+            setChunkedContent([compressor, owned, body, offset = size_t(0)](std::string& chunk) mutable {
+                if (offset > body.size()) return false;
+                size_t length = std::min(kSliceSize, body.size() - offset);
+                bool last = offset + length == body.size();
+                if (!compressor->update(body.substr(offset, length), chunk, last)) return false;
+                offset = last ? body.size() + 1 : offset + length;
+                return true;
+            });
+        }
+    }
+
+    setHeader("Content-Encoding", contentCodingName(coding));
+    // 强校验值对应未压缩的内容，压缩后改为弱校验值
+    std::string_view etag = header("ETag");
+    if (!etag.empty() && etag.front() == '"') setHeader("ETag", "W/" + std::string(etag));
+}
+
+// RequestArena类实现：按块递增分配，重置时只保留首块
+RequestArena::~RequestArena() {
+    while (head_) {
+        Block* next = head_->next;
+        ::operator delete(head_);
+        head_ = next;
+    }
+}
+
+void* RequestArena::do_allocate(size_t bytes, size_t alignment) {
+    uintptr_t aligned = (reinterpret_cast<uintptr_t>(cursor_) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    if (!head_ || aligned + bytes > reinterpret_cast<uintptr_t>(end_)) {
+        // 当前块不足：新块大小翻倍（有上限），超大的分配单独占用一块
+        size_t size = head_ ? std::min(head_->size * 2, kMaxBlockSize) : kInitialSize;
+        size = std::max(size, bytes + alignment);
+        Block* block = static_cast<Block*>(::operator new(sizeof(Block) + size));
+        block->next = head_;
+        block->size = size;
+        head_ = block;
+        cursor_ = reinterpret_cast<char*>(block + 1);
+        end_ = cursor_ + size;
+        aligned = (reinterpret_cast<uintptr_t>(cursor_) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    }
+    cursor_ = reinterpret_cast<char*>(aligned + bytes);
+    used_ += bytes;
+    return reinterpret_cast<void*>(aligned);
+}
+
+void RequestArena::reset() {
+    if (!head_) return;
+    while (head_->next) {
+        Block* next = head_->next;
+        ::operator delete(head_);
+        head_ = next;
+    }
+    cursor_ = reinterpret_cast<char*>(head_ + 1);
+    end_ = cursor_ + head_->size;
+    used_ = 0;
+}
+
+// OutputBuffer类实现：writev聚合发送内存片段，sendfile发送文件片段
+void OutputBuffer::append(std::string data) {
+    if (data.empty()) return;
+    pending_bytes_ += data.size();
+    chunks_.emplace_back();
+    chunks_.back().owned = std::move(data);
+}
+
+void OutputBuffer::append(std::shared_ptr<const std::string> data) {
+    if (!data) return;
+    size_t length = data->size();
+    append(std::move(data), 0, length);
+}
+
+void OutputBuffer::append(std::shared_ptr<const std::string> data, size_t offset, size_t length) {
+    if (!data || length == 0) return;
+    pending_bytes_ += length;
+    chunks_.emplace_back();
+    chunks_.back().view = std::string_view(*data).substr(offset, length);
+    chunks_.back().shared = std::move(data);
+}
+
+void OutputBuffer::appendView(std::string_view data) {
+    if (data.empty()) return;
+    pending_bytes_ += data.size();
+    chunks_.emplace_back();
+    chunks_.back().view = data;
+}
+
+void OutputBuffer::appendFile(FileDescriptor file, off_t offset, size_t length) {
+    if (length == 0) return;
+    pending_bytes_ += length;
+    chunks_.emplace_back();
+    chunks_.back().file = std::move(file);
+    chunks_.back().file_offset = offset;
+    chunks_.back().file_remaining = length;
+}
+
+void OutputBuffer::appendProducer(ChunkProducer producer, bool chunked) {
+    if (!producer) return;
+    chunks_.emplace_back();
+    chunks_.back().producer = std::move(producer);
+    chunks_.back().chunked = chunked;
+}
+
+void OutputBuffer::append(OutputBuffer&& other) {
+    for (Chunk& chunk : other.chunks_) {
+        chunks_.push_back(std::move(chunk));
+    }
+    pending_bytes_ += other.pending_bytes_;
+    other.clear();
+}
+
+OutputBuffer::WriteResult OutputBuffer::writeTo(int socket_fd, size_t& written) {
+    const unsigned kMaxIov = 64;
+
+    while (!chunks_.empty()) {
+        Chunk& front = chunks_.front();
+
+        // 文件片段：由内核直接从页缓存发送到套接字
+        if (front.isFile()) {
+            while (front.file_remaining > 0) {
+                size_t count = std::min<size_t>(front.file_remaining, 1 << 30);
+                ssize_t n = sendfile(socket_fd, front.file.get(), &front.file_offset, count);
+                if (n > 0) {
+                    front.file_remaining -= n;
+                    pending_bytes_ -= n;
+                    written += n;
+                    continue;
+                }
+                // 文件在发送过程中被截断，无法补齐声明的长度
+                if (n == 0) return WriteResult::Error;
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return WriteResult::WouldBlock;
+                return WriteResult::Error;
+            }
+            chunks_.pop_front();
+            continue;
+        }
+
+        // 生成片段：取得下一段内容，作为内存片段插入到生成片段之前
+        if (front.producer) {
+            std::string piece;
+            if (!front.producer(piece)) {
+                bool chunked = front.chunked;
+                chunks_.pop_front();
+                if (chunked) {
+                    static const char kLastChunk[] = "0\r\n\r\n";
+                    chunks_.emplace_front();
+                    chunks_.front().view = std::string_view(kLastChunk, sizeof(kLastChunk) - 1);
+                    pending_bytes_ += chunks_.front().view.size();
+                }
+                continue;
+            }
+            if (piece.empty()) continue;
+
+            bool chunked = front.chunked;
+            size_t length = piece.size();
+            if (chunked) {
+                static const char kCrlf[] = "\r\n";
+                chunks_.emplace_front();
+                chunks_.front().view = std::string_view(kCrlf, 2);
+                pending_bytes_ += 2;
+            }
+            chunks_.emplace_front();
+            chunks_.front().owned = std::move(piece);
+            pending_bytes_ += length;
+            if (chunked) {
+                char size_line[24];
+                char* end = std::to_chars(size_line, size_line + 16, length, 16).ptr;
+                *end++ = '\r';
+                *end++ = '\n';
+                chunks_.emplace_front();
+                chunks_.front().owned.assign(size_line, end - size_line);
+                pending_bytes_ += end - size_line;
+            }
+            continue;
+        }
+
+        // 连续的内存片段合并为一次系统调用
+        iovec iov[kMaxIov];
+        unsigned count = peekMemory(iov, kMaxIov);
+
+        // 使用sendmsg代替writev以便传入MSG_NOSIGNAL
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t n = sendmsg(socket_fd, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return WriteResult::WouldBlock;
+            return WriteResult::Error;
+        }
+        written += n;
+        consume(n);
+    }
+    return WriteResult::Done;
+}
+
+bool OutputBuffer::takeFront(OutputBuffer& dst, size_t max, size_t& moved) {
+    moved = 0;
+    while (moved < max && !chunks_.empty()) {
+        Chunk& front = chunks_.front();
+        size_t want = max - moved;
+
+        // 生成片段：取得下一段内容，作为内存片段插入到生成片段之前
+        if (front.producer) {
+            std::string piece;
+            if (!front.producer(piece)) {
+                chunks_.pop_front();
+            } else if (!piece.empty()) {
+                pending_bytes_ += piece.size();
+                chunks_.emplace_front();
+                chunks_.front().owned = std::move(piece);
+            }
+            continue;
+        }
+
+        // 文件片段：读入内存
+        if (front.isFile()) {
+            size_t count = std::min(want, front.file_remaining);
+            std::string data(count, '\0');
+            ssize_t n = pread(front.file.get(), &data[0], count, front.file_offset);
+            if (n < 0 && errno == EINTR) continue;
+            // 文件在发送过程中被截断，无法补齐声明的长度
+            if (n <= 0) return false;
+            data.resize(n);
+            front.file_offset += n;
+            front.file_remaining -= n;
+            pending_bytes_ -= n;
+            moved += n;
+            dst.append(std::move(data));
+            if (front.file_remaining == 0) chunks_.pop_front();
+            continue;
+        }
+
+        std::string_view data = front.data().substr(front.offset);
+        size_t count = std::min(want, data.size());
+        if (front.shared) {
+            size_t offset = data.data() - front.shared->data();
+            dst.append(front.shared, offset, count);
+        } else if (!front.owned.empty()) {
+            if (front.offset == 0 && count == data.size()) {
+                dst.append(std::move(front.owned));
+                front.owned.clear();
+                pending_bytes_ -= count;
+                moved += count;
+                chunks_.pop_front();
+                continue;
+            }
+            dst.append(std::string(data.substr(0, count)));
+        } else {
+            dst.appendView(data.substr(0, count));
+        }
+        consume(count);
+        moved += count;
+    }
+    return true;
+}
+
+unsigned OutputBuffer::peekMemory(iovec* iov, unsigned max, const std::shared_ptr<const std::string>** shared,
+                                  bool* all) const {
+    unsigned count = 0;
+    auto it = chunks_.begin();
+    for (; it != chunks_.end() && count < max && it->isMemory(); ++it) {
+        std::string_view data = it->data();
+        iov[count].iov_base = const_cast<char*>(data.data() + it->offset);
+        iov[count].iov_len = data.size() - it->offset;
+        if (shared) shared[count] = it->shared ? &it->shared : nullptr;
+        ++count;
+    }
+    if (all) *all = it == chunks_.end();
+    return count;
+}
+
+void OutputBuffer::consume(size_t n) {
+    pending_bytes_ -= n;
+    // 弹出已发送完的片段，记录部分发送的位置
+    while (n > 0) {
+        Chunk& chunk = chunks_.front();
+        size_t left = chunk.data().size() - chunk.offset;
+        if (n >= left) {
+            n -= left;
+            chunks_.pop_front();
+        } else {
+            chunk.offset += n;
+            n = 0;
+        }
+    }
+}
+
+// 把URL路径映射为静态缓存的键，拒绝包含..的路径
+static bool staticKeyFor(std::string_view path, std::string& key) {
+    if (path.empty() || path.front() != '/') return false;
+
+    size_t pos = 0;
+    while (pos < path.size()) {
+        size_t next = path.find('/', pos + 1);
+        if (next == std::string_view::npos) next = path.size();
+        if (path.substr(pos + 1, next - pos - 1) == "..") return false;
+        pos = next;
+    }
+
+    key.assign(path.data(), path.size());
+    // 处理根路径请求（返回index.html）
+    if (key.back() == '/') {
+        key += "index.html";
+    }
+    return true;
+}
+
+// 判断If-None-Match/If-Range中的校验值列表是否与ETag匹配（弱比较）
+static bool etagMatches(std::string_view list, std::string_view etag) {
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t comma = list.find(',', pos);
+        if (comma == std::string_view::npos) comma = list.size();
+        std::string_view item = list.substr(pos, comma - pos);
+        pos = comma + 1;
+        while (!item.empty() && (item.front() == ' ' || item.front() == '\t')) item.remove_prefix(1);
+        while (!item.empty() && (item.back() == ' ' || item.back() == '\t')) item.remove_suffix(1);
+        if (item == "*") return true;
+        if (item.substr(0, 2) == "W/") item.remove_prefix(2);
+        if (item == etag) return true;
+    }
+    return false;
+}
+
+// 解析Range头，结果为闭区间[first, last]列表
+// 返回1表示有效，0表示应忽略该头部，-1表示范围无法满足（416）
+static int parseByteRanges(std::string_view header, size_t size,
+                           std::vector<std::pair<size_t, size_t>>& ranges) {
+    const size_t kMaxRanges = 16;
+    if (header.substr(0, 6) != "bytes=") return 0;
+    header.remove_prefix(6);
+
+    size_t pos = 0;
+    while (pos < header.size()) {
+        size_t comma = header.find(',', pos);
+        if (comma == std::string_view::npos) comma = header.size();
+        std::string_view spec = header.substr(pos, comma - pos);
+        pos = comma + 1;
+        while (!spec.empty() && spec.front() == ' ') spec.remove_prefix(1);
+        while (!spec.empty() && spec.back() == ' ') spec.remove_suffix(1);
+
+        size_t dash = spec.find('-');
+        if (dash == std::string_view::npos) return 0;
+        std::string_view first_text = spec.substr(0, dash);
+        std::string_view last_text = spec.substr(dash + 1);
+        if (first_text.find_first_not_of("0123456789") != std::string_view::npos ||
+            last_text.find_first_not_of("0123456789") != std::string_view::npos ||
+            first_text.size() > 18 || last_text.size() > 18) {
+            return 0;
+        }
+
+        size_t first, last;
+        if (first_text.empty()) {
+            // 后缀范围：最后N个字节
+            if (last_text.empty()) return 0;
+            size_t suffix = std::stoull(std::string(last_text));
+            if (suffix == 0) continue;
+            first = suffix >= size ? 0 : size - suffix;
+            last = size - 1;
+        } else {
+            first = std::stoull(std::string(first_text));
+            last = last_text.empty() ? size - 1 : std::stoull(std::string(last_text));
+            if (last < first) return 0;
+            if (first >= size) continue;
+            if (last >= size) last = size - 1;
+        }
+        if (size == 0) continue;
+        ranges.emplace_back(first, last);
+        if (ranges.size() > kMaxRanges) return 0;
+    }
+    return ranges.empty() ? -1 : 1;
+}
+
+// 把文件的一段加入响应体：内存中的文件共享缓存内容，大文件使用sendfile
+static bool appendFileRange(const std::shared_ptr<const CachedFile>& file, size_t offset, size_t length,
+                            OutputBuffer& out) {
+    if (file->in_memory) {
+        out.append(std::shared_ptr<const std::string>(file, &file->body), offset, length);
+        return true;
+    }
+    int fd = open(file->path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    out.appendFile(FileDescriptor(fd), offset, length);
+    return true;
+}
+
+bool Router::serveStatic(const Request& req, const std::string& key, Response& res) const {
+    std::shared_ptr<const CachedFile> file = static_cache_->lookup(key);
+    if (!file->exists) return false;
+
+    // 选择预压缩版本：客户端接受时优先br，其次gzip
+    std::shared_ptr<const CachedFile> selected = file;
+    bool encoded = false;
+    bool has_variant = false;
+    std::string_view accept = req.header("Accept-Encoding");
+    if (file->encoding.empty()) {
+        static const char* const kVariants[][2] = { { "br", ".br" }, { "gzip", ".gz" } };
+        for (const auto& variant : kVariants) {
+            std::shared_ptr<const CachedFile> sibling = static_cache_->lookup(key + variant[1]);
+            if (!sibling->exists) continue;
+            has_variant = true;
+            if (!encoded && acceptsEncoding(accept, variant[0])) {
+                selected = sibling;
+                encoded = true;
+            }
+        }
+    }
+    // 没有客户端可用的预压缩文件：内存中的文件按需压缩，压缩结果保存在缓存条目中
+    if (!encoded && file->encoding.empty() && compression_.enabled && file->in_memory &&
+        static_cast<size_t>(file->size) >= compression_.min_size && compression_.compressible(file->content_type)) {
+        has_variant = true;
+        ContentCoding coding = negotiateEncoding(accept);
+        if (coding != ContentCoding::Identity) {
+            if (std::shared_ptr<const CachedFile> variant = static_cache_->compressed(file, coding, compression_)) {
+                selected = std::move(variant);
+                encoded = true;
+            }
+        }
+    }
+    if (has_variant) {
+        res.setHeader("Vary", "Accept-Encoding");
+    }
+
+    // 条件请求：If-None-Match优先于If-Modified-Since
+    std::string_view if_none_match = req.header("If-None-Match");
+    bool not_modified = false;
+    if (!if_none_match.empty()) {
+        not_modified = etagMatches(if_none_match, selected->etag);
+    } else {
+        std::string_view if_modified_since = req.header("If-Modified-Since");
+        if (!if_modified_since.empty()) {
+            time_t since = parseHttpDate(if_modified_since);
+            not_modified = since != -1 && selected->mtime <= since;
+        }
+    }
+    if (not_modified) {
+        res.setStatusCode(304, "Not Modified");
+        res.removeHeader("Content-Type");
+        res.setHeader("ETag", selected->etag);
+        res.setHeader("Last-Modified", selected->last_modified);
+        return true;
+    }
+
+    // Range请求：If-Range不匹配时发送完整内容
+    std::string_view range = req.header("Range");
+    std::string_view if_range = req.header("If-Range");
+    bool range_valid = if_range.empty() ||
+                       (if_range.front() == '"' ? if_range == selected->etag
+                                                : parseHttpDate(if_range) == selected->mtime);
+    if (!range.empty() && range_valid) {
+        size_t size = selected->size;
+        std::vector<std::pair<size_t, size_t>> ranges;
+        int result = parseByteRanges(range, size, ranges);
+        if (result < 0) {
+            res.setStatusCode(416, "Range Not Satisfiable");
+            res.setHeader("Content-Range", "bytes */" + std::to_string(size));
+            res.setContent("");
+            return true;
+        }
+        if (result > 0) {
+            const std::string& content_type = encoded ? mimeTypeFor(key) : selected->content_type;
+            OutputBuffer body;
+            res.setStatusCode(206, "Partial Content");
+            res.setHeader("ETag", selected->etag);
+            res.setHeader("Last-Modified", selected->last_modified);
+            res.setHeader("Accept-Ranges", "bytes");
+            if (encoded) {
+                res.setHeader("Content-Encoding", selected->encoding);
+            }
+
+            if (ranges.size() == 1) {
+                size_t first = ranges[0].first;
+                size_t last = ranges[0].second;
+                if (!appendFileRange(selected, first, last - first + 1, body)) {
+                    res = Response(res.arena());
+                    return false;
+                }
+                res.setHeader("Content-Type", content_type);
+                res.setHeader("Content-Range", "bytes " + std::to_string(first) + "-" +
+                                                   std::to_string(last) + "/" + std::to_string(size));
+            } else {
+                // 多段范围：multipart/byteranges
+                std::string boundary = "CPPWS" + std::to_string(std::hash<std::string>()(selected->etag));
+                for (const auto& part : ranges) {
+                    body.append("\r\n--" + boundary + "\r\n"
+                                "Content-Type: " + content_type + "\r\n"
+                                "Content-Range: bytes " + std::to_string(part.first) + "-" +
+                                std::to_string(part.second) + "/" + std::to_string(size) + "\r\n\r\n");
+                    if (!appendFileRange(selected, part.first, part.second - part.first + 1, body)) {
+                        res = Response(res.arena());
+                        return false;
+                    }
+                }
+                body.append("\r\n--" + boundary + "--\r\n");
+                res.setHeader("Content-Type", "multipart/byteranges; boundary=" + boundary);
+            }
+            res.setBodyChunks(std::move(body));
+            return true;
+        }
+    }
+
+    if (selected->in_memory) {
+        res.setStaticFile(selected, encoded);
+        return true;
+    }
+
+    // 超过缓存上限的大文件：由事件循环通过sendfile直接发送
+    int fd = open(selected->path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        res = Response(res.arena());
+        return false;
+    }
+    res.setHeader("Content-Type", encoded ? mimeTypeFor(key) : selected->content_type);
+    if (encoded) {
+        res.setHeader("Content-Encoding", selected->encoding);
+    }
+    res.setHeader("ETag", selected->etag);
+    res.setHeader("Last-Modified", selected->last_modified);
+    res.setHeader("Accept-Ranges", "bytes");
+    res.setFileContent(fd, 0, selected->size);
+    return true;
+}
+
+// RouteTree类实现：压缩前缀树
+RouteTree::Node* RouteTree::insertStatic(Node* node, std::string_view text) {
+    while (!text.empty()) {
+        // 查找首字符相同的子节点
+        size_t index = node->indices.find(text.front());
+        if (index == std::string::npos) {
+            std::unique_ptr<Node> child(new Node());
+            child->prefix.assign(text.data(), text.size());
+            node->indices += text.front();
+            node->children.push_back(std::move(child));
+            return node->children.back().get();
+        }
+
+        Node* child = node->children[index].get();
+        size_t common = 0;
+        while (common < text.size() && common < child->prefix.size() &&
+               text[common] == child->prefix[common]) {
+            ++common;
+        }
+
+        // 只匹配了边的一部分：在公共前缀处拆分
+        if (common < child->prefix.size()) {
+            std::unique_ptr<Node> split(new Node());
+            split->prefix = child->prefix.substr(0, common);
+            child->prefix.erase(0, common);
+            split->indices += child->prefix.front();
+            split->children.push_back(std::move(node->children[index]));
+            node->children[index] = std::move(split);
+            child = node->children[index].get();
+        }
+
+        node = child;
+        text.remove_prefix(common);
+    }
+    return node;
+}
+
+void RouteTree::insert(std::string_view pattern, Route route) {
+    const std::string full(pattern);
+    if (pattern.empty() || pattern.front() != '/') {
+        throw std::invalid_argument("路由必须以/开头: " + full);
+    }
+
+    Node* node = &root_;
+    size_t param_count = 0;
+    while (!pattern.empty()) {
+        char first = pattern.front();
+        if (first == ':' || first == '*') {
+            size_t end = pattern.find('/');
+            if (end == std::string_view::npos) end = pattern.size();
+            std::string name(pattern.substr(1, end - 1));
+            if (++param_count > Request::kMaxParams) {
+                throw std::invalid_argument("路由参数过多: " + full);
+            }
+
+            if (first == '*') {
+                // 通配段匹配剩余的全部路径，只能位于末尾
+                if (end != pattern.size()) {
+                    throw std::invalid_argument("通配段必须位于路由末尾: " + full);
+                }
+                if (!node->wildcard_child) {
+                    node->wildcard_child.reset(new Node());
+                    node->wildcard_name = name;
+                } else if (node->wildcard_name != name) {
+                    throw std::invalid_argument("通配段名称冲突: " + full);
+                }
+                node = node->wildcard_child.get();
+                pattern = std::string_view();
+                break;
+            }
+
+            if (name.empty()) {
+                throw std::invalid_argument("参数段缺少名称: " + full);
+            }
+            if (!node->param_child) {
+                node->param_child.reset(new Node());
+                node->param_name = name;
+            } else if (node->param_name != name) {
+                throw std::invalid_argument("参数段名称冲突: " + full);
+            }
+            node = node->param_child.get();
+            pattern.remove_prefix(end);
+            continue;
+        }
+
+        // 静态部分一直延伸到下一个参数段或通配段
+        size_t end = pattern.find_first_of(":*");
+        if (end == std::string_view::npos) end = pattern.size();
+        node = insertStatic(node, pattern.substr(0, end));
+        pattern.remove_prefix(end);
+    }
+    node->route = std::move(route);
+}
+
+const RouteTree::Node* RouteTree::match(const Node* node, std::string_view path, Match& result) {
+    if (path.empty()) {
+        if (node->route) return node;
+        // 通配段可以匹配空的剩余路径（如/files/*path匹配/files/）
+        if (node->wildcard_child && node->wildcard_child->route && result.count < Request::kMaxParams) {
+            result.names[result.count] = node->wildcard_name;
+            result.values[result.count] = path;
+            ++result.count;
+            return node->wildcard_child.get();
+        }
+        return nullptr;
+    }
+
+    // 1. 静态子节点
+    size_t index = node->indices.find(path.front());
+    if (index != std::string::npos) {
+        const Node* child = node->children[index].get();
+        if (path.compare(0, child->prefix.size(), child->prefix) == 0) {
+            const Node* found = match(child, path.substr(child->prefix.size()), result);
+            if (found) return found;
+        }
+    }
+
+    // 2. 参数段：匹配到下一个/为止
+    if (node->param_child && result.count < Request::kMaxParams) {
+        size_t end = path.find('/');
+        if (end == std::string_view::npos) end = path.size();
+        if (end > 0) {
+            size_t saved = result.count;
+            result.names[result.count] = node->param_name;
+            result.values[result.count] = path.substr(0, end);
+            ++result.count;
+            const Node* found = match(node->param_child.get(), path.substr(end), result);
+            if (found) return found;
+            result.count = saved;
+        }
+    }
+
+    // 3. 通配段：匹配剩余的全部路径
+    if (node->wildcard_child && node->wildcard_child->route && result.count < Request::kMaxParams) {
+        result.names[result.count] = node->wildcard_name;
+        result.values[result.count] = path;
+        ++result.count;
+        return node->wildcard_child.get();
+    }
+    return nullptr;
+}
+
+const Route* RouteTree::find(std::string_view path, Match& result) const {
+    const Node* node = match(&root_, path, result);
+    return node ? &node->route : nullptr;
+}
+
+// Router类实现：处理路由和静态文件
+RouteStats* Router::statsFor(std::string_view method, std::string_view route) {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    for (const auto& stats : stats_) {
+        if (stats->method() == method && stats->route() == route) return stats.get();
+    }
+    stats_.emplace_back(new RouteStats(std::string(method), std::string(route)));
+    return stats_.back().get();
+}
+
+RouteLimit* Router::limitFor(std::string_view method, std::string_view route) {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    std::string key = std::string(method) + " " + std::string(route);
+    for (const auto& limit : limits_) {
+        if (limit.first == key) return limit.second.get();
+    }
+    limits_.emplace_back(std::move(key), std::unique_ptr<RouteLimit>(new RouteLimit()));
+    return limits_.back().second.get();
+}
+
+void invokeMiddleware(const MiddlewareFunc* middleware, size_t count, const Request& req, Response& res,
+                      MiddlewareNext last) {
+    if (count == 0) {
+        last();
+        return;
+    }
+    auto next = [&]() { invokeMiddleware(middleware + 1, count - 1, req, res, last); };
+    (*middleware)(req, res, MiddlewareNext(next));
+}
+
+void Router::get(const std::string& path, HandlerFunc handler, const RouteCacheOptions& cache) {
+    Route route;
+    route.handler = handler;
+    route.stats = statsFor("GET", path);
+    route.limit = limitFor("GET", path);
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        caches_.push_back(std::make_shared<ResponseCache>(path, std::move(handler), cache));
+        route.cache = caches_.back().get();
+    }
+    trees_[static_cast<size_t>(HttpMethod::Get)].insert(path, std::move(route));
+}
+
+const Route* Router::findRoute(Request& req) const {
+    if (req.methodId() == HttpMethod::Unknown) return nullptr;
+
+    RouteTree::Match match;
+    const Route* route = trees_[static_cast<size_t>(req.methodId())].find(req.path(), match);
+    if (route == nullptr && req.methodId() == HttpMethod::Head) {
+        match.count = 0;
+        route = trees_[static_cast<size_t>(HttpMethod::Get)].find(req.path(), match);
+    }
+    if (route == nullptr) return nullptr;
+
+    // 路径参数的值指向请求自身的原始数据，只记录偏移
+    req.param_count_ = match.count;
+    for (size_t i = 0; i < match.count; ++i) {
+        req.params_[i].name = match.names[i];
+        req.params_[i].value = { static_cast<uint32_t>(match.values[i].data() - req.raw_.data()),
+                                 static_cast<uint32_t>(match.values[i].size()) };
+    }
+    return route;
+}
+
+std::unique_ptr<BodyHandler> Router::createBodyHandler(Request& req, const Route** matched) const {
+    const Route* route = findRoute(req);
+#ifdef WEBSERVER_HAS_COROUTINES
+    if (route != nullptr && route->async_body_handler) {
+        // 协程路由：请求体交给读取器，由处理函数逐段取走
+        if (matched) *matched = route;
+        return std::unique_ptr<BodyHandler>(new BodyReader());
+    }
+#endif
+    if (route == nullptr || !route->body_factory) {
+        req.param_count_ = 0;
+        return nullptr;
+    }
+    if (matched) *matched = route;
+    return route->body_factory();
+}
+
+#ifdef WEBSERVER_HAS_COROUTINES
+const Route* Router::findAsyncRoute(Request& req) const {
+    if (!has_async_routes_) return nullptr;
+    const Route* route = findRoute(req);
+    if (route == nullptr || !route->isAsync()) {
+        req.param_count_ = 0;
+        return nullptr;
+    }
+    return route;
+}
+#endif
+
+const Route* Router::findWebSocketRoute(Request& req) const {
+    if (!has_websocket_routes_) return nullptr;
+    const Route* route = findRoute(req);
+    if (route == nullptr || !route->websocket_factory) {
+        req.param_count_ = 0;
+        return nullptr;
+    }
+    return route;
+}
+
+static void setErrorPage(Response& res, int code);
+
+namespace {
+// 占用路由并发名额期间的守卫，处理函数抛出异常时也会归还
+struct RoutePermit {
+    RouteLimit* limit;
+    ~RoutePermit() {
+        if (limit) limit->release();
+    }
+};
+}
+
+RouteStats* Router::handle(Request& req, Response& res) const {
+    // 先检查是否是静态文件请求（命中缓存时不访问文件系统）
+    std::string key;
+    bool is_head = req.methodId() == HttpMethod::Head;
+    if (static_cache_ && (req.methodId() == HttpMethod::Get || is_head) && staticKeyFor(req.path(), key) &&
+        serveStatic(req, key, res)) {
+        return static_stats_;
+    }
+
+    // 处理路由
+    const Route* route = findRoute(req);
+    if (route != nullptr && route->websocket_factory) {
+        // WebSocket路由收到没有升级（或版本不支持）的请求
+        setErrorPage(res, 426);
+        res.setHeader("Upgrade", "websocket");
+        res.setHeader("Sec-WebSocket-Version", "13");
+        return route->stats;
+    }
+    if (route != nullptr) {
+        // 路由的并发已满：不执行处理函数，返回503（Retry-After由WebServer补全）
+        if (!route->isAsync() && route->limit && !route->limit->tryAcquire()) {
+            setErrorPage(res, 503);
+            return route->stats;
+        }
+        RoutePermit permit{route->isAsync() ? nullptr : route->limit};
+        if (route->cache) {
+            runMiddleware(req, res, [&]() { route->cache->handle(req, res, compression_, cache_refresh_executor_); });
+            return route->stats;
+        }
+        if (route->handler) {
+            runMiddleware(req, res, [&]() { route->handler(req, res); });
+            return route->stats;
+        }
+        if (route->isAsync()) {
+            // 协程路由只能由事件循环执行（见EventLoop::dispatchRequest）
+            res.setStatusCode(500, "Internal Server Error");
+            res.setHtml("<html><head><title>500 Internal Server Error</title></head>"
+                        "<body><h1>500 Internal Server Error</h1></body></html>");
+            return route->stats;
+        }
+        // 流式路由收到没有请求体的请求：处理器只会收到请求头和完成通知
+        std::unique_ptr<BodyHandler> body_handler = route->body_factory();
+        body_handler->onHeaders(req);
+        body_handler->onComplete(req, res);
+        return route->stats;
+    }
+
+    // 未找到路由，使用404处理函数
+    runMiddleware(req, res, [&]() { not_found_handler_(req, res); });
+    return not_found_stats_;
+}
+
+// ThreadPool类实现：工作窃取调度
+namespace {
+// 当前线程所属的线程池及其工作线程编号（非工作线程为nullptr）
+thread_local ThreadPool* tls_pool = nullptr;
+thread_local size_t tls_worker_index = 0;
+}
+
+ThreadPool::ThreadPool(size_t num_threads, size_t queue_capacity, OverflowPolicy policy)
+    : injection_queue_(queue_capacity), policy_(policy) {
+    if (num_threads == 0) num_threads = 1;
+    for (size_t i = 0; i < num_threads; ++i) {
+        local_queues_.emplace_back(new WorkerQueue());
+    }
+    for (size_t i = 0; i < num_threads; ++i) {
+        workers_.emplace_back(&ThreadPool::workerThread, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stop_.store(true);
+    }
+    sleep_condition_.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(space_mutex_);
+    }
+    space_condition_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+bool ThreadPool::submit(UniqueFunction fn) {
+    Task task{ std::move(fn), std::chrono::steady_clock::now() };
+
+    // 工作线程内部派生的任务放入自己的本地队列，无需经过共享的注入队列
+    if (tls_pool == this) {
+        WorkerQueue& queue = *local_queues_[tls_worker_index];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+        pending_.fetch_add(1);
+        notifyWorker();
+        return true;
+    }
+
+    if (!injection_queue_.tryPush(task)) {
+        switch (policy_) {
+            case OverflowPolicy::Reject:
+                rejected_count_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            case OverflowPolicy::CallerRuns:
+                task.fn();
+                return true;
+            case OverflowPolicy::Block:
+                if (!pushBlocking(task)) return false;
+                break;
+        }
+    }
+    pending_.fetch_add(1);
+    notifyWorker();
+    return true;
+}
+
+bool ThreadPool::pushBlocking(Task& task) {
+    // 先登记再重试，与notifyProducer中先取走任务再检查blocked_producers_的顺序配对，保证不会丢失唤醒
+    std::unique_lock<std::mutex> lock(space_mutex_);
+    blocked_producers_.fetch_add(1);
+    bool pushed = false;
+    while (!stop_.load() && !(pushed = injection_queue_.tryPush(task))) {
+        space_condition_.wait(lock);
+    }
+    blocked_producers_.fetch_sub(1);
+    return pushed;
+}
+
+void ThreadPool::notifyProducer() {
+    if (blocked_producers_.load() > 0) {
+        { std::lock_guard<std::mutex> lock(space_mutex_); }
+        space_condition_.notify_one();
+    }
+}
+
+void ThreadPool::notifyWorker() {
+    // 与workerThread中先登记空闲再检查pending_的顺序配对，保证不会丢失唤醒
+    if (idle_workers_.load() > 0) {
+        { std::lock_guard<std::mutex> lock(sleep_mutex_); }
+        sleep_condition_.notify_one();
+    }
+}
+
+bool ThreadPool::popTask(size_t index, Task& task) {
+    // 1. 本地队列：后进先出，缓存更热
+    WorkerQueue& own = *local_queues_[index];
+    {
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // 2. 注入队列
+    if (injection_queue_.tryPop(task)) {
+        notifyProducer();
+        return true;
+    }
+
+    // 3. 从其他工作线程的队列头部窃取
+    size_t count = local_queues_.size();
+    for (size_t i = 1; i < count; ++i) {
+        WorkerQueue& victim = *local_queues_[(index + i) % count];
+        std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+        if (lock.owns_lock() && !victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            steal_count_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerThread(size_t index) {
+    tls_pool = this;
+    tls_worker_index = index;
+
+    while (true) {
+        Task task;
+        if (popTask(index, task)) {
+            pending_.fetch_sub(1);
+            auto waited = std::chrono::steady_clock::now() - task.enqueued;
+            queue_wait_.record(std::chrono::duration_cast<std::chrono::microseconds>(waited).count());
+            task.fn();
+            continue;
+        }
+
+        // 没有可执行的任务：登记为空闲后再次确认，然后休眠
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        idle_workers_.fetch_add(1);
+        sleep_condition_.wait(lock, [this] {
+            return stop_.load() || pending_.load() > 0;
+        });
+        idle_workers_.fetch_sub(1);
+        if (stop_.load() && pending_.load() <= 0) return;
+    }
+}
+
+// 错误响应的原因短语
+static std::string_view statusText(int code) {
+    std::string_view text = httpReasonPhrase(code);
+    return text.empty() ? std::string_view("Error") : text;
+}
+
+// 构建请求无法解析时的错误响应（随后关闭连接）
+// 设置简单的错误页面
+static void setErrorPage(Response& res, int code) {
+    static const HtmlTemplate page("<html><head><title>{{code}} {{text}}</title></head>"
+                                   "<body><h1>{{code}} {{text}}</h1></body></html>");
+    char digits[16];
+    std::string_view code_text(digits, std::to_chars(digits, digits + sizeof(digits), code).ptr - digits);
+    res.setStatusCode(code, statusText(code));
+    res.setHtml(page, {{"code", code_text}, {"text", statusText(code)}});
+}
+
+// 过载时的503响应：拒绝连接和请求时共享同一份，不含Date（RFC 9110允许5xx响应省略）
+static std::string buildOverloadResponse(int retry_after_seconds) {
+    static const std::string_view body = "<html><head><title>503 Service Unavailable</title></head>"
+                                         "<body><h1>503 Service Unavailable</h1></body></html>";
+    return "HTTP/1.1 503 Service Unavailable\r\n"
+           "Content-Type: text/html; charset=UTF-8\r\n"
+           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+           "Retry-After: " + std::to_string(retry_after_seconds) + "\r\n"
+           "Connection: close\r\n\r\n" + std::string(body);
+}
+
+static std::string buildErrorResponse(int code) {
+    Response res;
+    setErrorPage(res, code);
+    res.setHeader("Connection", "close");
+    return res.buildResponse();
+}
+
+// EventLoop类实现：边缘触发的epoll反应器
+
+// 发送积压时请求内存池的用量上限，超过后暂停分发流水线请求
+static const size_t kArenaPauseThreshold = 256 * 1024;
+// 接收缓冲每增长该大小就先解析一次，使流式请求体及时交给处理器
+static const size_t kStreamFlushSize = 256 * 1024;
+
+// 每次读取的大小（epoll后端的栈缓冲区、io_uring后端的提供缓冲区）
+static const size_t kReadChunkSize = 16384;
+
+// io_uring后端的参数
+static const unsigned kUringEntries = 512;            // 提交队列长度
+static const unsigned kUringBufferCount = 128;        // 多次recv共用的提供缓冲区数量
+static const unsigned kFixedBufferSlots = 32;         // 固定缓冲区槽位数
+static const unsigned kFixedBufferHits = 8;           // 共享内容发送多少次后注册为固定缓冲区
+static const size_t kFixedBufferMinSize = 4096;       // 更小的内容注册的收益不足以抵消开销
+static const size_t kFixedBufferMaxSize = 4 << 20;
+static const size_t kFixedHitsLimit = 4096;           // 发送次数表的大小上限，超过时清空
+
+// io_uring操作的user_data：连接指针的低3位标记操作类型；指针为空时是循环自身的操作
+static const uint64_t kOpMask = 7;
+static const uint64_t kOpRecv = 1;
+static const uint64_t kOpSend = 2;
+static const uint64_t kOpFixed = 3;
+static const uint64_t kOpClose = 4;
+static const uint64_t kOpPollOut = 5;
+static const uint64_t kUdAccept = 1;
+static const uint64_t kUdLoopEvents = 2;   // 辅助epoll（唤醒fd、inotify、IoWatcher）可读
+static const uint64_t kUdIgnore = 3;       // 取消操作等不关心结果的操作
+static_assert(alignof(Connection) > kOpMask, "连接指针的低位用于标记操作类型");
+
+static uint64_t uringData(Connection& conn, uint64_t op) {
+    return reinterpret_cast<uint64_t>(&conn) | op;
+}
+
+// 当前线程正在运行的事件循环
+// HTTP/2连接：会话的回调把各个流交给路由（线程池、循环线程或协程处理函数），
+// 响应回到循环线程后交给会话，按优先级和流量控制窗口编码发送
+struct Http2Connection final : Http2Session::Handler {
+    EventLoop& loop;
+    Connection& conn;
+    Http2Session session;
+    bool receiving = false;   // 正在处理收到的帧：期间完成的响应留到处理完后一起发送
+    bool flushing = false;    // 正在flushHttp2()中（发送完毕的回调不重入）
+
+    Http2Connection(EventLoop& loop, Connection& conn)
+        : loop(loop),
+          conn(conn),
+          session(*this, loop.server_.config_.http2, loop.server_.config_.max_header_size,
+                  loop.server_.config_.max_body_size) {}
+
+    void onRequestHeaders(const std::shared_ptr<Http2Stream>& stream) override;
+    void onRequest(const std::shared_ptr<Http2Stream>& stream) override;
+    void onStreamClosed(Http2Stream& stream) override;
+
+    // 响应已生成（循环线程上）：归还路由名额，交给会话发送
+    void complete(Http2Stream& stream, std::unique_ptr<Response> response);
+    // 不执行处理函数，直接返回错误页
+    void reject(Http2Stream& stream, int status);
+#ifdef WEBSERVER_HAS_COROUTINES
+    // 在循环线程上启动协程处理函数
+    void startAsync(const std::shared_ptr<Http2Stream>& stream, const Route& route);
+    // 协程处理函数结束：流已被重置或连接已关闭时丢弃响应
+    void finishAsync(Http2Stream& stream, std::unique_ptr<Response> response, RouteStats* stats,
+                     std::chrono::steady_clock::time_point started);
+#endif
+};
+
+static thread_local EventLoop* current_loop = nullptr;
+
+EventLoop::EventLoop(WebServer& server, int listen_fd, bool watch_static, bool inline_handlers, bool want_uring)
+    : server_(server), listen_fd_(listen_fd), watch_static_(watch_static), inline_handlers_(inline_handlers),
+      want_uring_(want_uring) {
+}
+
+EventLoop::~EventLoop() {
+    // 先销毁io_uring实例，取消仍在进行的操作
+    uring_.reset();
+    for (auto& item : connections_) {
+        // 链接的关闭操作可能已经关闭了fd
+        if (!item.second->close_linked) close(item.first);
+        // 其他线程仍持有的WebSocket不再向本循环投递
+        if (item.second->websocket) item.second->websocket->open_.store(false, std::memory_order_relaxed);
+    }
+    if (wake_fd_ != -1) close(wake_fd_);
+    if (epoll_fd_ != -1) close(epoll_fd_);
+    if (spare_fd_ != -1) close(spare_fd_);
+}
+
+bool EventLoop::init() {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        perror("epoll创建失败");
+        return false;
+    }
+
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        perror("eventfd创建失败");
+        return false;
+    }
+    spare_fd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    // 监听套接字和唤醒fd均使用边缘触发；io_uring后端由io_uring接受连接
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = listen_fd_;
+    if (!(want_uring_ && initUring()) && epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev) < 0) {
+        perror("注册监听套接字失败");
+        return false;
+    }
+    ev.data.fd = wake_fd_;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev) < 0) {
+        perror("注册eventfd失败");
+        return false;
+    }
+
+    // 静态文件变化通知（多反应器时只由第一个循环处理）
+    const std::shared_ptr<StaticFileCache>& cache = server_.router_.staticCache();
+    if (watch_static_ && cache && cache->watchFd() >= 0) {
+        watch_fd_ = cache->watchFd();
+        ev.data.fd = watch_fd_;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, watch_fd_, &ev) < 0) {
+            perror("注册inotify失败");
+            watch_fd_ = -1;
+        }
+    }
+    return true;
+}
+
+bool EventLoop::initUring() {
+    std::string reason;
+    std::unique_ptr<IoUring> ring = IoUring::create(kUringEntries, reason);
+    if (!ring) {
+        std::cerr << "io_uring不可用（" << reason << "），使用epoll" << std::endl;
+        return false;
+    }
+
+    // 固定文件表：0为监听套接字，1为epoll fd
+    int files[2] = {listen_fd_, epoll_fd_};
+    if (!ring->registerFiles(files, 2) || !ring->setupBufferRing(kUringBufferCount, kReadChunkSize)) {
+        perror("io_uring初始化失败，使用epoll");
+        return false;
+    }
+    // 固定缓冲区只是优化，注册失败时不使用
+    if (ring->registerBufferTable(kFixedBufferSlots)) {
+        fixed_buffers_.resize(kFixedBufferSlots);
+    }
+
+    ring->acceptMultishot(0, kUdAccept);
+    ring->pollMultishot(1, POLLIN, kUdLoopEvents);
+    uring_ = std::move(ring);
+    return true;
+}
+
+void EventLoop::post(UniqueFunction fn) {
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        pending_.push_back(std::move(fn));
+    }
+    uint64_t one = 1;
+    ssize_t n = write(wake_fd_, &one, sizeof(one));
+    (void)n;
+}
+
+void EventLoop::stop() {
+    stopping_.store(true, std::memory_order_release);
+    uint64_t one = 1;
+    ssize_t n = write(wake_fd_, &one, sizeof(one));
+    (void)n;
+}
+
+void EventLoop::drain(std::chrono::milliseconds timeout) {
+    post([this, timeout]() { beginDrain(timeout); });
+}
+
+void EventLoop::beginDrain(std::chrono::milliseconds timeout) {
+    if (draining_) {
+        // 再次要求关闭：不再等待
+        closeAllConnections();
+        return;
+    }
+    draining_ = true;
+
+    // 停止接受新连接：监听套接字保持打开，平滑升级时新进程继续从中接受连接
+    if (uring_) {
+        uring_->cancel(kUdAccept, kUdIgnore);
+    } else {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, listen_fd_, nullptr);
+    }
+
+    // 空闲的长连接立即关闭，正在发送最后一个响应的连接发送完后关闭；
+    // 其余连接之后的响应不再保持连接（见WebServer::finishResponse）
+    std::vector<Connection*> idle;
+    std::vector<Connection*> http2;
+    std::vector<Connection*> websockets;
+    for (const auto& entry : connections_) {
+        Connection& conn = *entry.second;
+        if (conn.http2) {
+            http2.push_back(&conn);
+            continue;
+        }
+        if (conn.websocket) {
+            websockets.push_back(&conn);
+            continue;
+        }
+        if (conn.busy || conn.async_active || !conn.in_buf.empty()) continue;
+        if (conn.output.empty()) {
+            idle.push_back(&conn);
+        } else {
+            conn.close_after_write = true;
+        }
+    }
+    for (Connection* conn : idle) {
+        closeConnection(*conn);
+    }
+    // HTTP/2连接发送GOAWAY：已开始的流照常完成，全部完成后关闭
+    for (Connection* conn : http2) {
+        conn->http2->session.goAway(conn->output);
+        flushHttp2(*conn);
+    }
+    // WebSocket连接发起关闭握手（1001），对端回应后关闭
+    for (Connection* conn : websockets) {
+        conn->websocket->close(kWebSocketGoingAway, "server shutting down");
+    }
+    runAfter(timeout, [this]() { closeAllConnections(); });
+}
+
+void EventLoop::closeAllConnections() {
+    std::vector<std::shared_ptr<Connection>> remaining;
+    remaining.reserve(connections_.size());
+    for (const auto& entry : connections_) {
+        remaining.push_back(entry.second);
+    }
+    for (const std::shared_ptr<Connection>& conn : remaining) {
+        if (!conn->closed) closeConnection(*conn);
+    }
+}
+
+void EventLoop::runPending() {
+    uint64_t counter;
+    while (read(wake_fd_, &counter, sizeof(counter)) > 0) {
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        running_.swap(pending_);
+    }
+    for (auto& task : running_) {
+        task();
+    }
+    running_.clear();
+}
+
+EventLoop* EventLoop::current() {
+    return current_loop;
+}
+
+void EventLoop::runAfter(std::chrono::steady_clock::duration delay, UniqueFunction fn) {
+    timers_.emplace(std::chrono::steady_clock::now() + delay, std::move(fn));
+}
+
+int EventLoop::nextTimeout(int max_ms) const {
+    auto now = std::chrono::steady_clock::now();
+    max_ms = deadlines_.nextTimeout(now, max_ms);
+    if (timers_.empty()) return max_ms;
+    auto wait = timers_.begin()->first - now;
+    if (wait <= std::chrono::steady_clock::duration::zero()) return 0;
+    // 向上取整，避免在不足1毫秒时反复空转
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(wait + std::chrono::milliseconds(1) -
+                                                                    std::chrono::nanoseconds(1));
+    return static_cast<int>(std::min<int64_t>(ms.count(), max_ms));
+}
+
+void EventLoop::runTimers() {
+    // 只执行本轮开始前已到期的任务，回调中新加的零延迟任务留到下一轮
+    auto now = std::chrono::steady_clock::now();
+    while (!timers_.empty() && timers_.begin()->first <= now) {
+        UniqueFunction fn = std::move(timers_.begin()->second);
+        timers_.erase(timers_.begin());
+        fn();
+    }
+}
+
+bool EventLoop::watch(int fd, IoWatcher* watcher) {
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) return false;
+    watchers_[fd] = watcher;
+    return true;
+}
+
+void EventLoop::unwatch(int fd) {
+    if (watchers_.erase(fd) > 0) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    }
+}
+
+bool EventLoop::offload(UniqueFunction fn) {
+    return server_.thread_pool_->enqueue(std::move(fn));
+}
+
+bool EventLoop::handleLoopEvent(int fd, uint32_t events) {
+    if (fd == wake_fd_) {
+        runPending();
+        return true;
+    }
+    if (fd == watch_fd_) {
+        server_.router_.staticCache()->processEvents();
+        return true;
+    }
+    auto watcher = watchers_.find(fd);
+    if (watcher == watchers_.end()) return false;
+    watcher->second->onIoEvent(events);
+    return true;
+}
+
+void EventLoop::run() {
+    current_loop = this;
+    if (uring_) {
+        runUring();
+    } else {
+        runEpoll();
+    }
+    current_loop = nullptr;
+}
+
+void EventLoop::runEpoll() {
+    const int kMaxEvents = 256;
+    epoll_event events[kMaxEvents];
+
+    while (!stopping_.load(std::memory_order_acquire)) {
+        // 最多等待1秒，有连接超时或定时任务时等到最近的到期时间
+        int n = epoll_wait(epoll_fd_, events, kMaxEvents, nextTimeout(1000));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait失败");
+            return;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == listen_fd_) {
+                acceptConnections();
+                continue;
+            }
+
+            auto it = connections_.find(fd);
+            if (it == connections_.end()) {
+                handleLoopEvent(fd, events[i].events);
+                continue;
+            }
+            Connection& conn = *it->second;
+
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                closeConnection(conn);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                // 发送完毕后连接可能已被关闭
+                if (!handleWrite(conn)) continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP)) {
+                handleRead(conn);
+            }
+        }
+
+        expireDeadlines();
+        if (!timers_.empty()) runTimers();
+        if (!ws_flush_.empty()) flushWebSockets();
+        // 优雅关闭：所有连接都已关闭
+        if (draining_ && connections_.empty()) break;
+    }
+}
+
+void EventLoop::runUring() {
+    IoUring::Completion completion;
+
+    while (!stopping_.load(std::memory_order_acquire)) {
+        // 一次系统调用提交上一轮准备的所有操作并等待完成事件，等待时间与epoll后端相同
+        if (!uring_->submitAndWait(nextTimeout(1000))) {
+            perror("io_uring_enter失败");
+            return;
+        }
+
+        while (uring_->pop(completion)) {
+            handleCompletion(completion);
+        }
+
+        expireDeadlines();
+        if (!timers_.empty()) runTimers();
+        if (!ws_flush_.empty()) flushWebSockets();
+        // 优雅关闭：所有连接都已关闭，且它们的在途操作都已结束
+        if (draining_ && connections_.empty() && closing_.empty()) break;
+    }
+}
+
+void EventLoop::handleCompletion(const IoUring::Completion& completion) {
+    Connection* target = reinterpret_cast<Connection*>(completion.user_data & ~kOpMask);
+    if (target == nullptr) {
+        if (completion.user_data == kUdAccept) {
+            if (completion.res >= 0) {
+                if (Connection* conn = addConnection(completion.res)) armRecv(*conn);
+            } else if (completion.res == -EMFILE || completion.res == -ENFILE) {
+                // fd耗尽：拒绝所有等待中的连接，客户端不必等到超时
+                while (shedPendingConnection()) {
+                }
+            } else {
+                std::cerr << "接受连接失败: " << std::strerror(-completion.res) << std::endl;
+            }
+            if (!completion.more() && !draining_) {
+                // 多次accept因出错（如fd耗尽）而结束：稍后再重新启动，避免反复失败
+                if (completion.res < 0) {
+                    runAfter(std::chrono::milliseconds(100), [this]() { uring_->acceptMultishot(0, kUdAccept); });
+                } else {
+                    uring_->acceptMultishot(0, kUdAccept);
+                }
+            }
+        } else if (completion.user_data == kUdLoopEvents) {
+            const int kMaxEvents = 64;
+            epoll_event events[kMaxEvents];
+            int n;
+            do {
+                n = epoll_wait(epoll_fd_, events, kMaxEvents, 0);
+                for (int i = 0; i < n; ++i) {
+                    handleLoopEvent(events[i].data.fd, events[i].events);
+                }
+            } while (n == kMaxEvents);
+            if (!completion.more()) uring_->pollMultishot(1, POLLIN, kUdLoopEvents);
+        }
+        return;
+    }
+
+    // 处理期间持有连接：回调中关闭连接时不会提前释放
+    std::shared_ptr<Connection> self = target->shared_from_this();
+    Connection& conn = *target;
+    if (!completion.more()) --conn.uring_ops;
+
+    switch (completion.user_data & kOpMask) {
+    case kOpRecv:
+        onRecv(conn, completion);
+        break;
+    case kOpSend:
+    case kOpFixed:
+        onWriteComplete(conn, completion.user_data & kOpMask, completion.res);
+        break;
+    case kOpClose:
+        if (completion.res >= 0) {
+            // fd已由内核关闭：关闭连接时close_linked仍为true，不会再关闭fd
+            if (!conn.closed) closeConnection(conn);
+        } else if (conn.closed) {
+            // 写入出错或不完整，链接的关闭被取消，而连接已在此期间关闭
+            close(conn.fd);
+        }
+        conn.close_linked = false;
+        if (!conn.closed) continueWrite(conn);
+        break;
+    case kOpPollOut:
+        conn.pollout_armed = false;
+        if (conn.closed) break;
+        if (completion.res < 0) {
+            closeConnection(conn);
+        } else {
+            submitWrite(conn);
+        }
+        break;
+    }
+
+    // 读写都会改变连接所处的阶段，统一在完成事件处理后更新超时
+    if (!conn.closed) {
+        refreshDeadline(conn);
+    } else if (conn.uring_ops == 0) {
+        closing_.erase(&conn);
+    }
+}
+
+void EventLoop::onRecv(Connection& conn, const IoUring::Completion& completion) {
+    if (!completion.more()) conn.recv_armed = false;
+    int32_t res = completion.res;
+    if (completion.hasBuffer()) {
+        if (res > 0 && !conn.closed) conn.in_buf.append(uring_->buffer(completion.bufferId()), res);
+        uring_->recycleBuffer(completion.bufferId());
+    }
+    if (conn.closed) return;
+
+    if (res > 0) {
+        server_.metrics_.bytes_received.add(res);
+        const ServerConfig& config = server_.config_;
+        const size_t buffer_limit = config.max_header_size + config.max_body_size + kReadChunkSize;
+        if (conn.in_buf.size() >= buffer_limit && !conn.read_paused) {
+            // 暂停读取：取消多次recv，剩余数据留在内核缓冲区中，由TCP流控限制对端
+            conn.read_paused = true;
+            if (conn.recv_armed) uring_->cancel(uringData(conn, kOpRecv), kUdIgnore);
+        }
+        // 每次收到数据就解析：流式请求体随即交给处理器
+        if (!processInput(conn)) return;
+    } else if (res == 0) {
+        conn.peer_closed = true;
+        processInput(conn);
+        return;
+    } else if (res != -ENOBUFS && res != -ECANCELED) {
+        closeConnection(conn);
+        return;
+    }
+
+    // 多次recv因提供缓冲区暂时用尽等原因结束：重新启动
+    if (!conn.recv_armed) armRecv(conn);
+}
+
+void EventLoop::armRecv(Connection& conn) {
+    if (conn.recv_armed || conn.closed || conn.peer_closed || conn.read_paused || conn.close_linked) return;
+    uring_->recvMultishot(conn.fd, uringData(conn, kOpRecv));
+    conn.recv_armed = true;
+    ++conn.uring_ops;
+}
+
+void EventLoop::armPollOut(Connection& conn) {
+    uring_->pollOnce(conn.fd, POLLOUT, uringData(conn, kOpPollOut));
+    conn.pollout_armed = true;
+    ++conn.uring_ops;
+}
+
+bool EventLoop::submitWrite(Connection& conn) {
+    // 上一组写入或可写等待尚未结束：由它们的完成事件继续发送
+    if (conn.write_ops > 0 || conn.pollout_armed || conn.close_linked) return true;
+    if (conn.output.empty()) return outputDrained(conn);
+
+    if (!conn.output.frontIsMemory()) {
+        // 文件片段（sendfile）和生成片段仍在循环线程上同步发送，缓冲区满时等待可写
+        size_t written = 0;
+        OutputBuffer::WriteResult result = conn.output.writeTo(conn.fd, written);
+        if (written > 0) server_.metrics_.bytes_sent.add(written);
+        if (result == OutputBuffer::WriteResult::Error) {
+            closeConnection(conn);
+            return false;
+        }
+        if (result == OutputBuffer::WriteResult::WouldBlock) {
+            armPollOut(conn);
+            return true;
+        }
+        return outputDrained(conn);
+    }
+
+    if (!conn.uring_write) conn.uring_write.reset(new UringWrite());
+    UringWrite& write = *conn.uring_write;
+    const std::shared_ptr<const std::string>* shared[UringWrite::kMaxIov];
+    bool all = false;
+    unsigned count = conn.output.peekMemory(write.iov, UringWrite::kMaxIov, shared, &all);
+
+    // 热点静态文件内容从固定缓冲区发送，之前的片段用sendmsg发送，两者链接
+    unsigned send_count = count;
+    write.fixed_slot = -1;
+    for (unsigned i = 0; i < count; ++i) {
+        if (shared[i] && (write.fixed_slot = fixedBufferSlot(*shared[i])) >= 0) {
+            send_count = i;
+            break;
+        }
+    }
+    bool use_fixed = write.fixed_slot >= 0;
+    write.send_length = 0;
+    for (unsigned i = 0; i < send_count; ++i) {
+        write.send_length += write.iov[i].iov_len;
+    }
+    write.fixed_length = use_fixed ? write.iov[send_count].iov_len : 0;
+
+    // 响应后关闭且本组写入包含全部剩余数据：链接关闭操作，写入完整成功后由内核直接关闭fd
+    bool link_close = all && (!use_fixed || send_count + 1 == count) && conn.close_after_write &&
+                      !conn.busy && !conn.async_active;
+    if (link_close && conn.recv_armed) {
+        // 挂起的recv持有套接字的引用，不取消时关闭操作无法真正释放连接
+        uring_->cancel(uringData(conn, kOpRecv), kUdIgnore);
+    }
+
+    conn.write_blocked = false;
+    conn.write_failed = false;
+    if (send_count > 0) {
+        write.msg = msghdr{};
+        write.msg.msg_iov = write.iov;
+        write.msg.msg_iovlen = send_count;
+        // 后面还有固定缓冲区写入时加MSG_MORE，两段合并发送，避免Nagle算法等待对端的延迟确认
+        uring_->sendmsg(conn.fd, &write.msg, MSG_NOSIGNAL | (use_fixed ? MSG_MORE : 0), uringData(conn, kOpSend),
+                        use_fixed || link_close);
+        ++conn.write_ops;
+    }
+    if (use_fixed) {
+        ++fixed_buffers_[write.fixed_slot].inflight;
+        uring_->writeFixed(conn.fd, write.iov[send_count].iov_base, write.fixed_length, write.fixed_slot,
+                           uringData(conn, kOpFixed), link_close);
+        ++conn.write_ops;
+    }
+    conn.uring_ops += conn.write_ops;
+    if (link_close) {
+        uring_->close(conn.fd, uringData(conn, kOpClose));
+        conn.close_linked = true;
+        ++conn.uring_ops;
+    }
+    return true;
+}
+
+void EventLoop::onWriteComplete(Connection& conn, uint64_t op, int32_t res) {
+    --conn.write_ops;
+    UringWrite& write = *conn.uring_write;
+    size_t expected = write.send_length;
+    if (op == kOpFixed) {
+        --fixed_buffers_[write.fixed_slot].inflight;
+        expected = write.fixed_length;
+    }
+
+    if (res > 0) {
+        conn.output.consume(res);
+        server_.metrics_.bytes_sent.add(res);
+        if (static_cast<size_t>(res) < expected) conn.write_blocked = true;
+    } else if (res == 0 || res == -EAGAIN) {
+        conn.write_blocked = true;
+    } else if (res != -ECANCELED) {
+        // 被取消说明链接在前面的写入不完整或出错，已由它的完成事件记录
+        conn.write_failed = true;
+    }
+
+    if (conn.write_ops > 0 || conn.closed) return;
+    if (conn.write_failed) {
+        closeConnection(conn);
+        return;
+    }
+    // 链接的关闭操作随后结束，由它的完成事件决定连接已关闭还是继续发送
+    if (conn.close_linked) return;
+    continueWrite(conn);
+}
+
+void EventLoop::continueWrite(Connection& conn) {
+    if (conn.write_blocked) {
+        // 套接字缓冲区已满：等待可写后再提交剩余数据
+        conn.write_blocked = false;
+        armPollOut(conn);
+        return;
+    }
+    submitWrite(conn);
+}
+
+int EventLoop::fixedBufferSlot(const std::shared_ptr<const std::string>& data) {
+    if (fixed_buffers_.empty() || data->size() < kFixedBufferMinSize || data->size() > kFixedBufferMaxSize) {
+        return -1;
+    }
+    auto found = fixed_slots_.find(data.get());
+    if (found != fixed_slots_.end()) {
+        fixed_buffers_[found->second].last_used = ++fixed_clock_;
+        return static_cast<int>(found->second);
+    }
+
+    // 发送次数达到阈值后才注册，偶尔访问的文件不占用槽位
+    if (fixed_hits_.size() >= kFixedHitsLimit) fixed_hits_.clear();
+    unsigned& hits = fixed_hits_[data.get()];
+    if (++hits < kFixedBufferHits) return -1;
+
+    // 替换空闲或最久未用的槽位；有在途写入的槽位不能替换
+    int victim = -1;
+    for (size_t i = 0; i < fixed_buffers_.size(); ++i) {
+        const FixedBuffer& slot = fixed_buffers_[i];
+        if (slot.inflight == 0 && (victim < 0 || slot.last_used < fixed_buffers_[victim].last_used)) {
+            victim = static_cast<int>(i);
+        }
+    }
+    if (victim < 0) return -1;
+    // 注册失败（如超出RLIMIT_MEMLOCK）时重新计数，稍后再试
+    if (!uring_->updateBuffer(victim, data->data(), data->size())) {
+        hits = 0;
+        return -1;
+    }
+
+    FixedBuffer& slot = fixed_buffers_[victim];
+    if (slot.data) fixed_slots_.erase(slot.data.get());
+    slot.data = data;
+    slot.last_used = ++fixed_clock_;
+    fixed_slots_[data.get()] = victim;
+    fixed_hits_.erase(data.get());
+    return victim;
+}
+
+void EventLoop::acceptConnections() {
+    while (true) {
+        sockaddr_in client_addr;
+        socklen_t addr_len = sizeof(client_addr);
+        int client_socket = accept4(listen_fd_, (struct sockaddr*)&client_addr, &addr_len,
+                                    SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_socket < 0) {
+            if (errno == EINTR) continue;
+            // fd耗尽：边缘触发下不取走等待中的连接就不会再有通知
+            if ((errno == EMFILE || errno == ENFILE) && shedPendingConnection()) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("接受连接失败");
+            }
+            return;
+        }
+
+        addConnection(client_socket);
+    }
+}
+
+Connection* EventLoop::addConnection(int client_socket) {
+    // 连接数已达上限：立即拒绝，不为它分配任何状态
+    size_t max_connections = server_.config_.max_connections;
+    if (server_.open_connections_.fetch_add(1, std::memory_order_relaxed) >= max_connections &&
+        max_connections > 0) {
+        server_.open_connections_.fetch_sub(1, std::memory_order_relaxed);
+        rejectConnection(client_socket);
+        return nullptr;
+    }
+
+    std::shared_ptr<Connection> conn = std::make_shared<Connection>();
+    conn->fd = client_socket;
+    conn->id = server_.next_connection_id_.fetch_add(1, std::memory_order_relaxed);
+    conn->request.setConnectionId(conn->id);
+    conn->deadline_timer.owner = conn.get();
+    conn->parser = RequestParser(server_.config_.max_header_size, server_.config_.max_body_size);
+
+    if (!uring_) {
+        // 读写事件一次注册，边缘触发下无需反复修改监听集合
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = client_socket;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, client_socket, &ev) < 0) {
+            perror("注册客户端套接字失败");
+            close(client_socket);
+            server_.open_connections_.fetch_sub(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+    }
+    Connection* result = conn.get();
+    refreshDeadline(*conn);
+    connections_[client_socket] = std::move(conn);
+    server_.metrics_.connections_accepted.add();
+    server_.metrics_.active_connections.add();
+    return result;
+}
+
+void EventLoop::handleRead(Connection& conn) {
+    // io_uring后端：数据由多次recv送达，这里只需确保它在进行
+    if (uring_) {
+        armRecv(conn);
+        return;
+    }
+
+    char buffer[kReadChunkSize];
+    const ServerConfig& config = server_.config_;
+    // 单个完整请求不会超过该大小，超出的部分是在途请求之后的流水线数据
+    const size_t buffer_limit = config.max_header_size + config.max_body_size + sizeof(buffer);
+
+    // 边缘触发：必须一直读到EAGAIN
+    size_t processed_size = 0;
+    size_t received = 0;
+    while (true) {
+        if (conn.in_buf.size() >= processed_size + kStreamFlushSize && !conn.busy) {
+            // 边读边解析：流式请求体随即交给处理器，接收缓冲不随请求体增长
+            server_.metrics_.bytes_received.add(received);
+            received = 0;
+            if (!processInput(conn)) return;
+            processed_size = conn.in_buf.size();
+        }
+        if (conn.in_buf.size() >= buffer_limit) {
+            // 暂停读取，剩余数据留在内核缓冲区中，由TCP流控限制对端
+            conn.read_paused = true;
+            break;
+        }
+
+        ssize_t n = read(conn.fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            conn.in_buf.append(buffer, n);
+            received += n;
+            continue;
+        }
+        if (n == 0) {
+            conn.peer_closed = true;
+            break;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        server_.metrics_.bytes_received.add(received);
+        closeConnection(conn);
+        return;
+    }
+
+    server_.metrics_.bytes_received.add(received);
+    if (processInput(conn)) refreshDeadline(conn);
+}
+
+bool EventLoop::processInput(Connection& conn) {
+    // 流水线请求：每次只分发一个，响应按顺序逐个返回；
+    // 处理函数在循环线程上执行时，同一次调用中依次处理缓冲区里的所有完整请求
+    while (!conn.busy && !conn.close_after_write) {
+        // HTTP/2连接（已升级或以连接前言开始）：接收缓冲中是帧
+        if (conn.http2) return processHttp2(conn);
+        // 已升级为WebSocket：接收缓冲中是WebSocket帧
+        if (conn.websocket) return processWebSocket(conn);
+        // 第一个请求之前收到HTTP/2连接前言（先验知识的h2c）
+        if (conn.requests_served == 0 && !conn.body_handler && !conn.in_buf.empty() &&
+            server_.config_.http2.enabled) {
+            size_t n = std::min(conn.in_buf.size(), kHttp2Preface.size());
+            if (std::string_view(conn.in_buf).substr(0, n) == kHttp2Preface.substr(0, n)) {
+                if (n < kHttp2Preface.size()) return true;
+                startHttp2(conn);
                 continue;
             }
-        } else if (s[i] == '+') {
-            res += ' ';
+        }
+
+        // 前面的响应还在发送且请求内存池已经较大：暂停分发，发送完毕重置内存池后再继续
+        if (!conn.output.empty() && conn.arena.bytesUsed() >= kArenaPauseThreshold && !conn.async_active) {
+            conn.input_paused = true;
+            return true;
+        }
+
+        // 在接收缓冲上继续上次的解析
+        RequestParser::Status status = conn.parser.parse(&conn.in_buf[0], conn.in_buf.size(), conn.request);
+
+        if (status == RequestParser::Status::Headers) {
+            if (!beginBody(conn)) return false;
+            continue;
+        }
+
+        if (status == RequestParser::Status::Error) {
+            return abortRequest(conn, conn.parser.errorCode());
+        }
+
+        // 流式请求体：把目前已解码的部分交给处理器
+        if (conn.body_handler && !streamBody(conn)) {
+            conn.body_aborted = true;
+            conn.in_buf.clear();
+            return dispatchRequest(conn);
+        }
+
+        if (status == RequestParser::Status::Incomplete) {
+            // 客户端在等待许可后才发送请求体
+            if (conn.expect_continue) {
+                conn.expect_continue = false;
+                conn.output.append(std::string("HTTP/1.1 100 Continue\r\n\r\n"));
+                if (!handleWrite(conn)) return false;
+            }
+            // 对端已关闭写端且没有更多完整请求：发送完剩余响应后关闭
+            if (conn.peer_closed) {
+                conn.close_after_write = true;
+                return handleWrite(conn);
+            }
+            return true;
+        }
+
+        size_t length = conn.parser.consumed();
+        if (conn.body_handler) {
+            // 流式请求的请求头已转移到Request，请求体已交给处理器
+            conn.in_buf.erase(0, length);
+        } else {
+            // 把请求数据的所有权交给Request：后续流水线数据不多时直接移交整个缓冲区，
+            // 只复制较短的剩余部分，避免复制请求本身；
+            // 上一个请求回收的缓冲（spare_buf）接替成为接收缓冲，稳态下两块缓冲交替使用
+            std::string& raw = conn.spare_buf;
+            raw.clear();
+            if (length == conn.in_buf.size()) {
+                raw.swap(conn.in_buf);
+            } else if (conn.in_buf.size() - length <= length) {
+                raw.assign(conn.in_buf, length, std::string::npos);
+                conn.in_buf.resize(length);
+                raw.swap(conn.in_buf);
+            } else {
+                raw.assign(conn.in_buf, 0, length);
+                conn.in_buf.erase(0, length);
+            }
+            conn.request.setRaw(std::move(raw));
+        }
+        if (!dispatchRequest(conn)) return false;
+    }
+    return true;
+}
+
+bool EventLoop::beginBody(Connection& conn) {
+    // 暂时把接收缓冲交给Request，以便按路径匹配流式路由
+    conn.request.swapRaw(conn.in_buf);
+    conn.body_handler = server_.router_.createBodyHandler(conn.request, &conn.body_route);
+
+    // 流式路由的并发已满：不接收请求体，直接拒绝
+    if (conn.body_handler && conn.body_route->limit) {
+        if (!conn.body_route->limit->tryAcquire()) {
+            conn.request.swapRaw(conn.in_buf);
+            return abortRequest(conn, 503);
+        }
+        conn.route_permit = conn.body_route->limit;
+    }
+
+    if (!conn.body_handler) {
+        // 普通路由：请求体随请求一起缓存在接收缓冲中
+        conn.request.swapRaw(conn.in_buf);
+    } else {
+        // 流式路由：请求头留在Request中，接收缓冲只保存尚未交给处理器的请求体
+        size_t offset = conn.parser.bodyOffset();
+        conn.request.swapRaw(conn.in_buf);
+        conn.spare_buf.assign(conn.in_buf, offset, std::string::npos);
+        conn.in_buf.resize(offset);
+        conn.request.setRaw(std::move(conn.in_buf));
+        conn.in_buf.swap(conn.spare_buf);
+        conn.parser.dropPrefix(offset);
+        conn.parser.setStreaming(server_.config_.max_streaming_body_size);
+
+        // 处理器拒绝该请求：不接收请求体，直接生成响应
+        if (!conn.body_handler->onHeaders(conn.request)) {
+            conn.body_aborted = true;
+            conn.in_buf.clear();
+            return dispatchRequest(conn);
+        }
+    }
+
+    std::string_view expect = conn.request.header("Expect");
+    conn.expect_continue = !expect.empty() && equalsIgnoreCase(expect, "100-continue") &&
+                           conn.request.version() == "HTTP/1.1";
+
+#ifdef WEBSERVER_HAS_COROUTINES
+    // 协程路由：请求头到达即启动处理函数，请求体随后经读取器交给它
+    if (conn.body_route && conn.body_route->async_body_handler) {
+        return startAsync(conn, *conn.body_route);
+    }
+#endif
+    return true;
+}
+
+bool EventLoop::streamBody(Connection& conn) {
+    size_t available = conn.parser.bodyAvailable();
+    if (available == 0) return true;
+
+    size_t offset = conn.parser.bodyOffset();
+    bool accepted = conn.body_handler->onData(std::string_view(conn.in_buf.data() + offset, available));
+    conn.in_buf.erase(offset, conn.parser.consumed() - offset);
+    conn.parser.dropBody();
+    return accepted;
+}
+
+bool EventLoop::dispatchRequest(Connection& conn) {
+    // 要求升级到h2c（请求体已完整接收时才能升级）
+    const Request& req = conn.request;
+    if (server_.config_.http2.enabled && !draining_ && !conn.body_handler && req.version() == "HTTP/1.1" &&
+        containsToken(req.header("Upgrade"), "h2c") && !req.header("HTTP2-Settings").empty()) {
+        return upgradeHttp2(conn);
+    }
+    // 要求升级为WebSocket（只支持版本13，其他版本由路由返回426）
+    if (server_.router_.hasWebSocketRoutes() && !conn.body_handler &&
+        containsToken(req.header("Upgrade"), "websocket") && req.header("Sec-WebSocket-Version") == "13") {
+        if (const Route* route = server_.router_.findWebSocketRoute(conn.request)) {
+            return upgradeWebSocket(conn, *route);
+        }
+    }
+
+    conn.parser.reset();
+    conn.expect_continue = false;
+    conn.busy = true;
+    // 处理期间不计时
+    conn.deadline_timer.cancel();
+    conn.deadline = ConnDeadline::None;
+
+#ifdef WEBSERVER_HAS_COROUTINES
+    // 协程处理函数已在请求头到达时启动：通知它请求体已结束，由它在完成时发送响应
+    if (conn.async_active) {
+        static_cast<BodyReader*>(conn.body_handler.get())->finish();
+        return true;
+    }
+    // 协程路由：在当前循环线程上执行
+    if (!conn.body_handler) {
+        if (const Route* route = server_.router_.findAsyncRoute(conn.request)) {
+            if (route->limit) {
+                if (!route->limit->tryAcquire()) return abortRequest(conn, 503);
+                conn.route_permit = route->limit;
+            }
+            return startAsync(conn, *route);
+        }
+    }
+#endif
+
+    // 达到单连接请求上限或请求体未读完时，本次响应将关闭连接
+    const ServerConfig& config = server_.config_;
+    bool keep_alive = conn.requests_served + 1 < config.max_keep_alive_requests && !conn.body_aborted;
+    RouteStats* body_stats = conn.body_route ? conn.body_route->stats : nullptr;
+
+    // 多反应器模式：直接在接受连接的循环线程上处理
+    if (inline_handlers_) {
+        server_.handleRequest(conn.request, keep_alive, conn.response, &conn.arena, conn.body_handler.get(),
+                              body_stats);
+        return finishRequest(conn, keep_alive);
+    }
+
+    // 线程池排队的请求已达上限：立即返回503，不让队列和延迟无限增长
+    if (server_.thread_pool_->queueDepth() >= config.max_queued_requests) {
+        return abortRequest(conn, 503);
+    }
+
+    // 完整请求交给线程池处理，结果通过post回到循环线程；
+    // 工作线程只访问连接的request、response、body_handler和arena，处理期间事件循环不会触碰它们
+    // 限制了排队时间时记下入队时间，排队过久的请求不再执行处理函数
+    auto queued_at = config.max_queue_delay_ms > 0 ? std::chrono::steady_clock::now()
+                                                   : std::chrono::steady_clock::time_point();
+    std::shared_ptr<Connection> self = conn.shared_from_this();
+    bool queued = server_.thread_pool_->enqueue([this, self = std::move(self), keep_alive, body_stats,
+                                                 queued_at]() mutable {
+        bool allow_keep_alive = keep_alive;
+        const ServerConfig& config = server_.config_;
+        if (queued_at != std::chrono::steady_clock::time_point() &&
+            std::chrono::steady_clock::now() - queued_at > std::chrono::milliseconds(config.max_queue_delay_ms)) {
+            // 客户端多半已经超时放弃，执行处理函数只会让后面的请求等得更久
+            server_.incrementRequestCount();
+            server_.metrics_.requests_shed.add();
+            self->response.append(server_.overload_response_);
+            allow_keep_alive = false;
+        } else {
+            server_.handleRequest(self->request, allow_keep_alive, self->response, &self->arena,
+                                  self->body_handler.get(), body_stats);
+        }
+        post([this, self = std::move(self), allow_keep_alive]() {
+            deliver(*self, allow_keep_alive);
+        });
+    });
+    if (!queued) return abortRequest(conn, 503);
+    return true;
+}
+
+bool EventLoop::finishRequest(Connection& conn, bool keep_alive) {
+    conn.busy = false;
+    conn.body_handler.reset();
+    conn.body_route = nullptr;
+    conn.body_aborted = false;
+    if (conn.route_permit) {
+        conn.route_permit->release();
+        conn.route_permit = nullptr;
+    }
+    conn.spare_buf = conn.request.recycle();
+    conn.requests_served++;
+    if (!keep_alive) {
+        conn.close_after_write = true;
+    }
+    conn.output.append(std::move(conn.response));
+    if (!handleWrite(conn)) return false;
+    refreshDeadline(conn);
+    return true;
+}
+
+void EventLoop::deliver(Connection& conn, bool keep_alive) {
+    // 连接在处理期间已关闭，丢弃响应
+    if (conn.closed) return;
+    if (!finishRequest(conn, keep_alive)) return;
+
+    // 继续处理缓冲区中已到达的流水线请求
+    if (!processInput(conn)) return;
+    if (conn.read_paused && !conn.busy) {
+        conn.read_paused = false;
+        handleRead(conn);
+        return;
+    }
+    refreshDeadline(conn);
+}
+
+bool EventLoop::handleWrite(Connection& conn) {
+    if (uring_) return submitWrite(conn);
+
+    size_t written = 0;
+    OutputBuffer::WriteResult result = conn.output.writeTo(conn.fd, written);
+    if (written > 0) server_.metrics_.bytes_sent.add(written);
+    if (result == OutputBuffer::WriteResult::Error) {
+        closeConnection(conn);
+        return false;
+    }
+    if (result == OutputBuffer::WriteResult::WouldBlock) {
+        // 有进展时顺延发送超时
+        if (written > 0) refreshDeadline(conn);
+        return true;
+    }
+    if (!outputDrained(conn)) return false;
+    refreshDeadline(conn);
+    return true;
+}
+
+bool EventLoop::outputDrained(Connection& conn) {
+    // 协程处理函数在接收请求体期间就已启动，其响应同样分配在内存池中
+    if (conn.busy || conn.async_active) return true;
+    if (conn.close_after_write) {
+        closeConnection(conn);
+        return false;
+    }
+    // HTTP/2连接：继续发送各个流的响应（它们不使用连接的内存池）
+    if (conn.http2) return flushHttp2(conn);
+
+    // 没有在途请求且响应已全部发出：内存池中的数据都已不再使用
+    conn.arena.reset();
+    if (conn.input_paused) {
+        conn.input_paused = false;
+        if (!processInput(conn)) return false;
+        if (conn.read_paused && !conn.busy) {
+            conn.read_paused = false;
+            // 读取中可能关闭连接（从连接表中删除），持有引用直到检查完毕
+            std::shared_ptr<Connection> self = conn.shared_from_this();
+            handleRead(conn);
+            return !conn.closed;
+        }
+    }
+    return true;
+}
+
+void EventLoop::refreshDeadline(Connection& conn) {
+    if (conn.closed || conn.busy) {
+        conn.deadline_timer.cancel();
+        conn.deadline = ConnDeadline::None;
+        return;
+    }
+
+    const ServerConfig& config = server_.config_;
+    ConnDeadline deadline;
+    int timeout_ms;
+    if (!conn.output.empty()) {
+        deadline = ConnDeadline::Send;
+        timeout_ms = config.send_timeout_ms;
+    } else if (conn.websocket) {
+        // WebSocket连接：已发送关闭帧时等待对端回应，否则空闲一段时间后发送ping
+        if (conn.websocket->session_.closeSent()) {
+            timeout_ms = config.keep_alive_timeout_ms;
+        } else if (config.websocket.ping_interval_ms > 0) {
+            timeout_ms = config.websocket.ping_interval_ms;
+        } else {
+            conn.deadline_timer.cancel();
+            conn.deadline = ConnDeadline::None;
+            return;
+        }
+        deadline = ConnDeadline::Idle;
+    } else if (conn.parser.receivingBody() || conn.async_active || (conn.http2 && conn.http2->session.awaitingData())) {
+        deadline = ConnDeadline::Body;
+        timeout_ms = config.body_timeout_ms;
+    } else if (conn.http2 && conn.http2->session.activeStreams() > 0) {
+        // HTTP/2的流都在处理中：与HTTP/1.1的在途请求一样不计时
+        conn.deadline_timer.cancel();
+        conn.deadline = ConnDeadline::None;
+        return;
+    } else if (!conn.in_buf.empty()) {
+        // 请求头的期限从第一个字节起算，之后陆续到达的数据不顺延（防止逐字节发送请求头占住连接）
+        if (conn.deadline == ConnDeadline::Header && conn.deadline_timer.armed()) return;
+        deadline = ConnDeadline::Header;
+        timeout_ms = config.header_timeout_ms;
+    } else {
+        deadline = ConnDeadline::Idle;
+        timeout_ms = config.keep_alive_timeout_ms;
+    }
+    conn.deadline = deadline;
+    deadlines_.schedule(conn.deadline_timer,
+                        std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms));
+}
+
+void EventLoop::expireDeadlines() {
+    deadlines_.advance(std::chrono::steady_clock::now(), [this](TimerWheel::Timer& timer) {
+        onDeadline(*static_cast<Connection*>(timer.owner));
+    });
+}
+
+void EventLoop::onDeadline(Connection& conn) {
+    // 处理期间持有连接：关闭连接时不会提前释放
+    std::shared_ptr<Connection> self = conn.shared_from_this();
+    if (conn.closed || conn.busy) return;
+
+    ConnDeadline deadline = conn.deadline;
+    conn.deadline = ConnDeadline::None;
+    if (conn.websocket && deadline == ConnDeadline::Idle) {
+        // WebSocket连接空闲：先发送ping，之后仍没有任何数据（或关闭握手没有完成）时断开
+        WebSocket& ws = *conn.websocket;
+        if (ws.ping_outstanding_ || ws.session_.closeSent()) {
+            closeConnection(conn);
+            return;
+        }
+        ws.ping_outstanding_ = true;
+        ws.session_.ping(conn.output);
+        if (handleWrite(conn)) refreshDeadline(conn);
+        return;
+    }
+    if (conn.http2 && deadline != ConnDeadline::Send) {
+        // HTTP/2连接：告知对端不再处理新的流，发送完后关闭
+        if (deadline == ConnDeadline::Body) server_.metrics_.request_timeouts.add();
+        conn.http2->session.goAway(conn.output);
+        conn.close_after_write = true;
+        handleWrite(conn);
+        return;
+    }
+    if ((deadline == ConnDeadline::Header || deadline == ConnDeadline::Body) && conn.output.empty()) {
+        // 请求没有按时到达：告知客户端后关闭
+        server_.metrics_.request_timeouts.add();
+        if (abortRequest(conn, 408)) refreshDeadline(conn);
+        return;
+    }
+    closeConnection(conn);
+}
+
+bool EventLoop::abortRequest(Connection& conn, int status) {
+    if (status == 503) {
+        server_.incrementRequestCount();
+        server_.metrics_.requests_shed.add();
+    } else {
+        server_.recordBadRequest(status);
+    }
+    // 请求可能尚未解析完（请求行指向接收缓冲），访问日志只记录连接和状态码
+    if (server_.access_log_) server_.access_log_->log("", "", "", status, -1, 0, conn.id);
+    // 该请求不会再交给处理函数
+    conn.busy = false;
+    conn.in_buf.clear();
+#ifdef WEBSERVER_HAS_COROUTINES
+    // 协程处理函数可能正在等待请求体：读取器留到协程结束后随连接释放
+    if (conn.async_active) {
+        cancelAsync(conn);
+    } else {
+        conn.body_handler.reset();
+    }
+#else
+    conn.body_handler.reset();
+#endif
+    if (status == 503) {
+        conn.output.append(server_.overload_response_);
+    } else {
+        conn.output.append(buildErrorResponse(status));
+    }
+    conn.close_after_write = true;
+    return handleWrite(conn);
+}
+
+bool EventLoop::shedPendingConnection() {
+    if (spare_fd_ < 0) return false;
+    close(spare_fd_);
+    int client_socket = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (client_socket >= 0) rejectConnection(client_socket);
+    spare_fd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    return client_socket >= 0;
+}
+
+void EventLoop::rejectConnection(int client_socket) {
+    // 先读掉已经到达的请求：接收缓冲区中留有数据时关闭会发送RST，客户端可能收不到响应
+    char discard[4096];
+    for (int i = 0; i < 4 && recv(client_socket, discard, sizeof(discard), MSG_DONTWAIT) > 0; ++i) {
+    }
+    const std::string& response = *server_.overload_response_;
+    send(client_socket, response.data(), response.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    close(client_socket);
+    server_.metrics_.connections_rejected.add();
+}
+
+void EventLoop::closeConnection(Connection& conn) {
+    int fd = conn.fd;
+    conn.closed = true;
+    conn.deadline_timer.cancel();
+    if (conn.route_permit) {
+        conn.route_permit->release();
+        conn.route_permit = nullptr;
+    }
+#ifdef WEBSERVER_HAS_COROUTINES
+    if (conn.async_active) cancelAsync(conn);
+#endif
+    // 关闭所有HTTP/2流：归还路由名额，唤醒等待请求体的协程处理函数
+    if (conn.http2) conn.http2->session.closeAll();
+    // WebSocket连接：退订所有主题，通知处理器
+    if (conn.websocket) {
+        conn.websocket->detach();
+        server_.metrics_.websocket_connections.add(-1);
+    }
+    if (uring_) {
+        // 取消挂起的操作：它们持有套接字的引用，不取消时连接无法真正关闭
+        if (conn.recv_armed) uring_->cancel(uringData(conn, kOpRecv), kUdIgnore);
+        if (conn.pollout_armed) uring_->cancel(uringData(conn, kOpPollOut), kUdIgnore);
+        // 链接的关闭操作尚未结束时由它关闭fd（被取消时由其完成事件关闭）
+        if (!conn.close_linked) close(fd);
+        // 在途操作结束前保留连接：它们的user_data指向连接
+        if (conn.uring_ops > 0) closing_.emplace(&conn, conn.shared_from_this());
+    } else {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+    }
+    connections_.erase(fd);
+    server_.open_connections_.fetch_sub(1, std::memory_order_relaxed);
+    server_.metrics_.active_connections.add(-1);
+}
+
+#ifdef WEBSERVER_HAS_COROUTINES
+// 协程处理函数的支持：驱动协程、请求体读取器、可等待对象
+
+namespace {
+
+// 启动后独立运行、结束时自行销毁的协程（启动者不等待其结果）
+struct DetachedCoroutine {
+    struct promise_type {
+        DetachedCoroutine get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+};
+
+}  // namespace
+
+// 协程处理函数的驱动：持有连接直到处理函数结束，再在循环线程上发送响应
+struct AsyncDriver {
+    static DetachedCoroutine run(EventLoop& loop, std::shared_ptr<Connection> conn, const Route* route) {
+        loop.server_.incrementRequestCount();
+        auto started = std::chrono::steady_clock::now();
+
+        bool keep_alive = false;
+        bool deliverable;
+        {
+            // 响应在发送前销毁：发送完毕后内存池即被重置
+            Response res(&conn->arena);
+            bool failed = false;
+            try {
+                if (route->async_handler) {
+                    co_await route->async_handler(conn->request, res);
+                } else {
+                    // 没有请求体的请求使用一个已结束的读取器
+                    BodyReader empty;
+                    BodyReader* reader = static_cast<BodyReader*>(conn->body_handler.get());
+                    if (reader == nullptr) {
+                        empty.finish();
+                        reader = &empty;
+                    }
+                    co_await route->async_body_handler(conn->request, *reader, res);
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "协程处理函数异常: " << e.what() << std::endl;
+                failed = true;
+            } catch (...) {
+                std::cerr << "协程处理函数异常" << std::endl;
+                failed = true;
+            }
+            if (failed) {
+                res = Response(&conn->arena);
+                setErrorPage(res, 500);
+            }
+            deliverable = loop.prepareAsyncResponse(*conn, res, route->stats, started, keep_alive);
+        }
+        if (deliverable) loop.completeAsync(*conn, keep_alive);
+    }
+
+    // HTTP/2流上的协程处理函数（见Http2Connection::startAsync）
+    static DetachedCoroutine runHttp2(EventLoop& loop, std::shared_ptr<Connection> conn,
+                                      std::shared_ptr<Http2Stream> stream, const Route* route);
+};
+
+bool EventLoop::startAsync(Connection& conn, const Route& route) {
+    conn.async_active = true;
+    conn.async_starting = true;
+    conn.async_done = false;
+    AsyncDriver::run(*this, conn.shared_from_this(), &route);
+    conn.async_starting = false;
+    if (!conn.async_done) return true;
+
+    // 处理函数没有挂起就已结束：与普通处理函数一样直接发送
+    conn.async_done = false;
+    return finishRequest(conn, conn.async_keep_alive);
+}
+
+bool EventLoop::prepareAsyncResponse(Connection& conn, Response& res, RouteStats* stats,
+                                     std::chrono::steady_clock::time_point started, bool& keep_alive) {
+    if (conn.closed || !conn.async_active) return false;
+    conn.async_active = false;
+
+    if (!conn.busy) {
+        // 处理函数在请求体接收完之前结束：不再接收剩余请求体，响应后关闭连接
+        conn.busy = true;
+        conn.body_aborted = true;
+        conn.expect_continue = false;
+        conn.in_buf.clear();
+        conn.parser.reset();
+    }
+
+    const ServerConfig& config = server_.config_;
+    keep_alive = conn.requests_served + 1 < config.max_keep_alive_requests && !conn.body_aborted;
+    server_.finishResponse(conn.request, res, keep_alive, conn.response, stats, started);
+    return true;
+}
+
+void EventLoop::completeAsync(Connection& conn, bool keep_alive) {
+    if (conn.async_starting) {
+        conn.async_done = true;
+        conn.async_keep_alive = keep_alive;
+        return;
+    }
+    deliver(conn, keep_alive);
+}
+
+void EventLoop::cancelAsync(Connection& conn) {
+    conn.async_active = false;
+    if (conn.body_route && conn.body_route->async_body_handler && conn.body_handler) {
+        static_cast<BodyReader*>(conn.body_handler.get())->abort();
+    }
+}
+
+EventLoop& currentLoop() {
+    EventLoop* loop = EventLoop::current();
+    if (loop == nullptr) throw std::logic_error("只能在事件循环线程上等待该操作");
+    return *loop;
+}
+
+// BodyReader类实现
+void BodyReader::wake() {
+    if (!waiter_) return;
+    std::coroutine_handle<> handle = waiter_;
+    waiter_ = nullptr;
+    loop_->post([handle]() { handle.resume(); });
+}
+
+bool BodyReader::onData(std::string_view chunk) {
+    chunks_.emplace_back(chunk);
+    buffered_ += chunk.size();
+    wake();
+    return true;
+}
+
+void BodyReader::finish() {
+    finished_ = true;
+    wake();
+}
+
+void BodyReader::abort() {
+    aborted_ = true;
+    wake();
+}
+
+void BodyReader::NextAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    reader_.waiter_ = handle;
+    reader_.loop_ = &currentLoop();
+}
+
+std::optional<std::string> BodyReader::NextAwaiter::await_resume() {
+    if (reader_.chunks_.empty()) return std::nullopt;
+    std::string chunk = std::move(reader_.chunks_.front());
+    reader_.chunks_.pop_front();
+    reader_.buffered_ -= chunk.size();
+    return chunk;
+}
+
+std::optional<std::string> readWholeFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return std::nullopt;
+    FileDescriptor file(fd);
+
+    std::string content;
+    char buffer[65536];
+    while (true) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            content.append(buffer, n);
             continue;
         }
-        res += s[i];
+        if (n == 0) return content;
+        if (errno != EINTR) return std::nullopt;
     }
-    return res;
 }
 
-// Request类实现：解析HTTP请求
-bool Request::parse(const std::string& data) {
-    std::istringstream iss(data);
-    std::string line;
-
-    // 解析请求行（方法、路径、协议）
-    if (!std::getline(iss, line)) return false;
-    std::istringstream request_line(line);
-    if (!(request_line >> method_ >> path_)) return false;
-
-    // 解析查询参数（路径中的?后面部分）
-    size_t query_pos = path_.find('?');
-    if (query_pos != std::string::npos) {
-        std::string query = path_.substr(query_pos + 1);
-        path_ = path_.substr(0, query_pos);
-
-        // 解析key=value形式的查询参数
-        size_t pos = 0;
-        while (pos < query.size()) {
-            size_t eq_pos = query.find('=', pos);
-            size_t and_pos = query.find('&', pos);
-            if (eq_pos == std::string::npos || eq_pos > and_pos) break;
-
-            std::string key = query.substr(pos, eq_pos - pos);
-            std::string value = (and_pos != std::string::npos) 
-                ? query.substr(eq_pos + 1, and_pos - eq_pos - 1)
-                : query.substr(eq_pos + 1);
-            
-            // URL解码
-            key = urlDecode(key);
-            value = urlDecode(value);
-            
-            query_params_[key] = value;
-            pos = (and_pos != std::string::npos) ? and_pos + 1 : query.size();
-        }
-    }
-
-    // 解析请求头
-    while (std::getline(iss, line) && line != "\r") {
-        if (line.back() == '\r') line.pop_back(); // 移除\r
-        size_t colon_pos = line.find(':');
-        if (colon_pos != std::string::npos) {
-            std::string key = line.substr(0, colon_pos);
-            std::string value = line.substr(colon_pos + 2); // 跳过冒号和空格
-            headers_[key] = value;
-        }
-    }
-
-    // 解析请求体（简化实现，仅处理Content-Length指定的长度）
-    auto it = headers_.find("Content-Length");
-    if (it != headers_.end()) {
-        try {
-            size_t len = std::stoul(it->second);
-            char* buffer = new char[len + 1];
-            iss.read(buffer, len);
-            buffer[len] = '\0';
-            body_ = buffer;
-            delete[] buffer;
-        } catch (...) {
-            return false;
+// AsyncSocket类实现
+bool AsyncSocket::beginConnect(const std::string& host, uint16_t port, int& error) {
+    close();
+    loop_ = &currentLoop();
+
+    sockaddr_storage addr{};
+    socklen_t addr_len;
+    auto* addr4 = reinterpret_cast<sockaddr_in*>(&addr);
+    auto* addr6 = reinterpret_cast<sockaddr_in6*>(&addr);
+    if (inet_pton(AF_INET, host.c_str(), &addr4->sin_addr) == 1) {
+        addr4->sin_family = AF_INET;
+        addr4->sin_port = htons(port);
+        addr_len = sizeof(sockaddr_in);
+    } else if (inet_pton(AF_INET6, host.c_str(), &addr6->sin6_addr) == 1) {
+        addr6->sin6_family = AF_INET6;
+        addr6->sin6_port = htons(port);
+        addr_len = sizeof(sockaddr_in6);
+    } else {
+        error = EINVAL;
+        return true;
+    }
+
+    int fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        error = errno;
+        return true;
+    }
+    int rc = ::connect(fd, reinterpret_cast<sockaddr*>(&addr), addr_len);
+    if (rc < 0 && errno != EINPROGRESS) {
+        error = errno;
+        ::close(fd);
+        return true;
+    }
+    // 发起连接之后再注册，未连接的套接字会立即报告EPOLLHUP
+    if (!loop_->watch(fd, this)) {
+        error = errno;
+        ::close(fd);
+        return true;
+    }
+    fd_ = fd;
+    error = 0;
+    return rc == 0;
+}
+
+void AsyncSocket::onIoEvent(uint32_t events) {
+    // 先推进所有操作再恢复协程：恢复后的协程可能销毁本套接字，等待结果保存在各自的操作对象中
+    std::coroutine_handle<> ready[3];
+    size_t count = 0;
+
+    if (connecting_ && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if (getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &len) < 0) error = errno;
+        connecting_->error_ = error;
+        ready[count++] = connecting_->handle_;
+        connecting_ = nullptr;
+    }
+    if (reading_ && (events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) && reading_->attempt()) {
+        ready[count++] = reading_->handle_;
+        reading_ = nullptr;
+    }
+    if (writing_ && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) && writing_->attempt()) {
+        ready[count++] = writing_->handle_;
+        writing_ = nullptr;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        ready[i].resume();
+    }
+}
+
+bool AsyncSocket::ReadAwaiter::attempt() {
+    if (socket_.fd_ == -1) {
+        result_ = -EBADF;
+        return true;
+    }
+    while (true) {
+        ssize_t n = ::read(socket_.fd_, buffer_, size_);
+        if (n >= 0) {
+            result_ = n;
+            return true;
         }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return false;
+        result_ = -errno;
+        return true;
     }
+}
 
+bool AsyncSocket::WriteAwaiter::attempt() {
+    if (socket_.fd_ == -1) {
+        result_ = -EBADF;
+        return true;
+    }
+    while (written_ < data_.size()) {
+        ssize_t n = send(socket_.fd_, data_.data() + written_, data_.size() - written_, MSG_NOSIGNAL);
+        if (n >= 0) {
+            written_ += n;
+            continue;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return false;
+        result_ = -errno;
+        return true;
+    }
+    result_ = static_cast<ssize_t>(written_);
     return true;
 }
 
-// Response类实现：构建和发送响应
-std::string Response::buildResponse() const {
-    std::string response;
+void AsyncSocket::close() {
+    if (fd_ == -1) return;
+    loop_->unwatch(fd_);
+    ::close(fd_);
+    fd_ = -1;
+}
+#endif
 
-    // 状态行
-    response += "HTTP/1.1 " + std::to_string(status_code_) + " " + status_text_ + "\r\n";
+// Http2Connection类实现
+void Http2Connection::onRequestHeaders(const std::shared_ptr<Http2Stream>& stream) {
+    // 与HTTP/1.1相同：流式路由和协程路由在请求头到达时就选定请求体的接收方
+    WebServer& server = loop.server_;
+    stream->request.setConnectionId(conn.id);
+    stream->body_handler = server.router_.createBodyHandler(stream->request, &stream->body_route);
+    if (!stream->body_handler) return;
+    if (stream->body_route->limit) {
+        if (!stream->body_route->limit->tryAcquire()) {
+            stream->body_handler.reset();
+            stream->body_route = nullptr;
+            stream->error_status = 503;
+            return;
+        }
+        stream->route_permit = stream->body_route->limit;
+    }
+    if (!stream->body_handler->onHeaders(stream->request)) {
+        stream->body_aborted = true;
+        return;
+    }
+#ifdef WEBSERVER_HAS_COROUTINES
+    if (stream->body_route->async_body_handler) startAsync(stream, *stream->body_route);
+#endif
+}
 
-    // 响应头（C++11兼容写法）
-    for (std::map<std::string, std::string>::const_iterator it = headers_.begin(); 
-         it != headers_.end(); ++it) {
-        response += it->first + ": " + it->second + "\r\n";
+void Http2Connection::onRequest(const std::shared_ptr<Http2Stream>& stream) {
+    WebServer& server = loop.server_;
+    stream->request.setConnectionId(conn.id);
+#ifdef WEBSERVER_HAS_COROUTINES
+    // 协程处理函数已在请求头之后启动：通知它请求体已结束（或被中止）
+    if (stream->async_active) {
+        static_cast<BodyReader*>(stream->body_handler.get())->finish();
+        return;
     }
+#endif
+    if (stream->error_status != 0) {
+        reject(*stream, stream->error_status);
+        return;
+    }
+#ifdef WEBSERVER_HAS_COROUTINES
+    if (!stream->body_handler) {
+        if (const Route* route = server.router_.findAsyncRoute(stream->request)) {
+            if (route->limit) {
+                if (!route->limit->tryAcquire()) {
+                    reject(*stream, 503);
+                    return;
+                }
+                stream->route_permit = route->limit;
+            }
+            startAsync(stream, *route);
+            return;
+        }
+    }
+#endif
 
-    // 空行分隔头和体
-    response += "\r\n";
+    RouteStats* body_stats = stream->body_route ? stream->body_route->stats : nullptr;
+    if (loop.inline_handlers_) {
+        complete(*stream, server.handleHttp2Request(stream->request, stream->body_handler.get(), body_stats));
+        return;
+    }
 
-    // 响应体
-    response += body_;
+    const ServerConfig& config = server.config_;
+    if (server.thread_pool_->queueDepth() >= config.max_queued_requests) {
+        reject(*stream, 503);
+        return;
+    }
+    // 同一连接上的各个流并行处理；工作线程只访问流的request和body_handler
+    auto queued_at = config.max_queue_delay_ms > 0 ? std::chrono::steady_clock::now()
+                                                   : std::chrono::steady_clock::time_point();
+    EventLoop* owner = &loop;
+    bool queued = server.thread_pool_->enqueue([owner, self = conn.shared_from_this(), stream, body_stats,
+                                                queued_at]() mutable {
+        WebServer& server = owner->server_;
+        const ServerConfig& config = server.config_;
+        std::unique_ptr<Response> res;
+        if (queued_at != std::chrono::steady_clock::time_point() &&
+            std::chrono::steady_clock::now() - queued_at > std::chrono::milliseconds(config.max_queue_delay_ms)) {
+            server.incrementRequestCount();
+            server.metrics_.requests_shed.add();
+            res.reset(new Response());
+            setErrorPage(*res, 503);
+            server.finishHttp2Response(stream->request, *res, nullptr, std::chrono::steady_clock::now());
+        } else {
+            res = server.handleHttp2Request(stream->request, stream->body_handler.get(), body_stats);
+        }
+        owner->post([self = std::move(self), stream = std::move(stream), res = std::move(res)]() mutable {
+            // 连接在处理期间已关闭：流已随之关闭，丢弃响应
+            if (self->closed) return;
+            self->http2->complete(*stream, std::move(res));
+        });
+    });
+    if (!queued) reject(*stream, 503);
+}
 
-    return response;
+void Http2Connection::onStreamClosed(Http2Stream& stream) {
+    if (stream.route_permit) {
+        stream.route_permit->release();
+        stream.route_permit = nullptr;
+    }
+#ifdef WEBSERVER_HAS_COROUTINES
+    // 放弃协程处理函数的响应，唤醒等待请求体的协程（读取器留到协程结束后随流释放）
+    if (stream.async_active) {
+        stream.async_active = false;
+        if (stream.body_route && stream.body_route->async_body_handler && stream.body_handler) {
+            static_cast<BodyReader*>(stream.body_handler.get())->abort();
+        }
+    }
+#endif
 }
 
-bool Response::send() const {
-    std::string response = buildResponse();
-    // 使用全局send函数（::避免与类方法冲突）
-    ssize_t bytes_sent = ::send(socket_fd_, response.c_str(), response.size(), 0);
-    if (bytes_sent == -1) {
-        perror("发送响应失败");
-        return false;
+void Http2Connection::complete(Http2Stream& stream, std::unique_ptr<Response> response) {
+    if (stream.route_permit) {
+        stream.route_permit->release();
+        stream.route_permit = nullptr;
+    }
+    // 响应先于请求体结束时不再接收剩余的请求体（响应发出后重置该流）
+    stream.body_aborted = true;
+    stream.body_handler.reset();
+    conn.requests_served++;
+    session.respond(stream, std::move(response));
+    if (!receiving) loop.flushHttp2(conn);
+}
+
+void Http2Connection::reject(Http2Stream& stream, int status) {
+    WebServer& server = loop.server_;
+    if (status == 503) {
+        server.incrementRequestCount();
+        server.metrics_.requests_shed.add();
+    } else {
+        server.recordBadRequest(status);
+    }
+    std::unique_ptr<Response> res(new Response());
+    setErrorPage(*res, status);
+    server.finishHttp2Response(stream.request, *res, nullptr, std::chrono::steady_clock::now());
+    complete(stream, std::move(res));
+}
+
+#ifdef WEBSERVER_HAS_COROUTINES
+void Http2Connection::startAsync(const std::shared_ptr<Http2Stream>& stream, const Route& route) {
+    stream->async_active = true;
+    stream->dispatched = true;
+    AsyncDriver::runHttp2(loop, conn.shared_from_this(), stream, &route);
+}
+
+void Http2Connection::finishAsync(Http2Stream& stream, std::unique_ptr<Response> response, RouteStats* stats,
+                                  std::chrono::steady_clock::time_point started) {
+    if (conn.closed || !stream.async_active) return;
+    stream.async_active = false;
+    loop.server_.finishHttp2Response(stream.request, *response, stats, started);
+    complete(stream, std::move(response));
+}
+
+DetachedCoroutine AsyncDriver::runHttp2(EventLoop& loop, std::shared_ptr<Connection> conn,
+                                        std::shared_ptr<Http2Stream> stream, const Route* route) {
+    loop.server_.incrementRequestCount();
+    auto started = std::chrono::steady_clock::now();
+
+    // 响应由会话在发送时才编码，不能分配在连接的内存池中
+    std::unique_ptr<Response> res(new Response());
+    bool failed = false;
+    try {
+        if (route->async_handler) {
+            co_await route->async_handler(stream->request, *res);
+        } else {
+            BodyReader empty;
+            BodyReader* reader = static_cast<BodyReader*>(stream->body_handler.get());
+            if (reader == nullptr) {
+                empty.finish();
+                reader = &empty;
+            }
+            co_await route->async_body_handler(stream->request, *reader, *res);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "协程处理函数异常: " << e.what() << std::endl;
+        failed = true;
+    } catch (...) {
+        std::cerr << "协程处理函数异常" << std::endl;
+        failed = true;
     }
+    if (failed) {
+        *res = Response();
+        setErrorPage(*res, 500);
+    }
+    conn->http2->finishAsync(*stream, std::move(res), route->stats, started);
+}
+#endif
+
+void EventLoop::startHttp2(Connection& conn) {
+    conn.http2.reset(new Http2Connection(*this, conn));
+    conn.http2->session.start(conn.output);
+}
+
+bool EventLoop::upgradeHttp2(Connection& conn) {
+    conn.parser.reset();
+    conn.expect_continue = false;
+    std::string settings(conn.request.header("HTTP2-Settings"));
+    conn.output.append(std::string("HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n"));
+    startHttp2(conn);
+
+    Http2Connection& http2 = *conn.http2;
+    http2.receiving = true;
+    bool upgraded = http2.session.upgrade(settings, std::move(conn.request), conn.output);
+    http2.receiving = false;
+    conn.request = Request();
+    if (!upgraded) {
+        conn.close_after_write = true;
+        return handleWrite(conn);
+    }
+    // 之后的数据（客户端的连接前言）由processInput交给会话
     return true;
 }
 
-// Router类实现：处理路由和静态文件
-void Router::handle(const Request& req, Response& res) const {
-    // 先检查是否是静态文件请求
-    if (!static_dir_.empty() && req.method() == "GET") {
-        std::string file_path = static_dir_ + req.path();
-        
-        // 处理根路径请求（返回index.html）
-        if (req.path() == "/") {
-            file_path += "index.html";
-        }
-        
-        // 尝试打开文件
-        std::ifstream file(file_path, std::ios::binary);
-        if (file.good()) {
-            // 读取文件内容
-            std::string content((std::istreambuf_iterator<char>(file)), 
-                               std::istreambuf_iterator<char>());
-            
-            // 设置正确的Content-Type
-            std::string ext = file_path.substr(file_path.find_last_of(".") + 1);
-            std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-            
-            std::map<std::string, std::string> mime_types = {
-                {"html", "text/html"},
-                {"css", "text/css"},
-                {"js", "application/javascript"},
-                {"png", "image/png"},
-                {"jpg", "image/jpeg"},
-                {"jpeg", "image/jpeg"},
-                {"gif", "image/gif"},
-                {"ico", "image/x-icon"},
-                {"svg", "image/svg+xml"}
-            };
-            
-            if (mime_types.count(ext)) {
-                res.setHeader("Content-Type", mime_types[ext]);
-            } else {
-                res.setHeader("Content-Type", "application/octet-stream");
+bool EventLoop::processHttp2(Connection& conn) {
+    Http2Connection& http2 = *conn.http2;
+    http2.receiving = true;
+    bool ok = http2.session.receive(conn.in_buf, conn.output);
+    http2.receiving = false;
+    // 对端已关闭写端：不会再有新的流，已开始的流完成后关闭
+    if (ok && conn.peer_closed) http2.session.goAway(conn.output);
+    return flushHttp2(conn);
+}
+
+bool EventLoop::flushHttp2(Connection& conn) {
+    Http2Connection& http2 = *conn.http2;
+    // 发送完毕的回调（outputDrained）中再次进入：由外层继续
+    if (http2.flushing) return true;
+    http2.flushing = true;
+    while (true) {
+        http2.session.flush(conn.output);
+        if (http2.session.finished()) conn.close_after_write = true;
+        if (conn.output.empty()) {
+            if (conn.close_after_write) {
+                closeConnection(conn);
+                return false;
             }
-            
-            res.setContent(content);
-            return;
+            break;
         }
+        if (!handleWrite(conn)) return false;
+        // 套接字缓冲区已满（或io_uring的写入尚未结束）：发送完毕后由outputDrained继续
+        if (!conn.output.empty()) break;
+    }
+    http2.flushing = false;
+    refreshDeadline(conn);
+    return true;
+}
+
+bool EventLoop::upgradeWebSocket(Connection& conn, const Route& route) {
+    auto started = std::chrono::steady_clock::now();
+    const Request& req = conn.request;
+    std::string_view key = req.header("Sec-WebSocket-Key");
+    if (req.methodId() != HttpMethod::Get || req.version() != "HTTP/1.1" ||
+        !containsToken(req.header("Connection"), "upgrade") || !validWebSocketKey(key)) {
+        return abortRequest(conn, 400);
+    }
+    if (draining_) return abortRequest(conn, 503);
+    // 并发上限限制同时打开的连接数，名额在连接关闭时归还
+    if (route.limit) {
+        if (!route.limit->tryAcquire()) return abortRequest(conn, 503);
+        conn.route_permit = route.limit;
     }
 
-    // 处理路由
-    auto method_it = routes_.find(req.method());
-    if (method_it != routes_.end()) {
-        auto path_it = method_it->second.find(req.path());
-        if (path_it != method_it->second.end()) {
-            path_it->second(req, res);
-            return;
+    conn.parser.reset();
+    conn.expect_continue = false;
+    conn.output.append("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                       "Sec-WebSocket-Accept: " + webSocketAccept(key) + "\r\n\r\n");
+    const WebSocketConfig& config = server_.config_.websocket;
+    conn.websocket = std::make_shared<WebSocket>(*this, conn, route.websocket_factory(), config.max_message_size);
+    server_.metrics_.websocket_connections.add();
+    server_.incrementRequestCount();
+    conn.websocket->handler_->onOpen(*conn.websocket, conn.request);
+
+    uint64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started).count();
+    if (route.stats) route.stats->record(101, micros);
+    server_.logAccess(conn.request, 101, 0, micros);
+    conn.spare_buf = conn.request.recycle();
+    conn.requests_served++;
+    // 握手之后已到达的帧由processInput交给会话
+    return handleWrite(conn);
+}
+
+bool EventLoop::processWebSocket(Connection& conn) {
+    WebSocket& ws = *conn.websocket;
+    ws.ping_outstanding_ = false;
+    bool ok = ws.session_.receive(conn.in_buf, conn.output);
+    if (!ok) conn.in_buf.clear();
+    // 关闭握手已完成或出现协议错误；对端关闭写端时不会再收到关闭帧
+    if (!ok || ws.session_.finished() || conn.peer_closed) conn.close_after_write = true;
+    return handleWrite(conn);
+}
+
+void EventLoop::flushWebSockets() {
+    // 发送过程中可能有新的帧加入（如outputDrained中继续处理），交换出来后再遍历
+    std::vector<std::shared_ptr<Connection>> pending;
+    pending.swap(ws_flush_);
+    const size_t max_send_buffer = server_.config_.websocket.max_send_buffer;
+    for (const std::shared_ptr<Connection>& conn : pending) {
+        if (conn->closed) continue;
+        conn->websocket->flush_queued_ = false;
+        if (max_send_buffer > 0 && conn->output.pendingBytes() > max_send_buffer) {
+            // 接收过慢的连接：断开而不是无限缓存广播的消息
+            server_.metrics_.websocket_slow_consumers.add();
+            closeConnection(*conn);
+            continue;
         }
+        if (handleWrite(*conn)) refreshDeadline(*conn);
     }
-    
-    // 未找到路由，使用404处理函数
-    not_found_handler_(req, res);
+    // 保留容量供下一轮使用
+    pending.clear();
+    if (ws_flush_.empty()) ws_flush_.swap(pending);
+}
+
+void EventLoop::publishWebSocket(const std::string& topic, const std::shared_ptr<const std::string>& frame) {
+    auto it = ws_topics_.find(topic);
+    if (it == ws_topics_.end()) return;
+    // 只加入发送队列（不做I/O），订阅者列表在遍历期间不会变化
+    for (WebSocket* ws : it->second) {
+        ws->queueFrame(frame);
+    }
+}
+
+void EventLoop::removeSubscriber(const std::string& topic, WebSocket* ws) {
+    auto it = ws_topics_.find(topic);
+    if (it == ws_topics_.end()) return;
+    std::vector<WebSocket*>& subscribers = it->second;
+    auto pos = std::find(subscribers.begin(), subscribers.end(), ws);
+    if (pos != subscribers.end()) {
+        *pos = subscribers.back();
+        subscribers.pop_back();
+    }
+    if (subscribers.empty()) ws_topics_.erase(it);
 }
 
 // WebServer类实现：服务器核心逻辑
-WebServer::WebServer(int port, size_t thread_count)
-    : port_(port) {
-    // 初始化线程池（C++11兼容方式）
-    thread_pool_.reset(new ThreadPool(thread_count));
+WebServer::WebServer(int port, size_t thread_count, IoBackend backend)
+    : port_(port), io_backend_(backend) {
+    // 初始化线程池（C++11兼容方式）：队列已满时拒绝而不是阻塞事件循环，被拒绝的请求返回503
+    thread_pool_.reset(new ThreadPool(thread_count, 4096, ThreadPool::OverflowPolicy::Reject));
 
     // 初始化地址结构
     std::memset(&address_, 0, sizeof(address_));
@@ -202,91 +3606,645 @@ WebServer::WebServer(int port, size_t thread_count)
     address_.sin_port = htons(port_);
 }
 
-void WebServer::handleClient(int client_socket) {
+WebServer::~WebServer() {
+    // 先停止各反应器线程，再停止线程池，避免工作线程回投到已销毁的事件循环
+    for (auto& loop : loops_) {
+        loop->stop();
+    }
+    for (std::thread& thread : loop_threads_) {
+        if (thread.joinable()) thread.join();
+    }
+    thread_pool_.reset();
+    loops_.clear();
+    for (int fd : listen_fds_) {
+        close(fd);
+    }
+    // 所有可能写入访问日志的线程都已停止，写出剩余的条目
+    access_log_.reset();
+}
+
+void WebServer::handleRequest(Request& req, bool& keep_alive, OutputBuffer& out,
+                              std::pmr::memory_resource* arena, BodyHandler* body_handler,
+                              RouteStats* body_stats) {
     // 增加请求计数
     incrementRequestCount();
-    
-    // 读取客户端请求
-    char buffer[4096] = {0};
-    ssize_t bytes_read = read(client_socket, buffer, sizeof(buffer) - 1);
-    if (bytes_read <= 0) {
-        close(client_socket);
-        return;
+    auto started = std::chrono::steady_clock::now();
+
+    // 处理请求（响应头分配在请求内存池中）
+    Response res(arena);
+    RouteStats* stats = body_stats;
+    if (body_handler) {
+        body_handler->onComplete(req, res);
+    } else {
+        stats = router_.handle(req, res);
     }
-    buffer[bytes_read] = '\0';
-
-    // 解析请求
-    Request req;
-    if (!req.parse(buffer)) {
-        Response res(client_socket);
-        res.setStatusCode(400, "Bad Request");
-        res.setHtml("<html>"
-                    "<head><title>400 Bad Request</title></head>"
-                    "<body><h1>400 Bad Request</h1></body></html>");
-        res.send();
-        close(client_socket);
-        return;
+    finishResponse(req, res, keep_alive, out, stats, started);
+}
+
+// 不保持连接时的响应头
+static const std::string_view kConnectionCloseHeader = "Connection: close\r\n";
+
+void WebServer::finishResponse(const Request& req, Response& res, bool& keep_alive, OutputBuffer& out,
+                               RouteStats* stats, std::chrono::steady_clock::time_point started) {
+    // HEAD请求不发送响应体，不必压缩；HTTP/1.0不支持分块传输编码，大的响应体也一次压缩完
+    if (req.methodId() != HttpMethod::Head) {
+        res.compress(req.header("Accept-Encoding"), config_.compression, req.version() == "HTTP/1.1");
+    }
+
+    // HTTP/1.0不支持分块传输编码：直接发送生成的内容，以关闭连接表示结束
+    if (res.isStreaming() && req.version() != "HTTP/1.1") {
+        res.removeHeader("Transfer-Encoding");
+        keep_alive = false;
     }
 
-    // 处理请求
-    Response res(client_socket);
-    router_.handle(req, res);
-    res.send();
+    // 决定是否保持连接：客户端要求、处理函数未主动关闭、且未达到请求上限
+    keep_alive = keep_alive && req.keepAlive() && res.header("Connection") != "close" &&
+                 !draining_.load(std::memory_order_relaxed);
+    // 连接相关的响应头使用预先格式化的整块，不逐个插入响应头表
+    res.removeHeader("Connection");
+    // 过载时让客户端稍后重试
+    if (res.statusCode() == 503 && res.header("Retry-After").empty()) res.setHeader("Retry-After", retry_after_);
+    res.setHeaderBlock(keep_alive ? std::string_view(keep_alive_headers_) : kConnectionCloseHeader);
+    bool include_body = req.methodId() != HttpMethod::Head;
+    int64_t bytes = include_body ? res.bodySize() : 0;
+    res.writeTo(out, include_body);
 
-    // 关闭连接
-    close(client_socket);
+    // 处理耗时（不含线程池排队时间，后者单独统计）按路由和状态码记录
+    uint64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started).count();
+    if (stats) stats->record(res.statusCode(), micros);
+    logAccess(req, res.statusCode(), bytes, micros);
 }
 
-bool WebServer::start() {
-    // 创建服务器套接字
-    server_fd_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd_ == 0) {
+std::unique_ptr<Response> WebServer::handleHttp2Request(Request& req, BodyHandler* body_handler,
+                                                        RouteStats* body_stats) {
+    incrementRequestCount();
+    auto started = std::chrono::steady_clock::now();
+
+    // 响应在循环线程上发送时才编码，不使用连接的内存池
+    std::unique_ptr<Response> res(new Response());
+    RouteStats* stats = body_stats;
+    if (body_handler) {
+        body_handler->onComplete(req, *res);
+    } else {
+        stats = router_.handle(req, *res);
+    }
+    finishHttp2Response(req, *res, stats, started);
+    return res;
+}
+
+void WebServer::finishHttp2Response(const Request& req, Response& res, RouteStats* stats,
+                                    std::chrono::steady_clock::time_point started) {
+    // 响应体按DATA帧分段发送，大的响应体总是可以边发送边压缩
+    if (req.methodId() != HttpMethod::Head) res.compress(req.header("Accept-Encoding"), config_.compression, true);
+    if (res.statusCode() == 503 && res.header("Retry-After").empty()) res.setHeader("Retry-After", retry_after_);
+    uint64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started).count();
+    if (stats) stats->record(res.statusCode(), micros);
+    logAccess(req, res.statusCode(), req.methodId() != HttpMethod::Head ? res.bodySize() : 0, micros);
+}
+
+void WebServer::recordBadRequest(int status) {
+    incrementRequestCount();
+    bad_request_stats_.record(status, 0);
+}
+
+std::string WebServer::renderMetrics() const {
+    MetricsWriter writer;
+
+    writer.header("webserver_requests_total", "counter", "Total HTTP requests handled.");
+    writer.sample("webserver_requests_total", "", metrics_.requests.value());
+
+    writer.header("webserver_request_duration_seconds", "summary",
+                  "Request handling time by route and status code.");
+    auto writeRoute = [&writer](const RouteStats& stats) {
+        stats.forEach([&](int code, const LatencyHistogram& histogram) {
+            std::string labels = "method=\"" + MetricsWriter::escapeLabel(stats.method()) +
+                                 "\",route=\"" + MetricsWriter::escapeLabel(stats.route()) +
+                                 "\",code=\"" + (code < 0 ? std::string("other") : std::to_string(code)) + "\"";
+            writer.summary("webserver_request_duration_seconds", labels, histogram.snapshot());
+        });
+    };
+    router_.forEachStats(writeRoute);
+    writeRoute(bad_request_stats_);
+
+    writer.header("webserver_received_bytes_total", "counter", "Bytes read from client sockets.");
+    writer.sample("webserver_received_bytes_total", "", metrics_.bytes_received.value());
+    writer.header("webserver_sent_bytes_total", "counter", "Bytes written to client sockets.");
+    writer.sample("webserver_sent_bytes_total", "", metrics_.bytes_sent.value());
+    writer.header("webserver_connections_accepted_total", "counter", "Accepted client connections.");
+    writer.sample("webserver_connections_accepted_total", "", metrics_.connections_accepted.value());
+    writer.header("webserver_active_connections", "gauge", "Currently open client connections.");
+    writer.sample("webserver_active_connections", "", metrics_.active_connections.value());
+    writer.header("webserver_connections_rejected_total", "counter", "Connections rejected over max_connections.");
+    writer.sample("webserver_connections_rejected_total", "", metrics_.connections_rejected.value());
+    writer.header("webserver_requests_shed_total", "counter",
+                  "Requests rejected with 503 by the event loop (full or slow worker queue, streaming route limits).");
+    writer.sample("webserver_requests_shed_total", "", metrics_.requests_shed.value());
+    writer.header("webserver_request_timeouts_total", "counter", "Requests whose headers or body arrived too slowly.");
+    writer.sample("webserver_request_timeouts_total", "", metrics_.request_timeouts.value());
+    writer.header("webserver_websocket_connections", "gauge", "Currently open WebSocket connections.");
+    writer.sample("webserver_websocket_connections", "", metrics_.websocket_connections.value());
+    writer.header("webserver_websocket_slow_consumers_total", "counter",
+                  "WebSocket connections closed because their send queue exceeded max_send_buffer.");
+    writer.sample("webserver_websocket_slow_consumers_total", "", metrics_.websocket_slow_consumers.value());
+
+    if (thread_pool_) {
+        writer.header("webserver_threadpool_queue_wait_seconds", "summary",
+                      "Time tasks spend queued before a worker runs them.");
+        writer.summary("webserver_threadpool_queue_wait_seconds", "", thread_pool_->queueWait().snapshot());
+        writer.header("webserver_threadpool_queue_depth", "gauge", "Tasks waiting in the thread pool.");
+        writer.sample("webserver_threadpool_queue_depth", "", thread_pool_->queueDepth());
+        writer.header("webserver_threadpool_steals_total", "counter", "Tasks stolen between workers.");
+        writer.sample("webserver_threadpool_steals_total", "", thread_pool_->stealCount());
+        writer.header("webserver_threadpool_rejected_total", "counter", "Tasks rejected because the queue was full.");
+        writer.sample("webserver_threadpool_rejected_total", "", thread_pool_->rejectedCount());
+    }
+
+    if (const auto& cache = router_.staticCache()) {
+        uint64_t hits = cache->hits();
+        uint64_t misses = cache->misses();
+        writer.header("webserver_static_cache_hits_total", "counter", "Static file cache hits.");
+        writer.sample("webserver_static_cache_hits_total", "", hits);
+        writer.header("webserver_static_cache_misses_total", "counter", "Static file cache misses.");
+        writer.sample("webserver_static_cache_misses_total", "", misses);
+        writer.header("webserver_static_cache_hit_ratio", "gauge", "Static file cache hit ratio.");
+        writer.sample("webserver_static_cache_hit_ratio", "",
+                      hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0);
+        writer.header("webserver_static_cache_bytes", "gauge", "Bytes held by the static file cache.");
+        writer.sample("webserver_static_cache_bytes", "", cache->bytes());
+    }
+
+    if (router_.hasCachedRoutes()) {
+        auto writeCaches = [&](std::string_view name, std::string_view type, std::string_view help, auto value) {
+            writer.header(name, type, help);
+            router_.forEachCache([&](const ResponseCache& cache) {
+                writer.sample(name, "route=\"" + MetricsWriter::escapeLabel(cache.route()) + "\"",
+                              static_cast<double>(value(cache)));
+            });
+        };
+        writeCaches("webserver_response_cache_hits_total", "counter", "Requests served from a fresh cached response.",
+                    [](const ResponseCache& cache) { return cache.hits(); });
+        writeCaches("webserver_response_cache_stale_hits_total", "counter",
+                    "Requests served from a stale cached response while it was refreshed.",
+                    [](const ResponseCache& cache) { return cache.staleHits(); });
+        writeCaches("webserver_response_cache_misses_total", "counter", "Requests that ran the cached route's handler.",
+                    [](const ResponseCache& cache) { return cache.misses(); });
+        writeCaches("webserver_response_cache_coalesced_total", "counter",
+                    "Requests that waited for an identical in-flight request instead of running the handler.",
+                    [](const ResponseCache& cache) { return cache.coalesced(); });
+        writeCaches("webserver_response_cache_entries", "gauge", "Responses held by the route's cache.",
+                    [](const ResponseCache& cache) { return cache.size(); });
+    }
+
+    if (access_log_) {
+        writer.header("webserver_access_log_written_total", "counter", "Access log entries written to the file.");
+        writer.sample("webserver_access_log_written_total", "", access_log_->written());
+        writer.header("webserver_access_log_dropped_total", "counter",
+                      "Access log entries dropped because a ring buffer was full.");
+        writer.sample("webserver_access_log_dropped_total", "", access_log_->dropped());
+    }
+    return std::move(writer.str());
+}
+
+int WebServer::createListenSocket() {
+    // 创建服务器套接字（非阻塞，由事件循环接受连接）
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
         perror("socket创建失败");
-        return false;
+        return -1;
     }
 
-    // 设置端口复用
+    // 设置地址复用和端口复用：多个监听套接字绑定同一端口，由内核分配新连接
     int opt = 1;
-    if (setsockopt(server_fd_, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt))) {
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
         perror("setsockopt失败");
-        close(server_fd_);
-        return false;
+        close(fd);
+        return -1;
     }
 
     // 绑定端口
-    if (bind(server_fd_, (struct sockaddr*)&address_, sizeof(address_)) < 0) {
+    if (bind(fd, (struct sockaddr*)&address_, sizeof(address_)) < 0) {
         perror("绑定端口失败");
-        close(server_fd_);
-        return false;
+        close(fd);
+        return -1;
     }
 
     // 开始监听
-    if (listen(server_fd_, 10) < 0) {
+    if (listen(fd, config_.listen_backlog) < 0) {
         perror("监听失败");
-        close(server_fd_);
-        return false;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 当前线程可以运行的CPU列表
+static std::vector<int> availableCpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+        }
+    }
+    if (cpus.empty()) cpus.push_back(0);
+    return cpus;
+}
+
+// 把当前线程绑定到指定CPU
+static void pinCurrentThread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0) {
+        std::cerr << "绑定CPU " << cpu << " 失败: " << std::strerror(err) << std::endl;
+    }
+}
+
+// 按systemd的套接字激活约定（LISTEN_FDS/LISTEN_PID）取得继承的监听套接字，从fd 3开始依次排列
+// 取出后清除这些环境变量，避免再传给子进程
+static std::vector<int> inheritedListenFds() {
+    std::vector<int> fds;
+    const char* count_env = std::getenv("LISTEN_FDS");
+    const char* pid_env = std::getenv("LISTEN_PID");
+    int count = count_env ? std::atoi(count_env) : 0;
+    bool for_us = !pid_env || std::atol(pid_env) == static_cast<long>(getpid());
+    if (count > 0 && for_us) {
+        for (int fd = 3; fd < 3 + count; ++fd) {
+            int listening = 0;
+            socklen_t len = sizeof(listening);
+            if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) < 0 || !listening) {
+                std::cerr << "继承的fd " << fd << " 不是监听套接字，已忽略" << std::endl;
+                continue;
+            }
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+            fds.push_back(fd);
+        }
+    }
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDNAMES");
+    return fds;
+}
+
+// 平滑升级时由旧进程传入：初始化完成后写入一个字节通知旧进程开始关闭
+static void notifyUpgradeReady() {
+    const char* env = std::getenv("WEBSERVER_READY_FD");
+    if (!env) return;
+    int fd = std::atoi(env);
+    unsetenv("WEBSERVER_READY_FD");
+    if (fd < 3) return;
+    char byte = 1;
+    ssize_t n = write(fd, &byte, 1);
+    (void)n;
+    close(fd);
+}
+
+bool WebServer::start() {
+    // 对端关闭后继续写入（包括sendfile）不应终止进程
+    signal(SIGPIPE, SIG_IGN);
+
+    // 保持连接时的响应头只取决于配置，启动时格式化一次
+    keep_alive_headers_ = "Connection: keep-alive\r\nKeep-Alive: timeout=" +
+                          std::to_string(config_.keep_alive_timeout_ms / 1000) +
+                          ", max=" + std::to_string(config_.max_keep_alive_requests) + "\r\n";
+    retry_after_ = std::to_string(config_.retry_after_seconds);
+    overload_response_ = std::make_shared<const std::string>(buildOverloadResponse(config_.retry_after_seconds));
+
+    // 静态文件按需压缩使用同一份配置
+    router_.setCompression(config_.compression);
+    // 缓存路由的过期结果交给线程池在后台刷新（队列已满时由请求同步刷新）
+    router_.setCacheRefreshExecutor([this](std::function<void()> task) {
+        return thread_pool_->enqueue(std::move(task));
+    });
+
+    // 访问日志由后台线程写入，需在接受连接之前打开
+    if (!config_.access_log.path.empty() && !access_log_) {
+        access_log_.reset(new AccessLog(config_.access_log));
+        if (!access_log_->open()) {
+            access_log_.reset();
+            return false;
+        }
+    }
+
+    // 指标导出端点
+    if (!config_.metrics_path.empty()) {
+        router_.get(config_.metrics_path, [this](const Request&, Response& res) {
+            res.setContent(renderMetrics());
+            res.setHeader("Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+            res.setHeader("Cache-Control", "no-store");
+        });
+    }
+
+    std::vector<int> cpus = availableCpus();
+    size_t reactor_count = config_.reactor_count ? config_.reactor_count : cpus.size();
+    // 继承的监听套接字各需要一个反应器接受连接
+    std::vector<int> inherited = inheritedListenFds();
+    reactor_count = std::max(reactor_count, inherited.size());
+    bool multi_reactor = reactor_count > 1;
+
+    // 每个反应器一个监听套接字和一个事件循环；单反应器时处理函数交给线程池执行
+    for (size_t i = 0; i < reactor_count; ++i) {
+        int fd = i < inherited.size() ? inherited[i] : createListenSocket();
+        if (fd < 0) return false;
+        listen_fds_.push_back(fd);
+
+        loops_.emplace_back(new EventLoop(*this, fd, i == 0, multi_reactor, io_backend_ == IoBackend::IoUring));
+        if (!loops_.back()->init()) return false;
+        // 任何一个循环退回epoll时都报告为epoll
+        if (!loops_.back()->usingUring()) io_backend_ = IoBackend::Epoll;
     }
 
+    if (!inherited.empty()) {
+        std::cout << "使用继承的监听套接字: " << inherited.size() << " 个" << std::endl;
+    }
     std::cout << "服务器启动成功，监听端口 " << port_ << std::endl;
-    std::cout << "线程池大小: " << thread_pool_->getWorkerCount() << std::endl;
+    if (multi_reactor) {
+        std::cout << "反应器数量: " << reactor_count << std::endl;
+    } else {
+        std::cout << "线程池大小: " << thread_pool_->getWorkerCount() << std::endl;
+    }
+    std::cout << "I/O后端: " << (io_backend_ == IoBackend::IoUring ? "io_uring" : "epoll") << std::endl;
     std::cout << "静态文件目录: " << router_.getStaticDir() << std::endl;  // 使用getter方法
     std::cout << "访问地址: http://localhost:" << port_ << std::endl;
 
-    // 主循环：接受客户端连接
-    while (true) {
-        socklen_t addr_len = sizeof(address_);
-        int client_socket = accept(server_fd_, (struct sockaddr*)&address_, &addr_len);
-        if (client_socket < 0) {
-            perror("接受连接失败");
-            continue;
-        }
-
-        // 提交任务到线程池
-        thread_pool_->enqueue([this, client_socket]() {
-            handleClient(client_socket);
+    // 其余反应器各自运行在独立线程上，第一个反应器运行在当前线程
+    bool pin = multi_reactor && config_.pin_reactors;
+    for (size_t i = 1; i < reactor_count; ++i) {
+        int cpu = cpus[i % cpus.size()];
+        loop_threads_.emplace_back([this, i, pin, cpu]() {
+            if (pin) pinCurrentThread(cpu);
+            loops_[i]->run();
         });
     }
+    if (pin) pinCurrentThread(cpus[0]);
 
+    if (config_.handle_signals) installSignalHandlers();
+    notifyUpgradeReady();
+
+    // 主循环：由事件循环处理所有连接，优雅关闭完成后返回
+    loops_[0]->run();
+
+    for (std::thread& thread : loop_threads_) {
+        if (thread.joinable()) thread.join();
+    }
+    loop_threads_.clear();
+    if (config_.handle_signals) restoreSignalHandlers();
+    if (access_log_) access_log_->flush();
+    std::cout << "服务器已关闭" << std::endl;
     return true;
 }
-    
+
+void WebServer::shutdown() {
+    // 再次调用时不再等待在途请求
+    bool force = draining_.exchange(true);
+    std::chrono::milliseconds timeout(force ? 0 : config_.shutdown_timeout_ms);
+    for (auto& loop : loops_) {
+        loop->drain(timeout);
+    }
+}
+
+void WebServer::reload() {
+    if (const std::shared_ptr<StaticFileCache>& cache = router_.staticCache()) {
+        cache->clear();
+    }
+    std::function<void()> handler;
+    {
+        std::lock_guard<std::mutex> lock(reload_mutex_);
+        handler = reload_handler_;
+    }
+    if (handler) handler();
+    // 日志文件可能已被外部工具移走（如logrotate）
+    if (access_log_) access_log_->reopen();
+    std::cout << "已重新加载" << std::endl;
+}
+
+void WebServer::publish(const std::string& topic, std::string_view message, bool binary) {
+    // 帧只编码一次，各反应器上的订阅者共享同一份数据
+    std::shared_ptr<const std::string> frame = makeWebSocketFrame(message, binary);
+    EventLoop* current = EventLoop::current();
+    for (auto& loop : loops_) {
+        if (loop.get() == current) {
+            loop->publishWebSocket(topic, frame);
+        } else {
+            EventLoop* target = loop.get();
+            loop->post([target, topic, frame]() { target->publishWebSocket(topic, frame); });
+        }
+    }
+}
+
+void WebServer::upgrade() {
+    if (loops_.empty()) return;
+    loops_[0]->post([this]() { startUpgrade(); });
+}
+
+namespace {
+
+// 把fd上的事件转给回调
+class CallbackWatcher : public IoWatcher {
+public:
+    explicit CallbackWatcher(std::function<void()> callback) : callback_(std::move(callback)) {}
+    void onIoEvent(uint32_t) override { callback_(); }
+
+private:
+    std::function<void()> callback_;
+};
+
+// 信号处理函数只把信号编号写入管道，实际处理在事件循环上进行
+int signal_write_fd = -1;
+
+void forwardSignal(int sig) {
+    int saved_errno = errno;
+    unsigned char byte = static_cast<unsigned char>(sig);
+    ssize_t n = write(signal_write_fd, &byte, 1);
+    (void)n;
+    errno = saved_errno;
+}
+
+const int kHandledSignals[] = { SIGTERM, SIGINT, SIGHUP, SIGUSR2 };
+
+} // namespace
+
+void WebServer::installSignalHandlers() {
+    if (pipe2(signal_pipe_, O_NONBLOCK | O_CLOEXEC) < 0) {
+        perror("信号管道创建失败");
+        return;
+    }
+    signal_watcher_.reset(new CallbackWatcher([this]() {
+        unsigned char sigs[16];
+        ssize_t n;
+        while ((n = read(signal_pipe_[0], sigs, sizeof(sigs))) > 0) {
+            for (ssize_t i = 0; i < n; ++i) onSignal(sigs[i]);
+        }
+    }));
+    if (!loops_[0]->watch(signal_pipe_[0], signal_watcher_.get())) {
+        perror("信号管道监听失败");
+        return;
+    }
+    signal_write_fd = signal_pipe_[1];
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = forwardSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    for (int sig : kHandledSignals) {
+        sigaction(sig, &action, nullptr);
+    }
+}
+
+void WebServer::restoreSignalHandlers() {
+    for (int sig : kHandledSignals) {
+        signal(sig, SIG_DFL);
+    }
+    signal_write_fd = -1;
+    if (signal_pipe_[0] != -1) {
+        loops_[0]->unwatch(signal_pipe_[0]);
+        close(signal_pipe_[0]);
+        close(signal_pipe_[1]);
+        signal_pipe_[0] = signal_pipe_[1] = -1;
+    }
+    signal_watcher_.reset();
+}
+
+void WebServer::onSignal(int sig) {
+    switch (sig) {
+        case SIGTERM:
+        case SIGINT:
+            std::cout << (isDraining() ? "再次收到关闭信号，立即关闭" : "收到关闭信号，开始优雅关闭") << std::endl;
+            shutdown();
+            break;
+        case SIGHUP:
+            reload();
+            break;
+        case SIGUSR2:
+            startUpgrade();
+            break;
+        default:
+            break;
+    }
+}
+
+void WebServer::startUpgrade() {
+    if (isDraining() || upgrading_) return;
+
+    // fork之后子进程只能调用异步信号安全的函数，参数和环境变量事先准备好
+    std::string cmdline;
+    {
+        std::ifstream file("/proc/self/cmdline", std::ios::binary);
+        cmdline.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    std::vector<char*> argv;
+    for (size_t pos = 0; pos < cmdline.size(); ++pos) {
+        argv.push_back(&cmdline[pos]);
+        pos = cmdline.find('\0', pos);
+        if (pos == std::string::npos) break;
+    }
+    argv.push_back(nullptr);
+
+    // 程序文件已被替换时使用新的文件
+    char exe_buf[4096];
+    ssize_t exe_len = readlink("/proc/self/exe", exe_buf, sizeof(exe_buf) - 1);
+    if (argv.size() < 2 || exe_len <= 0) {
+        std::cerr << "平滑升级失败：无法取得程序路径" << std::endl;
+        return;
+    }
+    std::string exe(exe_buf, exe_len);
+    static const std::string kDeleted = " (deleted)";
+    if (exe.size() > kDeleted.size() && exe.compare(exe.size() - kDeleted.size(), kDeleted.size(), kDeleted) == 0) {
+        exe.resize(exe.size() - kDeleted.size());
+    }
+
+    int ready[2];
+    if (pipe2(ready, O_CLOEXEC) < 0) {
+        perror("平滑升级失败");
+        return;
+    }
+
+    // 监听套接字依次放在fd 3、4……，就绪通知管道紧随其后
+    int fd_count = static_cast<int>(listen_fds_.size());
+    std::vector<std::string> env_storage;
+    env_storage.push_back("LISTEN_FDS=" + std::to_string(fd_count));
+    env_storage.push_back("WEBSERVER_READY_FD=" + std::to_string(3 + fd_count));
+    std::vector<char*> envp;
+    for (char** env = environ; *env; ++env) {
+        std::string_view entry(*env);
+        if (entry.rfind("LISTEN_", 0) == 0 || entry.rfind("WEBSERVER_READY_FD=", 0) == 0) continue;
+        envp.push_back(*env);
+    }
+    for (std::string& entry : env_storage) {
+        envp.push_back(&entry[0]);
+    }
+    // LISTEN_PID为子进程的pid，在子进程中填写
+    char pid_env[32] = "LISTEN_PID=";
+    envp.push_back(pid_env);
+    envp.push_back(nullptr);
+    std::vector<int> moved(fd_count + 1);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("平滑升级失败");
+        close(ready[0]);
+        close(ready[1]);
+        return;
+    }
+    if (pid == 0) {
+        char digits[16];
+        int len = 0;
+        for (long value = getpid(); value > 0; value /= 10) digits[len++] = static_cast<char>('0' + value % 10);
+        char* out = pid_env + std::strlen("LISTEN_PID=");
+        while (len > 0) *out++ = digits[--len];
+        *out = '\0';
+
+        // 先全部移到目标范围之外，再依次放到目标位置，避免覆盖尚未移动的fd
+        int target_end = 3 + fd_count + 1;
+        for (int i = 0; i < fd_count; ++i) moved[i] = fcntl(listen_fds_[i], F_DUPFD_CLOEXEC, target_end);
+        moved[fd_count] = fcntl(ready[1], F_DUPFD_CLOEXEC, target_end);
+        for (int i = 0; i <= fd_count; ++i) {
+            if (moved[i] < 0 || dup2(moved[i], 3 + i) < 0) _exit(127);
+        }
+        execve(exe.c_str(), argv.data(), envp.data());
+        _exit(127);
+    }
+
+    close(ready[1]);
+    fcntl(ready[0], F_SETFL, fcntl(ready[0], F_GETFL) | O_NONBLOCK);
+    upgrade_ready_fd_ = ready[0];
+    upgrade_pid_ = pid;
+    upgrading_ = true;
+    upgrade_watcher_.reset(new CallbackWatcher([this]() { onUpgradeReady(); }));
+    if (!loops_[0]->watch(upgrade_ready_fd_, upgrade_watcher_.get())) {
+        // 无法得知新进程是否就绪：不关闭本进程
+        perror("平滑升级：监听就绪通知失败");
+        close(upgrade_ready_fd_);
+        upgrade_ready_fd_ = -1;
+        upgrading_ = false;
+        return;
+    }
+    std::cout << "平滑升级：已启动新进程 " << pid << std::endl;
+}
+
+void WebServer::onUpgradeReady() {
+    char byte;
+    ssize_t n = read(upgrade_ready_fd_, &byte, 1);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+
+    loops_[0]->unwatch(upgrade_ready_fd_);
+    close(upgrade_ready_fd_);
+    upgrade_ready_fd_ = -1;
+    upgrading_ = false;
+    if (n == 1) {
+        std::cout << "平滑升级：新进程 " << upgrade_pid_ << " 已就绪，开始优雅关闭" << std::endl;
+        shutdown();
+    } else {
+        // 新进程在就绪之前退出（管道写端随之关闭）
+        std::cerr << "平滑升级失败：新进程 " << upgrade_pid_ << " 未能启动，继续服务" << std::endl;
+        waitpid(upgrade_pid_, nullptr, WNOHANG);
+    }
+    upgrade_pid_ = -1;
+}
@@ -20,129 +20,993 @@
 #include <chrono>
 #include <ctime>
 #include <algorithm>
+#include "static_cache.h"
+#include "metrics.h"
+#include "simd_scan.h"
+#include "task.h"
+#include "uring.h"
+#include "html_template.h"
+#include "timer_wheel.h"
+#include "compress.h"
+#include "access_log.h"
+#include <unordered_map>
+#include <atomic>
+#include <deque>
+#include <type_traits>
+#include <new>
+#include <stdexcept>
+#include <string_view>
+#include <memory_resource>
+#include <optional>
+#include <charconv>
 
-// 声明urlDecode函数
-std::string urlDecode(const std::string& s);
+// 声明urlDecode函数（%XX和+解码；需要原地解码时使用simd_scan.h中的urlDecodeTo）
+std::string urlDecode(std::string_view s);
 
 // 前置声明
 class Request;
 class Response;
+class RequestParser;
+class WebServer;
+class EventLoop;
+struct Http2Connection;
+class WebSocket;
+class WebSocketHandler;
+class ResponseCache;
+struct RouteCacheOptions;
 
-// 请求类：解析HTTP请求
+// HTTP方法：路由表按枚举下标索引，避免字符串比较
+enum class HttpMethod : uint8_t {
+    Get,
+    Head,
+    Post,
+    Put,
+    Delete,
+    Patch,
+    Options,
+    Unknown
+};
+
+// 路由表支持的方法数量（不含Unknown）
+constexpr size_t kHttpMethodCount = static_cast<size_t>(HttpMethod::Unknown);
+
+// 方法名转换为枚举
+HttpMethod parseHttpMethod(std::string_view method);
+// 枚举转换为方法名（Unknown为空）
+std::string_view methodName(HttpMethod method);
+
+// 请求类：持有原始请求数据，各字段均为指向原始数据的视图
 class Request {
 private:
-    std::string method_;
-    std::string path_;
-    std::string body_;
-    std::map<std::string, std::string> query_params_;
-    std::map<std::string, std::string> headers_;
+    friend class RequestParser;
+    friend class Router;
+
+    // 原始数据中的一段（偏移+长度），Request移动后依然有效
+    struct Span {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+    struct HeaderSpan {
+        Span name;
+        Span value;
+    };
+
+    // 路径参数：名称指向路由表，值为原始数据中的一段
+    struct ParamSpan {
+        std::string_view name;
+        Span value;
+    };
+
+public:
+    // 单个请求最多支持的请求头数量
+    static constexpr size_t kMaxHeaders = 64;
+    // 单个路由最多支持的路径参数数量
+    static constexpr size_t kMaxParams = 8;
+
+private:
+    std::string raw_;
+    HttpMethod method_id_ = HttpMethod::Unknown;
+    Span method_;
+    Span path_;
+    Span query_;
+    Span version_;
+    Span body_;
+    HeaderSpan headers_[kMaxHeaders];
+    size_t header_count_ = 0;
+    ParamSpan params_[kMaxParams];
+    size_t param_count_ = 0;
+    uint64_t connection_id_ = 0;
+
+    std::string_view view(Span span) const {
+        return std::string_view(raw_.data() + span.offset, span.length);
+    }
 
 public:
     Request() = default;
     ~Request() = default;
 
-    // 解析原始请求数据
+    // 解析一段完整的原始请求数据（复制数据，主要用于测试和工具）
     bool parse(const std::string& data);
 
+    // 由其他协议（HTTP/2）的请求构建，各部分复制进原始数据：target为路径加查询串
+    // 请求头超过kMaxHeaders或总长度超出范围时返回false
+    bool assign(std::string_view method, std::string_view target, std::string_view version,
+                const std::vector<std::pair<std::string, std::string>>& headers);
+    // 设置请求体（复制到原始数据末尾），用于assign构建的请求
+    void setBody(std::string_view body);
+
+    // 接管解析完成的原始数据（由事件循环调用，不复制）
+    void setRaw(std::string raw) { raw_ = std::move(raw); }
+    // 与外部缓冲交换原始数据（事件循环在请求头解析完成时用于匹配流式路由）
+    void swapRaw(std::string& other) { raw_.swap(other); }
+
+    // 清空请求以便在同一连接上复用，返回原始数据缓冲（已清空，保留容量）
+    std::string recycle();
+
     // 获取请求方法（GET/POST等）
-    const std::string& method() const { return method_; }
-    // 获取请求路径
-    const std::string& path() const { return path_; }
-    // 获取请求体
-    const std::string& body() const { return body_; }
-    // 获取查询参数
-    std::string queryParam(const std::string& key) const {
-        auto it = query_params_.find(key);
-        return (it != query_params_.end()) ? it->second : "";
-    }
-    // 获取请求头
-    std::string header(const std::string& key) const {
-        auto it = headers_.find(key);
-        return (it != headers_.end()) ? it->second : "";
+    std::string_view method() const { return view(method_); }
+    // 获取请求方法枚举
+    HttpMethod methodId() const { return method_id_; }
+    // 获取请求路径（不含查询串）
+    std::string_view path() const { return view(path_); }
+    // 获取原始查询串（?之后的部分）
+    std::string_view query() const { return view(query_); }
+    // 获取协议版本（HTTP/1.0、HTTP/1.1）
+    std::string_view version() const { return view(version_); }
+    // 获取请求体（二进制安全）
+    std::string_view body() const { return view(body_); }
+    // 获取查询参数（按需解码）
+    std::string queryParam(std::string_view key) const;
+    // 获取请求头（名称不区分大小写）
+    std::string_view header(std::string_view key) const;
+    // 请求头数量
+    size_t headerCount() const { return header_count_; }
+    // 按序号获取请求头
+    std::pair<std::string_view, std::string_view> headerAt(size_t i) const {
+        return { view(headers_[i].name), view(headers_[i].value) };
     }
+    // 获取路径参数（如/users/:id中的id，或*path通配部分），不存在时为空
+    std::string_view param(std::string_view name) const {
+        for (size_t i = 0; i < param_count_; ++i) {
+            if (params_[i].name == name) return view(params_[i].value);
+        }
+        return std::string_view();
+    }
+    // 客户端是否希望保持连接
+    bool keepAlive() const;
+
+    // 请求所在连接的编号（服务器内唯一，同一连接上的请求相同；复用请求对象时保留）
+    uint64_t connectionId() const { return connection_id_; }
+    void setConnectionId(uint64_t id) { connection_id_ = id; }
 };
 
+// 请求解析器：可恢复的状态机
+// 数据可以分多次到达，每次传入从请求起始处开始的完整缓冲区，
+// 解析器只记录偏移，不复制数据，也不为请求头分配内存；
+// 分块传输编码的请求体在缓冲区内原地解码，解码后的请求体连续存放在请求头之后
+class RequestParser {
+public:
+    enum class Status {
+        Incomplete,   // 数据不足，等待更多数据
+        Headers,      // 请求头已完整且带有请求体：调用者可决定请求体的接收方式，然后继续解析
+        Complete,     // 已得到完整请求
+        Error         // 请求格式错误，见errorCode()
+    };
+
+private:
+    enum class State {
+        RequestLine,
+        Headers,
+        Body,         // Content-Length请求体
+        ChunkSize,    // 分块大小行
+        ChunkData,    // 分块数据
+        ChunkEnd,     // 分块数据后的CRLF
+        Trailers,     // 最后一个分块之后的尾部头部
+        Done
+    };
+
+    State state_ = State::RequestLine;
+    size_t pos_ = 0;              // 下一次扫描的起始位置
+    size_t content_length_ = 0;
+    size_t body_offset_ = 0;      // 请求体在缓冲区中的起始位置
+    size_t body_size_ = 0;        // 缓冲区中已解码的请求体字节数
+    size_t body_received_ = 0;    // 已被调用者取走的请求体字节数（流式接收）
+    size_t body_remaining_ = 0;   // Content-Length剩余字节数，或当前分块的剩余字节数
+    bool has_length_ = false;
+    bool chunked_ = false;
+    bool streaming_ = false;
+    size_t max_header_size_;
+    size_t max_body_size_;
+    size_t body_limit_;
+    int error_code_ = 0;
+
+    Status fail(int code) {
+        error_code_ = code;
+        return Status::Error;
+    }
+    bool parseRequestLine(const char* data, size_t end, Request& req);
+    bool parseHeaderLine(const char* data, size_t begin, size_t end, Request& req);
+    // 解析分块大小行，失败时返回false
+    bool parseChunkSize(const char* data, size_t end);
+
+public:
+    RequestParser(size_t max_header_size = 64 * 1024, size_t max_body_size = 8 * 1024 * 1024)
+        : max_header_size_(max_header_size), max_body_size_(max_body_size), body_limit_(max_body_size) {}
+
+    // 继续解析，req中的字段以data为基准记录偏移（分块请求体会改写data中已解析的部分）
+    Status parse(char* data, size_t size, Request& req);
+    // 完整请求占用的字节数（Complete后有效），解析过程中为已扫描的字节数
+    size_t consumed() const { return pos_; }
+    // 出错时建议返回的HTTP状态码（400/413/431/501/505）
+    int errorCode() const { return error_code_; }
+
+    // 请求头已完整、正在接收请求体
+    bool receivingBody() const { return state_ != State::RequestLine && state_ != State::Headers && state_ != State::Done; }
+    // 请求体在缓冲区中的起始位置（Headers之后有效）
+    size_t bodyOffset() const { return body_offset_; }
+    // 缓冲区中已解码、尚未被取走的请求体字节数
+    size_t bodyAvailable() const { return body_size_; }
+    // 改为流式接收：请求体由调用者逐段取走，不保留在Request中，上限改为max_body_size
+    void setStreaming(size_t max_body_size) {
+        streaming_ = true;
+        body_limit_ = max_body_size;
+    }
+    // 调用者已从缓冲区开头删除n字节（不超过bodyOffset()，如已转移给Request的请求头）
+    void dropPrefix(size_t n) {
+        pos_ -= n;
+        body_offset_ -= n;
+    }
+    // 调用者已取走已解码的请求体，并从缓冲区中删除了[bodyOffset(), consumed())
+    void dropBody() {
+        body_received_ += body_size_;
+        body_size_ = 0;
+        pos_ = body_offset_;
+    }
+
+    // 为下一个请求重置状态
+    void reset() {
+        state_ = State::RequestLine;
+        pos_ = 0;
+        content_length_ = 0;
+        body_offset_ = 0;
+        body_size_ = 0;
+        body_received_ = 0;
+        body_remaining_ = 0;
+        has_length_ = false;
+        chunked_ = false;
+        streaming_ = false;
+        body_limit_ = max_body_size_;
+        error_code_ = 0;
+    }
+};
+
+// 文件描述符的RAII封装（只可移动）
+class FileDescriptor {
+private:
+    int fd_ = -1;
+
+public:
+    FileDescriptor() = default;
+    explicit FileDescriptor(int fd) : fd_(fd) {}
+    ~FileDescriptor() { reset(); }
+
+    FileDescriptor(FileDescriptor&& other) noexcept : fd_(other.fd_) { other.fd_ = -1; }
+    FileDescriptor& operator=(FileDescriptor&& other) noexcept {
+        if (this != &other) {
+            reset();
+            fd_ = other.fd_;
+            other.fd_ = -1;
+        }
+        return *this;
+    }
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+    int get() const { return fd_; }
+    void reset() {
+        if (fd_ != -1) {
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+};
+
+// 请求级内存池：单调分配，释放为空操作，由reset()整体回收
+// 首块内存在连接的整个生命周期内保留，稳态下处理请求不再经过全局分配器；
+// 同一时刻只被一个线程使用（请求在事件循环和工作线程之间移交时已有同步）
+class RequestArena : public std::pmr::memory_resource {
+private:
+    struct Block {
+        Block* next;
+        size_t size;   // 数据区大小
+    };
+
+    static constexpr size_t kInitialSize = 4096;
+    static constexpr size_t kMaxBlockSize = 64 * 1024;
+
+    Block* head_ = nullptr;   // 当前块，链表末尾为首块
+    char* cursor_ = nullptr;
+    char* end_ = nullptr;
+    size_t used_ = 0;
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+public:
+    RequestArena() = default;
+    ~RequestArena() override;
+    RequestArena(const RequestArena&) = delete;
+    RequestArena& operator=(const RequestArena&) = delete;
+
+    // 回收全部分配，只保留首块
+    void reset();
+    // 自上次重置以来分配的字节数
+    size_t bytesUsed() const { return used_; }
+};
+
+// 流式响应的内容生成函数：每次调用把下一段内容写入chunk，返回false表示内容已结束
+// 在事件循环线程上按需调用（套接字可写时），生成速度自然受对端接收速度限制
+using ChunkProducer = std::function<bool(std::string& chunk)>;
+
+// 连接的发送队列：内存片段通过writev聚合发送，文件片段通过sendfile直接从fd发送，
+// 生成片段在发送到该位置时才调用生成函数取得内容
+// 正确处理部分写入和EAGAIN，剩余数据留在队列中等待下一次可写事件
+class OutputBuffer {
+public:
+    enum class WriteResult {
+        Done,        // 队列已全部发送
+        WouldBlock,  // 套接字缓冲区已满，等待EPOLLOUT
+        Error        // 连接出错
+    };
+
+private:
+    struct Chunk {
+        std::string owned;                          // 自有数据（如响应体）
+        std::shared_ptr<const std::string> shared;  // 共享数据（如缓存的文件内容），不复制
+        std::string_view view;                      // shared中需要发送的区间，或借用的外部数据
+        FileDescriptor file;                        // 文件片段
+        off_t file_offset = 0;
+        size_t file_remaining = 0;
+        size_t offset = 0;                          // 内存片段中已发送的字节数
+        ChunkProducer producer;                     // 生成片段
+        bool chunked = false;                       // 生成的内容是否使用分块传输编码
+
+        bool isFile() const { return file.get() != -1; }
+        bool isMemory() const { return !isFile() && !producer; }
+        std::string_view data() const { return owned.empty() ? view : std::string_view(owned); }
+    };
+
+    std::deque<Chunk> chunks_;
+    size_t pending_bytes_ = 0;
+
+public:
+    // 追加自有数据
+    void append(std::string data);
+    // 追加共享数据（只持有引用）
+    void append(std::shared_ptr<const std::string> data);
+    // 追加共享数据中的一段
+    void append(std::shared_ptr<const std::string> data, size_t offset, size_t length);
+    // 追加借用的数据（不复制），调用者保证数据在发送完之前有效（如请求内存池中的响应头）
+    void appendView(std::string_view data);
+    // 追加文件中的一段内容（接管fd的所有权）
+    void appendFile(FileDescriptor file, off_t offset, size_t length);
+    // 追加生成片段；chunked为true时每段内容按分块传输编码发送，结束时发送终止块
+    void appendProducer(ChunkProducer producer, bool chunked);
+    // 把另一个队列的内容整体移到末尾
+    void append(OutputBuffer&& other);
+
+    bool empty() const { return chunks_.empty(); }
+    // 队首是否为内存片段
+    bool frontIsMemory() const { return !chunks_.empty() && chunks_.front().isMemory(); }
+    // 尚未发送的字节数（不含尚未生成的内容）
+    size_t pendingBytes() const { return pending_bytes_; }
+    void clear() {
+        chunks_.clear();
+        pending_bytes_ = 0;
+    }
+
+    // 尽可能多地写入套接字，written累加实际发送的字节数
+    WriteResult writeTo(int socket_fd, size_t& written);
+    // 把队首最多max字节移到dst末尾（用于重新分帧，如HTTP/2的DATA帧）：共享和借用的内存片段不复制，
+    // 文件片段读入内存，生成片段按需调用生成函数（不做分块编码）；moved传出移动的字节数，
+    // 只有队列为空时moved才可能为0。读取文件失败时返回false
+    bool takeFront(OutputBuffer& dst, size_t max, size_t& moved);
+
+    // 以下供异步提交写入使用：提交后到完成前队列开头的片段保持不变（只可在末尾追加）
+    // 队首连续的内存片段（最多max个）填入iov，不出队；shared不为空时填入各片段的共享数据（非共享时为nullptr），
+    // all不为空时传出是否已包含队列中的全部内容；返回片段数
+    unsigned peekMemory(iovec* iov, unsigned max, const std::shared_ptr<const std::string>** shared = nullptr,
+                        bool* all = nullptr) const;
+    // 弹出队首已发送的n字节（必须都在内存片段中）
+    void consume(size_t n);
+};
+
+// 状态码对应的标准原因短语，未知状态码返回空
+std::string_view httpReasonPhrase(int code);
+
 // 响应类：构建HTTP响应
+// 响应头存放在请求内存池中（未指定时使用默认分配器），随请求结束整体回收
 class Response {
 private:
-    int socket_fd_;
+    std::pmr::memory_resource* arena_;               // 请求内存池，为空表示使用默认分配器
     int status_code_ = 200;
-    std::string status_text_ = "OK";
-    std::map<std::string, std::string> headers_;
+    std::pmr::string status_text_;
+    std::pmr::map<std::pmr::string, std::pmr::string, std::less<>> headers_;
+    std::string_view header_block_;                  // 预先格式化的响应头（只借用）
     std::string body_;
+    std::string_view body_view_;                     // 渲染在请求内存池中的响应体
+    std::shared_ptr<const CachedFile> static_file_;  // 来自静态缓存的文件（自带预格式化响应头）
+    bool static_encoded_ = false;                    // 使用预压缩版本的响应头
+    FileDescriptor file_;                            // 通过sendfile发送的文件内容
+    off_t file_offset_ = 0;
+    size_t file_length_ = 0;
+    OutputBuffer body_chunks_;                       // 分段组成的响应体（如Range响应）
+    ChunkProducer producer_;                         // 流式生成的响应体
 
-    // 构建完整响应字符串
-    std::string buildResponse() const;
+    std::pmr::memory_resource* resource() const {
+        return arena_ ? arena_ : std::pmr::get_default_resource();
+    }
+    // 状态行加响应头（含结尾空行）的总长度
+    size_t headersSize() const;
+    // 把状态行和响应头写入buffer，长度必须为headersSize()
+    void writeHeaders(char* buffer) const;
+
+    // 清除已设置的响应体（各种形式）
+    void clearBody() {
+        body_.clear();
+        body_view_ = std::string_view();
+        static_file_.reset();
+        file_.reset();
+        body_chunks_.clear();
+        producer_ = nullptr;
+    }
+    void setContentLength(size_t length) {
+        char digits[24];
+        setHeader("Content-Length",
+                  std::string_view(digits, std::to_chars(digits, digits + sizeof(digits), length).ptr - digits));
+    }
 
 public:
-    Response(int socket_fd) : socket_fd_(socket_fd) {
+    explicit Response(std::pmr::memory_resource* arena = nullptr)
+        : arena_(arena), status_text_("OK", resource()), headers_(resource()) {
         // 设置默认响应头
-        headers_["Content-Type"] = "text/html; charset=UTF-8";
-        headers_["Connection"] = "close";
+        setHeader("Content-Type", "text/html; charset=UTF-8");
     }
     ~Response() = default;
+    Response(Response&&) = default;
+    Response& operator=(Response&&) = default;
+
+    // 响应使用的请求内存池（可能为空）
+    std::pmr::memory_resource* arena() const { return arena_; }
 
     // 设置状态码
-    void setStatusCode(int code, const std::string& text) {
+    void setStatusCode(int code, std::string_view text) {
         status_code_ = code;
-        status_text_ = text;
+        status_text_.assign(text.data(), text.size());
     }
+    // 设置状态码，使用标准原因短语
+    void setStatusCode(int code) { setStatusCode(code, httpReasonPhrase(code)); }
+
+    // 获取状态码
+    int statusCode() const { return status_code_; }
+    // 获取原因短语
+    std::string_view statusText() const { return status_text_; }
 
     // 设置响应头
-    void setHeader(const std::string& key, const std::string& value) {
-        headers_[key] = value;
+    void setHeader(std::string_view key, std::string_view value) {
+        auto it = headers_.find(key);
+        if (it != headers_.end()) {
+            it->second.assign(value.data(), value.size());
+        } else {
+            headers_.emplace(key, value);
+        }
     }
 
+    // 删除响应头
+    void removeHeader(std::string_view key) {
+        auto it = headers_.find(key);
+        if (it != headers_.end()) headers_.erase(it);
+    }
+
+    // 获取已设置的响应头，不存在时为空（不含setHeaderBlock设置的响应头）
+    std::string_view header(std::string_view key) const {
+        auto it = headers_.find(key);
+        return (it != headers_.end()) ? std::string_view(it->second) : std::string_view();
+    }
+
+    // 复制other中已设置而本响应没有的响应头（不含预先格式化的响应头），
+    // 用于把另行生成的响应合并到已有中间件响应头的响应中
+    void inheritHeaders(const Response& other) {
+        for (const auto& item : other.headers_) {
+            if (headers_.find(item.first) == headers_.end()) headers_.emplace(item.first, item.second);
+        }
+    }
+
+    // 设置预先格式化的响应头（每行以\r\n结尾），原样写在其他响应头之后
+    // 只借用，内容在响应发送完之前必须有效（通常是启动时格式化好的常量）
+    void setHeaderBlock(std::string_view block) { header_block_ = block; }
+
     // 设置HTML响应体
-    void setHtml(const std::string& html) {
-        body_ = html;
-        headers_["Content-Length"] = std::to_string(html.size());
+    void setHtml(std::string html) {
+        clearBody();
+        setContentLength(html.size());
+        body_ = std::move(html);
+    }
+
+    // 使用预编译模板渲染HTML响应体：先算出长度，一次写入请求内存池（没有内存池时写入响应自身的缓冲）
+    // values中的内容只在调用期间使用
+    void setHtml(const HtmlTemplate& page, HtmlTemplate::Values values) {
+        clearBody();
+        size_t size = page.renderedSize(values);
+        if (arena_ && size > 0) {
+            char* buffer = static_cast<char*>(arena_->allocate(size, 1));
+            page.renderTo(buffer, values);
+            body_view_ = std::string_view(buffer, size);
+        } else {
+            page.render(body_, values);
+        }
+        setContentLength(size);
     }
 
     // 设置通用内容（用于二进制数据）
-    void setContent(const std::string& content) {
-        body_ = content;
-        headers_["Content-Length"] = std::to_string(content.size());
+    void setContent(std::string content) {
+        clearBody();
+        setContentLength(content.size());
+        body_ = std::move(content);
+    }
+
+    // 使用静态缓存中的文件作为响应内容，内容相关的响应头由缓存条目提供
+    // encoded为true时表示文件是预压缩版本（.gz/.br），使用带Content-Encoding的响应头
+    void setStaticFile(std::shared_ptr<const CachedFile> file, bool encoded = false) {
+        clearBody();
+        static_file_ = std::move(file);
+        static_encoded_ = encoded;
+        removeHeader("Content-Type");
+        removeHeader("Content-Length");
+    }
+
+    // 使用分段数据作为响应体（共享内存片段或文件片段，均不复制）
+    void setBodyChunks(OutputBuffer chunks) {
+        clearBody();
+        setContentLength(chunks.pendingBytes());
+        body_chunks_ = std::move(chunks);
+    }
+
+    // 使用文件中的一段作为响应内容（接管fd的所有权），由事件循环通过sendfile发送
+    void setFileContent(int fd, off_t offset, size_t length) {
+        clearBody();
+        file_ = FileDescriptor(fd);
+        file_offset_ = offset;
+        file_length_ = length;
+        setContentLength(length);
+    }
+
+    // 使用流式生成的内容作为响应体，事件循环在套接字可写时调用producer取得下一段内容
+    // 以分块传输编码发送；HTTP/1.0请求改为直接发送内容并在结束后关闭连接
+    // producer在事件循环线程上执行，不应阻塞
+    void setChunkedContent(ChunkProducer producer) {
+        clearBody();
+        producer_ = std::move(producer);
+        removeHeader("Content-Length");
+        setHeader("Transfer-Encoding", "chunked");
+    }
+
+    // 是否为流式生成的响应
+    bool isStreaming() const { return static_cast<bool>(producer_); }
+
+    // 响应体是否完全在内存中（setHtml/setContent设置，或为空），是时写入body（只在响应修改前有效）
+    bool bufferedBody(std::string_view& body) const {
+        if (static_file_ || file_.get() != -1 || !body_chunks_.empty() || producer_) return false;
+        body = body_view_.empty() ? std::string_view(body_) : body_view_;
+        return true;
     }
 
-    // 发送响应
-    bool send() const;
+    // 响应体的字节数（压缩后），流式生成的响应体未知，返回-1
+    int64_t bodySize() const;
+
+    // 按Accept-Encoding压缩响应体（由WebServer在发送前调用），同时加上Vary: Accept-Encoding
+    // 只处理内存中的响应体和流式生成的响应体；已设置Content-Encoding、类型不在允许列表中或小于min_size时不做处理
+    // allow_streaming为true时超过stream_threshold的响应体改为边发送边压缩（分块传输编码）
+    void compress(std::string_view accept_encoding, const CompressionConfig& config, bool allow_streaming);
+
+    // 依次取得所有响应头（含Date和预先格式化的响应头），名称保持设置时的大小写
+    void forEachHeader(const std::function<void(std::string_view name, std::string_view value)>& fn) const;
+    // 把响应体移入out（与writeTo相同，但不写响应头）；chunked为false时流式生成的内容不做分块编码
+    void moveBodyTo(OutputBuffer& out, bool chunked);
+
+    // 构建状态行和响应头（以空行结尾）
+    std::string buildHeaders() const;
+
+    // 构建完整响应字符串（复制响应体，文件内容除外，主要用于测试和工具）
+    std::string buildResponse() const;
+
+    // 把响应移入发送队列：响应头与响应体分段存放，缓存内容和文件内容均不复制
+    // 使用请求内存池时响应头直接写入内存池，发送队列只借用，内存池需在发送完后才能重置
+    // include_body为false时只发送响应头（HEAD请求）
+    void writeTo(OutputBuffer& out, bool include_body = true);
 };
 
 // 路由处理函数类型
 using HandlerFunc = std::function<void(const Request&, Response&)>;
 
+// 中间件调用链中的下一步（类型擦除，见middleware.h）：不持有所有权的函数引用，不分配内存，只在中间件调用期间有效
+class MiddlewareNext {
+private:
+    void* target_;
+    void (*call_)(void*);
+
+public:
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, MiddlewareNext>>>
+    explicit MiddlewareNext(F& fn)
+        : target_(&fn), call_([](void* target) { (*static_cast<F*>(target))(); }) {}
+
+    void operator()() const { call_(target_); }
+};
+
+// 运行时注册的中间件（见middleware.h和Router::use）：调用next()继续执行，不调用时以当前响应结束
+using MiddlewareFunc = std::function<void(const Request&, Response&, MiddlewareNext)>;
+
+// 依次执行count个中间件，最后调用last；某个中间件没有调用next时不再继续
+void invokeMiddleware(const MiddlewareFunc* middleware, size_t count, const Request& req, Response& res,
+                      MiddlewareNext last);
+
+// 流式请求体处理器：每个请求创建一个实例，请求体不在内存中缓存，而是边接收边交给处理器
+// onHeaders和onData在事件循环线程上调用，不应阻塞；onComplete与普通处理函数在同一位置执行
+class BodyHandler {
+public:
+    virtual ~BodyHandler() = default;
+
+    // 请求头已完整、尚未接收请求体（路径参数已可用）；
+    // 返回false表示拒绝该请求：不再接收请求体（也不发送100 Continue），直接调用onComplete生成响应
+    virtual bool onHeaders(const Request& req) { return true; }
+    // 收到一段已解码的请求体，返回false时中止接收，随后调用onComplete生成响应
+    virtual bool onData(std::string_view chunk) = 0;
+    // 请求体接收完毕（或被中止），生成响应；中止时响应发送后关闭连接
+    virtual void onComplete(const Request& req, Response& res) = 0;
+};
+
+// 为每个流式请求创建处理器
+using BodyHandlerFactory = std::function<std::unique_ptr<BodyHandler>()>;
+
+#ifdef WEBSERVER_HAS_COROUTINES
+// 协程路由的请求体读取器：co_await next()逐段取得已解码的请求体，结束时返回空
+// 请求体在事件循环线程上到达时复制进读取器，等待中的协程随后在同一循环线程上恢复
+class BodyReader : public BodyHandler {
+private:
+    std::deque<std::string> chunks_;
+    size_t buffered_ = 0;                 // 尚未取走的字节数
+    bool finished_ = false;               // 请求体已全部到达
+    bool aborted_ = false;                // 连接已关闭或请求出错，不会再有数据
+    std::coroutine_handle<> waiter_;
+    EventLoop* loop_ = nullptr;           // 等待者所在的事件循环
+
+    // 恢复等待中的协程（投递到循环，不在事件处理的调用栈上直接恢复）
+    void wake();
+
+public:
+    class NextAwaiter {
+    private:
+        BodyReader& reader_;
+
+    public:
+        explicit NextAwaiter(BodyReader& reader) : reader_(reader) {}
+        bool await_ready() const noexcept {
+            return !reader_.chunks_.empty() || reader_.finished_ || reader_.aborted_;
+        }
+        void await_suspend(std::coroutine_handle<> handle);
+        std::optional<std::string> await_resume();
+    };
+
+    // 取得下一段请求体，请求体结束（或被中止）时为空
+    NextAwaiter next() { return NextAwaiter(*this); }
+    // 请求体是否因连接关闭或请求出错而未能完整接收
+    bool aborted() const { return aborted_; }
+    // 已到达、尚未取走的字节数
+    size_t buffered() const { return buffered_; }
+
+    // 以下由事件循环调用
+    bool onData(std::string_view chunk) override;
+    void onComplete(const Request&, Response&) override {}
+    // 请求体已全部到达
+    void finish();
+    // 不会再有数据（连接关闭或请求出错）
+    void abort();
+};
+
+// 协程处理函数类型：返回Task<void>，请求和响应在协程结束前一直有效
+using AsyncHandlerFunc = std::function<Task<void>(Request&, Response&)>;
+// 以协程方式读取请求体的处理函数类型
+using AsyncBodyHandlerFunc = std::function<Task<void>(Request&, BodyReader&, Response&)>;
+#endif
+
+// 路由的并发上限：同时执行的处理函数数达到上限时直接返回503（见Router::setConcurrencyLimit）
+struct RouteLimit {
+    std::atomic<size_t> max_active{0};   // 0表示不限制
+    std::atomic<size_t> active{0};
+
+    // 占用一个名额，已达上限时返回false；不限制时不计数
+    bool tryAcquire() {
+        size_t max = max_active.load(std::memory_order_relaxed);
+        if (max == 0) return true;
+        if (active.fetch_add(1, std::memory_order_acq_rel) < max) return true;
+        active.fetch_sub(1, std::memory_order_acq_rel);
+        return false;
+    }
+    // 归还tryAcquire成功时占用的名额
+    void release() {
+        if (max_active.load(std::memory_order_relaxed) != 0) active.fetch_sub(1, std::memory_order_acq_rel);
+    }
+};
+
+// 为每个WebSocket连接创建处理器（见websocket.h）
+using WebSocketHandlerFactory = std::function<std::unique_ptr<WebSocketHandler>()>;
+
+// 在后台执行缓存路由的刷新任务，返回false表示无法执行（见response_cache.h）
+using CacheRefreshExecutor = std::function<bool(std::function<void()>)>;
+
+// 路由表中的一条路由：普通处理函数、流式请求体处理器的工厂、协程处理函数，或WebSocket处理器的工厂
+struct Route {
+    HandlerFunc handler;
+    BodyHandlerFactory body_factory;
+    WebSocketHandlerFactory websocket_factory;
+#ifdef WEBSERVER_HAS_COROUTINES
+    AsyncHandlerFunc async_handler;
+    AsyncBodyHandlerFunc async_body_handler;
+#endif
+    RouteStats* stats = nullptr;   // 该路由的请求统计（由Router持有）
+    RouteLimit* limit = nullptr;   // 该路由的并发上限（由Router持有）
+    ResponseCache* cache = nullptr; // 该路由的响应缓存（由Router持有），为空表示不缓存
+
+    // 是否为协程路由（由事件循环线程执行）
+    bool isAsync() const {
+#ifdef WEBSERVER_HAS_COROUTINES
+        return async_handler || async_body_handler;
+#else
+        return false;
+#endif
+    }
+    explicit operator bool() const { return handler || body_factory || websocket_factory || isAsync(); }
+};
+
+// 路由树：压缩前缀树（radix tree），支持:param参数段和*wildcard通配段
+// 匹配优先级：静态段 > 参数段 > 通配段；查找过程不分配内存
+class RouteTree {
+public:
+    // 匹配过程中收集的路径参数
+    struct Match {
+        std::string_view names[Request::kMaxParams];
+        std::string_view values[Request::kMaxParams];
+        size_t count = 0;
+    };
+
+private:
+    struct Node {
+        std::string prefix;                           // 静态前缀（压缩后的边）
+        std::string indices;                          // 各静态子节点前缀的首字符
+        std::vector<std::unique_ptr<Node>> children;  // 静态子节点
+        std::unique_ptr<Node> param_child;            // :param子节点
+        std::string param_name;
+        std::unique_ptr<Node> wildcard_child;         // *wildcard子节点（总是叶子）
+        std::string wildcard_name;
+        Route route;
+    };
+
+    Node root_;
+
+    // 插入一段静态文本，返回其末尾所在的节点（必要时拆分已有的边）
+    static Node* insertStatic(Node* node, std::string_view text);
+    // 递归匹配，失败时回溯
+    static const Node* match(const Node* node, std::string_view path, Match& result);
+
+public:
+    // 注册路由，模式非法或参数名冲突时抛出std::invalid_argument
+    void insert(std::string_view pattern, Route route);
+    // 查找路由，未找到时返回nullptr
+    const Route* find(std::string_view path, Match& result) const;
+};
+
 // 路由类：管理URL与处理函数的映射
 class Router {
 private:
-    std::map<std::string, std::map<std::string, HandlerFunc>> routes_;
+    RouteTree trees_[kHttpMethodCount];   // 每个方法一棵路由树
     HandlerFunc not_found_handler_;
     std::string static_dir_;
+    std::shared_ptr<StaticFileCache> static_cache_;
+    CompressionConfig compression_;       // 静态文件按需压缩的配置
+    // 各路由的请求统计：只在注册路由和导出指标时加锁，记录请求时直接通过Route中的指针
+    std::vector<std::unique_ptr<RouteStats>> stats_;
+    mutable std::mutex stats_mutex_;
+    // 各路由的并发上限，与统计一样按方法+路径模式共享
+    std::vector<std::pair<std::string, std::unique_ptr<RouteLimit>>> limits_;
+    // 缓存路由的响应缓存，与统计一样只在注册路由和导出指标时加锁
+    std::vector<std::shared_ptr<ResponseCache>> caches_;
+    CacheRefreshExecutor cache_refresh_executor_;
+    std::vector<MiddlewareFunc> middleware_;  // 全局中间件（按注册顺序执行）
+    RouteStats* static_stats_;       // 静态文件请求
+    RouteStats* not_found_stats_;    // 未匹配任何路由的请求
+    bool has_async_routes_ = false;  // 是否注册了协程路由（没有时分发请求不做额外查找）
+    bool has_websocket_routes_ = false;
+
+    // 获取（必要时创建）方法+路径模式对应的统计
+    RouteStats* statsFor(std::string_view method, std::string_view route);
+    // 获取（必要时创建）方法+路径模式对应的并发上限
+    RouteLimit* limitFor(std::string_view method, std::string_view route);
+    // 发送静态文件（处理条件请求、Range请求和预压缩版本），文件不存在时返回false
+    bool serveStatic(const Request& req, const std::string& key, Response& res) const;
+    // 查找路由（HEAD请求没有单独注册时使用GET的路由），匹配到的路径参数写入req
+    const Route* findRoute(Request& req) const;
+    // 在全局中间件之内执行fn（没有注册中间件时直接执行）
+    template <typename F>
+    void runMiddleware(const Request& req, Response& res, F fn) const {
+        if (middleware_.empty()) {
+            fn();
+            return;
+        }
+        invokeMiddleware(middleware_.data(), middleware_.size(), req, res, MiddlewareNext(fn));
+    }
 
 public:
     Router() {
+        static_stats_ = statsFor("GET", "<static>");
+        not_found_stats_ = statsFor("", "<not_found>");
+
         // 默认404处理函数
         not_found_handler_ = [](const Request& req, Response& res) {
-            res.setStatusCode(404, "Not Found");
+            res.setStatusCode(404);
             res.setHtml("<html>"
                         "<head><title>404 Not Found</title></head>"
                         "<body><h1>404 Not Found</h1></body></html>");
         };
     }
 
+    // 注册指定方法的请求处理
+    // 路径支持参数段（/users/:id）和通配段（/files/*path，只能位于末尾）
+    void add(HttpMethod method, const std::string& path, HandlerFunc handler) {
+        Route route;
+        route.handler = std::move(handler);
+        route.stats = statsFor(methodName(method), path);
+        route.limit = limitFor(methodName(method), path);
+        trees_[static_cast<size_t>(method)].insert(path, std::move(route));
+    }
+
+    // 注册流式请求体处理：请求体不受max_body_size限制（改用max_streaming_body_size），
+    // 也不在内存中缓存，而是逐段交给factory为该请求创建的处理器
+    void stream(HttpMethod method, const std::string& path, BodyHandlerFactory factory) {
+        Route route;
+        route.body_factory = std::move(factory);
+        route.stats = statsFor(methodName(method), path);
+        route.limit = limitFor(methodName(method), path);
+        trees_[static_cast<size_t>(method)].insert(path, std::move(route));
+    }
+
+#ifdef WEBSERVER_HAS_COROUTINES
+    // 注册协程处理函数：在接受该连接的事件循环线程上执行，可以co_await定时器（sleepFor）、
+    // 异步套接字（AsyncSocket）、线程池任务（runInPool）和其他Task，挂起期间循环继续处理其他连接；
+    // 处理函数不应执行阻塞操作（阻塞操作交给runInPool）。协程路由优先于同路径的静态文件
+    void addAsync(HttpMethod method, const std::string& path, AsyncHandlerFunc handler) {
+        Route route;
+        route.async_handler = std::move(handler);
+        route.stats = statsFor(methodName(method), path);
+        route.limit = limitFor(methodName(method), path);
+        trees_[static_cast<size_t>(method)].insert(path, std::move(route));
+        has_async_routes_ = true;
+    }
+
+    // 注册以协程方式读取请求体的处理：请求头到达后即启动处理函数，请求体通过reader逐段取得，
+    // 上限为max_streaming_body_size；处理函数提前结束时不再接收剩余请求体，响应后关闭连接
+    void streamAsync(HttpMethod method, const std::string& path, AsyncBodyHandlerFunc handler) {
+        Route route;
+        route.async_body_handler = std::move(handler);
+        route.stats = statsFor(methodName(method), path);
+        route.limit = limitFor(methodName(method), path);
+        trees_[static_cast<size_t>(method)].insert(path, std::move(route));
+        has_async_routes_ = true;
+    }
+
+    // 注册GET请求的协程处理
+    void getAsync(const std::string& path, AsyncHandlerFunc handler) {
+        addAsync(HttpMethod::Get, path, std::move(handler));
+    }
+
+    // 注册POST请求的协程处理
+    void postAsync(const std::string& path, AsyncHandlerFunc handler) {
+        addAsync(HttpMethod::Post, path, std::move(handler));
+    }
+
+    // 请求匹配协程路由时返回该路由（路径参数写入req），否则返回nullptr
+    const Route* findAsyncRoute(Request& req) const;
+#endif
+
+    // 注册WebSocket路由（GET）：握手成功后连接交给factory为它创建的处理器（见websocket.h），
+    // 不再按HTTP解析；没有升级的普通请求收到426。并发上限（setConcurrencyLimit）限制同时打开的连接数
+    void websocket(const std::string& path, WebSocketHandlerFactory factory) {
+        Route route;
+        route.websocket_factory = std::move(factory);
+        route.stats = statsFor("GET", path);
+        route.limit = limitFor("GET", path);
+        trees_[static_cast<size_t>(HttpMethod::Get)].insert(path, std::move(route));
+        has_websocket_routes_ = true;
+    }
+
+    // 是否注册了WebSocket路由
+    bool hasWebSocketRoutes() const { return has_websocket_routes_; }
+    // 请求匹配WebSocket路由时返回该路由（路径参数写入req），否则返回nullptr
+    const Route* findWebSocketRoute(Request& req) const;
+
+    // 限制路由同时执行的处理函数数（需在start之前设置，路由可以稍后注册），max为0表示不限制
+    // 超出时不执行处理函数，直接返回503和Retry-After；流式路由和协程路由在请求头到达时检查，不再接收请求体
+    void setConcurrencyLimit(HttpMethod method, const std::string& path, size_t max) {
+        limitFor(methodName(method), path)->max_active.store(max);
+    }
+
     // 注册GET请求处理
     void get(const std::string& path, HandlerFunc handler) {
-        routes_["GET"][path] = handler;
+        add(HttpMethod::Get, path, std::move(handler));
     }
 
+    // 注册GET请求处理，并缓存处理函数的结果（见response_cache.h）：TTL内相同的请求不再执行处理函数，
+    // 同时未命中的相同请求只执行一次；只缓存内存中的响应体，带Set-Cookie或Cache-Control: no-store/no-cache/private的响应不缓存
+    void get(const std::string& path, HandlerFunc handler, const RouteCacheOptions& cache);
+
     // 注册POST请求处理
     void post(const std::string& path, HandlerFunc handler) {
-        routes_["POST"][path] = handler;
+        add(HttpMethod::Post, path, std::move(handler));
+    }
+
+    // 注册PUT请求处理
+    void put(const std::string& path, HandlerFunc handler) {
+        add(HttpMethod::Put, path, std::move(handler));
+    }
+
+    // 注册DELETE请求处理（delete是关键字，故命名为del）
+    void del(const std::string& path, HandlerFunc handler) {
+        add(HttpMethod::Delete, path, std::move(handler));
+    }
+
+    // 注册PATCH请求处理
+    void patch(const std::string& path, HandlerFunc handler) {
+        add(HttpMethod::Patch, path, std::move(handler));
+    }
+
+    // 为所有方法注册同一个处理函数
+    void any(const std::string& path, HandlerFunc handler) {
+        for (size_t i = 0; i < kHttpMethodCount; ++i) {
+            add(static_cast<HttpMethod>(i), path, handler);
+        }
     }
 
-    // 设置静态文件目录
-    void setStaticDir(const std::string& dir) {
+    // 设置静态文件目录，同时创建静态文件缓存
+    // cache_bytes：缓存总字节上限；max_file_size：单个文件载入内存的上限
+    void setStaticDir(const std::string& dir, size_t cache_bytes = 64 * 1024 * 1024,
+                      size_t max_file_size = 1024 * 1024) {
         static_dir_ = dir;
+        static_cache_ = std::make_shared<StaticFileCache>(dir, cache_bytes, max_file_size);
+    }
+
+    // 设置静态文件按需压缩的配置（WebServer启动时使用ServerConfig::compression）
+    // 没有预压缩文件（.br/.gz）时，内存中的文件按客户端接受的编码压缩一次，结果随缓存条目保存
+    void setCompression(CompressionConfig config) {
+        compression_ = std::move(config);
+    }
+
+    // 注册全局中间件（需在start之前注册）：按注册顺序包在所有同步处理函数之外，包括缓存路由（在查找缓存之前执行）
+    // 和404处理函数；静态文件、协程路由、流式路由和WebSocket握手不经过全局中间件
+    // 每个全局中间件多一次间接调用，多个中间件可以先用middleware(...)静态组合后一次注册（见middleware.h）
+    void use(MiddlewareFunc middleware) {
+        middleware_.push_back(std::move(middleware));
+    }
+
+    // 设置缓存路由在后台刷新过期结果的方式（WebServer启动时设置为提交到线程池），未设置时由请求同步刷新
+    void setCacheRefreshExecutor(CacheRefreshExecutor executor) {
+        cache_refresh_executor_ = std::move(executor);
+    }
+
+    // 获取静态文件缓存（未设置静态目录时为空）
+    const std::shared_ptr<StaticFileCache>& staticCache() const {
+        return static_cache_;
     }
 
     // 获取静态文件目录
@@ -150,8 +1014,31 @@ public:
         return static_dir_;
     }
 
-    // 处理请求
-    void handle(const Request& req, Response& res) const;
+    // 处理请求（匹配到的路径参数写入req），返回应记入的请求统计
+    RouteStats* handle(Request& req, Response& res) const;
+
+    // 请求头解析完成时调用：请求匹配流式路由时创建并返回其处理器，否则返回nullptr
+    // matched不为空时写入匹配到的流式路由
+    std::unique_ptr<BodyHandler> createBodyHandler(Request& req, const Route** matched = nullptr) const;
+
+    // 遍历所有路由的请求统计（线程安全）
+    template <typename F>
+    void forEachStats(F&& fn) const {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        for (const auto& stats : stats_) fn(*stats);
+    }
+
+    // 是否注册了缓存路由
+    bool hasCachedRoutes() const {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        return !caches_.empty();
+    }
+    // 遍历所有缓存路由的响应缓存（线程安全）
+    template <typename F>
+    void forEachCache(F&& fn) const {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        for (const auto& cache : caches_) fn(*cache);
+    }
 
     // 设置404处理函数
     void setNotFoundHandler(HandlerFunc handler) {
@@ -159,91 +1046,832 @@ public:
     }
 };
 
-// 线程池类：管理工作线程
-class ThreadPool {
+// 只可移动的无参可调用对象：小对象直接存放在内部缓冲区，避免堆分配和std::function的复制
+class UniqueFunction {
 private:
-    std::vector<std::thread> workers_;
-    bool stop_ = false;
-    std::vector<std::function<void()>> tasks_;
-    mutable std::mutex mutex_;
-    std::condition_variable condition_;
+    static constexpr size_t kInlineSize = 64;
 
-    // 工作线程函数
-    void workerThread() {
-        while (true) {
-            std::function<void()> task;
-            {
-                std::unique_lock<std::mutex> lock(mutex_);
-                condition_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
-                if (stop_ && tasks_.empty()) return;
-                task = tasks_.front();
-                tasks_.erase(tasks_.begin());
+    struct Ops {
+        void (*call)(void* storage);
+        void (*move)(void* dst, void* src);
+        void (*destroy)(void* storage);
+    };
+
+    template <typename F>
+    static const Ops* inlineOps() {
+        static const Ops ops = {
+            [](void* s) { (*static_cast<F*>(s))(); },
+            [](void* dst, void* src) {
+                new (dst) F(std::move(*static_cast<F*>(src)));
+                static_cast<F*>(src)->~F();
+            },
+            [](void* s) { static_cast<F*>(s)->~F(); }
+        };
+        return &ops;
+    }
+
+    template <typename F>
+    static const Ops* heapOps() {
+        static const Ops ops = {
+            [](void* s) { (**static_cast<F**>(s))(); },
+            [](void* dst, void* src) { *static_cast<F**>(dst) = *static_cast<F**>(src); },
+            [](void* s) { delete *static_cast<F**>(s); }
+        };
+        return &ops;
+    }
+
+    alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+    const Ops* ops_ = nullptr;
+
+public:
+    UniqueFunction() = default;
+
+    template <typename F, typename Fn = typename std::decay<F>::type,
+              typename = typename std::enable_if<!std::is_same<Fn, UniqueFunction>::value>::type>
+    UniqueFunction(F&& f) {
+        if constexpr (sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(std::max_align_t) &&
+                      std::is_nothrow_move_constructible<Fn>::value) {
+            new (storage_) Fn(std::forward<F>(f));
+            ops_ = inlineOps<Fn>();
+        } else {
+            *reinterpret_cast<Fn**>(storage_) = new Fn(std::forward<F>(f));
+            ops_ = heapOps<Fn>();
+        }
+    }
+
+    UniqueFunction(UniqueFunction&& other) noexcept : ops_(other.ops_) {
+        if (ops_) {
+            ops_->move(storage_, other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    UniqueFunction& operator=(UniqueFunction&& other) noexcept {
+        if (this != &other) {
+            reset();
+            ops_ = other.ops_;
+            if (ops_) {
+                ops_->move(storage_, other.storage_);
+                other.ops_ = nullptr;
             }
-            task();
         }
+        return *this;
     }
 
-public:
-    // 构造函数：创建指定数量的工作线程
-    explicit ThreadPool(size_t num_threads) {
-        for (size_t i = 0; i < num_threads; ++i) {
-            workers_.emplace_back(&ThreadPool::workerThread, this);
+    UniqueFunction(const UniqueFunction&) = delete;
+    UniqueFunction& operator=(const UniqueFunction&) = delete;
+
+    ~UniqueFunction() { reset(); }
+
+    void reset() {
+        if (ops_) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
         }
     }
 
-    // 析构函数：停止所有工作线程
-    ~ThreadPool() {
-        {
-            std::unique_lock<std::mutex> lock(mutex_);
-            stop_ = true;
+    explicit operator bool() const { return ops_ != nullptr; }
+    void operator()() { ops_->call(storage_); }
+};
+
+// 有界多生产者多消费者环形队列（Vyukov算法，无锁）
+// 每个槽位的序号决定它当前可写还是可读，生产者和消费者只在各自的位置计数上竞争
+template <typename T>
+class MpmcQueue {
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> enqueue_pos_{0};
+    alignas(64) std::atomic<size_t> dequeue_pos_{0};
+
+public:
+    // 容量向上取整为2的幂
+    explicit MpmcQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        cells_.reset(new Cell[size]);
+        mask_ = size - 1;
+        for (size_t i = 0; i < size; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
         }
-        condition_.notify_all();
-        for (auto& worker : workers_) {
-            worker.join();
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+    // 队列满时返回false，value保持不变
+    bool tryPush(T& value) {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
         }
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
     }
 
-    // 添加任务到线程池
-    void enqueue(std::function<void()> task) {
-        {
-            std::unique_lock<std::mutex> lock(mutex_);
-            tasks_.push_back(task);
+    // 队列空时返回false
+    bool tryPop(T& value) {
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
         }
-        condition_.notify_one();
+        value = std::move(cell->value);
+        cell->value = T();
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+// 线程池类：工作窃取调度器
+// 外部线程提交的任务进入无锁的有界注入队列；工作线程内部提交的任务进入自己的本地双端队列。
+// 空闲的工作线程依次尝试本地队列、注入队列，最后从其他线程的本地队列尾部窃取任务。
+class ThreadPool {
+public:
+    // 注入队列已满时的处理策略
+    enum class OverflowPolicy {
+        Block,       // 在条件变量上休眠，直到工作线程从队列取走任务腾出空间
+        Reject,      // 立即拒绝，enqueue返回false
+        CallerRuns   // 由提交任务的线程直接执行
+    };
+
+private:
+    // 排队中的任务：记录入队时间以统计排队等待时间
+    struct Task {
+        UniqueFunction fn;
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
+    // 每个工作线程的本地队列：只有窃取时才会与其他线程竞争这把锁
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::thread> workers_;
+    std::vector<std::unique_ptr<WorkerQueue>> local_queues_;
+    MpmcQueue<Task> injection_queue_;
+    OverflowPolicy policy_;
+
+    std::atomic<bool> stop_{false};
+    std::atomic<int64_t> pending_{0};       // 排队中的任务数
+    std::atomic<size_t> idle_workers_{0};   // 正在休眠的工作线程数
+    std::atomic<uint64_t> steal_count_{0};
+    std::atomic<uint64_t> rejected_count_{0};
+    LatencyHistogram queue_wait_;           // 任务从提交到开始执行的等待时间（微秒）
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_condition_;
+    std::atomic<size_t> blocked_producers_{0};   // 因注入队列已满而休眠的提交者数（Block策略）
+    std::mutex space_mutex_;
+    std::condition_variable space_condition_;
+
+    // 工作线程函数
+    void workerThread(size_t index);
+    // 按本地队列、注入队列、窃取的顺序获取任务
+    bool popTask(size_t index, Task& task);
+    // 有任务入队后唤醒一个休眠的工作线程
+    void notifyWorker();
+    // 注入队列腾出空间后唤醒一个休眠的提交者
+    void notifyProducer();
+    // 队列已满时休眠等待空间（Block策略），线程池停止时返回false
+    bool pushBlocking(Task& task);
+    // 提交已封装好的任务
+    bool submit(UniqueFunction task);
+
+public:
+    // 构造函数：创建指定数量的工作线程，queue_capacity为注入队列容量
+    explicit ThreadPool(size_t num_threads, size_t queue_capacity = 4096,
+                        OverflowPolicy policy = OverflowPolicy::Block);
+
+    // 析构函数：执行完已提交的任务后停止所有工作线程
+    ~ThreadPool();
+
+    // 添加任务到线程池（任务只需可移动），被拒绝时返回false
+    template <typename F>
+    bool enqueue(F&& task) {
+        return submit(UniqueFunction(std::forward<F>(task)));
     }
 
     // 获取工作线程数量（公开接口）
     size_t getWorkerCount() const {
         return workers_.size();
     }
+
+    // 当前排队等待执行的任务数
+    size_t queueDepth() const {
+        int64_t depth = pending_.load(std::memory_order_relaxed);
+        return depth > 0 ? static_cast<size_t>(depth) : 0;
+    }
+
+    // 注入队列容量
+    size_t queueCapacity() const { return injection_queue_.capacity(); }
+
+    // 累计窃取次数
+    uint64_t stealCount() const { return steal_count_.load(std::memory_order_relaxed); }
+
+    // 累计因队列已满被拒绝的任务数
+    uint64_t rejectedCount() const { return rejected_count_.load(std::memory_order_relaxed); }
+
+    // 任务排队等待时间的分布
+    const LatencyHistogram& queueWait() const { return queue_wait_; }
+};
+
+// 事件循环的I/O后端，在构造WebServer时选择
+enum class IoBackend {
+    Epoll,    // 边缘触发epoll加非阻塞读写
+    IoUring   // io_uring：批量提交、多次accept/recv、链接的写入与关闭；内核不支持时自动退回epoll
+};
+
+// HTTP/2明文连接（h2c）的配置（ServerConfig::http2）
+struct Http2Config {
+    bool enabled = true;                          // 接受h2c（先验知识的连接前言和Upgrade: h2c）
+    uint32_t max_concurrent_streams = 100;        // 每个连接同时进行的流数上限
+    uint32_t initial_window_size = 1 << 20;       // 每个流的接收窗口
+    uint32_t connection_window_size = 16 << 20;   // 连接的接收窗口
+    size_t high_water = 256 * 1024;               // 发送队列超过该大小时暂停生成DATA帧，发出后再继续
+};
+
+// WebSocket连接的配置（ServerConfig::websocket）
+struct WebSocketConfig {
+    size_t max_message_size = 1 << 20;    // 单条消息（分片合计）的上限，超出时以1009关闭；不应超过max_body_size
+    size_t max_send_buffer = 4 << 20;     // 发送队列的上限：接收过慢的连接超过后被断开，不拖累广播
+    int ping_interval_ms = 30000;         // 连接空闲该时间后发送ping，再过同样时间仍无数据则断开；0表示不发送
+};
+
+// 服务器配置
+struct ServerConfig {
+    int keep_alive_timeout_ms = 5000;       // 长连接空闲超时（毫秒）
+    int header_timeout_ms = 10000;          // 从请求的第一个字节到请求头接收完整的时间上限，超时返回408
+    int body_timeout_ms = 30000;            // 接收请求体期间两次数据到达的最长间隔，超时返回408
+    int send_timeout_ms = 30000;            // 发送响应期间对端不接收数据的最长时间，超时关闭连接
+    size_t max_connections = 10000;         // 同时打开的连接数上限（所有反应器合计），超出时新连接收到503后关闭；0表示不限制
+    size_t max_queued_requests = 1024;      // 在线程池中排队等待处理的请求上限，超出时直接返回503
+    int max_queue_delay_ms = 0;             // 请求排队超过该时间后不再处理，直接返回503；0表示不限制
+    int retry_after_seconds = 1;            // 过载时503响应的Retry-After（秒）
+    size_t max_keep_alive_requests = 100;   // 单个连接最多处理的请求数
+    size_t max_header_size = 64 * 1024;     // 请求行加请求头的最大字节数
+    size_t max_body_size = 8 * 1024 * 1024; // 请求体最大字节数（缓存在内存中的请求体）
+    size_t max_streaming_body_size = 1ULL << 30;  // 流式路由（Router::stream）的请求体最大字节数
+    int listen_backlog = SOMAXCONN;         // 监听队列长度
+    // 反应器（事件循环）数量：1为单循环加线程池；大于1时每个循环拥有独立的SO_REUSEPORT监听套接字，
+    // 由内核在各循环间分配新连接，处理函数直接在接受该连接的循环线程上执行；0表示每个可用CPU一个
+    size_t reactor_count = 1;
+    bool pin_reactors = true;               // 多反应器模式下把每个循环绑定到一个CPU
+    std::string metrics_path = "/metrics";  // Prometheus指标的路径，为空时不注册
+    CompressionConfig compression;          // 响应压缩（gzip/deflate/br）的配置
+    Http2Config http2;                      // HTTP/2（h2c）的配置
+    WebSocketConfig websocket;              // WebSocket连接的配置
+    AccessLogConfig access_log;             // 访问日志，设置path后启用
+    int shutdown_timeout_ms = 30000;        // 优雅关闭时等待在途请求的上限，超时后强制关闭剩余连接
+    // start()期间处理信号：SIGTERM/SIGINT优雅关闭（再次收到时立即关闭），SIGHUP重新加载，SIGUSR2平滑升级
+    bool handle_signals = true;
+};
+
+// io_uring后端在途写入的参数：提交后到完成前必须保持有效
+struct UringWrite {
+    static const unsigned kMaxIov = 16;
+    iovec iov[kMaxIov];
+    msghdr msg;
+    size_t send_length = 0;      // sendmsg的字节数
+    size_t fixed_length = 0;     // 固定缓冲区写入的字节数
+    int fixed_slot = -1;         // 使用的固定缓冲区槽位
+};
+
+// 连接当前阶段适用的超时
+enum class ConnDeadline : uint8_t {
+    None,       // 请求正在处理，不计时
+    Idle,       // 等待下一个请求（keep_alive_timeout_ms）
+    Header,     // 接收请求头，从第一个字节起计时（header_timeout_ms）
+    Body,       // 接收请求体，每次收到数据后重新计时（body_timeout_ms）
+    Send        // 发送响应，每次发出数据后重新计时（send_timeout_ms）
+};
+
+// 连接状态：读写缓冲由事件循环独占；请求、响应和请求内存池在请求处理期间交给工作线程使用
+// 工作线程持有连接的shared_ptr，连接在处理期间被关闭时不会提前释放
+struct Connection : std::enable_shared_from_this<Connection> {
+    int fd = -1;
+    uint64_t id = 0;                 // 连接唯一编号，防止fd复用导致响应错投
+    std::string in_buf;              // 已接收但尚未处理的数据
+    std::string spare_buf;           // 回收的请求数据缓冲，下次交接时复用其容量
+    RequestParser parser;            // 可恢复的请求解析状态
+    Request request;                 // 正在解析或处理的请求（跨请求复用）
+    OutputBuffer response;           // 工作线程生成的响应，交付时移入output
+    OutputBuffer output;             // 待发送的数据
+    std::unique_ptr<BodyHandler> body_handler;  // 流式路由的请求体处理器（接收请求体期间有效）
+    const Route* body_route = nullptr;          // 请求体处理器所属的流式路由
+    RequestArena arena;              // 请求内存池，连接空闲（无在途请求且发送完毕）时重置
+    size_t requests_served = 0;      // 该连接上已完成的请求数
+    TimerWheel::Timer deadline_timer;  // 当前阶段的超时（见ConnDeadline）
+    ConnDeadline deadline = ConnDeadline::None;
+    RouteLimit* route_permit = nullptr;  // 在循环线程上占用的路由并发名额（流式路由和协程路由）
+    std::unique_ptr<Http2Connection> http2;  // HTTP/2会话（收到连接前言或升级到h2c之后），之后不再按HTTP/1.1解析
+    std::shared_ptr<WebSocket> websocket;    // 升级为WebSocket之后的会话，之后接收缓冲中是WebSocket帧
+    bool busy = false;               // 是否有请求正在线程池中处理
+    bool peer_closed = false;        // 对端已关闭写端
+    bool close_after_write = false;  // 发送完毕后关闭连接
+    bool input_paused = false;       // 等待发送完毕、内存池重置后再继续分发请求
+    bool read_paused = false;        // 接收缓冲已满，等待在途请求完成后再继续读取
+    bool expect_continue = false;    // 客户端等待100 Continue后才发送请求体
+    bool body_aborted = false;       // 流式请求体被处理器中止，响应后关闭连接
+    bool closed = false;             // 连接已关闭，丢弃之后交付的响应
+    bool async_active = false;       // 协程处理函数正在执行（在循环线程上，可能挂起）
+    bool async_starting = false;     // 正在启动协程处理函数
+    bool async_done = false;         // 协程处理函数在启动过程中已同步完成
+    bool async_keep_alive = false;   // 同步完成时的保持连接结果
+
+    // 以下只用于io_uring后端：连接关闭后等在途操作全部结束再释放
+    std::unique_ptr<UringWrite> uring_write;  // 在途写入的参数（首次写入时分配）
+    unsigned uring_ops = 0;          // 尚未结束的操作数
+    unsigned write_ops = 0;          // 尚未结束的写入操作数
+    bool recv_armed = false;         // 多次recv正在进行
+    bool pollout_armed = false;      // 正在等待可写
+    bool close_linked = false;       // 写入之后链接了关闭操作，由它关闭fd
+    bool write_blocked = false;      // 本组写入不完整（套接字缓冲区已满）
+    bool write_failed = false;       // 本组写入出错
+};
+
+// 监听任意fd读写事件的对象（如AsyncSocket），由事件循环在其线程上回调
+class IoWatcher {
+public:
+    virtual ~IoWatcher() = default;
+    // events为epoll事件位（EPOLLIN、EPOLLOUT等）
+    virtual void onIoEvent(uint32_t events) = 0;
+};
+
+// 事件循环类：基于边缘触发epoll的非阻塞I/O反应器
+// 循环独占所有连接的读写状态，只把完整的请求交给线程池处理
+class EventLoop {
+private:
+    friend struct AsyncDriver;
+    friend struct Http2Connection;
+    friend class WebSocket;
+    friend class WebServer;
+
+    WebServer& server_;
+    int listen_fd_;
+    bool watch_static_;              // 是否由该循环处理静态缓存的文件变化通知
+    bool inline_handlers_;           // 在循环线程上直接执行处理函数（多反应器模式）
+    std::atomic<bool> stopping_{false};
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1;               // eventfd：工作线程投递结果后唤醒循环
+    int watch_fd_ = -1;              // 静态缓存的inotify描述符
+    int spare_fd_ = -1;              // 预留的fd：fd耗尽时关闭它以便接受并拒绝新连接
+    TimerWheel deadlines_;           // 各连接的超时（先于连接构造，后于连接销毁）
+    std::unordered_map<int, std::shared_ptr<Connection>> connections_;
+    std::mutex pending_mutex_;
+    std::vector<UniqueFunction> pending_;
+    std::vector<UniqueFunction> running_;  // 与pending_交换，复用两者的容量
+    std::multimap<std::chrono::steady_clock::time_point, UniqueFunction> timers_;  // 按到期时间排序的定时任务
+    std::unordered_map<int, IoWatcher*> watchers_;   // 连接以外的fd（如AsyncSocket）
+
+    // io_uring后端：epoll只用于唤醒fd、inotify和IoWatcher，epoll fd本身由io_uring监听
+    struct FixedBuffer {
+        std::shared_ptr<const std::string> data;   // 注册的内容，注册期间保持有效
+        unsigned inflight = 0;                     // 正在使用该槽位的写入数
+        uint64_t last_used = 0;
+    };
+    bool want_uring_;                                // 要求使用io_uring后端
+    std::unique_ptr<IoUring> uring_;                 // 为空时使用epoll后端
+    std::unordered_map<Connection*, std::shared_ptr<Connection>> closing_;  // 已关闭、仍有在途操作的连接
+    std::vector<FixedBuffer> fixed_buffers_;         // 热点静态文件内容的固定缓冲区槽位
+    std::unordered_map<const std::string*, unsigned> fixed_slots_;  // 已注册内容到槽位
+    std::unordered_map<const std::string*, unsigned> fixed_hits_;   // 尚未注册内容的发送次数
+    uint64_t fixed_clock_ = 0;
+    bool draining_ = false;                          // 正在优雅关闭：不再接受新连接，连接空闲后关闭
+
+    // WebSocket：本循环上各主题的订阅者，以及本轮加入了待发送帧的连接
+    std::unordered_map<std::string, std::vector<WebSocket*>> ws_topics_;
+    std::vector<std::shared_ptr<Connection>> ws_flush_;
+
+    // 接受所有等待中的新连接
+    void acceptConnections();
+    // 为新接受的套接字创建连接（epoll后端同时注册读写事件），失败时关闭套接字并返回nullptr
+    Connection* addConnection(int client_socket);
+    // 处理唤醒fd、inotify和IoWatcher的事件，fd不属于它们时返回false
+    bool handleLoopEvent(int fd, uint32_t events);
+    // 读取数据直到EAGAIN
+    void handleRead(Connection& conn);
+    // 发送缓冲区中的数据直到EAGAIN（io_uring后端为提交写入），连接被关闭时返回false
+    bool handleWrite(Connection& conn);
+    // 发送队列已全部发出：重置内存池并继续处理暂停的请求，连接被关闭时返回false
+    bool outputDrained(Connection& conn);
+    // 从输入缓冲中取出完整请求并分发，连接被关闭时返回false
+    bool processInput(Connection& conn);
+    // 请求头解析完成、请求体尚未接收：选择请求体的接收方式，连接被关闭时返回false
+    bool beginBody(Connection& conn);
+    // 把已解码的流式请求体交给处理器，处理器中止时返回false
+    bool streamBody(Connection& conn);
+    // 分发已完整的请求（线程池或当前线程），连接被关闭时返回false
+    bool dispatchRequest(Connection& conn);
+    // 请求处理完毕：把响应移入发送队列并发送，连接被关闭时返回false
+    bool finishRequest(Connection& conn, bool keep_alive);
+    // 工作线程处理完成后，把响应写回连接并继续处理流水线请求
+    void deliver(Connection& conn, bool keep_alive);
+    // 为连接创建HTTP/2会话并发送服务器的连接前言
+    void startHttp2(Connection& conn);
+    // 请求要求升级到h2c：回复101，原请求作为流1交给会话，连接被关闭时返回false
+    bool upgradeHttp2(Connection& conn);
+    // 把接收缓冲交给HTTP/2会话处理，连接被关闭时返回false
+    bool processHttp2(Connection& conn);
+    // 请求要求升级为WebSocket：校验握手，回复101并创建会话，连接被关闭时返回false
+    bool upgradeWebSocket(Connection& conn, const Route& route);
+    // 把接收缓冲交给WebSocket会话处理，连接被关闭时返回false
+    bool processWebSocket(Connection& conn);
+    // 发送本轮加入发送队列的WebSocket帧，断开发送队列超过上限的连接（每轮事件处理结束时调用）
+    void flushWebSockets();
+    // 把已编码的帧加入本循环上订阅了topic的所有连接的发送队列（共享同一份数据）
+    void publishWebSocket(const std::string& topic, const std::shared_ptr<const std::string>& frame);
+    // 从主题的订阅者中移除ws
+    void removeSubscriber(const std::string& topic, WebSocket* ws);
+    // 生成并发送HTTP/2帧，直到没有可发送的内容或套接字缓冲区已满，连接被关闭时返回false
+    bool flushHttp2(Connection& conn);
+    // 按连接当前的状态设置超时：处理中不计时，接收请求头时保持首次设置的期限，其余阶段从现在重新计时
+    void refreshDeadline(Connection& conn);
+    // 处理已到期的连接超时
+    void expireDeadlines();
+    // 连接超时：请求未接收完时返回408，空闲或发送停滞时直接关闭
+    void onDeadline(Connection& conn);
+    // 放弃当前请求：发送错误响应（503为预先格式化的过载响应）后关闭连接，连接被关闭时返回false
+    bool abortRequest(Connection& conn, int status);
+    // 超出连接数上限：发送过载响应后立即关闭套接字
+    void rejectConnection(int client_socket);
+    // fd耗尽时借用预留的fd取走并拒绝等待中的连接，取到连接时返回true
+    bool shedPendingConnection();
+    // 关闭连接并释放状态
+    void closeConnection(Connection& conn);
+    // 开始优雅关闭（见drain）
+    void beginDrain(std::chrono::milliseconds timeout);
+    // 强制关闭所有连接
+    void closeAllConnections();
+    // 执行其他线程投递的任务
+    void runPending();
+    // 执行已到期的定时任务
+    void runTimers();
+    // 距下一个定时任务到期的毫秒数（向上取整，最多max_ms）
+    int nextTimeout(int max_ms) const;
+    // 两种后端的事件循环
+    void runEpoll();
+    void runUring();
+    // 创建io_uring实例并启动多次accept，失败时返回false（使用epoll）
+    bool initUring();
+    // 处理一个io_uring完成事件
+    void handleCompletion(const IoUring::Completion& completion);
+    void onRecv(Connection& conn, const IoUring::Completion& completion);
+    void onWriteComplete(Connection& conn, uint64_t op, int32_t res);
+    // 启动连接的多次recv（已在进行、读取暂停或连接已关闭时不做任何事）
+    void armRecv(Connection& conn);
+    // 等待连接可写
+    void armPollOut(Connection& conn);
+    // 提交发送队列开头的数据（上一组写入尚未结束时等它结束），连接被关闭时返回false
+    bool submitWrite(Connection& conn);
+    // 一组写入全部结束后继续发送、等待可写或收尾
+    void continueWrite(Connection& conn);
+    // 共享数据（静态文件内容）对应的固定缓冲区槽位，尚不够热或没有可用槽位时返回-1
+    int fixedBufferSlot(const std::shared_ptr<const std::string>& data);
+#ifdef WEBSERVER_HAS_COROUTINES
+    // 在当前线程上启动协程处理函数；同步完成时直接发送响应，连接被关闭时返回false
+    bool startAsync(Connection& conn, const Route& route);
+    // 协程处理函数结束：补全响应并移入连接的发送队列，连接已关闭或请求已取消时返回false
+    bool prepareAsyncResponse(Connection& conn, Response& res, RouteStats* stats,
+                              std::chrono::steady_clock::time_point started, bool& keep_alive);
+    // 发送协程处理函数生成的响应（启动过程中同步完成时留给startAsync发送）
+    void completeAsync(Connection& conn, bool keep_alive);
+    // 连接关闭或请求出错：放弃正在执行的协程处理函数的响应，唤醒等待请求体的协程
+    void cancelAsync(Connection& conn);
+#endif
+
+public:
+    EventLoop(WebServer& server, int listen_fd, bool watch_static, bool inline_handlers, bool want_uring = false);
+    ~EventLoop();
+
+    // 创建epoll实例并注册监听套接字；要求io_uring时先尝试创建，内核不支持时退回epoll
+    bool init();
+    // 是否使用io_uring后端（init之后有效）
+    bool usingUring() const { return uring_ != nullptr; }
+    // 运行事件循环（阻塞，直到stop()）
+    void run();
+    // 线程安全：让run()尽快返回
+    void stop();
+    // 线程安全：优雅关闭——停止接受新连接、关闭空闲连接，其余连接发送完当前响应后关闭，
+    // 全部关闭后run()返回；超过timeout时强制关闭剩余连接。再次调用时立即强制关闭
+    void drain(std::chrono::milliseconds timeout);
+    // 线程安全：投递任务到循环线程执行
+    void post(UniqueFunction fn);
+
+    // 以下只能在循环线程上调用
+    // 在delay之后执行fn
+    void runAfter(std::chrono::steady_clock::duration delay, UniqueFunction fn);
+    // 监听fd的读写事件（边缘触发），失败时返回false
+    bool watch(int fd, IoWatcher* watcher);
+    // 取消监听（在关闭fd之前调用）
+    void unwatch(int fd);
+    // 把任务交给服务器的线程池执行，被拒绝时返回false
+    bool offload(UniqueFunction fn);
+
+    // 当前线程正在运行的事件循环，不在循环线程上时为nullptr
+    static EventLoop* current();
+};
+
+#ifdef WEBSERVER_HAS_COROUTINES
+// 以下可等待对象只能在事件循环线程上（协程处理函数中）使用，协程总是在同一个循环线程上恢复
+
+// 获取当前线程的事件循环，不在循环线程上时抛出std::logic_error
+EventLoop& currentLoop();
+
+// 挂起当前协程，delay之后恢复
+class SleepAwaiter {
+private:
+    std::chrono::steady_clock::duration delay_;
+
+public:
+    explicit SleepAwaiter(std::chrono::steady_clock::duration delay) : delay_(delay) {}
+    bool await_ready() const noexcept { return delay_ <= std::chrono::steady_clock::duration::zero(); }
+    void await_suspend(std::coroutine_handle<> handle) {
+        currentLoop().runAfter(delay_, [handle]() { handle.resume(); });
+    }
+    void await_resume() const noexcept {}
+};
+
+inline SleepAwaiter sleepFor(std::chrono::steady_clock::duration delay) {
+    return SleepAwaiter(delay);
+}
+
+// 在线程池中执行fn，完成后回到原来的循环线程恢复协程，返回fn的结果（或重新抛出其异常）
+// 线程池拒绝任务时直接在当前线程执行
+template <typename F>
+class PoolAwaiter {
+private:
+    using Result = std::invoke_result_t<F&>;
+    using Stored = std::conditional_t<std::is_void_v<Result>, bool, Result>;
+
+    F fn_;
+    std::optional<Stored> result_;
+    std::exception_ptr error_;
+
+    void execute() {
+        try {
+            if constexpr (std::is_void_v<Result>) {
+                fn_();
+                result_.emplace(true);
+            } else {
+                result_.emplace(fn_());
+            }
+        } catch (...) {
+            error_ = std::current_exception();
+        }
+    }
+
+public:
+    explicit PoolAwaiter(F fn) : fn_(std::move(fn)) {}
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+        EventLoop* loop = &currentLoop();
+        bool queued = loop->offload([this, handle, loop]() {
+            execute();
+            loop->post([handle]() { handle.resume(); });
+        });
+        if (queued) return true;
+        execute();
+        return false;
+    }
+    Result await_resume() {
+        if (error_) std::rethrow_exception(error_);
+        if constexpr (!std::is_void_v<Result>) return std::move(*result_);
+    }
+};
+
+template <typename F>
+PoolAwaiter<std::decay_t<F>> runInPool(F&& fn) {
+    return PoolAwaiter<std::decay_t<F>>(std::forward<F>(fn));
+}
+
+// 读取整个文件，失败时返回空（阻塞调用，协程中通过readFileAsync使用）
+std::optional<std::string> readWholeFile(const std::string& path);
+
+// 在线程池中读取整个文件，不阻塞事件循环
+inline auto readFileAsync(std::string path) {
+    return runInPool([path = std::move(path)]() { return readWholeFile(path); });
+}
+
+// 非阻塞TCP客户端套接字：连接、读写均以co_await完成，只能在创建它的循环线程上使用
+// 同一时刻最多一个读操作和一个写操作；有操作等待时不能销毁或关闭套接字
+class AsyncSocket : private IoWatcher {
+public:
+    class ConnectAwaiter;
+    class ReadAwaiter;
+    class WriteAwaiter;
+
+private:
+    int fd_ = -1;
+    EventLoop* loop_ = nullptr;
+    ConnectAwaiter* connecting_ = nullptr;   // 等待中的操作
+    ReadAwaiter* reading_ = nullptr;
+    WriteAwaiter* writing_ = nullptr;
+
+    void onIoEvent(uint32_t events) override;
+    // 创建套接字并发起连接，已有结果（成功或失败）时返回true
+    bool beginConnect(const std::string& host, uint16_t port, int& error);
+
+public:
+    // 连接操作：结果为0表示成功，否则为errno
+    class ConnectAwaiter {
+    private:
+        friend class AsyncSocket;
+        AsyncSocket& socket_;
+        std::string host_;
+        uint16_t port_;
+        int error_ = 0;
+        std::coroutine_handle<> handle_;
+
+    public:
+        ConnectAwaiter(AsyncSocket& socket, std::string host, uint16_t port)
+            : socket_(socket), host_(std::move(host)), port_(port) {}
+        bool await_ready() { return socket_.beginConnect(host_, port_, error_); }
+        void await_suspend(std::coroutine_handle<> handle) {
+            handle_ = handle;
+            socket_.connecting_ = this;
+        }
+        int await_resume() const noexcept { return error_; }
+    };
+
+    // 读操作：结果为读到的字节数，0表示对端已关闭，负数为-errno
+    class ReadAwaiter {
+    private:
+        friend class AsyncSocket;
+        AsyncSocket& socket_;
+        char* buffer_;
+        size_t size_;
+        ssize_t result_ = 0;
+        std::coroutine_handle<> handle_;
+
+        // 尝试读取，有结果时返回true
+        bool attempt();
+
+    public:
+        ReadAwaiter(AsyncSocket& socket, char* buffer, size_t size)
+            : socket_(socket), buffer_(buffer), size_(size) {}
+        bool await_ready() { return attempt(); }
+        void await_suspend(std::coroutine_handle<> handle) {
+            handle_ = handle;
+            socket_.reading_ = this;
+        }
+        ssize_t await_resume() const noexcept { return result_; }
+    };
+
+    // 写操作：写完全部数据后完成，结果为写入的字节数，负数为-errno
+    class WriteAwaiter {
+    private:
+        friend class AsyncSocket;
+        AsyncSocket& socket_;
+        std::string_view data_;
+        size_t written_ = 0;
+        ssize_t result_ = 0;
+        std::coroutine_handle<> handle_;
+
+        // 尝试写入剩余数据，全部写完或出错时返回true
+        bool attempt();
+
+    public:
+        WriteAwaiter(AsyncSocket& socket, std::string_view data) : socket_(socket), data_(data) {}
+        bool await_ready() { return attempt(); }
+        void await_suspend(std::coroutine_handle<> handle) {
+            handle_ = handle;
+            socket_.writing_ = this;
+        }
+        ssize_t await_resume() const noexcept { return result_; }
+    };
+
+    AsyncSocket() = default;
+    ~AsyncSocket() override { close(); }
+    AsyncSocket(const AsyncSocket&) = delete;
+    AsyncSocket& operator=(const AsyncSocket&) = delete;
+
+    // 连接到host:port（host为IPv4或IPv6地址字面量，需要域名解析时通过runInPool调用getaddrinfo）
+    ConnectAwaiter connect(std::string host, uint16_t port) {
+        return ConnectAwaiter(*this, std::move(host), port);
+    }
+    // 读取最多size字节，没有数据时挂起
+    ReadAwaiter read(char* buffer, size_t size) { return ReadAwaiter(*this, buffer, size); }
+    // 写入全部数据（调用者保证数据在完成前有效），发送缓冲区满时挂起
+    WriteAwaiter write(std::string_view data) { return WriteAwaiter(*this, data); }
+    // 关闭套接字
+    void close();
+
+    bool isOpen() const { return fd_ != -1; }
+    int fd() const { return fd_; }
 };
+#endif
 
 // Web服务器类：核心服务类
 class WebServer {
 private:
+    friend class EventLoop;
+    friend struct Http2Connection;
+
     int port_;
-    int server_fd_ = -1;
+    std::vector<int> listen_fds_;                    // 每个反应器一个监听套接字
     std::unique_ptr<ThreadPool> thread_pool_;
+    std::vector<std::unique_ptr<EventLoop>> loops_;
+    std::vector<std::thread> loop_threads_;          // 除第一个以外的反应器线程
     Router router_;
+    ServerConfig config_;
     sockaddr_in address_;
-    size_t request_count_ = 0;
-    mutable std::mutex request_mutex_;
+    ServerMetrics metrics_;
+    RouteStats bad_request_stats_{"", "<bad_request>"};   // 无法解析的请求
+    std::string keep_alive_headers_;  // 预先格式化的Connection和Keep-Alive响应头
+    std::string retry_after_;         // 预先格式化的Retry-After值
+    std::shared_ptr<const std::string> overload_response_;  // 预先格式化的503响应（拒绝连接和请求时共享）
+    std::atomic<size_t> open_connections_{0};  // 所有反应器当前打开的连接数
+    std::atomic<uint64_t> next_connection_id_{1};
+    std::unique_ptr<AccessLog> access_log_;    // 未启用时为空
+    IoBackend io_backend_;            // 要求的I/O后端，启动后为实际使用的后端
 
-    // 处理客户端连接
-    void handleClient(int client_socket);
+    // 优雅关闭、重新加载和平滑升级
+    std::atomic<bool> draining_{false};          // 正在优雅关闭，之后的响应都不再保持连接
+    std::mutex reload_mutex_;
+    std::function<void()> reload_handler_;
+    int signal_pipe_[2] = {-1, -1};              // 信号处理函数写入信号编号，由第一个事件循环读取
+    std::unique_ptr<IoWatcher> signal_watcher_;
+    bool upgrading_ = false;                     // 新进程已启动、尚未就绪（只在第一个事件循环上访问）
+    pid_t upgrade_pid_ = -1;
+    int upgrade_ready_fd_ = -1;                  // 新进程就绪时写入一个字节，失败时直接关闭
+    std::unique_ptr<IoWatcher> upgrade_watcher_;
 
-public:
-    // 构造函数：指定端口和线程数量
-    WebServer(int port, size_t thread_count);
-    ~WebServer() {
-        if (server_fd_ != -1) {
-            close(server_fd_);
+    // 创建、绑定并监听一个套接字，失败时返回-1
+    int createListenSocket();
+
+    // 处理一个完整的请求，把响应写入out，响应头分配在arena中
+    // keep_alive：传入是否允许保持连接，传出本次响应是否保持连接
+    // body_handler不为空时由流式请求体处理器生成响应，耗时记入body_stats
+    void handleRequest(Request& req, bool& keep_alive, OutputBuffer& out, std::pmr::memory_resource* arena,
+                       BodyHandler* body_handler = nullptr, RouteStats* body_stats = nullptr);
+    // 处理函数已生成响应：补全连接相关的响应头，把响应移入out，并把自started以来的耗时记入stats
+    void finishResponse(const Request& req, Response& res, bool& keep_alive, OutputBuffer& out,
+                        RouteStats* stats, std::chrono::steady_clock::time_point started);
+    // 处理一个HTTP/2流上的请求：响应不含连接相关的响应头，由HTTP/2会话在循环线程上编码发送
+    std::unique_ptr<Response> handleHttp2Request(Request& req, BodyHandler* body_handler, RouteStats* body_stats);
+    // HTTP/2响应的收尾：压缩、Retry-After，并把自started以来的耗时记入stats
+    void finishHttp2Response(const Request& req, Response& res, RouteStats* stats,
+                             std::chrono::steady_clock::time_point started);
+    // 记录一个无法解析的请求
+    void recordBadRequest(int status);
+    // 写入访问日志（未启用时不做任何事）；bytes为-1表示响应体长度未知
+    void logAccess(const Request& req, int status, int64_t bytes, uint64_t latency_us) {
+        if (access_log_) {
+            access_log_->log(req.method(), req.path(), req.version(), status, bytes, latency_us,
+                             req.connectionId());
         }
     }
 
+    // 安装/恢复信号处理（config().handle_signals）
+    void installSignalHandlers();
+    void restoreSignalHandlers();
+    // 在第一个事件循环上处理收到的信号
+    void onSignal(int sig);
+    // 在第一个事件循环上启动新进程，监听套接字通过继承的fd交给它
+    void startUpgrade();
+    // 新进程就绪（或启动失败）
+    void onUpgradeReady();
+
+public:
+    // 构造函数：指定端口、线程数量和I/O后端
+    WebServer(int port, size_t thread_count, IoBackend backend = IoBackend::Epoll);
+    ~WebServer();
+
     // 获取路由实例
     Router& router() { return router_; }
 
+    // 获取服务器配置（需在start之前修改）
+    ServerConfig& config() { return config_; }
+
+    // I/O后端：启动前为构造时的选择，启动后为实际使用的后端（内核不支持io_uring时为Epoll）
+    IoBackend ioBackend() const { return io_backend_; }
+
     // 设置404处理函数
     void setNotFoundHandler(HandlerFunc handler) {
         router_.setNotFoundHandler(handler);
@@ -251,23 +1879,50 @@ public:
 
     // 获取请求计数
     size_t getRequestCount() const {
-        std::lock_guard<std::mutex> lock(request_mutex_);
-        return request_count_;
+        return static_cast<size_t>(metrics_.requests.value());
     }
 
-    // 增加请求计数
+    // 增加请求计数（按线程分片，无锁）
     void incrementRequestCount() {
-        std::lock_guard<std::mutex> lock(request_mutex_);
-        request_count_++;
+        metrics_.requests.add();
     }
 
+    // 获取服务器计数器
+    const ServerMetrics& metrics() const { return metrics_; }
+
+    // 以Prometheus文本格式导出所有指标
+    std::string renderMetrics() const;
+
     // 获取线程池
     const std::unique_ptr<ThreadPool>& thread_pool() const {
         return thread_pool_;
     }
 
-    // 启动服务器
+    // 启动服务器：运行事件循环，直到优雅关闭完成后返回
+    // 从systemd的套接字激活或upgrade()的旧进程继承了监听套接字（LISTEN_FDS）时直接使用，不重新绑定
     bool start();
+
+    // 线程安全：优雅关闭——停止接受新连接，在途请求处理完、响应发送完后关闭连接，随后start()返回
+    // 超过config().shutdown_timeout_ms仍未关闭的连接被强制关闭；再次调用时立即强制关闭
+    void shutdown();
+    // 是否正在优雅关闭
+    bool isDraining() const { return draining_.load(std::memory_order_relaxed); }
+
+    // 线程安全：重新加载——清空静态文件缓存，重新打开访问日志文件，然后调用setReloadHandler设置的回调（如重新读取应用配置）
+    // ServerConfig中影响监听和预先格式化内容的项不在运行中修改，需要时使用upgrade()
+    void reload();
+    // 设置重新加载时调用的回调（在第一个事件循环线程上执行，不应长时间阻塞）
+    void setReloadHandler(std::function<void()> handler) {
+        std::lock_guard<std::mutex> lock(reload_mutex_);
+        reload_handler_ = std::move(handler);
+    }
+
+    // 线程安全：把消息发布到主题：只编码一次，编码后的帧由所有订阅了该主题的WebSocket连接（所有反应器）共享发送
+    void publish(const std::string& topic, std::string_view message, bool binary = false);
+
+    // 线程安全：平滑升级——以相同的程序路径和参数启动新进程，监听套接字以继承fd的方式交给它，
+    // 新进程完成初始化后本进程优雅关闭；新进程启动失败时本进程继续服务。只能在start()期间调用
+    void upgrade();
 };
 
 #endif // WEBSERVER_H
@@ -0,0 +1,451 @@
+#include "websocket.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// 握手中与Sec-WebSocket-Key拼接的固定GUID（RFC 6455 1.3）
+constexpr std::string_view kHandshakeGuid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// 控制帧载荷的上限；关闭帧的原因短语还要减去2字节的关闭码
+constexpr size_t kMaxControlPayload = 125;
+
+// 分片消息的重组缓冲超过该容量时在消息结束后释放
+constexpr size_t kMessageShrinkSize = 64 * 1024;
+
+uint32_t rotl(uint32_t value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+// SHA-1（只用于握手，输入很短）
+void sha1(std::string_view data, unsigned char digest[20]) {
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+    // 补位：0x80，若干0，最后8字节为以位计的长度（大端）
+    std::string message(data);
+    uint64_t bit_length = static_cast<uint64_t>(data.size()) * 8;
+    message.push_back(static_cast<char>(0x80));
+    while (message.size() % 64 != 56) message.push_back('\0');
+    for (int i = 7; i >= 0; --i) message.push_back(static_cast<char>(bit_length >> (i * 8)));
+
+    for (size_t block = 0; block < message.size(); block += 64) {
+        uint32_t w[80];
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(message.data() + block);
+        for (int i = 0; i < 16; ++i) {
+            w[i] = (static_cast<uint32_t>(p[i * 4]) << 24) | (static_cast<uint32_t>(p[i * 4 + 1]) << 16) |
+                   (static_cast<uint32_t>(p[i * 4 + 2]) << 8) | static_cast<uint32_t>(p[i * 4 + 3]);
+        }
+        for (int i = 16; i < 80; ++i) w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotl(b, 30);
+            b = a;
+            a = temp;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    for (int i = 0; i < 5; ++i) {
+        digest[i * 4] = static_cast<unsigned char>(h[i] >> 24);
+        digest[i * 4 + 1] = static_cast<unsigned char>(h[i] >> 16);
+        digest[i * 4 + 2] = static_cast<unsigned char>(h[i] >> 8);
+        digest[i * 4 + 3] = static_cast<unsigned char>(h[i]);
+    }
+}
+
+const char kBase64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+std::string base64Encode(const unsigned char* data, size_t length) {
+    std::string out;
+    out.reserve((length + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 3 <= length; i += 3) {
+        uint32_t group = (static_cast<uint32_t>(data[i]) << 16) | (static_cast<uint32_t>(data[i + 1]) << 8) |
+                         data[i + 2];
+        out.push_back(kBase64[(group >> 18) & 0x3f]);
+        out.push_back(kBase64[(group >> 12) & 0x3f]);
+        out.push_back(kBase64[(group >> 6) & 0x3f]);
+        out.push_back(kBase64[group & 0x3f]);
+    }
+    if (i < length) {
+        uint32_t group = static_cast<uint32_t>(data[i]) << 16;
+        if (i + 1 < length) group |= static_cast<uint32_t>(data[i + 1]) << 8;
+        out.push_back(kBase64[(group >> 18) & 0x3f]);
+        out.push_back(kBase64[(group >> 12) & 0x3f]);
+        out.push_back(i + 1 < length ? kBase64[(group >> 6) & 0x3f] : '=');
+        out.push_back('=');
+    }
+    return out;
+}
+
+uint16_t readU16(const unsigned char* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint64_t readU64(const unsigned char* p) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) value = (value << 8) | p[i];
+    return value;
+}
+
+// 关闭帧中允许出现的关闭码（RFC 6455 7.4）：1004-1006和1015只在本地使用，3000以下未定义的保留
+bool validCloseCode(uint16_t code) {
+    return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1014) || (code >= 3000 && code <= 4999);
+}
+
+} // namespace
+
+std::string webSocketAccept(std::string_view key) {
+    std::string input(key);
+    input.append(kHandshakeGuid);
+    unsigned char digest[20];
+    sha1(input, digest);
+    return base64Encode(digest, sizeof(digest));
+}
+
+bool validWebSocketKey(std::string_view key) {
+    // 16字节的base64编码固定为22个字符加"=="
+    if (key.size() != 24 || key[22] != '=' || key[23] != '=') return false;
+    for (size_t i = 0; i < 22; ++i) {
+        char c = key[i];
+        bool alnum = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9');
+        if (!alnum && c != '+' && c != '/') return false;
+    }
+    return true;
+}
+
+bool validUtf8(std::string_view text) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(text.data());
+    const unsigned char* end = p + text.size();
+    while (p < end) {
+        // 连续的ASCII每次检查8字节
+        if (end - p >= 8) {
+            uint64_t word;
+            std::memcpy(&word, p, 8);
+            if ((word & 0x8080808080808080ULL) == 0) {
+                p += 8;
+                continue;
+            }
+        }
+        unsigned char c = *p;
+        if (c < 0x80) {
+            ++p;
+            continue;
+        }
+        size_t length;
+        uint32_t min;
+        uint32_t code;
+        if ((c & 0xe0) == 0xc0) {
+            length = 2;
+            min = 0x80;
+            code = c & 0x1f;
+        } else if ((c & 0xf0) == 0xe0) {
+            length = 3;
+            min = 0x800;
+            code = c & 0x0f;
+        } else if ((c & 0xf8) == 0xf0) {
+            length = 4;
+            min = 0x10000;
+            code = c & 0x07;
+        } else {
+            return false;
+        }
+        if (static_cast<size_t>(end - p) < length) return false;
+        for (size_t i = 1; i < length; ++i) {
+            if ((p[i] & 0xc0) != 0x80) return false;
+            code = (code << 6) | (p[i] & 0x3f);
+        }
+        // 过长编码、代理码点和超出Unicode范围的码点
+        if (code < min || (code >= 0xd800 && code <= 0xdfff) || code > 0x10ffff) return false;
+        p += length;
+    }
+    return true;
+}
+
+void encodeWebSocketFrame(WebSocketOpcode opcode, std::string_view payload, std::string& out, bool fin) {
+    size_t length = payload.size();
+    out.reserve(out.size() + length + 10);
+    out.push_back(static_cast<char>((fin ? 0x80 : 0) | static_cast<uint8_t>(opcode)));
+    if (length < 126) {
+        out.push_back(static_cast<char>(length));
+    } else if (length <= 0xffff) {
+        out.push_back(static_cast<char>(126));
+        out.push_back(static_cast<char>(length >> 8));
+        out.push_back(static_cast<char>(length));
+    } else {
+        out.push_back(static_cast<char>(127));
+        for (int i = 7; i >= 0; --i) out.push_back(static_cast<char>(static_cast<uint64_t>(length) >> (i * 8)));
+    }
+    out.append(payload);
+}
+
+std::shared_ptr<const std::string> makeWebSocketFrame(std::string_view payload, bool binary) {
+    std::string frame;
+    encodeWebSocketFrame(binary ? WebSocketOpcode::Binary : WebSocketOpcode::Text, payload, frame);
+    return std::make_shared<const std::string>(std::move(frame));
+}
+
+// WebSocketSession类实现
+WebSocketSession::WebSocketSession(Handler& handler, size_t max_message_size)
+    : handler_(handler), max_message_size_(max_message_size) {
+}
+
+bool WebSocketSession::receive(std::string& in, OutputBuffer& out) {
+    if (failed_) {
+        in.clear();
+        return false;
+    }
+
+    size_t pos = 0;
+    while (in.size() - pos >= 2) {
+        // 关闭握手之后对端不应再发送数据，收到的忽略
+        if (close_received_) {
+            pos = in.size();
+            break;
+        }
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(in.data() + pos);
+        bool fin = (p[0] & 0x80) != 0;
+        auto opcode = static_cast<WebSocketOpcode>(p[0] & 0x0f);
+        uint64_t length = p[1] & 0x7f;
+        size_t header = 2 + (length == 126 ? 2 : length == 127 ? 8 : 0) + 4;
+
+        // 没有协商扩展，RSV位必须为0；客户端发送的帧必须加掩码
+        if ((p[0] & 0x70) != 0 || (p[1] & 0x80) == 0) return fail(kWebSocketProtocolError, out);
+        if (in.size() - pos < header) break;
+        if (length == 126) {
+            length = readU16(p + 2);
+        } else if (length == 127) {
+            length = readU64(p + 2);
+            if (length >> 63) return fail(kWebSocketProtocolError, out);
+        }
+
+        switch (opcode) {
+        case WebSocketOpcode::Close:
+        case WebSocketOpcode::Ping:
+        case WebSocketOpcode::Pong:
+            // 控制帧不能分片，可以插在分片消息的各帧之间
+            if (!fin || length > kMaxControlPayload) return fail(kWebSocketProtocolError, out);
+            break;
+        case WebSocketOpcode::Continuation:
+            if (!fragmented_) return fail(kWebSocketProtocolError, out);
+            if (message_.size() + length > max_message_size_) return fail(kWebSocketMessageTooBig, out);
+            break;
+        case WebSocketOpcode::Text:
+        case WebSocketOpcode::Binary:
+            if (fragmented_) return fail(kWebSocketProtocolError, out);
+            if (length > max_message_size_) return fail(kWebSocketMessageTooBig, out);
+            break;
+        default:
+            return fail(kWebSocketProtocolError, out);
+        }
+
+        // 载荷尚未完整到达（长度已检查，接收缓冲不会超过消息上限）
+        if (in.size() - pos - header < length) break;
+        unsigned char key[4];
+        std::memcpy(key, p + header - 4, 4);
+        char* payload = &in[pos + header];
+        applyWebSocketMask(payload, length, key);
+        pos += header + length;
+        if (!handleFrame(opcode, fin, std::string_view(payload, length), out)) return false;
+    }
+    in.erase(0, pos);
+    return true;
+}
+
+bool WebSocketSession::handleFrame(WebSocketOpcode opcode, bool fin, std::string_view payload, OutputBuffer& out) {
+    switch (opcode) {
+    case WebSocketOpcode::Text:
+    case WebSocketOpcode::Binary:
+        if (!fin) {
+            fragmented_ = true;
+            message_binary_ = opcode == WebSocketOpcode::Binary;
+            message_.assign(payload);
+            return true;
+        }
+        // 不分片的消息：直接交出接收缓冲中的载荷
+        if (opcode == WebSocketOpcode::Text && !validUtf8(payload)) return fail(kWebSocketInvalidPayload, out);
+        handler_.onMessage(payload, opcode == WebSocketOpcode::Binary);
+        return true;
+    case WebSocketOpcode::Continuation:
+        message_.append(payload);
+        if (!fin) return true;
+        fragmented_ = false;
+        if (!message_binary_ && !validUtf8(message_)) return fail(kWebSocketInvalidPayload, out);
+        handler_.onMessage(message_, message_binary_);
+        if (message_.capacity() > kMessageShrinkSize) {
+            std::string().swap(message_);
+        } else {
+            message_.clear();
+        }
+        return true;
+    case WebSocketOpcode::Ping:
+        if (!close_sent_) {
+            std::string frame;
+            encodeWebSocketFrame(WebSocketOpcode::Pong, payload, frame);
+            out.append(std::move(frame));
+        }
+        return true;
+    case WebSocketOpcode::Pong:
+        return true;
+    case WebSocketOpcode::Close:
+        return handleClose(payload, out);
+    }
+    return fail(kWebSocketProtocolError, out);
+}
+
+bool WebSocketSession::handleClose(std::string_view payload, OutputBuffer& out) {
+    uint16_t code = kWebSocketNoStatus;
+    if (payload.size() == 1) return fail(kWebSocketProtocolError, out);
+    if (payload.size() >= 2) {
+        code = readU16(reinterpret_cast<const unsigned char*>(payload.data()));
+        if (!validCloseCode(code)) return fail(kWebSocketProtocolError, out);
+        if (!validUtf8(payload.substr(2))) return fail(kWebSocketInvalidPayload, out);
+    }
+    close_received_ = true;
+    close_code_ = code;
+    // 回应关闭帧，带回对端的关闭码
+    close(code, {}, out);
+    return true;
+}
+
+bool WebSocketSession::fail(uint16_t code, OutputBuffer& out) {
+    close(code, {}, out);
+    failed_ = true;
+    close_code_ = code;
+    return false;
+}
+
+void WebSocketSession::close(uint16_t code, std::string_view reason, OutputBuffer& out) {
+    if (close_sent_) return;
+    close_sent_ = true;
+    std::string payload;
+    if (code != kWebSocketNoStatus && code != kWebSocketAbnormalClosure) {
+        payload.push_back(static_cast<char>(code >> 8));
+        payload.push_back(static_cast<char>(code));
+        payload.append(reason.substr(0, kMaxControlPayload - 2));
+    }
+    std::string frame;
+    encodeWebSocketFrame(WebSocketOpcode::Close, payload, frame);
+    out.append(std::move(frame));
+}
+
+void WebSocketSession::ping(OutputBuffer& out) {
+    if (close_sent_) return;
+    std::string frame;
+    encodeWebSocketFrame(WebSocketOpcode::Ping, {}, frame);
+    out.append(std::move(frame));
+}
+
+// WebSocket类实现
+WebSocket::WebSocket(EventLoop& loop, Connection& conn, std::unique_ptr<WebSocketHandler> handler,
+                     size_t max_message_size)
+    : loop_(loop), conn_(&conn), handler_(std::move(handler)), session_(*this, max_message_size) {
+}
+
+void WebSocket::onMessage(std::string_view data, bool binary) {
+    handler_->onMessage(*this, data, binary);
+}
+
+template <typename F>
+void WebSocket::runOnLoop(F fn) {
+    if (EventLoop::current() == &loop_) {
+        fn();
+        return;
+    }
+    // 连接关闭后的发送直接丢弃，不必投递
+    if (!isOpen()) return;
+    loop_.post([self = shared_from_this(), fn = std::move(fn)]() mutable { fn(); });
+}
+
+void WebSocket::send(std::string_view text) {
+    // 在调用者的线程上编码，循环线程只需加入发送队列
+    std::string frame;
+    encodeWebSocketFrame(WebSocketOpcode::Text, text, frame);
+    runOnLoop([this, frame = std::move(frame)]() mutable { queueFrame(std::move(frame)); });
+}
+
+void WebSocket::sendBinary(std::string_view data) {
+    std::string frame;
+    encodeWebSocketFrame(WebSocketOpcode::Binary, data, frame);
+    runOnLoop([this, frame = std::move(frame)]() mutable { queueFrame(std::move(frame)); });
+}
+
+void WebSocket::sendFrame(std::shared_ptr<const std::string> frame) {
+    runOnLoop([this, frame = std::move(frame)]() mutable { queueFrame(std::move(frame)); });
+}
+
+void WebSocket::close(uint16_t code, std::string_view reason) {
+    runOnLoop([this, code, reason = std::string(reason)]() {
+        if (!conn_ || session_.closeSent()) return;
+        session_.close(code, reason, conn_->output);
+        scheduleFlush();
+    });
+}
+
+void WebSocket::subscribe(const std::string& topic) {
+    runOnLoop([this, topic]() {
+        if (!conn_ || std::find(topics_.begin(), topics_.end(), topic) != topics_.end()) return;
+        topics_.push_back(topic);
+        loop_.ws_topics_[topic].push_back(this);
+    });
+}
+
+void WebSocket::unsubscribe(const std::string& topic) {
+    runOnLoop([this, topic]() {
+        auto it = std::find(topics_.begin(), topics_.end(), topic);
+        if (it == topics_.end()) return;
+        topics_.erase(it);
+        loop_.removeSubscriber(topic, this);
+    });
+}
+
+void WebSocket::queueFrame(std::string frame) {
+    if (!conn_ || session_.closeSent()) return;
+    conn_->output.append(std::move(frame));
+    scheduleFlush();
+}
+
+void WebSocket::queueFrame(std::shared_ptr<const std::string> frame) {
+    if (!conn_ || session_.closeSent()) return;
+    conn_->output.append(std::move(frame));
+    scheduleFlush();
+}
+
+void WebSocket::scheduleFlush() {
+    if (flush_queued_) return;
+    flush_queued_ = true;
+    loop_.ws_flush_.push_back(conn_->shared_from_this());
+}
+
+void WebSocket::detach() {
+    for (const std::string& topic : topics_) {
+        loop_.removeSubscriber(topic, this);
+    }
+    topics_.clear();
+    conn_ = nullptr;
+    open_.store(false, std::memory_order_relaxed);
+    uint16_t code = session_.closeCode();
+    std::unique_ptr<WebSocketHandler> handler = std::move(handler_);
+    handler->onClose(*this, code != 0 ? code : kWebSocketAbnormalClosure);
+}
@@ -0,0 +1,159 @@
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include "webserver.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// WebSocket（RFC 6455）：握手、帧的解析与生成、掩码、分片重组、ping/pong和关闭握手
+// WebSocketSession只处理协议本身；WebSocket把会话绑定到事件循环上的连接，供处理器收发消息和订阅主题
+
+// 帧的操作码
+enum class WebSocketOpcode : uint8_t {
+    Continuation = 0x0,
+    Text = 0x1,
+    Binary = 0x2,
+    Close = 0x8,
+    Ping = 0x9,
+    Pong = 0xa
+};
+
+// 关闭码（RFC 6455 7.4.1）
+constexpr uint16_t kWebSocketNormalClosure = 1000;
+constexpr uint16_t kWebSocketGoingAway = 1001;        // 服务器关闭
+constexpr uint16_t kWebSocketProtocolError = 1002;
+constexpr uint16_t kWebSocketUnsupportedData = 1003;
+constexpr uint16_t kWebSocketNoStatus = 1005;         // 关闭帧不含关闭码（不在帧中发送）
+constexpr uint16_t kWebSocketAbnormalClosure = 1006;  // 没有收到关闭帧就断开（不在帧中发送）
+constexpr uint16_t kWebSocketInvalidPayload = 1007;   // 文本消息不是合法的UTF-8
+constexpr uint16_t kWebSocketPolicyViolation = 1008;
+constexpr uint16_t kWebSocketMessageTooBig = 1009;
+constexpr uint16_t kWebSocketInternalError = 1011;
+
+// 握手响应中的Sec-WebSocket-Accept：base64(SHA-1(key + 固定GUID))
+std::string webSocketAccept(std::string_view key);
+// Sec-WebSocket-Key是否为16字节随机数的base64编码
+bool validWebSocketKey(std::string_view key);
+// 文本是否为合法的UTF-8（不允许过长编码和代理码点）
+bool validUtf8(std::string_view text);
+
+// 把一个服务器帧（不加掩码）追加到out
+void encodeWebSocketFrame(WebSocketOpcode opcode, std::string_view payload, std::string& out, bool fin = true);
+// 编码一个完整的数据帧：结果可以加入任意多个连接的发送队列而不复制（见WebServer::publish）
+std::shared_ptr<const std::string> makeWebSocketFrame(std::string_view payload, bool binary = false);
+
+class WebSocketSession {
+public:
+    // 收到完整消息时的回调（在receive()期间调用，不应写入套接字）
+    class Handler {
+    public:
+        virtual ~Handler() = default;
+        // 一条完整的数据消息（分片已重组，文本已校验）；data只在回调期间有效
+        virtual void onMessage(std::string_view data, bool binary) = 0;
+    };
+
+private:
+    Handler& handler_;
+    size_t max_message_size_;
+    std::string message_;            // 正在重组的分片消息
+    bool fragmented_ = false;        // 已收到分片消息的第一帧，等待后续帧
+    bool message_binary_ = false;
+    bool close_sent_ = false;
+    bool close_received_ = false;
+    bool failed_ = false;            // 因协议错误已发送关闭帧
+    uint16_t close_code_ = 0;
+
+    // 处理一个已解除掩码的完整帧，出现协议错误时返回false
+    bool handleFrame(WebSocketOpcode opcode, bool fin, std::string_view payload, OutputBuffer& out);
+    bool handleClose(std::string_view payload, OutputBuffer& out);
+    // 协议错误：发送带关闭码的关闭帧，之后不再处理收到的数据，返回false
+    bool fail(uint16_t code, OutputBuffer& out);
+
+public:
+    // max_message_size：单条消息（分片合计）的上限，超出时以1009关闭
+    WebSocketSession(Handler& handler, size_t max_message_size);
+
+    // 处理收到的数据，已处理的完整帧从in中删除；载荷在in中原地解除掩码，
+    // 不分片的消息直接以in中的数据回调，不复制。出现协议错误时已写入关闭帧，返回false
+    bool receive(std::string& in, OutputBuffer& out);
+    // 发起关闭握手（已发送关闭帧时不做任何事），reason超过123字节时截断
+    void close(uint16_t code, std::string_view reason, OutputBuffer& out);
+    // 发送一个空的ping帧（已发送关闭帧时不做任何事）
+    void ping(OutputBuffer& out);
+
+    // 已发送关闭帧：之后不能再发送数据帧
+    bool closeSent() const { return close_sent_; }
+    // 可以关闭连接：关闭握手已完成（收到关闭帧时已回应），或因协议错误已发送关闭帧
+    bool finished() const { return failed_ || close_received_; }
+    // 对端关闭帧中的关闭码（不含关闭码时为1005）；因协议错误关闭时为本端发送的关闭码；都没有时为0
+    uint16_t closeCode() const { return close_code_; }
+};
+
+// WebSocket路由的处理器：每个连接由路由的工厂创建一个，连接关闭后销毁
+// 回调都在接受该连接的事件循环线程上执行（与协程处理函数一样），不应执行阻塞操作，
+// 阻塞的工作可以交给线程池（EventLoop::offload），完成后在任意线程上调用WebSocket::send
+class WebSocketHandler {
+public:
+    virtual ~WebSocketHandler() = default;
+    // 握手完成（101响应已加入发送队列）：可以发送消息、订阅主题；req为升级请求（含路径参数），只在回调期间有效
+    virtual void onOpen(WebSocket& ws, const Request& req) {}
+    // 收到一条完整的消息；data只在回调期间有效
+    virtual void onMessage(WebSocket& ws, std::string_view data, bool binary) = 0;
+    // 连接已关闭（已退订所有主题，之后的发送被忽略）；code为对端的关闭码，没有收到关闭帧就断开时为1006
+    virtual void onClose(WebSocket& ws, uint16_t code) {}
+};
+
+// 一个WebSocket连接：以shared_ptr持有，可以保存下来在任意线程上发送消息
+// 在连接所属的事件循环线程上调用时直接加入发送队列，其他线程上调用时投递到该线程；
+// 加入发送队列的帧在本轮事件处理结束时统一发送，发送队列超过WebSocketConfig::max_send_buffer的连接被断开
+class WebSocket : public std::enable_shared_from_this<WebSocket>, private WebSocketSession::Handler {
+private:
+    friend class EventLoop;
+
+    EventLoop& loop_;
+    Connection* conn_;                           // 连接关闭后为nullptr（只在循环线程上访问）
+    std::unique_ptr<WebSocketHandler> handler_;  // 连接关闭后销毁，打破处理器持有WebSocket造成的循环引用
+    WebSocketSession session_;
+    std::vector<std::string> topics_;            // 已订阅的主题
+    std::atomic<bool> open_{true};
+    bool ping_outstanding_ = false;              // 已发送ping，之后还没有收到任何数据
+    bool flush_queued_ = false;                  // 已在事件循环的待发送列表中
+
+    void onMessage(std::string_view data, bool binary) override;
+    // 以下只在循环线程上调用
+    // 把已编码的帧加入发送队列（已关闭或已发送关闭帧时丢弃）
+    void queueFrame(std::string frame);
+    void queueFrame(std::shared_ptr<const std::string> frame);
+    // 加入事件循环的待发送列表
+    void scheduleFlush();
+    // 连接已关闭：退订所有主题，通知处理器后销毁它
+    void detach();
+    // 在循环线程上执行fn
+    template <typename F>
+    void runOnLoop(F fn);
+
+public:
+    WebSocket(EventLoop& loop, Connection& conn, std::unique_ptr<WebSocketHandler> handler, size_t max_message_size);
+
+    // 线程安全：发送文本消息（调用者保证是合法的UTF-8）
+    void send(std::string_view text);
+    // 线程安全：发送二进制消息
+    void sendBinary(std::string_view data);
+    // 线程安全：发送makeWebSocketFrame编码好的帧（不复制）
+    void sendFrame(std::shared_ptr<const std::string> frame);
+    // 线程安全：发起关闭握手，对端回应后关闭连接
+    void close(uint16_t code = kWebSocketNormalClosure, std::string_view reason = {});
+    // 线程安全：订阅主题，之后WebServer::publish发布到该主题的消息都会发给这个连接
+    void subscribe(const std::string& topic);
+    // 线程安全：退订主题
+    void unsubscribe(const std::string& topic);
+
+    // 连接是否仍然打开（关闭后的发送被忽略）
+    bool isOpen() const { return open_.load(std::memory_order_relaxed); }
+    // 连接所属的事件循环
+    EventLoop& loop() { return loop_; }
+};
+
+#endif // WEBSOCKET_H